@@ -12,6 +12,11 @@ void print_int(int num) {
     printf("%d\n", num);
 }
 
+// 打印布尔值：true或false
+void print_bool(int b) {
+    printf("%s\n", b ? "true" : "false");
+}
+
 // 读取文件
 void read_file(const char *path) {
     FILE *fp = fopen(path, "r");
@@ -6,6 +6,9 @@ void print_str(const char *str);
 // 打印整数
 void print_int(int num);
 
+// 打印布尔值：true或false
+void print_bool(int b);
+
 // 读取文件
 void read_file(const char *path);
 
@@ -0,0 +1,175 @@
+#include <stdlib.h>
+#include <string.h>
+#include "asm.h"
+
+AsmFn *asm_new_fn(char *name) {
+    AsmFn *fn = calloc(1, sizeof(AsmFn));
+    fn->name = name;
+    return fn;
+}
+
+AsmIns *asm_emit(AsmFn *fn, AsmOp op, AsmOpnd a, AsmOpnd b) {
+    if (fn->count >= fn->cap) {
+        fn->cap = fn->cap * 2 + 16;
+        fn->code = realloc(fn->code, fn->cap * sizeof(AsmIns));
+    }
+    AsmIns *ins = &fn->code[fn->count++];
+    memset(ins, 0, sizeof(AsmIns));
+    ins->op = op;
+    ins->a = a;
+    ins->b = b;
+    return ins;
+}
+
+static const char *REG64[R_COUNT] = {
+    "rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi",
+    "r8", "r9", "r10", "r11", "r12", "r13", "r14", "r15",
+};
+static const char *REG32[R_COUNT] = {
+    "eax", "ecx", "edx", "ebx", "esp", "ebp", "esi", "edi",
+    "r8d", "r9d", "r10d", "r11d", "r12d", "r13d", "r14d", "r15d",
+};
+static const char *REG8[R_COUNT] = {
+    "al", "cl", "dl", "bl", "spl", "bpl", "sil", "dil",
+    "r8b", "r9b", "r10b", "r11b", "r12b", "r13b", "r14b", "r15b",
+};
+
+static const char *OP_NAMES[] = {
+    [A_MOV] = "mov", [A_MOVABS] = "movabs", [A_MOVZX] = "movzx", [A_ADD] = "add",
+    [A_SUB] = "sub", [A_AND] = "and", [A_OR] = "or", [A_XOR] = "xor",
+    [A_CMP] = "cmp", [A_IMUL] = "imul", [A_IDIV] = "idiv", [A_CDQ] = "cdq",
+    [A_NEG] = "neg", [A_SET] = "set", [A_PUSH] = "push", [A_POP] = "pop",
+    [A_LEA] = "lea", [A_CALL] = "call", [A_JMP] = "jmp", [A_JCC] = "j",
+    [A_RET] = "ret", [A_MOVSS] = "movss", [A_MOVSD] = "movsd", [A_ADDSS] = "addss",
+    [A_ADDSD] = "addsd", [A_SUBSS] = "subss", [A_SUBSD] = "subsd", [A_MULSS] = "mulss",
+    [A_MULSD] = "mulsd", [A_DIVSS] = "divss", [A_DIVSD] = "divsd", [A_UCOMISS] = "ucomiss",
+    [A_UCOMISD] = "ucomisd", [A_CVTSI2SS] = "cvtsi2ss", [A_CVTSI2SD] = "cvtsi2sd",
+    [A_CVTTSS2SI] = "cvttss2si", [A_CVTTSD2SI] = "cvttsd2si", [A_CVTSS2SD] = "cvtss2sd",
+    [A_CVTSD2SS] = "cvtsd2ss", [A_XORPS] = "xorps", [A_MOVQ] = "movq",
+    [A_MOVUPS] = "movups", [A_ADDPS] = "addps", [A_ADDPD] = "addpd", [A_SUBPS] = "subps",
+    [A_SUBPD] = "subpd", [A_MULPS] = "mulps", [A_MULPD] = "mulpd", [A_DIVPS] = "divps",
+    [A_DIVPD] = "divpd", [A_PADDD] = "paddd", [A_PSUBD] = "psubd", [A_MOVD] = "movd",
+    [A_PSHUFD] = "pshufd", [A_SHUFPS] = "shufps", [A_UNPCKLPD] = "unpcklpd",
+};
+
+static const char *cc_name(Cond cc) {
+    switch (cc) {
+    case CC_B: return "b";
+    case CC_AE: return "ae";
+    case CC_BE: return "be";
+    case CC_A: return "a";
+    case CC_E: return "e";
+    case CC_NE: return "ne";
+    case CC_L: return "l";
+    case CC_GE: return "ge";
+    case CC_LE: return "le";
+    case CC_G: return "g";
+    }
+    return "?";
+}
+
+static void print_opnd(Buf *out, AsmOpnd *o, bool masm) {
+    switch (o->kind) {
+    case AO_REG:
+        if (is_xmm(o->reg)) {
+            buf_puts(out, "xmm");
+            buf_int(out, o->reg - R_XMM0);
+        } else {
+            buf_puts(out, o->size == 8 ? REG64[o->reg] : o->size == 1 ? REG8[o->reg] : REG32[o->reg]);
+        }
+        return;
+    case AO_IMM:
+        buf_int(out, o->val);
+        return;
+    case AO_MEM: {
+        buf_puts(out, o->size == 16 ? "xmmword ptr [" : o->size == 8 ? "qword ptr [" : "dword ptr [");
+        buf_puts(out, REG64[o->reg]);
+        if (o->scale) {
+            buf_putc(out, '+');
+            buf_puts(out, REG64[o->index]);
+            buf_putc(out, '*');
+            buf_int(out, o->scale);
+        }
+        if (o->val >= 0) buf_putc(out, '+');
+        buf_int(out, o->val);
+        buf_putc(out, ']');
+        return;
+    }
+    case AO_STR:
+        buf_puts(out, masm ? "ct" : "[rip+ct");
+        buf_int(out, o->val);
+        if (!masm) buf_putc(out, ']');
+        return;
+    case AO_NUM:
+        if (masm) buf_puts(out, "cf");
+        else buf_puts(out, o->size == 8 ? "qword ptr [rip+cf" : "dword ptr [rip+cf");
+        buf_int(out, o->val);
+        if (!masm) buf_putc(out, ']');
+        return;
+    default:
+        return;
+    }
+}
+
+static void print_label(Buf *out, int label) {
+    buf_puts(out, "_L");
+    buf_int(out, label);
+}
+
+// 每条指令由几个固定的片段和整数拼成，直接追加，不经过格式化
+void asm_print(Buf *out, AsmFn *fn, bool masm) {
+    for (int i = 0; i < fn->count; i++) {
+        AsmIns *ins = &fn->code[i];
+        switch (ins->op) {
+        case A_LABEL:
+            print_label(out, ins->label);
+            buf_puts(out, ":\n");
+            continue;
+        case A_JMP:
+            buf_puts(out, "    jmp ");
+            print_label(out, ins->label);
+            buf_putc(out, '\n');
+            continue;
+        case A_JCC:
+            buf_puts(out, "    j");
+            buf_puts(out, cc_name(ins->cc));
+            buf_putc(out, ' ');
+            print_label(out, ins->label);
+            buf_putc(out, '\n');
+            continue;
+        case A_CALL:
+            buf_puts(out, "    call ");
+            buf_puts(out, ins->sym);
+            buf_putc(out, '\n');
+            continue;
+        case A_MOVABS:
+            // masm64中64位立即数也用mov
+            buf_puts(out, masm ? "    mov " : "    movabs ");
+            buf_puts(out, REG64[ins->a.reg]);
+            buf_puts(out, ", ");
+            buf_int(out, ins->imm64);
+            buf_putc(out, '\n');
+            continue;
+        case A_SET:
+            buf_puts(out, "    set");
+            buf_puts(out, cc_name(ins->cc));
+            buf_putc(out, ' ');
+            break;
+        default:
+            buf_puts(out, "    ");
+            buf_puts(out, OP_NAMES[ins->op]);
+            if (ins->a.kind != AO_NONE) buf_putc(out, ' ');
+            break;
+        }
+        print_opnd(out, &ins->a, masm);
+        if (ins->b.kind != AO_NONE) {
+            buf_puts(out, ", ");
+            print_opnd(out, &ins->b, masm);
+        }
+        if (ins->c.kind != AO_NONE) {
+            buf_puts(out, ", ");
+            print_opnd(out, &ins->c, masm);
+        }
+        buf_putc(out, '\n');
+    }
+}
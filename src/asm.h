@@ -0,0 +1,149 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "regalloc.h"
+#include "buf.h"
+
+// 汇编指令列表
+//
+// 指令选择（codegen.c）的结果先存放在内存中的指令列表里，之后可以：
+// - 输出成gas或masm64语法的汇编文本（asm_print）；
+// - 直接编码成x86-64机器码（x86.c），用于JIT和直接输出目标文件。
+
+typedef struct AsmOpnd AsmOpnd;
+typedef struct AsmIns AsmIns;
+typedef struct AsmFn AsmFn;
+
+typedef enum {
+    AO_NONE,
+    AO_REG, // 寄存器，size是宽度：1、4或8字节；向量寄存器的size是其中浮点数的宽度，整个向量是16
+    AO_IMM, // 立即数
+    AO_MEM, // 内存：[reg + index * scale + val]，宽度为size
+    AO_STR, // 字符串常量的地址，val是序号
+    AO_NUM, // 浮点数常量（内存操作数），val是序号，宽度为size
+} AsmOpndKind;
+
+struct AsmOpnd {
+    AsmOpndKind kind;
+    int size;
+    Reg reg;
+    int32_t val;
+    Reg index; // AO_MEM的变址寄存器（64位），scale为0时没有
+    int scale;
+};
+
+typedef enum {
+    A_MOV, // a = b
+    A_MOVABS, // a = imm64，a是64位寄存器
+    A_MOVZX, // a = b，b是8位寄存器
+    A_ADD,
+    A_SUB,
+    A_AND,
+    A_OR,
+    A_XOR,
+    A_CMP,
+    A_IMUL, // a = a * b；有c时a = b * c
+    A_IDIV, // edx:eax / a
+    A_CDQ,
+    A_NEG,
+    A_SET, // a = cc ? 1 : 0
+    A_PUSH,
+    A_POP,
+    A_LEA, // a = b的地址
+    A_CALL, // 调用sym
+    A_JMP, // 跳转到label
+    A_JCC, // cc成立时跳转到label
+    A_RET,
+    A_LABEL, // 标签label
+    // SSE2的标量浮点数指令，ss是float，sd是double
+    A_MOVSS,
+    A_MOVSD,
+    A_ADDSS,
+    A_ADDSD,
+    A_SUBSS,
+    A_SUBSD,
+    A_MULSS,
+    A_MULSD,
+    A_DIVSS,
+    A_DIVSD,
+    A_UCOMISS, // 比较a和b，结果和无符号数的比较一样，在CF和ZF中
+    A_UCOMISD,
+    A_CVTSI2SS, // int转换成float
+    A_CVTSI2SD,
+    A_CVTTSS2SI, // float截断成int
+    A_CVTTSD2SI,
+    A_CVTSS2SD, // float转换成double
+    A_CVTSD2SS,
+    A_XORPS,
+    A_MOVQ, // a = b，a是64位通用寄存器，b是向量寄存器
+    // SSE2的向量指令，ps是4个float，pd是2个double，d是4个int
+    A_MOVUPS, // 读写16字节，不要求对齐
+    A_ADDPS,
+    A_ADDPD,
+    A_SUBPS,
+    A_SUBPD,
+    A_MULPS,
+    A_MULPD,
+    A_DIVPS,
+    A_DIVPD,
+    A_PADDD,
+    A_PSUBD,
+    A_MOVD, // a = b，a是向量寄存器，b是32位的通用寄存器或内存
+    A_PSHUFD, // 按立即数c重排b的4个int，存入a
+    A_SHUFPS, // 按立即数c从a和b中各取两个float，存入a
+    A_UNPCKLPD, // a = {a[0], b[0]}
+} AsmOp;
+
+// 条件码，取值就是x86编码中的条件码
+typedef enum {
+    CC_B = 0x2, // 无符号数（和浮点数）的比较
+    CC_AE = 0x3,
+    CC_E = 0x4,
+    CC_NE = 0x5,
+    CC_BE = 0x6,
+    CC_A = 0x7,
+    CC_L = 0xc,
+    CC_GE = 0xd,
+    CC_LE = 0xe,
+    CC_G = 0xf,
+} Cond;
+
+// 相反的条件：x86的条件码成对出现，只差最低位
+static inline Cond cc_invert(Cond cc) { return (Cond)(cc ^ 1); }
+
+struct AsmIns {
+    AsmOp op;
+    Cond cc;
+    AsmOpnd a;
+    AsmOpnd b;
+    AsmOpnd c;
+    char *sym; // A_CALL的函数名
+    int label; // A_JMP、A_JCC和A_LABEL的标签
+    int64_t imm64; // A_MOVABS的立即数
+};
+
+// 一个函数的指令列表
+struct AsmFn {
+    char *name;
+    int count;
+    int cap;
+    AsmIns *code;
+};
+
+static inline AsmOpnd asm_reg(Reg reg, int size) { return (AsmOpnd){AO_REG, size, reg, 0}; }
+static inline AsmOpnd asm_imm(int32_t val) { return (AsmOpnd){AO_IMM, 4, 0, val}; }
+static inline AsmOpnd asm_mem(Reg base, int32_t disp) { return (AsmOpnd){AO_MEM, 4, base, disp}; }
+static inline AsmOpnd asm_str(int idx) { return (AsmOpnd){AO_STR, 8, 0, idx}; }
+static inline AsmOpnd asm_num(int idx, int size) { return (AsmOpnd){AO_NUM, size, 0, idx}; }
+
+AsmFn *asm_new_fn(char *name);
+// 在末尾添加一条指令
+AsmIns *asm_emit(AsmFn *fn, AsmOp op, AsmOpnd a, AsmOpnd b);
+
+// 窥孔优化，见asmopt.c
+void asm_optimize(AsmFn *fn);
+
+// 输出汇编文本。masm为true时输出masm64语法，否则输出gas的intel语法
+void asm_print(Buf *out, AsmFn *fn, bool masm);
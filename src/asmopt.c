@@ -0,0 +1,288 @@
+#include <stdlib.h>
+#include <string.h>
+#include "asm.h"
+
+// 指令列表上的窥孔优化
+//
+// 指令选择每次只看一条IR，相邻IR的指令拼在一起时会留下一些多余的指令，
+// 这里在输出汇编文本或者编码成机器码之前，把它们清理掉：
+// - 比较与跳转的融合：`setl al; movzx ecx, al; cmp ecx, 0; je L`中的`cmp`可以省掉，
+//   直接用前面比较的结果跳转：`jge L`（set和mov都不改变标志位）；
+// - 跳转的化简：跳到下一条指令的跳转删除，`jcc L1; jmp L2; L1:`改成`jncc L2`，
+//   跳到`jmp L2`的跳转直接跳到L2，跳转和返回之后到下一个标签之前的代码执行不到；
+// - 多余的传送：`mov x, x`，以及`mov a, b`之后紧跟的`mov b, a`（包括存入栈上槽位后马上读回）；
+// - push/pop配对：`push x; pop x`删除，`push x; pop y`改成`mov y, x`；
+// - 死存储：存入栈上的槽位之后，在同一个基本块中没有读取就又被覆盖的存储；
+// - 重复的`movabs r11, imm`：JIT中每次访问存量都要先取地址，基本块中只需要取一次。
+//
+// 各项化简互相创造机会，因此反复进行，直到不再变化。没有用到的标签最后统一删除。
+
+static bool opnd_eq(AsmOpnd *x, AsmOpnd *y) {
+    if (x->kind != y->kind) return false;
+    switch (x->kind) {
+    case AO_NONE: return true;
+    case AO_REG: return x->reg == y->reg && x->size == y->size;
+    case AO_IMM:
+    case AO_STR: return x->val == y->val;
+    case AO_NUM: return x->val == y->val && x->size == y->size; // 同一个浮点数常量
+    case AO_MEM: return x->reg == y->reg && x->val == y->val && x->scale == y->scale && (!x->scale || x->index == y->index);
+    }
+    return false;
+}
+
+// 用变址寄存器或者整个向量访问的内存，可能和其他任何[rbp + disp]重叠
+static bool is_wide_mem(AsmOpnd *o) {
+    return o->kind == AO_MEM && (o->scale || o->size == 16);
+}
+
+// 两个操作数是否占用同一个寄存器（不论宽度）
+static bool same_reg(AsmOpnd *x, AsmOpnd *y) {
+    return x->kind == AO_REG && y->kind == AO_REG && x->reg == y->reg;
+}
+
+static bool is_nop(AsmIns *ins) {
+    return ins->op == A_LABEL && ins->label < 0;
+}
+
+// 删除的指令先改成无效的标签，最后由compact()统一移除
+static void drop(AsmIns *ins) {
+    memset(ins, 0, sizeof(AsmIns));
+    ins->op = A_LABEL;
+    ins->label = -1;
+}
+
+static void compact(AsmFn *fn) {
+    int n = 0;
+    for (int i = 0; i < fn->count; i++) {
+        if (!is_nop(&fn->code[i])) fn->code[n++] = fn->code[i];
+    }
+    fn->count = n;
+}
+
+// 下一条有效指令的位置，没有时返回-1
+static int next(AsmFn *fn, int i) {
+    for (i++; i < fn->count; i++) {
+        if (!is_nop(&fn->code[i])) return i;
+    }
+    return -1;
+}
+
+static bool ends_block(AsmIns *ins) {
+    return ins->op == A_LABEL || ins->op == A_JMP || ins->op == A_JCC || ins->op == A_RET || ins->op == A_CALL;
+}
+
+// 指令是否读取操作数o。只有mov、movzx、movabs、lea、set和pop的a是单纯的写入
+static bool reads(AsmIns *ins, AsmOpnd *o) {
+    if (opnd_eq(&ins->b, o) || opnd_eq(&ins->c, o)) return true;
+    switch (ins->op) {
+    case A_MOV:
+    case A_MOVZX:
+    case A_MOVABS:
+    case A_LEA:
+    case A_SET:
+    case A_POP:
+        return false;
+    default:
+        return opnd_eq(&ins->a, o);
+    }
+}
+
+// `mov a, b; mov b, a`中的第二条；`mov x, x`
+static bool redundant_mov(AsmFn *fn, int i) {
+    AsmIns *ins = &fn->code[i];
+    if (ins->op != A_MOV) return false;
+    if (opnd_eq(&ins->a, &ins->b)) {
+        drop(ins);
+        return true;
+    }
+    int j = next(fn, i);
+    if (j < 0) return false;
+    AsmIns *nx = &fn->code[j];
+    if (nx->op != A_MOV || !opnd_eq(&ins->a, &nx->b) || !opnd_eq(&ins->b, &nx->a)) return false;
+    // 第一条改写了第二条的地址寄存器时，两条访问的不是同一个位置
+    if (ins->a.kind == AO_REG && ins->b.kind == AO_MEM && ins->a.reg == ins->b.reg) return false;
+    if (ins->a.kind == AO_REG && ins->b.kind == AO_MEM && ins->b.scale && ins->a.reg == ins->b.index) return false;
+    drop(nx);
+    return true;
+}
+
+static bool push_pop(AsmFn *fn, int i) {
+    AsmIns *ins = &fn->code[i];
+    if (ins->op != A_PUSH) return false;
+    int j = next(fn, i);
+    if (j < 0 || fn->code[j].op != A_POP) return false;
+    AsmOpnd src = ins->a, dst = fn->code[j].a;
+    drop(&fn->code[j]);
+    if (same_reg(&src, &dst)) {
+        drop(ins);
+    } else {
+        ins->op = A_MOV;
+        ins->a = dst;
+        ins->b = src;
+    }
+    return true;
+}
+
+// 比较与跳转的融合：从set开始，跟踪哪些位置保存着比较的结果（0或1），
+// 直到遇到`cmp x, 0`，其中x是这样的位置，并且后面紧跟着je或jne
+static bool fuse_branch(AsmFn *fn, int i) {
+    AsmIns *set = &fn->code[i];
+    if (set->op != A_SET) return false;
+    AsmOpnd held[8];
+    int count = 0;
+    held[count++] = set->a;
+    for (int j = next(fn, i); j >= 0; j = next(fn, j)) {
+        AsmIns *ins = &fn->code[j];
+        if (ins->op == A_CMP && ins->b.kind == AO_IMM && ins->b.val == 0) {
+            bool found = false;
+            for (int k = 0; k < count; k++) {
+                if (opnd_eq(&held[k], &ins->a)) found = true;
+            }
+            int b = next(fn, j);
+            if (!found || b < 0) return false;
+            AsmIns *br = &fn->code[b];
+            if (br->op != A_JCC || (br->cc != CC_E && br->cc != CC_NE)) return false;
+            int after = next(fn, b);
+            if (after >= 0 && (fn->code[after].op == A_JCC || fn->code[after].op == A_SET)) return false;
+            br->cc = br->cc == CC_NE ? set->cc : cc_invert(set->cc);
+            drop(ins);
+            return true;
+        }
+        if (ins->op != A_MOV && ins->op != A_MOVZX) return false;
+        bool holds = false;
+        for (int k = 0; k < count; k++) {
+            if (opnd_eq(&held[k], &ins->b)) holds = true;
+        }
+        // 写入的位置不再保存原来的值
+        int n = 0;
+        for (int k = 0; k < count; k++) {
+            if (!opnd_eq(&held[k], &ins->a) && !same_reg(&held[k], &ins->a)) held[n++] = held[k];
+        }
+        count = n;
+        if (holds && count < 8) held[count++] = ins->a;
+        if (count == 0) return false;
+    }
+    return false;
+}
+
+// 存入rbp上的槽位之后，在同一个基本块中没有读取就被覆盖
+static bool dead_store(AsmFn *fn, int i) {
+    AsmIns *ins = &fn->code[i];
+    if (ins->op != A_MOV || ins->a.kind != AO_MEM || ins->a.reg != R_RBP || ins->a.scale) return false;
+    for (int j = next(fn, i); j >= 0; j = next(fn, j)) {
+        AsmIns *nx = &fn->code[j];
+        if (ends_block(nx) || reads(nx, &ins->a)) return false;
+        if (is_wide_mem(&nx->a) || is_wide_mem(&nx->b)) return false;
+        if (nx->op == A_MOV && opnd_eq(&nx->a, &ins->a)) {
+            drop(ins);
+            return true;
+        }
+    }
+    return false;
+}
+
+// 同一个基本块中重复的movabs：目标寄存器在中间没有被改写过
+static bool repeated_movabs(AsmFn *fn, int i) {
+    AsmIns *ins = &fn->code[i];
+    if (ins->op != A_MOVABS) return false;
+    for (int j = next(fn, i); j >= 0; j = next(fn, j)) {
+        AsmIns *nx = &fn->code[j];
+        if (nx->op == A_MOVABS && nx->a.reg == ins->a.reg && nx->imm64 == ins->imm64) {
+            drop(nx);
+            return true;
+        }
+        if (ends_block(nx) || same_reg(&nx->a, &ins->a)) return false;
+        if (nx->op == A_IDIV || nx->op == A_CDQ) {
+            if (ins->a.reg == R_RAX || ins->a.reg == R_RDX) return false;
+        }
+    }
+    return false;
+}
+
+// 标签label所在的位置，-1表示没有
+static int find_label(AsmFn *fn, int label) {
+    for (int i = 0; i < fn->count; i++) {
+        if (fn->code[i].op == A_LABEL && fn->code[i].label == label) return i;
+    }
+    return -1;
+}
+
+// 从i开始（包括i）是否先遇到标签label，中间只隔着其他标签
+static bool label_follows(AsmFn *fn, int i, int label) {
+    for (; i >= 0; i = next(fn, i)) {
+        AsmIns *ins = &fn->code[i];
+        if (ins->op != A_LABEL) return false;
+        if (ins->label == label) return true;
+    }
+    return false;
+}
+
+static bool simplify_jump(AsmFn *fn, int i) {
+    AsmIns *ins = &fn->code[i];
+    if (ins->op == A_RET || ins->op == A_JMP) {
+        // 之后到下一个标签之前的代码执行不到
+        int j = next(fn, i);
+        if (j >= 0 && fn->code[j].op != A_LABEL) {
+            drop(&fn->code[j]);
+            return true;
+        }
+    }
+    if (ins->op != A_JMP && ins->op != A_JCC) return false;
+    int j = next(fn, i);
+    if (j >= 0 && label_follows(fn, j, ins->label)) {
+        drop(ins);
+        return true;
+    }
+    // jcc L1; jmp L2; L1:
+    if (ins->op == A_JCC && j >= 0 && fn->code[j].op == A_JMP && label_follows(fn, next(fn, j), ins->label)) {
+        ins->cc = cc_invert(ins->cc);
+        ins->label = fn->code[j].label;
+        drop(&fn->code[j]);
+        return true;
+    }
+    // 目标处是另一条jmp
+    int at = find_label(fn, ins->label);
+    int target = at >= 0 ? next(fn, at) : -1;
+    while (target >= 0 && fn->code[target].op == A_LABEL) target = next(fn, target);
+    if (target >= 0 && fn->code[target].op == A_JMP && fn->code[target].label != ins->label) {
+        ins->label = fn->code[target].label;
+        return true;
+    }
+    return false;
+}
+
+// 删除没有被任何跳转用到的标签
+static void remove_labels(AsmFn *fn) {
+    for (int i = 0; i < fn->count; i++) {
+        AsmIns *ins = &fn->code[i];
+        if (ins->op != A_LABEL || is_nop(ins)) continue;
+        bool used = false;
+        for (int j = 0; j < fn->count; j++) {
+            AsmIns *jmp = &fn->code[j];
+            if ((jmp->op == A_JMP || jmp->op == A_JCC) && jmp->label == ins->label) used = true;
+        }
+        if (!used) drop(ins);
+    }
+    compact(fn);
+}
+
+void asm_optimize(AsmFn *fn) {
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int i = 0; i < fn->count; i++) {
+            if (is_nop(&fn->code[i])) continue;
+            if (redundant_mov(fn, i) || push_pop(fn, i) || fuse_branch(fn, i) || dead_store(fn, i) ||
+                repeated_movabs(fn, i) || simplify_jump(fn, i)) {
+                changed = true;
+            }
+        }
+        compact(fn);
+        if (!changed) {
+            // 删除标签之后可能又出现跳到下一条的跳转
+            int count = fn->count;
+            remove_labels(fn);
+            changed = fn->count != count;
+        }
+    }
+}
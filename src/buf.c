@@ -0,0 +1,108 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include "buf.h"
+
+#define BUF_INIT_CAP 4096
+
+Buf *new_buf() {
+    Buf *buf = calloc(1, sizeof(Buf));
+    buf->cap = BUF_INIT_CAP;
+    buf->data = malloc(buf->cap);
+    buf->data[0] = '\0';
+    return buf;
+}
+
+void free_buf(Buf *buf) {
+    free(buf->data);
+    free(buf);
+}
+
+// 保证还能再追加n个字节（以及结尾的'\0'）
+static void reserve(Buf *buf, size_t n) {
+    if (buf->len + n + 1 <= buf->cap) return;
+    while (buf->len + n + 1 > buf->cap) buf->cap *= 2;
+    buf->data = realloc(buf->data, buf->cap);
+}
+
+void buf_putn(Buf *buf, const char *str, size_t n) {
+    reserve(buf, n);
+    memcpy(buf->data + buf->len, str, n);
+    buf->len += n;
+    buf->data[buf->len] = '\0';
+}
+
+void buf_putc(Buf *buf, char c) {
+    reserve(buf, 1);
+    buf->data[buf->len++] = c;
+    buf->data[buf->len] = '\0';
+}
+
+void buf_puts(Buf *buf, const char *str) {
+    buf_putn(buf, str, strlen(str));
+}
+
+void buf_int(Buf *buf, int64_t val) {
+    char tmp[24];
+    int n = 0;
+    // 用无符号数计算，INT64_MIN取负也不会溢出
+    uint64_t u = val < 0 ? 0 - (uint64_t)val : (uint64_t)val;
+    do {
+        tmp[sizeof(tmp) - 1 - n++] = '0' + u % 10;
+        u /= 10;
+    } while (u > 0);
+    if (val < 0) tmp[sizeof(tmp) - 1 - n++] = '-';
+    buf_putn(buf, tmp + sizeof(tmp) - n, n);
+}
+
+void buf_printf(Buf *buf, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    va_list copy;
+    va_copy(copy, args);
+    int n = vsnprintf(NULL, 0, fmt, copy);
+    va_end(copy);
+    if (n > 0) {
+        reserve(buf, n);
+        vsnprintf(buf->data + buf->len, n + 1, fmt, args);
+        buf->len += n;
+    }
+    va_end(args);
+}
+
+// 缓存一段空格，缩进时直接复制
+static const char SPACES[] = "                                                                ";
+
+void buf_indent(Buf *buf, int level) {
+    size_t n = level * 4;
+    while (n > 0) {
+        size_t k = n < sizeof(SPACES) - 1 ? n : sizeof(SPACES) - 1;
+        buf_putn(buf, SPACES, k);
+        n -= k;
+    }
+}
+
+bool buf_save(Buf *buf, const char *path) {
+    size_t len = strlen(path);
+    char *tmp = malloc(len + 5);
+    memcpy(tmp, path, len);
+    memcpy(tmp + len, ".tmp", 5);
+    // 文本方式打开，与直接fopen(path, "w")写出的换行相同；关闭缓冲，整块内容由一次write写出
+    FILE *fp = fopen(tmp, "w");
+    if (fp == NULL) {
+        free(tmp);
+        return false;
+    }
+    setvbuf(fp, NULL, _IONBF, 0);
+    bool ok = fwrite(buf->data, 1, buf->len, fp) == buf->len;
+    ok = fclose(fp) == 0 && ok;
+#ifdef _WIN32
+    // Windows上的rename不会覆盖已有的文件
+    if (ok) remove(path);
+#endif
+    if (ok) ok = rename(tmp, path) == 0;
+    if (!ok) remove(tmp);
+    free(tmp);
+    return ok;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief 输出缓冲：代码生成器把输出的文本先追加到内存中，最后一次性写入文件。
+ *
+ * 相比每个片段调用一次fprintf，追加字符串和整数不需要解析格式，也没有stdio的加锁开销。
+ */
+typedef struct Buf Buf;
+
+struct Buf {
+    char *data; /**< 内容，总是以'\0'结尾 */
+    size_t len; /**< 内容的长度 */
+    size_t cap; /**< 已分配的空间 */
+};
+
+Buf *new_buf();
+void free_buf(Buf *buf);
+
+void buf_putc(Buf *buf, char c);
+void buf_puts(Buf *buf, const char *str);
+void buf_putn(Buf *buf, const char *str, size_t n);
+void buf_int(Buf *buf, int64_t val);
+// 按格式追加，只在需要格式化（如浮点数）时使用
+void buf_printf(Buf *buf, const char *fmt, ...);
+// 追加level层缩进，每层4个空格
+void buf_indent(Buf *buf, int level);
+
+/**
+ * @brief 把内容写入文件path。
+ *
+ * 先用一次写入保存到临时文件，再改名为path，这样path要么是旧的内容，要么是完整的新内容。
+ * 返回false表示写入失败。
+ */
+bool buf_save(Buf *buf, const char *path);
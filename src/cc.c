@@ -0,0 +1,264 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#ifdef _WIN32
+#include <direct.h>
+#include <windows.h>
+#else
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include "cc.h"
+#include "buf.h"
+#include "pool.h"
+#include "util.h"
+
+#define CACHE_DIR ".zcache"
+
+#ifdef _WIN32
+#define DEFAULT_CC "cl"
+#define OBJ_EXT "obj"
+#else
+#define DEFAULT_CC "clang"
+#define OBJ_EXT "o"
+#endif
+
+static int level = 1;
+static char *home = NULL; // 找不到z所在的目录时为NULL，到编译时再报错
+static const char *prog = "z";
+
+void cc_set_level(int n) {
+    level = n;
+}
+
+// 路径中最后一个目录分隔符的位置
+static const char *last_slash(const char *path) {
+    const char *slash = strrchr(path, '/');
+#ifdef _WIN32
+    const char *back = strrchr(path, '\\');
+    if (back > slash) slash = back;
+#endif
+    return slash;
+}
+
+// 取出路径中的目录部分，没有目录时返回NULL
+static char *dir_of(const char *path) {
+    const char *slash = last_slash(path);
+    if (slash == NULL) return NULL;
+    return substr((char*)path, 0, slash - path);
+}
+
+#ifdef _WIN32
+// Windows上直接向系统查询当前程序的路径
+static char *find_self(const char *argv0) {
+    char path[MAX_PATH];
+    DWORD len = GetModuleFileNameA(NULL, path, sizeof(path));
+    if (len == 0 || len >= sizeof(path)) return NULL;
+    return dir_of(path);
+}
+#else
+// argv0中没有目录时（例如z在PATH中，直接用`z`运行），先从/proc/self/exe读取当前程序的路径，
+// 没有/proc的系统上再到PATH的各个目录中查找argv0
+static char *find_self(const char *argv0) {
+    char path[4096];
+    ssize_t len = readlink("/proc/self/exe", path, sizeof(path) - 1);
+    if (len > 0) {
+        path[len] = '\0';
+        return dir_of(path);
+    }
+    const char *env = getenv("PATH");
+    if (env == NULL) return NULL;
+    for (const char *p = env; *p != '\0';) {
+        const char *end = strchr(p, ':');
+        size_t n = end ? (size_t)(end - p) : strlen(p);
+        // PATH中的空项表示当前目录
+        if (n == 0) snprintf(path, sizeof(path), "./%s", argv0);
+        else snprintf(path, sizeof(path), "%.*s/%s", (int)n, p, argv0);
+        if (access(path, X_OK) == 0) return dir_of(path);
+        if (end == NULL) break;
+        p = end + 1;
+    }
+    return NULL;
+}
+#endif
+
+void cc_set_home(const char *argv0) {
+    prog = argv0;
+    home = dir_of(argv0);
+    if (home == NULL) home = find_self(argv0);
+}
+
+static const char *compiler(void) {
+    const char *cc = getenv("CC");
+    return cc && *cc ? cc : DEFAULT_CC;
+}
+
+// 一个要编译的模块
+typedef struct Unit Unit;
+
+struct Unit {
+    char *src; // .c文件
+    char *obj; // 缓存中的目标文件
+    bool ok; // 编译是否成功
+};
+
+// 编译命令中与文件无关的部分，也是缓存哈希值的一部分
+static char *compile_flags(void) {
+    Buf *buf = new_buf();
+#ifdef _WIN32
+    buf_printf(buf, "%s /nologo /c %s /I\"%s\"", compiler(), level > 0 ? "/O2" : "/Od", home);
+#else
+    buf_printf(buf, "%s -c -O%d -I\"%s\"", compiler(), level, home);
+#endif
+    char *flags = buf->data;
+    free(buf);
+    return flags;
+}
+
+// FNV-1a哈希，可以分段累加
+static uint64_t fnv(uint64_t h, const char *data, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)data[i];
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+// 读取整个文件，文件不存在时返回NULL
+static char *read_all(const char *path, size_t *len) {
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL) return NULL;
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    char *data = malloc(size + 1);
+    *len = fread(data, 1, size, fp);
+    data[*len] = '\0';
+    fclose(fp);
+    return data;
+}
+
+// 把.c文件以及它用`#include "..."`引用的头文件都算进哈希值。
+// 头文件先在当前目录找，找不到再到标准库的目录找
+static uint64_t hash_src(uint64_t h, const char *path) {
+    size_t len;
+    char *code = read_all(path, &len);
+    if (code == NULL) return h;
+    h = fnv(h, code, len);
+    for (char *p = strstr(code, "#include \""); p != NULL; p = strstr(p, "#include \"")) {
+        p += strlen("#include \"");
+        char *end = strchr(p, '"');
+        if (end == NULL) break;
+        char *name = substr(p, 0, end - p);
+        size_t hlen;
+        char *header = read_all(name, &hlen);
+        if (header == NULL) {
+            char *alt = malloc(strlen(home) + strlen(name) + 2);
+            sprintf(alt, "%s/%s", home, name);
+            header = read_all(alt, &hlen);
+            free(alt);
+        }
+        if (header != NULL) {
+            h = fnv(h, header, hlen);
+            free(header);
+        }
+        free(name);
+    }
+    free(code);
+    return h;
+}
+
+static bool exists(const char *path) {
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL) return false;
+    fclose(fp);
+    return true;
+}
+
+static char *flags;
+
+// 编译一个模块：先输出到临时文件，成功后再改名，这样缓存中不会留下不完整的目标文件
+static void compile_task(void *arg, int i) {
+    Unit *unit = ((Unit**)arg)[i];
+    char *tmp = malloc(strlen(unit->obj) + 5);
+    sprintf(tmp, "%s.tmp", unit->obj);
+    Buf *cmd = new_buf();
+#ifdef _WIN32
+    buf_printf(cmd, "%s \"%s\" /Fo\"%s\"", flags, unit->src, tmp);
+#else
+    buf_printf(cmd, "%s \"%s\" -o \"%s\"", flags, unit->src, tmp);
+#endif
+    log_trace("%s\n", cmd->data);
+    unit->ok = system(cmd->data) == 0 && rename(tmp, unit->obj) == 0;
+    if (!unit->ok) remove(tmp);
+    free_buf(cmd);
+    free(tmp);
+}
+
+static bool link_exe(Unit *units, int count, const char *exe) {
+    Buf *cmd = new_buf();
+#ifdef _WIN32
+    buf_printf(cmd, "%s /nologo", compiler());
+    for (int i = 0; i < count; i++) buf_printf(cmd, " \"%s\"", units[i].obj);
+    buf_printf(cmd, " \"%s\\stdz.lib\" /Fe\"%s\"", home, exe);
+#else
+    buf_puts(cmd, compiler());
+    for (int i = 0; i < count; i++) buf_printf(cmd, " \"%s\"", units[i].obj);
+    buf_printf(cmd, " -L\"%s\" -lstdz -lm -o \"%s\"", home, exe);
+#endif
+    log_trace("%s\n", cmd->data);
+    bool ok = system(cmd->data) == 0;
+    free_buf(cmd);
+    return ok;
+}
+
+bool cc_build(char **files, int count, const char *exe) {
+    if (home == NULL) {
+        printf("Error: cannot find the directory of %s, which holds stdz.h and the stdz library; run it by its full path\n", prog);
+        return false;
+    }
+#ifdef _WIN32
+    _mkdir(CACHE_DIR);
+#else
+    mkdir(CACHE_DIR, 0755);
+#endif
+    flags = compile_flags();
+    uint64_t seed = fnv(0xcbf29ce484222325ULL, flags, strlen(flags));
+
+    // 计算每个模块的哈希值，缓存中没有对应目标文件的模块才需要编译
+    Unit *units = calloc(count, sizeof(Unit));
+    Unit **todo = calloc(count, sizeof(Unit*));
+    int todo_count = 0;
+    for (int i = 0; i < count; i++) {
+        Unit *unit = &units[i];
+        unit->src = files[i];
+        char *base = remove_ext(files[i]);
+        unit->obj = malloc(strlen(CACHE_DIR) + strlen(base) + 32);
+        sprintf(unit->obj, "%s/%s-%016llx.%s", CACHE_DIR, base, (unsigned long long)hash_src(seed, files[i]), OBJ_EXT);
+        free(base);
+        if (exists(unit->obj)) {
+            log_trace("Cached %s\n", unit->obj);
+            unit->ok = true;
+        } else {
+            todo[todo_count++] = unit;
+        }
+    }
+
+    pool_run(todo_count, compile_task, todo);
+
+    bool ok = true;
+    for (int i = 0; i < count; i++) {
+        if (!units[i].ok) {
+            printf("Error: failed to compile %s\n", units[i].src);
+            ok = false;
+        }
+    }
+    if (ok) ok = link_exe(units, count, exe);
+
+    for (int i = 0; i < count; i++) free(units[i].obj);
+    free(units);
+    free(todo);
+    free(flags);
+    return ok;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <stdbool.h>
+
+// C编译驱动
+//
+// `z run c`转译出各个模块的.c文件之后，由这里调用系统的C编译器（Windows上是cl，其他平台是clang，
+// 可以用环境变量CC指定）把它们编译成可执行文件：
+// - 各个.c文件分别编译成目标文件，用线程池（见pool.h）并行进行；
+// - 目标文件缓存在.zcache目录中，按内容的哈希值命名。哈希值包括编译命令、.c文件和它引用的本地头文件，
+//   内容不变的模块直接复用缓存，不再编译；
+// - 最后与标准库libstdz链接。标准库和它的头文件stdz.h都在z所在的目录中。
+
+// 设置C编译器的优化级别，对应`-O<N>`选项，默认为1
+void cc_set_level(int level);
+
+// 设置z所在的目录，用来查找标准库。argv0中没有目录时，从/proc/self/exe（Windows上用GetModuleFileName）
+// 或PATH中查找z；都找不到时cc_build报错
+void cc_set_home(const char *argv0);
+
+// 把files中的count个.c文件编译并链接成exe，返回false表示编译失败
+bool cc_build(char **files, int count, const char *exe);
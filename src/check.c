@@ -0,0 +1,285 @@
+#include <stdlib.h>
+#include "check.h"
+#include "meta.h"
+#include "type.h"
+
+// 类型检查
+//
+// 解析器在声明处记下了存量的类型，但这些类型不一定都可信：例如存量的初值类型未知时默认为int，
+// 之后又可能被赋予其他类型的值；没有标注返回类型的函数默认返回int，函数体却可能返回别的类型。
+//
+// 检查时先乐观地假设声明的类型都成立，同时核对每一处写入（声明的初值、赋值、函数体的返回值）。
+// 发现不符时，把对应的存量或函数记为“动态的”，再从头检查一遍，直到不再有新的不符。
+// 动态的存量和函数、对象的字段、字典的元素，类型都视为不确定，涉及它们的运算使用通用的实现。
+// 数组只有在由数组字面量初始化、元素都符合声明的类型、之后也没有被整体赋值时，元素的类型才是确定的；
+// 解释器不允许改变已有元素的种类（见interp.c中对ND_INDEX的赋值），所以对元素的赋值不影响这一点。
+//
+// 函数的参数总是按声明的类型特化，解释器在调用时检查实参的种类（见interp.c中的check_arg）。
+
+typedef struct PtrSet PtrSet;
+
+struct PtrSet {
+    void **items;
+    int count;
+    int cap;
+};
+
+static PtrSet dyn_vars; // 动态的存量，元素是Meta*
+static PtrSet typed_arrays; // 元素类型确定的数组存量，元素是Meta*，其中被记为动态的仍然不确定
+static PtrSet dyn_fns; // 返回值类型与声明不符的函数，元素是Fn*
+static bool changed; // 这一遍检查是否发现了新的动态存量或函数
+
+static bool set_has(PtrSet *set, void *p) {
+    for (int i = 0; i < set->count; i++) {
+        if (set->items[i] == p) return true;
+    }
+    return false;
+}
+
+static void set_add(PtrSet *set, void *p) {
+    if (set_has(set, p)) return;
+    if (set->count >= set->cap) {
+        set->cap = set->cap ? set->cap * 2 : 16;
+        set->items = realloc(set->items, set->cap * sizeof(void *));
+    }
+    set->items[set->count++] = p;
+    changed = true;
+}
+
+static bool is_scalar(const Type *t) {
+    return t && (t->kind == TY_INT || t->kind == TY_FLOAT || t->kind == TY_DOUBLE || t->kind == TY_BOOL);
+}
+
+static bool is_num(const Type *t) {
+    return t && (t->kind == TY_INT || t->kind == TY_FLOAT || t->kind == TY_DOUBLE);
+}
+
+static bool same(const Type *a, const Type *b) {
+    return a && b && a->kind == b->kind;
+}
+
+static const Type *check(Node *expr);
+
+// 存量的类型；类型不确定时返回NULL
+static const Type *var_type(Meta *m) {
+    if (m == NULL || m->is_field || set_has(&dyn_vars, m)) return NULL;
+    return is_scalar(m->type) ? m->type : NULL;
+}
+
+// 给存量m写入类型为t的值，与声明的类型不符时，m就成为动态的
+static void write_var(Meta *m, const Type *t) {
+    if (m == NULL || m->is_field || !is_scalar(m->type)) return;
+    if (!same(m->type, t)) set_add(&dyn_vars, m);
+}
+
+// 自定义函数的返回值类型；类型不确定时返回NULL
+static const Type *ret_type(Meta *m) {
+    if (m == NULL || m->kind != ND_FN || !m->is_def || m->node == NULL) return NULL;
+    Fn *fn = &m->node->as.fn;
+    if (fn->type == NULL || set_has(&dyn_fns, fn)) return NULL;
+    Type *ret = fn->type->as.fn.ret;
+    return is_scalar(ret) ? ret : NULL;
+}
+
+// 由数组字面量初始化的数组存量：元素都符合声明的类型时，元素的类型才是确定的
+static void init_array(Meta *m, Node *value) {
+    if (m == NULL || m->is_field || m->type == NULL || m->type->kind != TY_ARRAY) return;
+    if (value == NULL || value->kind != ND_ARRAY) return;
+    set_add(&typed_arrays, m);
+    Type *item = m->type->as.array.item;
+    for (int i = 0; i < value->as.array.size; i++) {
+        if (!same(item, check(value->as.array.items[i]))) set_add(&dyn_vars, m);
+    }
+}
+
+// 数组元素的类型；类型不确定时返回NULL
+static const Type *item_type(Node *parent) {
+    if (parent->kind != ND_IDENT || parent->as.path.len != 1 || parent->as.path.names[0].kind != NM_NAME) return NULL;
+    Meta *m = parent->meta;
+    if (m == NULL || m->is_field || !set_has(&typed_arrays, m) || set_has(&dyn_vars, m)) return NULL;
+    Type *item = m->type->as.array.item;
+    return is_scalar(item) ? item : NULL;
+}
+
+// 数值运算的特化：每种类型的运算按Op的顺序排列
+static Spec num_spec(const Type *t, Op op) {
+    switch (t->kind) {
+    case TY_INT: return SP_ADD_INT + op;
+    case TY_FLOAT: return SP_ADD_FLOAT + op;
+    case TY_DOUBLE: return SP_ADD_DOUBLE + op;
+    default: return SP_NONE;
+    }
+}
+
+static const Type *check_binop(Node *expr) {
+    BinOp *bop = &expr->as.bop;
+    bop->spec = SP_NONE;
+    if (bop->op == OP_ASN) {
+        Node *left = bop->left;
+        const Type *t = check(bop->right);
+        if (left->kind == ND_INDEX) {
+            check(left->as.index.idx);
+        } else if ((left->kind == ND_LNAME || left->kind == ND_IDENT) && left->as.path.len == 1) {
+            write_var(left->meta, t);
+            // 整体赋值后，数组的元素就不再确定了
+            if (set_has(&typed_arrays, left->meta)) set_add(&dyn_vars, left->meta);
+        }
+        return t;
+    }
+    const Type *l = check(bop->left);
+    const Type *r = check(bop->right);
+    if (!same(l, r)) return NULL;
+    switch (bop->op) {
+    case OP_AND:
+    case OP_OR:
+        if (l->kind != TY_BOOL) return NULL;
+        bop->spec = bop->op == OP_AND ? SP_AND : SP_OR;
+        return &TYPE_BOOL;
+    case OP_EQ:
+    case OP_NE:
+        if (l->kind == TY_BOOL) {
+            bop->spec = bop->op == OP_EQ ? SP_EQ_BOOL : SP_NE_BOOL;
+            return &TYPE_BOOL;
+        }
+        // 数值的比较见下
+    case OP_ADD:
+    case OP_SUB:
+    case OP_MUL:
+    case OP_DIV:
+    case OP_GT:
+    case OP_LT:
+    case OP_GE:
+    case OP_LE:
+        if (!is_num(l)) return NULL;
+        bop->spec = num_spec(l, bop->op);
+        return bop->op < OP_GT ? l : &TYPE_BOOL;
+    default:
+        return NULL;
+    }
+}
+
+static const Type *check_unary(Node *expr) {
+    Unary *una = &expr->as.una;
+    const Type *t = check(una->body);
+    una->spec = SP_NONE;
+    if (t == NULL) return NULL;
+    if (expr->kind == ND_NOT) {
+        if (t->kind != TY_BOOL) return NULL;
+        una->spec = SP_NOT;
+        return t;
+    }
+    switch (t->kind) {
+    case TY_INT: una->spec = SP_NEG_INT; return t;
+    case TY_FLOAT: una->spec = SP_NEG_FLOAT; return t;
+    case TY_DOUBLE: una->spec = SP_NEG_DOUBLE; return t;
+    default: return NULL;
+    }
+}
+
+// 函数体最后一个表达式的值就是返回值，它的类型与声明不符时，调用处的类型不确定
+static void check_fn(Node *expr) {
+    Fn *fn = &expr->as.fn;
+    const Type *t = check(fn->body);
+    if (fn->type == NULL) return;
+    Type *ret = fn->type->as.fn.ret;
+    if (is_scalar(ret) && !same(ret, t)) set_add(&dyn_fns, fn);
+}
+
+static void check_obj(Node *expr) {
+    Type *type = expr->meta->type;
+    for (int i = 0; i < type->as.user.field_count; i++) {
+        check(expr->as.obj.fields[i]);
+    }
+}
+
+static void check_dict(Node *expr) {
+    HashIter *i = hash_iter(expr->as.dict.entries);
+    while (hash_next(expr->as.dict.entries, i)) {
+        Node *kv = (Node*)i->value;
+        check(kv->as.kv.val);
+    }
+}
+
+static const Type *check(Node *expr) {
+    if (expr == NULL) return NULL;
+    const Type *t = NULL;
+    switch (expr->kind) {
+    case ND_INT:
+    case ND_FLOAT:
+    case ND_DOUBLE:
+    case ND_BOOL:
+    case ND_STR:
+        return check_primary_type(expr);
+    case ND_IDENT:
+        // 注意：名称节点的meta是声明处的元信息，不能改写
+        if (expr->as.path.len != 1 || expr->as.path.names[0].kind != NM_NAME) return NULL;
+        return var_type(expr->meta);
+    case ND_PROG:
+    case ND_BLOCK:
+        for (int i = 0; i < expr->as.exprs.count; i++) {
+            t = check(expr->as.exprs.list[i]);
+        }
+        return t;
+    case ND_LET:
+    case ND_MUT:
+        t = check(expr->as.asn.value);
+        write_var(expr->as.asn.name->meta, t);
+        init_array(expr->as.asn.name->meta, expr->as.asn.value);
+        return t;
+    case ND_BINOP:
+        t = check_binop(expr);
+        break;
+    case ND_NEG:
+    case ND_NOT:
+        t = check_unary(expr);
+        break;
+    case ND_IF: {
+        check(expr->as.if_else.cond);
+        const Type *then = check(expr->as.if_else.then);
+        const Type *els = check(expr->as.if_else.els);
+        if (expr->as.if_else.els && same(then, els)) t = then;
+        break;
+    }
+    case ND_FOR:
+        check(expr->as.loop.cond);
+        check(expr->as.loop.body);
+        return NULL;
+    case ND_FN:
+        check_fn(expr);
+        return NULL;
+    case ND_CALL:
+        // 注意：调用节点的meta是函数的元信息，不能改写
+        for (int i = 0; i < expr->as.call.argc; i++) {
+            check(expr->as.call.args[i]);
+        }
+        return ret_type(expr->meta);
+    case ND_ARRAY:
+        for (int i = 0; i < expr->as.array.size; i++) {
+            check(expr->as.array.items[i]);
+        }
+        return NULL;
+    case ND_INDEX:
+        // 下标节点的meta在解析时已经记下了元素的类型，这里只需要判断它是否可信
+        check(expr->as.index.idx);
+        return item_type(expr->as.index.parent);
+    case ND_OBJ:
+        check_obj(expr);
+        return NULL;
+    case ND_DICT:
+        check_dict(expr);
+        return NULL;
+    default:
+        return NULL;
+    }
+    // 基本类型是共享的只读对象，Meta中的类型指针不会被用来修改它
+    if (t && expr->meta) expr->meta->type = (Type*)t;
+    return t;
+}
+
+void check_types(Node *prog) {
+    if (prog == NULL) return;
+    do {
+        changed = false;
+        check(prog);
+    } while (changed);
+}
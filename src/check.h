@@ -0,0 +1,9 @@
+#pragma once
+
+#include "zast.h"
+
+// 类型检查
+//
+// 在解析和优化之后，自底向上推导每个表达式的类型，写入节点的meta->type，
+// 并为操作数类型确定的运算选择特化的运算（见Spec），解释器执行时就不需要再检查存值的种类。
+void check_types(Node *prog);
@@ -2,525 +2,986 @@
 #include <inttypes.h>
 #include <stdbool.h>
 #include <string.h>
+#include <stdlib.h>
 #include "codegen.h"
 #include "meta.h"
+#include "ir.h"
+#include "regalloc.h"
+#include "opt.h"
+#include "util.h"
+#include "x86.h"
+#include "obj.h"
 
-#define MAX_INCLUDE 100
-#define MAX_CONSTS 100
-#define MAX_EXTERN 100
+static int align16(int n) {
+    return n % 16 == 0 ? n : n + 16 - n % 16;
+}
 
-// 常量信息
-typedef struct ConstData ConstData;
-struct ConstData {
-    int idx;
-    bool has_newline;
-    char *value;
+// 基于IR和寄存器分配结果的指令选择
+//
+// 指令选择的结果是内存中的指令列表（见asm.h），linux/gas和windows/masm64共用同一套指令选择，
+// 区别只在于调用约定（见regalloc.h中的Abi）；汇编语法的差别由asm_print()处理。
+// 同样的指令列表也可以直接编码成机器码，见x86.c。
+//
+// 每个虚拟寄存器要么在物理寄存器中，要么在栈上的溢出槽位中。
+// x86的指令最多只有一个内存操作数，遇到两个操作数都在内存中时，借助rax中转。
+//
+// float和double用SSE2的标量指令计算，放在向量寄存器中，中转时使用Abi.fscratch；
+// 浮点数常量放在只读数据段的常量池中（cf0、cf1……），直接作为内存操作数使用。
+//
+// 栈帧中rbp之下依次是：保存的寄存器、溢出槽位和数组。有数组或向量时，溢出槽位区和数组区都16字节对齐，
+// 向量的溢出槽位可以直接作为SSE指令的内存操作数；数组元素则用movups读写，不要求对齐。
+
+// 当前正在生成的函数
+typedef struct FnGen FnGen;
+struct FnGen {
+    AsmFn *out;
+    const Abi *abi;
+    IrFn *fn;
+    RegAlloc *ra;
+    bool *labeled; // 哪些块是跳转目标，需要输出标签
+    int label_base; // 标签在整个文件中不能重复，每个函数的块号从这里开始编
+    int saved_count; // 序言中保存的被调用者保存寄存器个数
+    Reg saved[R_COUNT];
+    int frame_size; // 序言中`sub rsp`的大小
+    bool has_frame;
+    int spill_base; // 溢出槽位区在rbp之下的起点，字节数
+    int array_base; // 数组区在溢出槽位区中的起点，以4字节为单位
+    int *uses; // 每个虚拟寄存器被使用的次数
+    int fused; // 结果直接交给分支的比较，-1表示没有
+    Cond fused_cc;
 };
 
-// 元信息
-struct CodegenMeta {
-    // includes
-    int inc_count;
-    char *includes[MAX_INCLUDE];
+static FnGen G;
 
-    // data
-    int data_count;
-    ConstData data[MAX_CONSTS];
+#define EAX asm_reg(R_RAX, 4)
 
-    // externdef
-    int extern_count;
-    char *externs[MAX_CONSTS];
-};
+static AsmIns *emit(AsmOp op, AsmOpnd a, AsmOpnd b) {
+    return asm_emit(G.out, op, a, b);
+}
+
+static bool in_mem(IrArg a) {
+    return a.kind == IA_REG && G.ra->locs[a.val].spilled;
+}
+
+static bool in_reg(IrArg a) {
+    return a.kind == IA_REG && !G.ra->locs[a.val].spilled;
+}
+
+static Reg reg_of(IrArg a) {
+    return G.ra->locs[a.val].reg;
+}
+
+static IrType type_of(IrArg a) {
+    return ir_arg_type(G.fn, a);
+}
+
+static bool is_float(IrArg a) {
+    return type_of(a) != IT_INT;
+}
 
-static struct CodegenMeta META;
+// 类型的宽度：double是8字节，向量是16字节，其他都是4字节
+static int vsize(IrType t) {
+    return ir_type_size(t);
+}
 
-static char *WIN_REGS[4] = {"rcx", "rdx", "r8", "r9"};
-static char *LINUX_REGS[6] = {"rdi", "rsi", "rdx", "rcx", "r8", "r9"};
+// 浮点数指令：float和double的指令在AsmOp中相邻，ss在前
+static AsmOp fop(AsmOp ss, IrType t) {
+    return t == IT_DOUBLE ? ss + 1 : ss;
+}
+
+static AsmOp mov_op(IrType t) {
+    if (ir_lanes(t) > 1) return A_MOVUPS;
+    return t == IT_INT ? A_MOV : fop(A_MOVSS, t);
+}
+
+static AsmOpnd fscratch(IrType t) {
+    return asm_reg(G.abi->fscratch, vsize(t));
+}
+
+// 两个操作数是否在同一个位置
+static bool same_loc(IrArg a, IrArg b) {
+    if (a.kind != IA_REG || b.kind != IA_REG) return false;
+    Loc *x = &G.ra->locs[a.val];
+    Loc *y = &G.ra->locs[b.val];
+    if (x->spilled != y->spilled) return false;
+    return x->spilled ? x->slot == y->slot : x->reg == y->reg;
+}
+
+// IR操作数所在的位置：寄存器、栈上的溢出槽位、立即数或常量
+static AsmOpnd opnd(IrArg a) {
+    switch (a.kind) {
+    case IA_IMM:
+        return asm_imm(a.val);
+    case IA_REG: {
+        Loc *loc = &G.ra->locs[a.val];
+        int size = vsize(type_of(a));
+        if (!loc->spilled) return asm_reg(loc->reg, size);
+        AsmOpnd mem = asm_mem(R_RBP, -(G.spill_base + (loc->slot + size / 4) * 4));
+        mem.size = size;
+        return mem;
+    }
+    case IA_STR:
+        return asm_str(a.val);
+    case IA_FLT:
+        return asm_num(a.val, vsize(type_of(a)));
+    default:
+        return (AsmOpnd){0};
+    }
+}
 
-static int count() {
-    static int i = 0;
-    return ++i;
+static IrArg dst_arg(Ir *ir) {
+    return ir_reg(ir->dst);
 }
 
-static void gen_expr(FILE *fp, Node *expr) {
-    switch(expr->kind) {
-    case ND_BLOCK:
-        for (int i = 0; i < expr->as.exprs.count; ++i) {
-            gen_expr(fp, expr->as.exprs.list[i]);
+static void emit_mov(IrArg dst, IrArg src) {
+    if (same_loc(dst, src)) return;
+    if (is_float(dst)) {
+        // 浮点数常量也是内存操作数
+        IrType t = type_of(dst);
+        if (in_reg(dst) || in_reg(src)) {
+            emit(mov_op(t), opnd(dst), opnd(src));
+        } else {
+            emit(mov_op(t), fscratch(t), opnd(src));
+            emit(mov_op(t), opnd(dst), fscratch(t));
         }
         return;
-    case ND_MUT: // 这里和ND_LET一样
-    case ND_LET: {
-        gen_expr(fp, expr->as.asn.value);
-#ifdef _WIN32
-        fprintf(fp, "    mov %s$[rbp], eax\n", get_name(expr->as.asn.name));
-#else
-        Meta *m = expr->meta;
-        fprintf(fp, "    mov dword ptr[rbp-%d], eax\n", m->offset);
-#endif
-        return;
     }
-    case ND_IF: {
-        int c = count();
-        gen_expr(fp, expr->as.if_else.cond);
-        fprintf(fp, "    cmp rax, 0\n");
-        fprintf(fp, "    je _L_else%d\n", c);
-        gen_expr(fp, expr->as.if_else.then);
-        fprintf(fp, "    jmp _L_end%d\n", c);
-        fprintf(fp, "_L_else%d:\n", c);
-        if (expr->as.if_else.els != NULL) {
-            gen_expr(fp, expr->as.if_else.els);
-        }
-        fprintf(fp, "_L_end%d:\n", c);
+    if (in_mem(dst) && in_mem(src)) {
+        emit(A_MOV, EAX, opnd(src));
+        emit(A_MOV, opnd(dst), EAX);
         return;
     }
-    case ND_FOR: {
-        int c = count();
-        fprintf(fp, "_L_begin%d:\n", c);
-        gen_expr(fp, expr->as.loop.cond);
-        fprintf(fp, "    cmp rax, 0\n");
-        fprintf(fp, "    je _L_end%d\n", c);
-        gen_expr(fp, expr->as.loop.body);
-        fprintf(fp, "    jmp _L_begin%d\n", c);
-        fprintf(fp, "_L_end%d:\n", c);
+    emit(A_MOV, opnd(dst), opnd(src));
+}
+
+static const AsmOp ARITH_OPS[] = {[IR_ADD] = A_ADD, [IR_SUB] = A_SUB, [IR_AND] = A_AND, [IR_OR] = A_OR};
+
+// 在寄存器reg中计算reg = reg op b
+static void emit_arith_reg(IrOp op, AsmOpnd reg, IrArg b) {
+    if (op == IR_MUL) {
+        if (b.kind == IA_IMM) emit(A_IMUL, reg, reg)->c = asm_imm(b.val);
+        else emit(A_IMUL, reg, opnd(b));
+    } else {
+        emit(ARITH_OPS[op], reg, opnd(b));
+    }
+}
+
+static const AsmOp FARITH_OPS[] = {[IR_ADD] = A_ADDSS, [IR_SUB] = A_SUBSS, [IR_MUL] = A_MULSS, [IR_DIV] = A_DIVSS};
+static const AsmOp VARITH_OPS[] = {[IR_ADD] = A_ADDPS, [IR_SUB] = A_SUBPS, [IR_MUL] = A_MULPS, [IR_DIV] = A_DIVPS};
+
+// 浮点数和向量的四则运算指令。ps和pd相邻；int的向量只有加减法
+static AsmOp farith_op(IrOp op, IrType t) {
+    switch (t) {
+    case IT_VINT: return op == IR_ADD ? A_PADDD : A_PSUBD;
+    case IT_VFLOAT: return VARITH_OPS[op];
+    case IT_VDOUBLE: return VARITH_OPS[op] + 1;
+    default: return fop(FARITH_OPS[op], t);
+    }
+}
+
+// 浮点数的四则运算：和int一样是两地址的指令，但结果必须在向量寄存器中
+static void gen_farith(Ir *ir) {
+    IrArg dst = dst_arg(ir);
+    IrArg a = ir->a, b = ir->b;
+    IrType t = type_of(dst);
+    AsmOp op = farith_op(ir->op, t);
+    bool commutative = ir->op == IR_ADD || ir->op == IR_MUL;
+    if (!same_loc(dst, a) && same_loc(dst, b) && commutative) {
+        IrArg tmp = a; a = b; b = tmp;
+    }
+    if (in_reg(dst) && !same_loc(dst, b)) {
+        emit_mov(dst, a);
+        emit(op, opnd(dst), opnd(b));
+    } else {
+        emit(mov_op(t), fscratch(t), opnd(a));
+        emit(op, fscratch(t), opnd(b));
+        emit(mov_op(t), opnd(dst), fscratch(t));
+    }
+}
+
+static void gen_arith(Ir *ir) {
+    IrArg dst = dst_arg(ir);
+    if (is_float(dst)) {
+        gen_farith(ir);
         return;
     }
-    case ND_IDENT: {
-#ifdef _WIN32
-        // 变量名，需要获取其值
-        fprintf(fp, "    mov rax, %s$[rbp]\n", expr->as.path.names[0].name);
-#else
-        // 先获取变量地址
-        Meta *m = expr->meta;
-        // 再加载变量值
-        fprintf(fp, "    mov eax, [rbp-%d]\n", m->offset);
-#endif
+    IrArg a = ir->a, b = ir->b;
+    bool commutative = ir->op != IR_SUB;
+    if (!same_loc(dst, a) && same_loc(dst, b) && commutative) {
+        IrArg t = a; a = b; b = t;
+    }
+    if (in_reg(dst) && !same_loc(dst, b)) {
+        emit_mov(dst, a);
+        emit_arith_reg(ir->op, opnd(dst), b);
+    } else if (in_mem(dst) && same_loc(dst, a) && ir->op != IR_MUL && !in_mem(b)) {
+        // 内存操作数可以直接参与加减和位运算
+        emit(ARITH_OPS[ir->op], opnd(dst), opnd(b));
+    } else {
+        emit(A_MOV, EAX, opnd(a));
+        emit_arith_reg(ir->op, EAX, b);
+        emit(A_MOV, opnd(dst), EAX);
+    }
+}
+
+static void gen_div(Ir *ir) {
+    if (is_float(dst_arg(ir))) {
+        gen_farith(ir);
         return;
     }
-    case ND_LNAME: {
-        Meta *m = expr->meta;
-        fprintf(fp, "    mov rax, rbp\n");
-        if (m->offset != 0) {
-            fprintf(fp, "    sub rax, %d\n", m->offset);
+    emit(A_MOV, EAX, opnd(ir->a));
+    emit(A_CDQ, (AsmOpnd){0}, (AsmOpnd){0});
+    if (ir->b.kind == IA_IMM) {
+        emit(A_MOV, asm_reg(R_R11, 4), asm_imm(ir->b.val));
+        emit(A_IDIV, asm_reg(R_R11, 4), (AsmOpnd){0});
+    } else {
+        emit(A_IDIV, opnd(ir->b), (AsmOpnd){0});
+    }
+    emit(A_MOV, opnd(dst_arg(ir)), EAX);
+}
+
+static const Cond CONDS[] = {
+    [IR_EQ] = CC_E, [IR_NE] = CC_NE, [IR_LT] = CC_L,
+    [IR_LE] = CC_LE, [IR_GT] = CC_G, [IR_GE] = CC_GE,
+};
+
+// ucomiss/ucomisd的结果和无符号数的比较一样
+static const Cond FCONDS[] = {
+    [IR_EQ] = CC_E, [IR_NE] = CC_NE, [IR_LT] = CC_B,
+    [IR_LE] = CC_BE, [IR_GT] = CC_A, [IR_GE] = CC_AE,
+};
+
+// 比较的结果只被紧接着的分支使用时，分支直接根据标志位跳转，不需要把结果存成0或1
+static bool fuses_branch(IrBlock *block, Ir *ir) {
+    Ir *next = ir + 1;
+    if (next >= block->code + block->count || next->op != IR_BR) return false;
+    return next->a.kind == IA_REG && next->a.val == ir->dst && G.uses[ir->dst] == 1;
+}
+
+static void gen_cmp(IrBlock *block, Ir *ir) {
+    IrArg a = ir->a;
+    Cond cc = CONDS[ir->op];
+    if (is_float(a)) {
+        // 第一个操作数必须在向量寄存器中
+        IrType t = type_of(a);
+        AsmOpnd x = opnd(a);
+        if (!in_reg(a)) {
+            x = fscratch(t);
+            emit(mov_op(t), x, opnd(a));
         }
+        emit(fop(A_UCOMISS, t), x, opnd(ir->b));
+        cc = FCONDS[ir->op];
+    } else if (a.kind == IA_IMM || (in_mem(a) && in_mem(ir->b))) {
+        emit(A_MOV, EAX, opnd(a));
+        emit(A_CMP, EAX, opnd(ir->b));
+    } else {
+        emit(A_CMP, opnd(a), opnd(ir->b));
+    }
+    if (fuses_branch(block, ir)) {
+        G.fused = ir->dst;
+        G.fused_cc = cc;
         return;
     }
-    case ND_INT: {
-        fprintf(fp, "    mov rax, %d\n", expr->as.num.val);
+    IrArg dst = dst_arg(ir);
+    emit(A_SET, asm_reg(R_RAX, 1), (AsmOpnd){0})->cc = cc;
+    if (in_reg(dst)) {
+        emit(A_MOVZX, opnd(dst), asm_reg(R_RAX, 1));
+    } else {
+        emit(A_MOVZX, EAX, asm_reg(R_RAX, 1));
+        emit(A_MOV, opnd(dst), EAX);
+    }
+}
+
+static void gen_unary(Ir *ir) {
+    IrArg dst = dst_arg(ir);
+    if (is_float(dst)) {
+        // -a算作0 - a
+        IrType t = type_of(dst);
+        emit(A_XORPS, fscratch(t), fscratch(t));
+        emit(fop(A_SUBSS, t), fscratch(t), opnd(ir->a));
+        emit(mov_op(t), opnd(dst), fscratch(t));
         return;
     }
-    case ND_NEG: {
-        gen_expr(fp, expr->as.una.body);
-        fprintf(fp, "    neg rax\n");
+    emit_mov(dst, ir->a);
+    if (ir->op == IR_NEG) emit(A_NEG, opnd(dst), (AsmOpnd){0});
+    else emit(A_XOR, opnd(dst), asm_imm(1));
+}
+
+// 类型转换。结果不在寄存器中时，先在eax或者临时向量寄存器中算出
+static void gen_cvt(Ir *ir) {
+    IrArg dst = dst_arg(ir);
+    IrType from = type_of(ir->a), to = type_of(dst);
+    AsmOpnd src = opnd(ir->a);
+    if (ir->a.kind == IA_IMM) {
+        emit(A_MOV, EAX, src);
+        src = EAX;
+    }
+    AsmOpnd res = in_reg(dst) ? opnd(dst) : to == IT_INT ? EAX : fscratch(to);
+    AsmOp op;
+    if (from == IT_INT) op = fop(A_CVTSI2SS, to);
+    else if (to == IT_INT) op = fop(A_CVTTSS2SI, from);
+    else op = to == IT_DOUBLE ? A_CVTSS2SD : A_CVTSD2SS;
+    emit(op, res, src);
+    if (!in_reg(dst)) emit(mov_op(to), opnd(dst), res);
+}
+
+// 数组元素a[idx]的内存操作数，宽度为size。下标不在寄存器中时先放入r11。
+// int的运算结果总是零扩展到64位，所以下标所在的寄存器可以直接用作变址
+static AsmOpnd elem_opnd(IrArg arr, IrArg idx, int size) {
+    IrArray *array = &G.fn->arrays[arr.val];
+    int esize = ir_type_size(array->type);
+    int slots = (array->size * esize + 15) / 16 * 4;
+    AsmOpnd mem = asm_mem(R_RBP, -(G.spill_base + (G.array_base + array->slot + slots) * 4));
+    mem.size = size;
+    if (idx.kind == IA_IMM) {
+        mem.val += idx.val * esize;
+        return mem;
+    }
+    if (in_reg(idx)) {
+        mem.index = reg_of(idx);
+    } else {
+        emit(A_MOV, asm_reg(R_R11, 4), opnd(idx));
+        mem.index = R_R11;
+    }
+    mem.scale = esize;
+    return mem;
+}
+
+static void gen_elem(Ir *ir) {
+    IrArg dst = dst_arg(ir);
+    IrType t = type_of(dst);
+    AsmOpnd mem = elem_opnd(ir->a, ir->b, vsize(t));
+    if (in_reg(dst)) {
+        emit(mov_op(t), opnd(dst), mem);
         return;
     }
-    case ND_NOT: {
-        gen_expr(fp, expr->as.una.body);
-        fprintf(fp, "    xor al, -1\n");
-        fprintf(fp, "    and al, 1\n");
-        fprintf(fp, "    movzx rax, al\n");
+    AsmOpnd tmp = t == IT_INT ? EAX : fscratch(t);
+    emit(mov_op(t), tmp, mem);
+    emit(mov_op(t), opnd(dst), tmp);
+}
+
+static void gen_setelem(Ir *ir) {
+    IrType t = type_of(ir->c);
+    AsmOpnd mem = elem_opnd(ir->a, ir->b, vsize(t));
+    if (in_reg(ir->c) || ir->c.kind == IA_IMM) {
+        emit(mov_op(t), mem, opnd(ir->c));
         return;
     }
-    case ND_BOOL: {
-        if (expr->as.bul) {
-            fprintf(fp, "    mov rax, 1\n");
+    AsmOpnd tmp = t == IT_INT ? EAX : fscratch(t);
+    emit(mov_op(t), tmp, opnd(ir->c));
+    emit(mov_op(t), mem, tmp);
+}
+
+// 把标量复制到向量的每一路：先放入最低的一路，再用shuffle铺开
+static void gen_splat(Ir *ir) {
+    IrArg dst = dst_arg(ir);
+    IrType t = type_of(dst);
+    AsmOpnd x = in_reg(dst) ? opnd(dst) : fscratch(t);
+    switch (t) {
+    case IT_VINT:
+        if (in_reg(ir->a)) {
+            emit(A_MOVD, x, opnd(ir->a));
         } else {
-            fprintf(fp, "    mov rax, 0\n");
+            emit(A_MOV, EAX, opnd(ir->a));
+            emit(A_MOVD, x, EAX);
         }
-        return;
+        emit(A_PSHUFD, x, x)->c = asm_imm(0);
+        break;
+    case IT_VFLOAT:
+        emit(A_MOVSS, asm_reg(x.reg, 4), opnd(ir->a));
+        emit(A_SHUFPS, x, x)->c = asm_imm(0);
+        break;
+    default:
+        emit(A_MOVSD, asm_reg(x.reg, 8), opnd(ir->a));
+        emit(A_UNPCKLPD, x, x);
+        break;
+    }
+    if (!in_reg(dst)) emit(A_MOVUPS, opnd(dst), x);
+}
+
+// JIT中存量的存储区：先把地址放入r11
+static AsmOpnd slot_of(IrArg a) {
+    emit(A_MOVABS, asm_reg(R_R11, 8), (AsmOpnd){0})->imm64 = (int64_t)(intptr_t)G.fn->slots;
+    return asm_mem(R_R11, a.val * 4);
+}
+
+static void gen_load(Ir *ir) {
+    AsmOpnd slot = slot_of(ir->a);
+    IrArg dst = dst_arg(ir);
+    if (in_reg(dst)) {
+        emit(A_MOV, opnd(dst), slot);
+    } else {
+        emit(A_MOV, EAX, slot);
+        emit(A_MOV, opnd(dst), EAX);
     }
-    case ND_CALL: {
-        // 处理函数名称
-        CallExpr *call = &expr->as.call;
-        char *name = get_name(call->name);
-        bool is_print = strcmp(name, "print") == 0;
-#ifdef _WIN32
-        if (is_print) { // printf 要单独处理，加上'\n'
-            Node *arg = call->args[0];
-            ConstData *data = (ConstData*)arg->meta;
-            if (arg->kind == ND_INT) {
-                fprintf(fp, "    lea rcx, ct%d\n", data->idx);
-                fprintf(fp, "    mov rdx, %d\n", call->args[0]->as.num.val);
-            } else {
-                fprintf(fp, "    lea rcx, ct%d\n", data->idx);
+}
+
+static void gen_store(Ir *ir) {
+    if (in_mem(ir->b)) emit(A_MOV, EAX, opnd(ir->b));
+    AsmOpnd slot = slot_of(ir->a);
+    emit(A_MOV, slot, in_mem(ir->b) ? EAX : opnd(ir->b));
+}
+
+// 寄存器之间的复制，t是其中的值的类型
+static void emit_reg_mov(Reg dst, Reg src, IrType t) {
+    emit(mov_op(t), asm_reg(dst, vsize(t)), asm_reg(src, vsize(t)));
+}
+
+// 并行赋值出现环的时候，用来暂存一个值的寄存器
+static Reg tmp_for(Reg reg) {
+    return is_xmm(reg) ? G.abi->fscratch : R_RAX;
+}
+
+// 把一个参数放入参数寄存器
+static void load_arg(Reg reg, IrArg a) {
+    if (a.kind == IA_STR) {
+        emit(A_LEA, asm_reg(reg, 8), asm_str(a.val));
+    } else if (!in_reg(a) || reg_of(a) != reg) {
+        IrType t = type_of(a);
+        emit(mov_op(t), asm_reg(reg, vsize(t)), opnd(a));
+    }
+}
+
+// 参数寄存器的并行赋值：参数的值可能正好在别的参数寄存器里，
+// 所以每次挑一个目标寄存器不再被其他参数读取的赋值先做；出现环的时候借助rax（或临时向量寄存器）打破。
+static void gen_call_args(Ir *ir, const Reg *regs) {
+    int n = ir->argc;
+    bool done[IR_MAX_USES] = {0};
+    bool from_tmp[IR_MAX_USES] = {0}; // 参数的值已经挪到了临时寄存器中
+    int left = n;
+    while (left > 0) {
+        bool progress = false;
+        for (int i = 0; i < n; i++) {
+            if (done[i]) continue;
+            Reg dst = regs[i];
+            bool blocked = false;
+            for (int j = 0; j < n; j++) {
+                IrArg src = ir->args[j];
+                if (j != i && !done[j] && !from_tmp[j] && in_reg(src) && reg_of(src) == dst) blocked = true;
             }
-            fprintf(fp, "    call printf\n");
-        } else {
-            for (int i = 0; i < call->argc; ++i) {
-                Node *arg = call->args[i];
-                ConstData *data = (ConstData*)arg->meta;
-                if (arg->kind == ND_INT) {
-                    fprintf(fp, "    mov %s, %d\n", WIN_REGS[i], arg->as.num.val);
-                } else {
-                    fprintf(fp, "    lea %s, ct%d\n", WIN_REGS[i], data->idx);
+            if (blocked) continue;
+            if (from_tmp[i]) emit_reg_mov(dst, tmp_for(dst), type_of(ir->args[i]));
+            else load_arg(dst, ir->args[i]);
+            done[i] = true;
+            left--;
+            progress = true;
+        }
+        if (!progress) {
+            // 剩下的赋值构成了环：先把某个目标寄存器的旧值挪到临时寄存器，读取它的参数改从临时寄存器读取
+            for (int i = 0; i < n; i++) {
+                if (done[i]) continue;
+                Reg dst = regs[i];
+                IrType t = IT_INT;
+                for (int j = 0; j < n; j++) {
+                    IrArg src = ir->args[j];
+                    if (!done[j] && !from_tmp[j] && in_reg(src) && reg_of(src) == dst) t = type_of(src);
+                }
+                emit_reg_mov(tmp_for(dst), dst, t);
+                for (int j = 0; j < n; j++) {
+                    IrArg src = ir->args[j];
+                    if (!done[j] && !from_tmp[j] && in_reg(src) && reg_of(src) == dst) from_tmp[j] = true;
                 }
+                break;
             }
-            fprintf(fp, "    call %s\n", name);
         }
-#else
-        if (is_print) {
-            Node *arg = call->args[0];
-            ConstData *data = (ConstData*)arg->meta;
-            fprintf(fp, "    lea rdi, [rip+ct%d]\n", data->idx);
-            if (arg->kind == ND_INT) {
-                fprintf(fp, "    mov rsi, %d\n", arg->as.num.val);
-            }
-            fprintf(fp, "    call printf\n");
+    }
+}
+
+static void gen_call(Ir *ir) {
+    IrType types[IR_MAX_USES];
+    Reg regs[IR_MAX_USES];
+    int float_count = 0;
+    for (int i = 0; i < ir->argc && i < IR_MAX_USES; i++) types[i] = type_of(ir->args[i]);
+    for (int i = 0; i < ir->argc; i++) {
+        regs[i] = i < IR_MAX_USES ? abi_arg_reg(G.abi, types, i) : R_COUNT;
+        if (regs[i] == R_COUNT) {
+            printf("Error: too many arguments for native call: %s\n", ir->name);
+            exit(1);
+        }
+        if (types[i] != IT_INT) float_count++;
+    }
+    gen_call_args(ir, regs);
+    bool is_printf = strcmp(ir->name, "printf") == 0;
+    if (is_printf && G.abi->positional) {
+        // Windows下变参函数的浮点数参数还要复制一份到对应的通用寄存器中
+        for (int i = 0; i < ir->argc; i++) {
+            if (types[i] != IT_INT) emit(A_MOVQ, asm_reg(G.abi->args[i], 8), asm_reg(regs[i], 8));
+        }
+    }
+    if (G.abi->vararg_al && is_printf) emit(A_MOV, EAX, asm_imm(float_count));
+    emit(A_CALL, (AsmOpnd){0}, (AsmOpnd){0})->sym = ir->name;
+    if (ir->dst < 0) return;
+    IrType t = type_of(dst_arg(ir));
+    emit(mov_op(t), opnd(dst_arg(ir)), asm_reg(t == IT_INT ? R_RAX : R_XMM0, vsize(t)));
+}
+
+// 入口处的参数一起从参数寄存器中取出：先存入栈上的槽位，再在寄存器之间做并行赋值，出现环的时候借助rax打破
+static void gen_params(IrBlock *block) {
+    int n = 0;
+    while (n < block->count && block->code[n].op == IR_PARAM) n++;
+    Reg src[6];
+    IrArg dst[6];
+    bool done[6] = {0};
+    int left = 0;
+    for (int i = 0; i < n; i++) {
+        Ir *ir = &block->code[i];
+        src[i] = abi_arg_reg(G.abi, G.fn->param_types, ir->a.val);
+        dst[i] = dst_arg(ir);
+        if (in_mem(dst[i])) {
+            IrType t = type_of(dst[i]);
+            emit(mov_op(t), opnd(dst[i]), asm_reg(src[i], vsize(t)));
+            done[i] = true;
+        } else if (reg_of(dst[i]) == src[i]) {
+            done[i] = true;
         } else {
-            for (int i = 0; i < call->argc; ++i) {
-                Node *arg = call->args[i];
-                ConstData *data = (ConstData*)arg->meta;
-                if (arg->kind == ND_INT) {
-                    fprintf(fp, "    mov %s, %d\n", LINUX_REGS[i], arg->as.num.val);
-                } else {
-                    fprintf(fp, "    lea %s, [rip+ct%d]\n", LINUX_REGS[i], i);
-                }
-            }
-            fprintf(fp, "    call %s\n", name);
+            left++;
         }
-#endif
-        return;
     }
+    while (left > 0) {
+        bool progress = false;
+        for (int i = 0; i < n; i++) {
+            if (done[i]) continue;
+            bool blocked = false;
+            for (int j = 0; j < n; j++) {
+                if (j != i && !done[j] && src[j] == reg_of(dst[i])) blocked = true;
+            }
+            if (blocked) continue;
+            emit_reg_mov(reg_of(dst[i]), src[i], type_of(dst[i]));
+            done[i] = true;
+            left--;
+            progress = true;
+        }
+        if (!progress) {
+            for (int i = 0; i < n; i++) {
+                if (done[i]) continue;
+                Reg tmp = tmp_for(src[i]);
+                emit_reg_mov(tmp, src[i], type_of(dst[i]));
+                src[i] = tmp;
+                break;
+            }
+        }
     }
+}
 
-    // 错误情况：
-    if (expr->kind != ND_BINOP) {
-        printf("Error: unknown node kind for gen_expr: %d\n", expr->kind);
-        return;
+static void gen_prolog(void) {
+    if (!G.has_frame) return;
+    emit(A_PUSH, asm_reg(R_RBP, 8), (AsmOpnd){0});
+    emit(A_MOV, asm_reg(R_RBP, 8), asm_reg(R_RSP, 8));
+    for (int i = 0; i < G.saved_count; i++) {
+        emit(A_PUSH, asm_reg(G.saved[i], 8), (AsmOpnd){0});
     }
+    if (G.frame_size > 0) emit(A_SUB, asm_reg(R_RSP, 8), asm_imm(G.frame_size));
+}
 
-    // 处理二元表达式
-
-    // 左膀，gen_expr_win完成之后，结果存在rax中
-    gen_expr(fp, expr->as.bop.left);
-    // 右臂，现在的语境下，右臂只可能是整数，因此可以当做立即数直接参与计算
-    if (expr->as.bop.right->kind == ND_INT) {
-        int right = expr->as.bop.right->as.num.val;
-        // 具体的二元运算
-        switch (expr->as.bop.op) {
-        case OP_ADD:
-            fprintf(fp, "    add rax, %d\n", right);
-            break;
-        case OP_SUB:
-            fprintf(fp, "    sub rax, %d\n", right);
-            break;
-        case OP_MUL:
-            fprintf(fp, "    imul rax, %d\n", right);
-            break;
-        case OP_DIV:
-            fprintf(fp, "    mov rdi, %d\n", right);
-            fprintf(fp, "    cqo\n");
-            fprintf(fp, "    idiv rdi\n");
-            break;
-        case OP_EQ:
-            fprintf(fp, "    cmp rax, %d\n", right);
-            fprintf(fp, "    sete al\n");
-            fprintf(fp, "    movzx rax, al\n");
-            break;
-        case OP_NE:
-            fprintf(fp, "    cmp rax, %d\n", right);
-            fprintf(fp, "    setne al\n");
-            fprintf(fp, "    movzx rax, al\n");
-            break;
-        case OP_LT:
-            fprintf(fp, "    cmp rax, %d\n", right);
-            fprintf(fp, "    setl al\n");
-            fprintf(fp, "    movzx rax, al\n");
-            break;
-        case OP_LE: 
-            fprintf(fp, "    cmp rax, %d\n", right);
-            fprintf(fp, "    setle al\n");
-            fprintf(fp, "    movzx rax, al\n");
-            break;
-        case OP_GT:
-            fprintf(fp, "    cmp rax, %d\n", right);
-            fprintf(fp, "    setg al\n");
-            fprintf(fp, "    movzx rax, al\n");
-            break;
-        case OP_GE:
-            fprintf(fp, "    cmp rax, %d\n", right);
-            fprintf(fp, "    setge al\n");
-            fprintf(fp, "    movzx rax, al\n");
-            break;
-        case OP_ASN:
-            fprintf(fp, "    mov dword ptr [rax], %d\n", right);
-            break;
-        default:
-            printf("Error: unknown operator for binop expr: %d\n", expr->as.bop.op);
+static void gen_epilog(void) {
+    if (G.has_frame) {
+        if (G.frame_size > 0) emit(A_ADD, asm_reg(R_RSP, 8), asm_imm(G.frame_size));
+        for (int i = G.saved_count - 1; i >= 0; i--) {
+            emit(A_POP, asm_reg(G.saved[i], 8), (AsmOpnd){0});
         }
+        emit(A_POP, asm_reg(R_RBP, 8), (AsmOpnd){0});
+    }
+    emit(A_RET, (AsmOpnd){0}, (AsmOpnd){0});
+}
+
+static bool is_next(IrBlock *block, IrBlock *target) {
+    return target->id == block->id + 1;
+}
+
+static void emit_jump(AsmOp op, Cond cc, IrBlock *target) {
+    AsmIns *ins = emit(op, (AsmOpnd){0}, (AsmOpnd){0});
+    ins->cc = cc;
+    ins->label = G.label_base + target->id;
+}
+
+// 块的结尾：跳到紧接着的下一块时不需要跳转指令
+static void gen_branch(IrBlock *block, Ir *ir) {
+    IrBlock *yes = block->succs[0];
+    if (ir->op == IR_JMP || ir->a.kind == IA_IMM) {
+        IrBlock *target = ir->op == IR_BR && ir->a.val == 0 ? block->succs[1] : yes;
+        if (!is_next(block, target)) emit_jump(A_JMP, 0, target);
+        return;
+    }
+    IrBlock *no = block->succs[1];
+    Cond cc = CC_NE;
+    if (ir->a.val == G.fused) {
+        cc = G.fused_cc;
+        G.fused = -1;
     } else {
-        fprintf(fp, "    push rax\n");
-        // 右臂
-        gen_expr(fp, expr->as.bop.right);
-        fprintf(fp, "    push rax\n");
-        // 取出结果，进行运算操作
-        fprintf(fp, "    pop rdi\n");
-        fprintf(fp, "    pop rax\n");
-
-        // 具体的二元运算
-        switch (expr->as.bop.op) {
-        case OP_ADD:
-            fprintf(fp, "    add rax, rdi\n");
-            break;
-        case OP_SUB:
-            fprintf(fp, "    sub rax, rdi\n");
-            break;
-        case OP_MUL:
-            fprintf(fp, "    imul rax, rdi\n");
-            break;
-        case OP_DIV:
-            fprintf(fp, "    cqo\n");
-            fprintf(fp, "    idiv rdi\n");
-            break;
-        case OP_EQ:
-            fprintf(fp, "    cmp rax, rdi\n");
-            fprintf(fp, "    sete al\n");
-            fprintf(fp, "    movzx rax, al\n");
-            break;
-        case OP_NE:
-            fprintf(fp, "    cmp rax, rdi\n");
-            fprintf(fp, "    setne al\n");
-            fprintf(fp, "    movzx rax, al\n");
-            break;
-        case OP_LT:
-            fprintf(fp, "    cmp rax, rdi\n");
-            fprintf(fp, "    setl al\n");
-            fprintf(fp, "    movzx rax, al\n");
-            break;
-        case OP_LE: 
-            fprintf(fp, "    cmp rax, rdi\n");
-            fprintf(fp, "    setle al\n");
-            fprintf(fp, "    movzx rax, al\n");
-            break;
-        case OP_GT:
-            fprintf(fp, "    cmp rax, rdi\n");
-            fprintf(fp, "    setg al\n");
-            fprintf(fp, "    movzx rax, al\n");
-            break;
-        case OP_GE:
-            fprintf(fp, "    cmp rax, rdi\n");
-            fprintf(fp, "    setge al\n");
-            fprintf(fp, "    movzx rax, al\n");
-            break;
-        case OP_AND:
-            fprintf(fp, "    and rax, rdi\n");
-            break;
-        case OP_OR:
-            fprintf(fp, "    or rax, rdi\n");
-            break;
-        case OP_ASN:
-            fprintf(fp, "    mov dword ptr[rax], edi\n");
-            break;
-        default:
-            printf("Error: unknown operator for binop expr: %d\n", expr->as.bop.op);
-        }
+        emit(A_CMP, opnd(ir->a), asm_imm(0));
+    }
+    if (is_next(block, no)) {
+        emit_jump(A_JCC, cc, yes);
+    } else {
+        emit_jump(A_JCC, cc_invert(cc), no);
+        if (!is_next(block, yes)) emit_jump(A_JMP, 0, yes);
     }
-    return;
 }
 
+static void gen_ir(IrBlock *block, Ir *ir) {
+    switch (ir->op) {
+    case IR_IMM:
+    case IR_MOV:
+        emit_mov(dst_arg(ir), ir->a);
+        return;
+    case IR_ADD:
+    case IR_SUB:
+    case IR_MUL:
+    case IR_AND:
+    case IR_OR:
+        gen_arith(ir);
+        return;
+    case IR_DIV:
+        gen_div(ir);
+        return;
+    case IR_EQ:
+    case IR_NE:
+    case IR_LT:
+    case IR_LE:
+    case IR_GT:
+    case IR_GE:
+        gen_cmp(block, ir);
+        return;
+    case IR_NEG:
+    case IR_NOT:
+        gen_unary(ir);
+        return;
+    case IR_CALL:
+        gen_call(ir);
+        return;
+    case IR_LOAD:
+        gen_load(ir);
+        return;
+    case IR_STORE:
+        gen_store(ir);
+        return;
+    case IR_JMP:
+    case IR_BR:
+        gen_branch(block, ir);
+        return;
+    case IR_RET: {
+        IrType t = G.fn->ret_type;
+        Reg ret = t == IT_INT ? R_RAX : R_XMM0;
+        if (!in_reg(ir->a) || reg_of(ir->a) != ret) emit(mov_op(t), asm_reg(ret, vsize(t)), opnd(ir->a));
+        gen_epilog();
+        return;
+    }
+    case IR_CVT:
+        gen_cvt(ir);
+        return;
+    case IR_ELEM:
+        gen_elem(ir);
+        return;
+    case IR_SETELEM:
+        gen_setelem(ir);
+        return;
+    case IR_SPLAT:
+        gen_splat(ir);
+        return;
+    case IR_PARAM:
+        // 入口处的参数由gen_params()一起处理
+        if (ir == &block->code[0]) gen_params(block);
+        return;
+    case IR_PHI:
+        // ir_out_ssa()之后不会再有phi
+        printf("Error: unexpected phi in codegen\n");
+        exit(1);
+    }
+}
 
+static void use(IrArg a) {
+    if (a.kind == IA_REG) G.uses[a.val]++;
+}
 
-static void do_meta(Node *prog) {
-    META.includes[META.inc_count++] = "msvcrt.lib";
-    bool has_print = false;
-    bool need_stdz = false;
-    for (int i = 0; i < prog->as.exprs.count; ++i) {
-        Node *expr = prog->as.exprs.list[i];
-        if (expr->kind == ND_CALL) {
-            char *name = get_name(expr->as.call.name);
-            bool is_print = strcmp(name, "print") == 0;
-            if (is_print) {
-                META.externs[META.extern_count++] = "printf";
-                has_print = true;
-            } else {
-                need_stdz = true;
-                META.externs[META.extern_count++] = name;
+static void count_uses(IrFn *fn) {
+    G.uses = calloc(fn->vreg_count + 1, sizeof(int));
+    for (int i = 0; i < fn->block_count; i++) {
+        IrBlock *block = fn->blocks[i];
+        for (int j = 0; j < block->count; j++) {
+            Ir *ir = &block->code[j];
+            use(ir->a);
+            use(ir->b);
+            use(ir->c);
+            if (ir->op == IR_CALL) {
+                for (int k = 0; k < ir->argc; k++) use(ir->args[k]);
             }
+        }
+    }
+}
 
-            for (int j = 0; j < expr->as.call.argc; ++j) {
-                Node *arg = expr->as.call.args[j];
-                META.data[META.data_count].idx = META.data_count;
-                if (is_print) {
-                    META.data[META.data_count].has_newline = true;
-                    if (arg->kind == ND_INT) {
-                        META.data[META.data_count].value = "%d";
-                    } else {
-                        META.data[META.data_count].value = get_name(arg);
-                    }
-                } else {
-                    if (arg->kind == ND_STR) {
-                        META.data[META.data_count].value = get_name(arg);
-                    }
-                }
-                arg->meta = &META.data[META.data_count];
-                META.data_count++;
-            }
+// 标出需要输出标签的块，和gen_branch()中实际输出的跳转一致
+static void mark_labels(IrFn *fn) {
+    G.labeled = calloc(fn->block_count + 1, sizeof(bool));
+    for (int i = 0; i < fn->block_count; i++) {
+        IrBlock *block = fn->blocks[i];
+        Ir *ir = ir_last(block);
+        if (ir->op == IR_RET) continue;
+        IrBlock *yes = block->succs[0];
+        if (ir->op == IR_JMP || ir->a.kind == IA_IMM) {
+            IrBlock *target = ir->op == IR_BR && ir->a.val == 0 ? block->succs[1] : yes;
+            if (!is_next(block, target)) G.labeled[target->id] = true;
+            continue;
+        }
+        IrBlock *no = block->succs[1];
+        if (is_next(block, no)) {
+            G.labeled[yes->id] = true;
+        } else {
+            G.labeled[no->id] = true;
+            if (!is_next(block, yes)) G.labeled[yes->id] = true;
         }
     }
-    if (has_print) {
-        META.includes[META.inc_count++] = "legacy_stdio_definitions.lib";
+}
+
+AsmFn *gen_asm_fn(IrFn *fn, const Abi *abi, int label_base) {
+    if (fn->param_count > abi->arg_count) {
+        printf("Error: too many parameters for native function: %s\n", fn->name);
+        exit(1);
+    }
+    G = (FnGen){.out = asm_new_fn(fn->name), .abi = abi, .fn = fn, .label_base = label_base, .fused = -1};
+    G.ra = linear_scan(fn, abi);
+    bool has_call = false;
+    for (int i = 0; i < fn->block_count; i++) {
+        IrBlock *block = fn->blocks[i];
+        block->id = i;
+        for (int j = 0; j < block->count; j++) {
+            if (block->code[j].op == IR_CALL) has_call = true;
+        }
     }
-    if (need_stdz) {
-        META.includes[META.inc_count++] = "stdz.lib";
+    for (int r = 0; r < R_COUNT; r++) {
+        if ((G.ra->used >> r & 1) && is_callee_saved(abi, r)) G.saved[G.saved_count++] = r;
+    }
+    bool wide = fn->array_count > 0;
+    for (int v = 0; v < fn->vreg_count; v++) {
+        if (ir_lanes(fn->vtypes[v]) > 1) wide = true;
+    }
+    G.spill_base = wide ? align16(G.saved_count * 8) : G.saved_count * 8;
+    G.array_base = (G.ra->slot_count + 3) / 4 * 4;
+    int spill_size = (fn->array_count > 0 ? G.array_base + fn->array_slots : G.ra->slot_count) * 4;
+    int shadow = has_call ? abi->shadow : 0;
+    G.has_frame = has_call || G.saved_count > 0 || spill_size > 0;
+    if (spill_size + shadow > 0 || (has_call && G.saved_count % 2 == 1)) {
+        // 调用函数时rsp需要16字节对齐：返回地址和rbp共16字节，再加上保存的寄存器、溢出槽位、数组和影子空间
+        G.frame_size = align16(G.spill_base + spill_size + shadow) - G.saved_count * 8;
+    }
+    mark_labels(fn);
+    count_uses(fn);
+
+    gen_prolog();
+    for (int i = 0; i < fn->block_count; i++) {
+        IrBlock *block = fn->blocks[i];
+        if (G.labeled[i]) asm_emit(G.out, A_LABEL, (AsmOpnd){0}, (AsmOpnd){0})->label = G.label_base + i;
+        for (int j = 0; j < block->count; j++) {
+            gen_ir(block, &block->code[j]);
+        }
     }
+    free(G.labeled);
+    free(G.uses);
+    if (OPT.peep) asm_optimize(G.out);
+    return G.out;
 }
 
-// 根据META信息输出include语句
-static void do_includes(FILE *fp, Node *prog) {
-    for (int i = 0; i < META.inc_count; ++i) {
-        fprintf(fp, "includelib %s\n", META.includes[i]);
-    }
+void codegen_lower(IrFn *fn) {
+    if (OPT.ir) ir_optimize(fn);
+    ir_out_ssa(fn);
+#ifdef LOG_TRACE
+    ir_print(stdout, fn);
+#endif
 }
 
-// 根据META信息输出.data字段
-static void do_data(FILE *fp) {
-    if (META.data_count > 0) {
-        fprintf(fp, ".data\n");
+// 翻译成IR并优化，最后消去phi，交给寄存器分配
+static IrProg *lower(Node *prog) {
+    IrProg *ir = ir_build(prog);
+    log_trace("IR:\n");
+    for (int i = 0; i < ir->fn_count; i++) {
+        codegen_lower(ir->fns[i]);
     }
-    for (int i = 0; i < META.data_count; ++i) {
-        ConstData *data = &META.data[i];
-        fprintf(fp, "    ct%d db '%s'", data->idx, data->value);
-        if (data->has_newline) {
-            fprintf(fp, ", 10");
+    codegen_lower(ir->main);
+    return ir;
+}
+
+// 先输出自定义函数，最后是main。返回各个函数的指令列表，顺序相同
+static AsmFn **gen_fns(Buf *out, IrProg *ir, const Abi *abi, bool masm) {
+    AsmFn **fns = calloc(ir->fn_count + 1, sizeof(AsmFn *));
+    int label_count = 0;
+    for (int i = 0; i <= ir->fn_count; i++) {
+        IrFn *fn = i < ir->fn_count ? ir->fns[i] : ir->main;
+        AsmFn *code = gen_asm_fn(fn, abi, label_count);
+        label_count += fn->block_count;
+        buf_puts(out, fn->name);
+        buf_puts(out, masm ? " proc\n" : ":\n");
+        asm_print(out, code, masm);
+        if (masm) {
+            buf_puts(out, fn->name);
+            buf_puts(out, " endp\n");
         }
-        fprintf(fp, ", 0\n");
+        fns[i] = code;
     }
+    return fns;
 }
 
-// 根据META信息输出externdef语句
-static bool do_externdef(FILE *fp, Node *prog) {
-    for (int i = 0; i < META.extern_count; ++i) {
-        fprintf(fp, "    externdef %s:proc\n", META.externs[i]);
-    }
-    return META.extern_count > 0;
+// 同样的指令列表直接编码成机器码，输出ELF目标文件，不需要再调用汇编器
+static void write_obj(char *path, IrProg *ir, AsmFn **fns) {
+    X86Code code = {0};
+    int count = ir->fn_count + 1;
+    ElfFn *syms = calloc(count, sizeof(ElfFn));
+    for (int i = 0; i < count; i++) {
+        syms[i].name = fns[i]->name;
+        syms[i].offset = x86_encode(&code, fns[i]);
+        syms[i].global = i == count - 1; // 只有main需要导出
+    }
+    for (int i = 0; i < count; i++) {
+        syms[i].size = (i + 1 < count ? syms[i + 1].offset : code.size) - syms[i].offset;
+    }
+    if (!elf_write(path, &code, count, syms, ir)) {
+        printf("Error: failed to write %s\n", path);
+        exit(1);
+    }
+    free(syms);
+    free(code.buf);
+    free(code.relocs);
 }
 
-static void do_data_linux(FILE *fp) {
-    for (int i = 0; i < META.data_count; ++i) {
-        ConstData *data = &META.data[i];
-        fprintf(fp, "ct%d:\n", data->idx);
-        fprintf(fp, "    .asciz \"%s%s\"\n", data->value, data->has_newline ? "\\n" : "");
+// 写入文件并释放缓冲
+static void save_file(Buf *out, char *path) {
+    if (!buf_save(out, path)) {
+        printf("Error: failed to write %s\n", path);
+        exit(1);
     }
+    free_buf(out);
 }
 
-static int align16(int n) {
-    return n % 16 == 0 ? n : n + 16 - n % 16;
+// 浮点数常量的文本，保证有小数点（masm中没有小数点的是整数）
+static void format_num(char *buf, int size, IrNum *num) {
+    snprintf(buf, size, "%.*g", num->type == IT_DOUBLE ? 17 : 9, num->val);
+    if (strpbrk(buf, ".ni")) return; // 已有小数点，或者是inf、nan
+    char *e = strchr(buf, 'e');
+    char exp[16] = "";
+    if (e) {
+        snprintf(exp, sizeof(exp), "%s", e);
+        *e = '\0';
+    }
+    snprintf(buf + strlen(buf), size - strlen(buf), ".0%s", exp);
+}
+
+static void do_data_linux(Buf *out, IrProg *prog) {
+    for (int i = 0; i < prog->str_count; ++i) {
+        IrStr *str = &prog->strs[i];
+        buf_printf(out, "ct%d:\n", i);
+        buf_printf(out, "    .asciz \"%s%s\"\n", str->value, str->has_newline ? "\\n" : "");
+    }
+    if (prog->num_count > 0) buf_puts(out, "    .p2align 3\n");
+    for (int i = 0; i < prog->num_count; ++i) {
+        IrNum *num = &prog->nums[i];
+        char buf[64];
+        format_num(buf, sizeof(buf), num);
+        buf_printf(out, "cf%d:\n", i);
+        buf_printf(out, "    %s %s\n", num->type == IT_DOUBLE ? ".double" : ".float", buf);
+    }
 }
 
 // 将AST编译成汇编代码：linux/gas
 void codegen_linux(Node *prog) {
-    do_meta(prog);
     printf("start writing .s\n");
     print_node(prog);
-    // 打开输出文件
-    FILE *fp = fopen("app.s", "w");
+    IrProg *ir = lower(prog);
+    // 输出内容先写到缓冲中
+    Buf *out = new_buf();
     // 首行配置
-    fprintf(fp, "    .intel_syntax noprefix\n");
-    printf("start writing .s\n");
+    buf_puts(out, "    .intel_syntax noprefix\n");
 
-    fprintf(fp, "    .text\n");
-    fprintf(fp, "    .global main\n");
-    fprintf(fp, "main:\n");
-    bool has_call = META.extern_count > 0;
-    int locals_size = total_meta_size();
-    if (has_call || locals_size > 0) {
-        // prolog
-        fprintf(fp, "    push rbp\n");
-        fprintf(fp, "    mov rbp, rsp\n");
-    }
-    if (locals_size > 0) {
-        // size+8之后要16字节对齐，其中单独的8时`push rbp`导致的。
-        locals_size = align16(locals_size + 8) - 8;
-        fprintf(fp, "    sub rsp, %d\n", locals_size);
-    }
+    buf_puts(out, "    .text\n");
+    buf_puts(out, "    .global main\n");
+    AsmFn **fns = gen_fns(out, ir, &ABI_SYSV, false);
 
-    for (int i = 0; i < prog->as.exprs.count; ++i) {
-        Node *expr = prog->as.exprs.list[i];
-        gen_expr(fp, expr);
-    }
+    do_data_linux(out, ir);
 
-    if (has_call || locals_size > 0) {
-        // epilog
-        fprintf(fp, "    pop rbp\n");
-    }
-    if (locals_size > 0) {
-        fprintf(fp, "    add rsp, %d\n", locals_size);
-    }
-    fprintf(fp, "    ret\n");
+    // 一次性写入文件
+    save_file(out, "app.s");
+
+    write_obj("app.o", ir, fns);
+}
 
-    do_data_linux(fp);
+#define MAX_EXTERN 100
 
-    // 保存并关闭文件
-    fclose(fp);
+// 函数中调用的外部函数，存入externs，返回新的个数
+static int collect_externs(IrProg *prog, IrFn *fn, char **externs, int count) {
+    for (int i = 0; i < fn->block_count; i++) {
+        IrBlock *block = fn->blocks[i];
+        for (int j = 0; j < block->count; j++) {
+            Ir *ir = &block->code[j];
+            if (ir->op != IR_CALL) continue;
+            bool found = false;
+            for (int k = 0; k < prog->fn_count; k++) {
+                if (strcmp(prog->fns[k]->name, ir->name) == 0) found = true;
+            }
+            for (int k = 0; k < count; k++) {
+                if (strcmp(externs[k], ir->name) == 0) found = true;
+            }
+            if (!found && count < MAX_EXTERN) externs[count++] = ir->name;
+        }
+    }
+    return count;
 }
 
-static bool do_locals(FILE *fp) {
-    HashTable *table = global_scope()->as.block->table;
-    HashIter *i = hash_iter(table);
-    bool has_locals = false;
-    while (hash_next(table, i)) {
-        Meta *meta = (Meta*)i->value;
-        if (meta->kind == ND_FN) {
-            // TODO: 处理自定义函数
-            continue;
+// 导入标准库：printf在legacy_stdio_definitions.lib中，其他的都是stdz中的函数
+static void do_includes(Buf *out, char **externs, int count) {
+    buf_puts(out, "includelib msvcrt.lib\n");
+    bool has_print = false;
+    bool need_stdz = false;
+    for (int i = 0; i < count; ++i) {
+        if (strcmp(externs[i], "printf") == 0) has_print = true;
+        else need_stdz = true;
+    }
+    if (has_print) buf_puts(out, "includelib legacy_stdio_definitions.lib\n");
+    if (need_stdz) buf_puts(out, "includelib stdz.lib\n");
+}
+
+static void do_data_win(Buf *out, IrProg *prog) {
+    if (prog->str_count > 0 || prog->num_count > 0) {
+        buf_puts(out, ".data\n");
+    }
+    if (prog->num_count > 0) buf_puts(out, "    align 8\n");
+    for (int i = 0; i < prog->num_count; ++i) {
+        IrNum *num = &prog->nums[i];
+        char buf[64];
+        format_num(buf, sizeof(buf), num);
+        buf_printf(out, "    cf%d %s %s\n", i, num->type == IT_DOUBLE ? "real8" : "real4", buf);
+    }
+    for (int i = 0; i < prog->str_count; ++i) {
+        IrStr *str = &prog->strs[i];
+        buf_printf(out, "    ct%d db '%s'", i, str->value);
+        if (str->has_newline) {
+            buf_puts(out, ", 10");
         }
-        fprintf(fp, "%s$ = -%d\n", get_name(meta->node), meta->offset);
-        has_locals = true;
+        buf_puts(out, ", 0\n");
     }
-    return has_locals;
 }
 
 // 将AST编译成汇编代码：windows/masm64
 void codegen_win(Node *prog) {
-    do_meta(prog);
-    // 打开输出文件
-    FILE *fp = fopen("app.asm", "w");
+    IrProg *ir = lower(prog);
+    char *externs[MAX_EXTERN];
+    int extern_count = 0;
+    for (int i = 0; i < ir->fn_count; i++) {
+        extern_count = collect_externs(ir, ir->fns[i], externs, extern_count);
+    }
+    extern_count = collect_externs(ir, ir->main, externs, extern_count);
+    // 输出内容先写到缓冲中
+    Buf *out = new_buf();
     // 导入标准库
-    do_includes(fp, prog);
+    do_includes(out, externs, extern_count);
 
     // 数据段
-    do_data(fp);
+    do_data_win(out, ir);
 
     // 代码段
-    fprintf(fp, ".code\n");
-
-    bool has_call = do_externdef(fp, prog);
-
-    bool has_locals = do_locals(fp);
-
-    int reserve = align16(total_meta_size()) + 8;
-
-    fprintf(fp, "main proc\n");
-
-    if (has_call || has_locals) {
-        // prolog
-        fprintf(fp, "    push rbp\n");
-        fprintf(fp, "    mov rbp, rsp\n");
-    }
-    if (has_locals) {
-        // reserve stack for shadow space
-        fprintf(fp, "    sub rsp, %d\n", reserve);
-    }
-
-    for (int i = 0; i < prog->as.exprs.count; ++i) {
-        Node *expr = prog->as.exprs.list[i];
-        gen_expr(fp, expr);
+    buf_puts(out, ".code\n");
+    for (int i = 0; i < extern_count; ++i) {
+        buf_printf(out, "    externdef %s:proc\n", externs[i]);
     }
 
-    if (has_locals) {
-        // restore stack
-        fprintf(fp, "    add rsp, %d\n", reserve);
-    }
-    if (has_call || has_locals) {
-        // epilog
-        fprintf(fp, "    pop rbp\n");
-    }
-    fprintf(fp, "    ret\n");
+    gen_fns(out, ir, &ABI_WIN64, true);
 
     // 结束
-    fprintf(fp, "main endp\n");
-    fprintf(fp, "end\n");
-    fclose(fp);
-
-    return;
+    buf_puts(out, "end\n");
+    save_file(out, "app.asm");
 }
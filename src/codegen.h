@@ -1,6 +1,15 @@
 #pragma once
 
 #include "zast.h"
+#include "ir.h"
+#include "asm.h"
+#include "regalloc.h"
 
 void codegen_linux(Node *expr);
-void codegen_win(Node *expr);
\ No newline at end of file
+void codegen_win(Node *expr);
+
+// IR上的优化，最后消去phi
+void codegen_lower(IrFn *fn);
+// 对codegen_lower()之后的函数做寄存器分配和指令选择。
+// label_base是标签编号的起点，同一个文件中的标签不能重复
+AsmFn *gen_asm_fn(IrFn *fn, const Abi *abi, int label_base);
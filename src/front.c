@@ -1,8 +1,11 @@
 #include <stdlib.h>
+#include <string.h>
 #include "front.h"
 #include "util.h"
 #include "builtin.h"
 #include "parser.h"
+#include "opt.h"
+#include "check.h"
 
 Front *new_front() {
     Front *front = calloc(1, sizeof(Front));
@@ -23,11 +26,15 @@ Front *new_front() {
 static Mod *process_src(Front *front, Source *src) {
     Parser *parser = new_parser(src->code, src->scope);
     parser->front = front;
+    parser->source = src;
     Node *prog = parse(parser);
+    optimize(front, prog);
+    check_types(prog);
     Mod *mod = calloc(1, sizeof(Mod));
     mod->prog = prog;
     mod->scope = parser->root_scope;
     mod->name = remove_ext(src->name);
+    mod->source = src;
     mod->uses = parser->uses;
     return mod;
 }
@@ -78,6 +85,38 @@ Source *add_source(Front *front, const char *code) {
     return src;
 }
 
+// 建立行表：用memchr找换行符，比逐个字符比较快得多
+static void build_lines(Source *src) {
+    const char *code = src->code;
+    size_t len = strlen(code);
+    int cap = 64;
+    src->lines = malloc(cap * sizeof(uint32_t));
+    src->lines[0] = 0;
+    src->line_count = 1;
+    for (const char *p = memchr(code, '\n', len); p != NULL; p = memchr(p, '\n', code + len - p)) {
+        p++;
+        if (src->line_count >= cap) {
+            cap *= 2;
+            src->lines = realloc(src->lines, cap * sizeof(uint32_t));
+        }
+        src->lines[src->line_count++] = p - code;
+    }
+}
+
+void source_locate(Source *src, uint32_t loc, int *line, int *col) {
+    if (src->lines == NULL) build_lines(src);
+    uint32_t off = loc - 1;
+    // 二分查找最后一个起始偏移不大于off的行
+    int lo = 0, hi = src->line_count - 1;
+    while (lo < hi) {
+        int mid = (lo + hi + 1) / 2;
+        if (src->lines[mid] <= off) lo = mid;
+        else hi = mid - 1;
+    }
+    *line = lo + 1;
+    *col = off - src->lines[lo] + 1;
+}
+
 Mod *find_mod(Front *front, const char *name) {
     return hash_get(front->mods, name);
 }
@@ -12,6 +12,8 @@ struct Source {
     const char *name; // 源码的名称，一般即文件名。
     const char *code; // 源码的文本。
     Scope *scope; // 源码的视野，这里的源码可能是整个源码的一部分（例如REPL的一段），因此它可能有先天的共享视野
+    uint32_t *lines; // 每一行起始字节的偏移，第一次查询行列时才建立
+    int line_count;
 };
 
 struct SourceQueue {
@@ -58,3 +60,6 @@ Meta *mod_lookup(Front *front, Node *path);
 Source *add_source(Front *front, const char *code);
 // 添加文件形式的源码
 Source *load_source(Front *front, const char *name);
+
+// 查询节点位置loc（见Node.loc）所在的行和列，都从1开始
+void source_locate(Source *src, uint32_t loc, int *line, int *col);
@@ -41,97 +41,74 @@ static size_t hash_idx(HashTable* hash, char *key) {
     return hash_modulo(key, hash->cap);
 }
 
+/**
+ * @brief 沿着探测链查找key所在的位置
+ *
+ * @return 如果key存在，返回它的位置；否则返回探测链末尾的空位
+ */
+static size_t entries_probe(Entry **entries, char *key, size_t cap) {
+    size_t idx = hash_modulo(key, cap);
+    while (entries[idx] != NULL && strcmp(entries[idx]->key, key) != 0) {
+        idx = (idx + 1) % cap;
+    }
+    return idx;
+}
+
 bool hash_has(HashTable *hash, char *key) {
-    size_t idx = hash_idx(hash, key);
-    return hash->entries[idx] != NULL && strcmp(hash->entries[idx]->key, key) == 0;
+    return hash->entries[entries_probe(hash->entries, key, hash->cap)] != NULL;
 }
 
-void hash_set_int(HashTable *hash, char *key, int value) {
-    // 如果size/cap超过LOAD_FACTOR，就扩容一倍
-    if ((double) hash->size / (double) hash->cap > LOAD_FACTOR) {
-        int old_cap = hash->cap;
-        hash->cap *= 2;
-        hash->entries = realloc(hash->entries, hash->cap * sizeof(IntEntry));
-        for (int n = old_cap; n < hash->cap; n++) {
-            hash->entries[n] = NULL;
+// 如果size/cap超过LOAD_FACTOR，就扩容一倍
+static void grow(HashTable *hash) {
+    if ((double) hash->size / (double) hash->cap <= LOAD_FACTOR) return;
+    int new_cap = hash->cap * 2;
+    Entry **new_entries = calloc(new_cap, sizeof(Entry*));
+    // 注意：扩容时直接搬移原有的Entry，而不是新建，这样hash_ref返回的指针依然有效
+    for (int n = 0; n < hash->cap; n++) {
+        Entry *ent = hash->entries[n];
+        if (ent != NULL) {
+            new_entries[entries_probe(new_entries, ent->key, new_cap)] = ent;
         }
     }
+    free(hash->entries);
+    hash->entries = new_entries;
+    hash->cap = new_cap;
+}
 
-    size_t idx = hash_idx(hash, key);
+void hash_set_int(HashTable *hash, char *key, int value) {
+    grow(hash);
+    size_t idx = entries_probe(hash->entries, key, hash->cap);
     if (hash->entries[idx] != NULL) {
-        Entry *ent = hash->entries[idx];
-        char *exist_key = ent->key;
-        if (strcmp(exist_key, key) == 0) { 
-            // 如果key相同，说明找到目标了，直接更新值
-            ((IntEntry*)ent)->value = value;
-            return;
-        } else {
-            // 冲突了，寻找下一个空位
-            idx = (idx + 1) % hash->cap;
-            while (hash->entries[idx] != NULL) {
-                idx = (idx + 1) % hash->cap;
-            }
-            // 注意，这里没有处理找了一圈儿没找到的情况，因为扩容的问题另外处理
-            // 所以假设循环结束时，总会找到一个空位
-        }
+        // 如果key相同，说明找到目标了，直接更新值
+        ((IntEntry*)hash->entries[idx])->value = value;
+        return;
     }
     // 找到了空位，新建一项并写入
     hash->entries[idx] = calloc(1, sizeof(IntEntry));
-    Entry *ent = hash->entries[idx];
-    ent->key = key;
-    ((IntEntry*)ent)->value = value;
-}
-
-void entries_set(Entry **entries, char *key, size_t cap, void *value) {
-    size_t idx = hash_modulo(key, cap);
-    if (entries[idx] != NULL) {
-        Entry *ent = entries[idx];
-        char *exist_key = ent->key;
-        if (strcmp(exist_key, key) == 0) { 
-            // 如果key相同，说明找到目标了，直接更新值
-            ((ObjEntry*)ent)->value = value;
-            return;
-        } else {
-            // 冲突了，寻找下一个空位
-            idx = (idx + 1) % cap;
-            while (entries[idx] != NULL) {
-                idx = (idx + 1) % cap;
-            }
-            // 注意，这里没有处理找了一圈儿没找到的情况，因为扩容的问题另外处理
-            // 所以假设循环结束时，总会找到一个空位
-        }
-    }
-    // 找到了空位，新建一项并写入
-    entries[idx] = calloc(1, sizeof(ObjEntry));
-    entries[idx]->key = key;
-    ((ObjEntry*)entries[idx])->value = value;
+    hash->entries[idx]->key = key;
+    ((IntEntry*)hash->entries[idx])->value = value;
+    hash->size++;
 }
 
 void hash_set(HashTable *hash, char *key, void *value) {
-    // 如果size/cap超过LOAD_FACTOR，就扩容一倍
-    if ((double) hash->size / (double) hash->cap > LOAD_FACTOR) {
-        int new_cap = hash->cap * 2;
-        Entry **new_entries = calloc(new_cap, sizeof(Entry*));
-        for (int n = 0; n < hash->cap; n++) {
-            if (hash->entries[n] != NULL) {
-                Entry *ent = hash->entries[n];
-                entries_set(new_entries, ent->key, new_cap, ((ObjEntry*)ent)->value);
-            }
-        }
-        hash->entries = new_entries;
-        hash->cap = new_cap;
-        // TODO: free old entries
-    }
+    grow(hash);
 
-    entries_set(hash->entries, key, hash->cap, value);
+    size_t idx = entries_probe(hash->entries, key, hash->cap);
+    if (hash->entries[idx] != NULL) {
+        // 如果key相同，说明找到目标了，直接更新值
+        ((ObjEntry*)hash->entries[idx])->value = value;
+        return;
+    }
+    // 找到了空位，新建一项并写入
+    hash->entries[idx] = calloc(1, sizeof(ObjEntry));
+    hash->entries[idx]->key = key;
+    ((ObjEntry*)hash->entries[idx])->value = value;
     hash->size++;
 }
 
 int hash_get_int(HashTable *hash, char *key) {
-    size_t idx = hash_idx(hash, key);
-    Entry *ent = hash->entries[idx];
+    Entry *ent = hash->entries[entries_probe(hash->entries, key, hash->cap)];
     if (ent == NULL) return 0;
-    if (strcmp(ent->key, key) != 0) return 0;
     return ((IntEntry*)ent)->value;
 }
 
@@ -149,6 +126,12 @@ void *hash_get(HashTable *hash, char *key) {
     return NULL;
 }
 
+void **hash_ref(HashTable *hash, char *key) {
+    Entry *ent = hash->entries[entries_probe(hash->entries, key, hash->cap)];
+    if (ent == NULL) return NULL;
+    return &((ObjEntry*)ent)->value;
+}
+
 ValueArray *new_value_array() {
     ValueArray *arr = calloc(1, sizeof(ValueArray));
     arr->cap = DEFAULT_ARRAY_CAP;
@@ -93,6 +93,17 @@ void hash_set(HashTable *hash, char *key, void *value);
 int hash_get_int(HashTable *hash, char *key);
 void *hash_get(HashTable *hash, char *key);
 
+/**
+ * @brief 获取key对应的存值的存储位置，可以用来缓存查找结果
+ * 
+ * 哈希表扩容时不会移动存值，因此返回的指针在哈希表的生命周期内一直有效。
+ *
+ * @param hash 哈希表
+ * @param key 键匙
+ * @return 存值的位置；如果key不存在，返回NULL
+ */
+void **hash_ref(HashTable *hash, char *key);
+
 
 #define DEFAULT_ARRAY_CAP 16
 
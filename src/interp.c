@@ -1,4 +1,6 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include "interp.h"
 #include "parser.h"
 #include "util.h"
@@ -6,13 +8,16 @@
 #include "hash.h"
 #include "builtin.h"
 #include "meta.h"
+#include "opt.h"
+#include "jit.h"
 
 static void set_val(char *name, Value *val) {
     hash_set(global_scope()->as.runtime->values, name, val);
 }
 
-static Value *get_val(char *name) {
-    return hash_get(global_scope()->as.runtime->values, name);
+// 供JIT读写循环外的存量
+static Value **val_ref(char *name) {
+    return (Value**)hash_ref(global_scope()->as.runtime->values, name);
 }
 
 static Value *get_mod_val(Mod *mod, char *name) {
@@ -25,6 +30,102 @@ static void set_mod_val(Mod *mod, char *name, Value *val) {
 
 Value *eval(Node *expr);
 
+// 当前正在执行的方法的接收者，即方法体中的self
+static Value *SELF = NULL;
+
+// 内联缓存（Inline Cache）
+//
+// 每个名称节点（即一个访问处）都有自己的缓存，分两部分：
+// 1. 存量的存储位置：第一次查到之后就记下来，后续访问不再计算哈希。
+// 2. 成员的查找结果：以对象的类型为键，记下字段的槽位或方法的定义。
+//    同一个访问处最多记住IC_WAYS种类型（多态缓存），超过之后就退化为每次查成员表。
+
+#define IC_WAYS 4
+
+typedef struct ICEntry ICEntry;
+struct ICEntry {
+    Type *type; // 对象的类型
+    int slot; // 字段的槽位
+    Fn *method; // 方法的定义；如果成员是字段，则为NULL
+};
+
+struct InlineCache {
+    HashTable *table; // slot所在的存值表
+    Value **slot; // 存量的存储位置
+    int count; // 已缓存的类型个数
+    ICEntry entries[IC_WAYS];
+};
+
+static InlineCache *get_ic(Node *path) {
+    if (path->as.path.ic == NULL) {
+        path->as.path.ic = calloc(1, sizeof(InlineCache));
+    }
+    return path->as.path.ic;
+}
+
+// 获取名称为key的存量的存储位置；如果存量还不存在，返回NULL
+static Value **var_ref(Node *path, char *key) {
+    InlineCache *ic = get_ic(path);
+    HashTable *values = global_scope()->as.runtime->values;
+    if (ic->slot == NULL || ic->table != values) {
+        ic->slot = (Value**)hash_ref(values, key);
+        ic->table = values;
+    }
+    return ic->slot;
+}
+
+static Value *get_var(Node *path, char *key) {
+    Value **ref = var_ref(path, key);
+    return ref ? *ref : NULL;
+}
+
+static void set_var(Node *path, char *key, Value *val) {
+    Value **ref = var_ref(path, key);
+    if (ref) {
+        *ref = val;
+    } else {
+        set_val(key, val);
+    }
+}
+
+// 根据名称路径的第一个名称取得对象，`self`指向当前方法的接收者
+static Value *get_obj(Node *path) {
+    char *name = path->as.path.names[0].name;
+    if (SELF != NULL && strcmp(name, "self") == 0) return SELF;
+    return get_var(path, name);
+}
+
+// 在对象类型上查找`obj.name`中的成员
+static ICEntry *member_ic(Node *path, Type *type) {
+    InlineCache *ic = get_ic(path);
+    for (int i = 0; i < ic->count; i++) {
+        if (ic->entries[i].type == type) return &ic->entries[i];
+    }
+    // 缓存未命中，查找成员表
+    static ICEntry mega;
+    char *name = path->as.path.names[1].name;
+    Meta *m = hash_get(type->as.user.members, name);
+    if (m == NULL) {
+        printf("Error: Unknown member %s of type %s\n", name, type->name);
+        exit(1);
+    }
+    ICEntry *e = ic->count < IC_WAYS ? &ic->entries[ic->count++] : &mega;
+    e->type = type;
+    e->slot = m->seq;
+    e->method = m->kind == ND_FN ? &m->node->as.fn : NULL;
+    return e;
+}
+
+// 对象字段`obj.name`的存储位置
+static Value **member_ref(Value *obj, Node *path) {
+    return &obj->as.obj->fields[member_ic(path, obj->as.obj->type)->slot];
+}
+
+// 方法体中直接访问的字段，由于方法只属于一个类型，槽位在解析时就确定了
+static Value **self_field_ref(Meta *field) {
+    return &SELF->as.obj->fields[field->seq];
+}
+
 // 内置函数
 
 // print
@@ -192,6 +293,54 @@ static Value *eval_logic(Value *left, Value *right, Op op) {
     }
 }
 
+static bool int_eq(int a, int b) {
+    return a == b;
+}
+
+// 特化的数值运算，操作数的种类在类型检查时已经确定
+#define SPEC_NUM_OPS(KIND, FIELD, NEW, EQ) \
+    case SP_ADD_##KIND: return NEW(l->as.FIELD + r->as.FIELD); \
+    case SP_SUB_##KIND: return NEW(l->as.FIELD - r->as.FIELD); \
+    case SP_MUL_##KIND: return NEW(l->as.FIELD * r->as.FIELD); \
+    case SP_DIV_##KIND: return NEW(l->as.FIELD / r->as.FIELD); \
+    case SP_GT_##KIND: return new_bool(l->as.FIELD > r->as.FIELD); \
+    case SP_LT_##KIND: return new_bool(l->as.FIELD < r->as.FIELD); \
+    case SP_GE_##KIND: return new_bool(l->as.FIELD >= r->as.FIELD); \
+    case SP_LE_##KIND: return new_bool(l->as.FIELD <= r->as.FIELD); \
+    case SP_EQ_##KIND: return new_bool(EQ(l->as.FIELD, r->as.FIELD)); \
+    case SP_NE_##KIND: return new_bool(!EQ(l->as.FIELD, r->as.FIELD));
+
+static Value *eval_spec(Spec spec, Value *l, Value *r) {
+    switch (spec) {
+    SPEC_NUM_OPS(INT, num, new_int, int_eq)
+    SPEC_NUM_OPS(FLOAT, float_num, new_float, float_eq)
+    SPEC_NUM_OPS(DOUBLE, double_num, new_double, double_eq)
+    case SP_EQ_BOOL: return new_bool(l->as.bul == r->as.bul);
+    case SP_NE_BOOL: return new_bool(l->as.bul != r->as.bul);
+    case SP_AND: return new_bool(l->as.bul && r->as.bul);
+    case SP_OR: return new_bool(l->as.bul || r->as.bul);
+    case SP_NEG_INT: return new_int(-l->as.num);
+    case SP_NEG_FLOAT: return new_float(-l->as.float_num);
+    case SP_NEG_DOUBLE: return new_double(-l->as.double_num);
+    case SP_NOT: return new_bool(!l->as.bul);
+    default:
+        printf("Unknown specialized operation: %d\n", spec);
+        return new_nil();
+    }
+}
+
+// 实参的种类是否符合形参声明的类型。函数体中的运算按形参的类型特化（见check.c），所以在调用时检查一次
+static bool check_arg(Node *param, Value *arg) {
+    Type *type = param->meta->type;
+    switch (type ? type->kind : TY_VOID) {
+    case TY_INT: return arg->kind == VAL_INT;
+    case TY_FLOAT: return arg->kind == VAL_FLOAT;
+    case TY_DOUBLE: return arg->kind == VAL_DOUBLE;
+    case TY_BOOL: return arg->kind == VAL_BOOL;
+    default: return true;
+    }
+}
+
 bool call_builtin(Node *expr) {
     char *name = get_name(expr->as.call.name);
     if (strcmp(name, "print") == 0) {
@@ -243,9 +392,15 @@ Value *eval_asn(Node *expr) {
         Node *left = expr->as.bop.left;
         Node *right = expr->as.bop.right;
         Value *res = eval(right);
-        if (left->kind == ND_IDENT || left->kind == ND_LNAME) {
-            char *name = get_name(left);
-            set_val(name, res);
+        if ((left->kind == ND_IDENT || left->kind == ND_LNAME) && left->meta->is_field) {
+            // 对象字段赋值：`p.x = 1`，或方法体中的`x = 1`
+            if (left->as.path.len > 1) {
+                *member_ref(get_obj(left), left) = res;
+            } else {
+                *self_field_ref(left->meta) = res;
+            }
+        } else if (left->kind == ND_IDENT || left->kind == ND_LNAME) {
+            set_var(left, get_name(left), res);
         } else if (left->kind == ND_INDEX) {
             // 由于这里得到的item本身就是个指针，我们可以把它当做左值来使用。
             Value *item = eval(left);
@@ -269,7 +424,11 @@ Value *eval_asn(Node *expr) {
 static Value *get_ident_val(Node *expr) {
 
     // 简单名符
-    if (expr->as.path.len <= 1) return get_val(get_name(expr));
+    if (expr->as.path.len <= 1) {
+        // 方法体中直接访问的字段，如`x`，相当于`self.x`
+        if (expr->as.path.names[0].kind == NM_MEMB) return *self_field_ref(expr->meta);
+        return get_var(expr, get_name(expr));
+    }
 
     // 模块成员访问
     // TODO: 暂时只支持单层模块
@@ -277,10 +436,11 @@ static Value *get_ident_val(Node *expr) {
     switch (head->kind) {
     case NM_MOD:
         // TODO：到对应的模块中查找
-        return get_val(get_name(expr));
+        return get_var(expr, get_name(expr));
     case NM_NAME: {
-        Value *obj = get_val(head->name);
+        Value *obj = get_obj(expr);
         // TODO: 暂时只支持单层成员查找，如p.x
+        if (obj->kind == VAL_OBJ) return *member_ref(obj, expr);
         char *key = expr->as.path.names[1].name;
         Value *val = hash_get(obj->as.dict->entries, key);
         return val;
@@ -289,6 +449,51 @@ static Value *get_ident_val(Node *expr) {
     return new_nil();
 }
 
+// 调用对象的方法，执行期间self指向接收者
+// 求出调用的各个实参并检查类型，失败时返回NULL
+static Value **eval_args(Fn *fn, Node *expr) {
+    Params *params = fn->params;
+    Value **args = calloc(params->count + 1, sizeof(Value *));
+    for (int i = 0; i < params->count; ++i) {
+        args[i] = eval(expr->as.call.args[i]);
+        if (!check_arg(params->list[i], args[i])) {
+            printf("Type mismatch: argument %s of %s\n", get_name(params->list[i]), fn->name);
+            free(args);
+            return NULL;
+        }
+    }
+    return args;
+}
+
+// 把实参绑定到形参上并执行函数体；形参原来的值在调用结束后恢复，这样递归调用不会改写外层的参数
+static Value *call_body(Fn *fn, Value **args) {
+    Params *params = fn->params;
+    Value **saved = calloc(params->count + 1, sizeof(Value *));
+    for (int i = 0; i < params->count; ++i) {
+        Node *p = params->list[i];
+        saved[i] = get_var(p, get_name(p));
+        set_var(p, get_name(p), args[i]);
+    }
+    Value *ret = eval(fn->body);
+    for (int i = 0; i < params->count; ++i) {
+        Node *p = params->list[i];
+        if (saved[i] != NULL) set_var(p, get_name(p), saved[i]);
+    }
+    free(saved);
+    return ret;
+}
+
+static Value *call_method(Value *recv, Fn *fn, Node *expr) {
+    Value **args = eval_args(fn, expr);
+    if (args == NULL) return new_nil();
+    Value *outer = SELF;
+    SELF = recv;
+    Value *ret = call_body(fn, args);
+    SELF = outer;
+    free(args);
+    return ret;
+}
+
 // 对表达式求值
 Value *eval(Node *expr) {
     switch (expr->kind) {
@@ -305,14 +510,16 @@ Value *eval(Node *expr) {
     case ND_IDENT:
         return get_ident_val(expr);
     case ND_NEG:
+        if (expr->as.una.spec != SP_NONE) return eval_spec(expr->as.una.spec, eval(expr->as.una.body), NULL);
         return neg_val(eval(expr->as.una.body));
     case ND_NOT:
+        if (expr->as.una.spec != SP_NONE) return eval_spec(expr->as.una.spec, eval(expr->as.una.body), NULL);
         return not(eval(expr->as.una.body));
     case ND_LET: 
     case ND_MUT: {
         Value *val = eval(expr->as.asn.value);
-        char *name = get_name(expr->as.asn.name);
-        set_val(name, val);
+        Node *name = expr->as.asn.name;
+        set_var(name, get_name(name), val);
         return val;
     }
     case ND_BLOCK: {
@@ -365,7 +572,13 @@ Value *eval(Node *expr) {
         }
     }
     case ND_OBJ: {
-        return eval_hashtable(expr->as.obj.members);
+        Type *type = expr->meta->type;
+        Value *obj = new_obj_val(type);
+        for (int i = 0; i < type->as.user.field_count; i++) {
+            Node *init = expr->as.obj.fields[i];
+            obj->as.obj->fields[i] = init ? eval(init) : new_nil();
+        }
+        return obj;
     }
     case ND_DICT: {
         return eval_hashtable(expr->as.dict.entries);
@@ -378,19 +591,22 @@ Value *eval(Node *expr) {
         }
         if (cond->as.bul) {
             return eval(expr->as.if_else.then);
-        } else {
+        } else if (expr->as.if_else.els) {
             return eval(expr->as.if_else.els);
         }
+        return new_nil();
     }
     case ND_FOR: {
-        Value *cond = eval(expr->as.loop.cond);
-        if (cond->kind != VAL_BOOL) {
-            printf("Type mismatch: %d\n", cond->kind);
-            return new_nil();
-        }
-        while (cond->as.bul) {
+        while (true) {
+            // 迭代次数足够多的循环交给JIT，剩下的迭代直接执行机器码
+            if (OPT.jit && jit_loop(expr, val_ref)) break;
+            Value *cond = eval(expr->as.loop.cond);
+            if (cond->kind != VAL_BOOL) {
+                printf("Type mismatch: %d\n", cond->kind);
+                return new_nil();
+            }
+            if (!cond->as.bul) break;
             eval(expr->as.loop.body);
-            cond = eval(expr->as.loop.cond);
         }
         // 没有实现数组和切片之前，for循环的返回值暂时当做nil;
         return new_nil();
@@ -406,20 +622,27 @@ Value *eval(Node *expr) {
         return val;
     }
     case ND_CALL: {
+        Node *name = expr->as.call.name;
+        if (name->as.path.len > 1 && name->as.path.names[1].kind == NM_FN) {
+            // 方法调用：`obj.method()`，按接收者的类型在内联缓存中找到方法
+            Value *recv = get_obj(name);
+            return call_method(recv, member_ic(name, recv->as.obj->type)->method, expr);
+        }
         if (call_builtin(expr)) return new_nil();
         if (call_stdlib(expr)) return new_nil();
-        Value *val = get_val(get_name(expr->as.call.name));
+        Value *val = get_var(name, get_name(name));
         if (val == NULL) {
             printf("Unknown function: %s\n", get_name(expr->as.call.name));
             return new_nil();
         }
-        Exprs *params = val->as.fn->params;
-        for (int i = 0; i < params->count; ++i) {
-            Node *p = params->list[i];
-            char *n= get_name(p);
-            set_val(n, eval(expr->as.call.args[i]));
-        }
-        return eval(val->as.fn->body);
+        // 先求出所有实参，再绑定到形参上
+        Value **args = eval_args(val->as.fn, expr);
+        if (args == NULL) return new_nil();
+        // 调用足够频繁的函数交给JIT，直接执行机器码
+        Value *ret = NULL;
+        if (!(OPT.jit && jit_call(val->as.fn, args, &ret))) ret = call_body(val->as.fn, args);
+        free(args);
+        return ret;
     }
     case ND_TYPE: {
         Value *name = new_str(get_name(expr->as.type.name));
@@ -427,6 +650,11 @@ Value *eval(Node *expr) {
     }
     case ND_BINOP: {
         BinOp *bop = &expr->as.bop;
+        if (bop->spec != SP_NONE) {
+            // 按顺序先求左侧，再求右侧
+            Value *l = eval(bop->left);
+            return eval_spec(bop->spec, l, eval(bop->right));
+        }
         Value *res = NULL;
         switch (bop->op) {
         case OP_ADD:
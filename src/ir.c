@@ -0,0 +1,1131 @@
+#include <stdlib.h>
+#include <string.h>
+#include "ir.h"
+#include "meta.h"
+#include "type.h"
+#include "opt.h"
+
+// AST到IR的翻译
+//
+// SSA的构造采用Braun等人的方法（Simple and Efficient Construction of SSA Form, 2013）：
+// 翻译的同时记录每个存量在每个基本块中的当前值；读取存量时，如果本块中没有赋值，
+// 就沿着前驱块往上找，遇到多个前驱时插入phi指令。
+// 前驱还没有全部确定的块（如循环头）是“未封闭”的，在其中读取存量先插入不完整的phi，
+// 等所有前驱都确定之后（seal_block）再补全。
+
+typedef struct IrBuilder IrBuilder;
+struct IrBuilder {
+    IrProg *prog;
+    IrFn *fn;
+    IrBlock *cur; // 当前正在添加指令的基本块
+    // 存量表。同一个存量的所有ND_IDENT节点都共享声明处的Meta，因此可以直接用Meta*来查找；
+    // 函数参数在函数体中的Meta和参数节点上的不是同一个，但指向同一个节点。
+    // 表中也有没有Meta的临时存量，如if表达式的结果。
+    int var_count;
+    int var_cap;
+    Meta **var_metas;
+    char **var_names;
+    IrType *var_types;
+    // 数组表，和B.fn->arrays一一对应
+    Meta **arr_metas;
+};
+
+static IrBuilder B;
+
+int ir_new_typed_vreg(IrFn *fn, char *name, IrType type) {
+    if (fn->vreg_count >= fn->vreg_cap) {
+        fn->vreg_cap = fn->vreg_cap * 2 + 8;
+        fn->vnames = realloc(fn->vnames, fn->vreg_cap * sizeof(char *));
+        fn->vtypes = realloc(fn->vtypes, fn->vreg_cap * sizeof(IrType));
+    }
+    fn->vnames[fn->vreg_count] = name;
+    fn->vtypes[fn->vreg_count] = type;
+    return fn->vreg_count++;
+}
+
+int ir_new_vreg(IrFn *fn, char *name) {
+    return ir_new_typed_vreg(fn, name, IT_INT);
+}
+
+IrType ir_arg_type(IrFn *fn, IrArg a) {
+    switch (a.kind) {
+    case IA_REG: return fn->vtypes[a.val];
+    case IA_FLT: return fn->prog->nums[a.val].type;
+    case IA_ARR: return fn->arrays[a.val].type;
+    default: return IT_INT;
+    }
+}
+
+int ir_type_size(IrType type) {
+    switch (type) {
+    case IT_DOUBLE: return 8;
+    case IT_VINT:
+    case IT_VFLOAT:
+    case IT_VDOUBLE: return 16;
+    default: return 4;
+    }
+}
+
+int ir_lanes(IrType type) {
+    switch (type) {
+    case IT_VINT:
+    case IT_VFLOAT: return 4;
+    case IT_VDOUBLE: return 2;
+    default: return 1;
+    }
+}
+
+IrType ir_lane_type(IrType type) {
+    switch (type) {
+    case IT_VINT: return IT_INT;
+    case IT_VFLOAT: return IT_FLOAT;
+    case IT_VDOUBLE: return IT_DOUBLE;
+    default: return type;
+    }
+}
+
+IrArg ir_num(IrProg *prog, double val, IrType type) {
+    for (int i = 0; i < prog->num_count; i++) {
+        IrNum *n = &prog->nums[i];
+        // 按位比较，这样0.0和-0.0是不同的常量
+        if (n->type == type && memcmp(&n->val, &val, sizeof(double)) == 0) return (IrArg){IA_FLT, i};
+    }
+    if (prog->num_count >= prog->num_cap) {
+        prog->num_cap = prog->num_cap * 2 + 4;
+        prog->nums = realloc(prog->nums, prog->num_cap * sizeof(IrNum));
+    }
+    prog->nums[prog->num_count] = (IrNum){val, type};
+    return (IrArg){IA_FLT, prog->num_count++};
+}
+
+Ir *ir_emit(IrBlock *block, IrOp op, int dst, IrArg a, IrArg b) {
+    if (block->count >= block->cap) {
+        block->cap = block->cap * 2 + 8;
+        block->code = realloc(block->code, block->cap * sizeof(Ir));
+    }
+    Ir *ir = &block->code[block->count++];
+    memset(ir, 0, sizeof(Ir));
+    ir->op = op;
+    ir->dst = dst;
+    ir->a = a;
+    ir->b = b;
+    return ir;
+}
+
+IrBlock *ir_new_block(IrFn *fn) {
+    IrBlock *block = calloc(1, sizeof(IrBlock));
+    block->id = fn->block_count;
+    if (fn->block_count >= fn->block_cap) {
+        fn->block_cap = fn->block_cap * 2 + 8;
+        fn->blocks = realloc(fn->blocks, fn->block_cap * sizeof(IrBlock *));
+    }
+    fn->blocks[fn->block_count++] = block;
+    return block;
+}
+
+void ir_add_edge(IrBlock *from, IrBlock *to) {
+    from->succs[from->succ_count++] = to;
+    if (to->pred_count >= to->pred_cap) {
+        to->pred_cap = to->pred_cap * 2 + 2;
+        to->preds = realloc(to->preds, to->pred_cap * sizeof(IrBlock *));
+    }
+    to->preds[to->pred_count++] = from;
+}
+
+void ir_remove_pred(IrBlock *to, IrBlock *from) {
+    for (int k = 0; k < to->pred_count; k++) {
+        if (to->preds[k] != from) continue;
+        to->pred_count--;
+        memmove(&to->preds[k], &to->preds[k + 1], (to->pred_count - k) * sizeof(IrBlock *));
+        for (int i = 0; i < to->phi_count; i++) {
+            Ir *phi = &to->phis[i];
+            phi->argc--;
+            memmove(&phi->args[k], &phi->args[k + 1], (phi->argc - k) * sizeof(IrArg));
+        }
+        return;
+    }
+}
+
+Ir *ir_last(IrBlock *block) {
+    return block->count > 0 ? &block->code[block->count - 1] : NULL;
+}
+
+static bool is_terminated(IrBlock *block) {
+    Ir *last = ir_last(block);
+    return last && (last->op == IR_JMP || last->op == IR_BR || last->op == IR_RET);
+}
+
+// 翻译过程中新建的块先不加入函数的块列表，等开始往里面添加指令时才加入，
+// 这样块的顺序就是代码的书写顺序，输出汇编时大部分跳转都可以省掉
+static IrBlock *add_block(void) {
+    IrBlock *block = calloc(1, sizeof(IrBlock));
+    block->id = -1;
+    return block;
+}
+
+static void start_block(IrBlock *block) {
+    IrFn *fn = B.fn;
+    block->id = fn->block_count;
+    if (fn->block_count >= fn->block_cap) {
+        fn->block_cap = fn->block_cap * 2 + 8;
+        fn->blocks = realloc(fn->blocks, fn->block_cap * sizeof(IrBlock *));
+    }
+    fn->blocks[fn->block_count++] = block;
+    B.cur = block;
+}
+
+static void jump(IrBlock *to) {
+    if (is_terminated(B.cur)) return;
+    ir_emit(B.cur, IR_JMP, -1, (IrArg){0}, (IrArg){0});
+    ir_add_edge(B.cur, to);
+}
+
+static void branch(IrArg cond, IrBlock *then, IrBlock *els) {
+    ir_emit(B.cur, IR_BR, -1, cond, (IrArg){0});
+    ir_add_edge(B.cur, then);
+    ir_add_edge(B.cur, els);
+}
+
+static IrArg add_str(char *value, bool has_newline) {
+    IrProg *prog = B.prog;
+    for (int i = 0; i < prog->str_count; i++) {
+        IrStr *s = &prog->strs[i];
+        if (s->has_newline == has_newline && strcmp(s->value, value) == 0) return (IrArg){IA_STR, i};
+    }
+    if (prog->str_count >= prog->str_cap) {
+        prog->str_cap = prog->str_cap * 2 + 4;
+        prog->strs = realloc(prog->strs, prog->str_cap * sizeof(IrStr));
+    }
+    prog->strs[prog->str_count] = (IrStr){value, has_newline};
+    return (IrArg){IA_STR, prog->str_count++};
+}
+
+// ---- 存量与SSA构造 ----
+
+static int var_lookup(Meta *m) {
+    if (m == NULL) return -1;
+    for (int i = B.var_count - 1; i >= 0; i--) {
+        Meta *vm = B.var_metas[i];
+        if (vm == m || (vm != NULL && vm->node == m->node)) return i;
+    }
+    return -1;
+}
+
+static int var_define(Meta *m, char *name, IrType type) {
+    if (B.var_count >= B.var_cap) {
+        B.var_cap = B.var_cap * 2 + 8;
+        B.var_metas = realloc(B.var_metas, B.var_cap * sizeof(Meta *));
+        B.var_names = realloc(B.var_names, B.var_cap * sizeof(char *));
+        B.var_types = realloc(B.var_types, B.var_cap * sizeof(IrType));
+    }
+    B.var_metas[B.var_count] = m;
+    B.var_names[B.var_count] = name;
+    B.var_types[B.var_count] = type;
+    return B.var_count++;
+}
+
+static IrArg *def_slot(IrBlock *block, int var) {
+    if (var >= block->def_cap) {
+        int cap = B.var_cap > var ? B.var_cap : var + 1;
+        block->defs = realloc(block->defs, cap * sizeof(IrArg));
+        memset(&block->defs[block->def_cap], 0, (cap - block->def_cap) * sizeof(IrArg));
+        block->def_cap = cap;
+    }
+    return &block->defs[var];
+}
+
+static void write_var(int var, IrBlock *block, IrArg val) {
+    *def_slot(block, var) = val;
+    // 给虚拟寄存器标上存量的名称，方便阅读IR
+    if (val.kind == IA_REG && B.fn->vnames[val.val] == NULL) B.fn->vnames[val.val] = B.var_names[var];
+}
+
+static IrArg read_var(int var, IrBlock *block);
+
+static int new_phi(IrBlock *block, int var) {
+    if (block->phi_count >= block->phi_cap) {
+        block->phi_cap = block->phi_cap * 2 + 4;
+        block->phis = realloc(block->phis, block->phi_cap * sizeof(Ir));
+    }
+    int idx = block->phi_count++;
+    Ir *phi = &block->phis[idx];
+    memset(phi, 0, sizeof(Ir));
+    phi->op = IR_PHI;
+    phi->dst = ir_new_typed_vreg(B.fn, B.var_names[var], B.var_types[var]);
+    phi->var = var;
+    return idx;
+}
+
+static void add_phi_operands(IrBlock *block, int idx) {
+    int argc = block->pred_count;
+    IrArg *args = calloc(argc + 1, sizeof(IrArg));
+    // 注意：read_var可能在本块中插入新的phi，因此不能提前保存phi的指针
+    for (int k = 0; k < argc; k++) {
+        args[k] = read_var(block->phis[idx].var, block->preds[k]);
+    }
+    block->phis[idx].args = args;
+    block->phis[idx].argc = argc;
+}
+
+static IrArg read_var(int var, IrBlock *block) {
+    IrArg *slot = def_slot(block, var);
+    if (slot->kind != IA_NONE) return *slot;
+    IrArg val;
+    if (!block->sealed) {
+        // 前驱还没确定，先插入一个不完整的phi，封闭时再补全
+        int idx = new_phi(block, var);
+        val = ir_reg(block->phis[idx].dst);
+    } else if (block->pred_count == 0) {
+        // 入口块中也没有赋值，说明存量未初始化。Z的语法不允许这种情况，这里按0处理
+        val = B.var_types[var] == IT_INT ? ir_imm(0) : ir_num(B.prog, 0, B.var_types[var]);
+    } else if (block->pred_count == 1) {
+        val = read_var(var, block->preds[0]);
+    } else {
+        // 先写入phi，打破循环中的递归查找
+        int idx = new_phi(block, var);
+        val = ir_reg(block->phis[idx].dst);
+        write_var(var, block, val);
+        add_phi_operands(block, idx);
+    }
+    write_var(var, block, val);
+    return val;
+}
+
+static void seal_block(IrBlock *block) {
+    int count = block->phi_count;
+    for (int i = 0; i < count; i++) {
+        if (block->phis[i].args == NULL) add_phi_operands(block, i);
+    }
+    block->sealed = true;
+}
+
+// ---- 翻译表达式 ----
+
+static IrArg gen_expr(Node *expr);
+static void gen_stmt(Node *expr);
+static IrFn *gen_fn(Fn *def);
+
+// 翻译代码块。need_value为true时，返回最后一个表达式的值
+static IrArg gen_block(Node *block, bool need_value) {
+    int count = block->as.exprs.count;
+    for (int i = 0; i < count - 1; i++) {
+        gen_stmt(block->as.exprs.list[i]);
+    }
+    if (count == 0) return (IrArg){0};
+    Node *last = block->as.exprs.list[count - 1];
+    if (need_value) return gen_expr(last);
+    gen_stmt(last);
+    return (IrArg){0};
+}
+
+// AST中的类型对应的IR类型，float和double之外都按int处理
+static IrType ir_type(Type *type) {
+    if (type == NULL) return IT_INT;
+    if (type->kind == TY_FLOAT) return IT_FLOAT;
+    if (type->kind == TY_DOUBLE) return IT_DOUBLE;
+    return IT_INT;
+}
+
+// 两个操作数运算时的公共类型，和C一样：int < float < double
+static IrType join_type(IrType a, IrType b) {
+    return a > b ? a : b;
+}
+
+// 把a转换成类型to：常量在翻译时直接转换，其他的值用IR_CVT
+static IrArg convert(IrArg a, IrType to) {
+    IrType from = ir_arg_type(B.fn, a);
+    if (from == to || a.kind == IA_NONE || a.kind == IA_STR) return a;
+    if (a.kind == IA_IMM) return ir_num(B.prog, a.val, to);
+    if (a.kind == IA_FLT) {
+        double val = B.prog->nums[a.val].val;
+        if (to == IT_INT) return ir_imm((int32_t)val);
+        return ir_num(B.prog, to == IT_FLOAT ? (float)val : val, to);
+    }
+    int dst = ir_new_typed_vreg(B.fn, NULL, to);
+    ir_emit(B.cur, IR_CVT, dst, a, (IrArg){0});
+    return ir_reg(dst);
+}
+
+// 存量的类型：声明了float或double时以声明为准，否则取初始值的类型
+static IrType var_type(Meta *m, IrArg val) {
+    IrType declared = m ? ir_type(m->type) : IT_INT;
+    return declared != IT_INT ? declared : ir_arg_type(B.fn, val);
+}
+
+// ---- 数组 ----
+
+static int array_lookup(Meta *m) {
+    if (m == NULL) return -1;
+    for (int i = B.fn->array_count - 1; i >= 0; i--) {
+        Meta *am = B.arr_metas[i];
+        if (am == m || am->node == m->node) return i;
+    }
+    return -1;
+}
+
+// 在栈帧中为数组分配存储。只支持元素是数字的一维数组
+static int array_define(Meta *m, char *name, Type *type) {
+    Type *item = type->as.array.item;
+    if (item->kind == TY_ARRAY || item->kind == TY_STR || item->kind == TY_USER || item->kind == TY_DICT) {
+        printf("Error: only one-dimensional arrays of numbers are supported in native code: %s\n", name);
+        exit(1);
+    }
+    IrFn *fn = B.fn;
+    if (fn->array_count >= fn->array_cap) {
+        fn->array_cap = fn->array_cap * 2 + 4;
+        fn->arrays = realloc(fn->arrays, fn->array_cap * sizeof(IrArray));
+        B.arr_metas = realloc(B.arr_metas, fn->array_cap * sizeof(Meta *));
+    }
+    IrType elem = ir_type(item);
+    int bytes = type->as.array.size * ir_type_size(elem);
+    fn->arrays[fn->array_count] = (IrArray){name, elem, type->as.array.size, fn->array_slots};
+    fn->array_slots += (bytes + 15) / 16 * 4;
+    B.arr_metas[fn->array_count] = m;
+    return fn->array_count++;
+}
+
+// 数组字面量逐个元素写入数组的存储
+static void gen_array(Node *name, Node *value) {
+    int arr = array_define(name->meta, get_name(name), value->meta->type);
+    IrType elem = B.fn->arrays[arr].type;
+    for (int i = 0; i < value->as.array.size; i++) {
+        IrArg val = convert(gen_expr(value->as.array.items[i]), elem);
+        ir_emit(B.cur, IR_SETELEM, -1, (IrArg){IA_ARR, arr}, ir_imm(i))->c = val;
+    }
+}
+
+// 被索引的数组，只能是本函数中的数组存量
+static IrArg array_of(Node *parent) {
+    int arr = parent->kind == ND_IDENT ? array_lookup(parent->meta) : -1;
+    if (arr < 0) {
+        printf("Error: only local one-dimensional arrays can be indexed in native code\n");
+        exit(1);
+    }
+    return (IrArg){IA_ARR, arr};
+}
+
+static IrArg gen_index(Node *expr) {
+    IrArg arr = array_of(expr->as.index.parent);
+    IrArg idx = convert(gen_expr(expr->as.index.idx), IT_INT);
+    int dst = ir_new_typed_vreg(B.fn, NULL, B.fn->arrays[arr.val].type);
+    ir_emit(B.cur, IR_ELEM, dst, arr, idx);
+    return ir_reg(dst);
+}
+
+static IrOp binop_to_ir(Op op) {
+    switch (op) {
+    case OP_ADD: return IR_ADD;
+    case OP_SUB: return IR_SUB;
+    case OP_MUL: return IR_MUL;
+    case OP_DIV: return IR_DIV;
+    case OP_EQ: return IR_EQ;
+    case OP_NE: return IR_NE;
+    case OP_LT: return IR_LT;
+    case OP_LE: return IR_LE;
+    case OP_GT: return IR_GT;
+    case OP_GE: return IR_GE;
+    case OP_AND: return IR_AND;
+    case OP_OR: return IR_OR;
+    default:
+        printf("Error: unknown operator for IR: %s\n", op_to_str(op));
+        exit(1);
+    }
+}
+
+static IrArg gen_asn(Node *expr) {
+    Node *left = expr->as.bop.left;
+    if (left->kind == ND_INDEX) {
+        IrArg arr = array_of(left->as.index.parent);
+        IrArg val = convert(gen_expr(expr->as.bop.right), B.fn->arrays[arr.val].type);
+        IrArg idx = convert(gen_expr(left->as.index.idx), IT_INT);
+        ir_emit(B.cur, IR_SETELEM, -1, arr, idx)->c = val;
+        return val;
+    }
+    int var = var_lookup(left->meta);
+    if (left->kind != ND_LNAME || var < 0) {
+        printf("Error: unsupported assignment target for native code: %s\n", get_name(left));
+        exit(1);
+    }
+    IrArg val = convert(gen_expr(expr->as.bop.right), B.var_types[var]);
+    write_var(var, B.cur, val);
+    return val;
+}
+
+// 自定义函数：解析器登记的ND_FN，内置函数和stdz中的函数都不是
+static bool is_user_fn(Node *name) {
+    Meta *m = name->meta;
+    return m != NULL && m->kind == ND_FN && m->is_def && name->as.path.len == 1;
+}
+
+// 值是不是bool。IR中bool和int一样用IT_INT表示，只能从AST上判断
+static bool is_bool(Node *expr) {
+    switch (expr->kind) {
+    case ND_BOOL:
+    case ND_NOT:
+        return true;
+    case ND_BINOP:
+        switch (expr->as.bop.op) {
+        case OP_GT: case OP_LT: case OP_GE: case OP_LE: case OP_EQ: case OP_NE: case OP_AND: case OP_OR:
+            return true;
+        case OP_ASN:
+            return is_bool(expr->as.bop.right);
+        default:
+            return false;
+        }
+    case ND_CALL: {
+        // 调用节点的meta是函数的元信息
+        if (!is_user_fn(expr->as.call.name)) return false;
+        Type *ret = expr->as.call.name->meta->node->as.fn.type->as.fn.ret;
+        return ret && ret->kind == TY_BOOL;
+    }
+    default:
+        return expr->meta && expr->meta->type && expr->meta->type->kind == TY_BOOL;
+    }
+}
+
+// 翻译函数调用。内置函数和stdz中的函数没有返回值；自定义函数的实参和返回值按照函数的类型转换
+static IrArg gen_call(Node *expr) {
+    CallExpr *call = &expr->as.call;
+    char *name = get_name(call->name);
+    bool is_print = strcmp(name, "print") == 0;
+    bool is_user = is_user_fn(call->name);
+    TypeFn *type = is_user ? &call->name->meta->node->as.fn.type->as.fn : NULL;
+    IrArg *args = calloc(call->argc + 2, sizeof(IrArg));
+    int argc = 0;
+    if (is_print) {
+        // print(x)编译为printf调用：字符串直接作为格式串，整数用"%d"格式输出，
+        // 浮点数和C的变参函数一样先转换成double，再用"%f"格式输出。
+        // bool要和解释器一样输出true/false，调用stdz中的print_bool
+        Node *arg = call->args[0];
+        name = "printf";
+        if (arg->kind == ND_STR) {
+            args[argc++] = add_str(arg->as.str, true);
+        } else if (is_bool(arg)) {
+            args[argc++] = gen_expr(arg);
+            name = "print_bool";
+        } else {
+            IrArg val = gen_expr(arg);
+            bool is_int = ir_arg_type(B.fn, val) == IT_INT;
+            args[argc++] = add_str(is_int ? "%d" : "%f", true);
+            args[argc++] = is_int ? val : convert(val, IT_DOUBLE);
+        }
+    } else {
+        for (int i = 0; i < call->argc; i++) {
+            Node *arg = call->args[i];
+            args[argc] = arg->kind == ND_STR ? add_str(arg->as.str, false) : gen_expr(arg);
+            if (type && i < type->param_count) args[argc] = convert(args[argc], ir_type(type->params[i]));
+            argc++;
+        }
+    }
+    int dst = -1;
+    if (is_user) {
+        name = ir_symbol(name);
+        dst = ir_new_typed_vreg(B.fn, NULL, ir_type(type->ret));
+    }
+    Ir *ir = ir_emit(B.cur, IR_CALL, dst, (IrArg){0}, (IrArg){0});
+    ir->name = name;
+    ir->argc = argc;
+    ir->args = args;
+    return dst >= 0 ? ir_reg(dst) : (IrArg){0};
+}
+
+// 翻译条件：成立时跳到yes，否则跳到no。
+// `&&`和`||`翻译成短路的分支：左边已经能决定结果时，右边不再求值
+static void gen_cond(Node *cond, IrBlock *yes, IrBlock *no) {
+    if (cond->kind == ND_NOT) {
+        gen_cond(cond->as.una.body, no, yes);
+        return;
+    }
+    if (cond->kind == ND_BINOP && (cond->as.bop.op == OP_AND || cond->as.bop.op == OP_OR)) {
+        IrBlock *right = add_block();
+        if (cond->as.bop.op == OP_AND) gen_cond(cond->as.bop.left, right, no);
+        else gen_cond(cond->as.bop.left, yes, right);
+        seal_block(right);
+        start_block(right);
+        gen_cond(cond->as.bop.right, yes, no);
+        return;
+    }
+    branch(gen_expr(cond), yes, no);
+}
+
+// 翻译if-else。need_value为true时，通过一个临时存量汇合两个分支的值
+static IrArg gen_if(Node *expr, bool need_value) {
+    IfElse *if_else = &expr->as.if_else;
+    int res = need_value ? var_define(NULL, NULL, IT_INT) : -1;
+    IrBlock *then = add_block();
+    // 没有else分支时也建一个空块，这样条件块到汇合块之间不会有关键边（critical edge）
+    IrBlock *els = add_block();
+    IrBlock *join = add_block();
+    gen_cond(if_else->cond, then, els);
+    seal_block(then);
+    seal_block(els);
+
+    start_block(then);
+    IrArg v1 = gen_block(if_else->then, need_value);
+    // 结果的类型以then分支为准
+    if (need_value) B.var_types[res] = ir_arg_type(B.fn, v1);
+    if (need_value && v1.kind != IA_NONE) write_var(res, B.cur, v1);
+    jump(join);
+
+    start_block(els);
+    IrArg v2 = (IrArg){0};
+    if (if_else->els) v2 = gen_block(if_else->els, need_value);
+    if (need_value && v2.kind != IA_NONE) write_var(res, B.cur, convert(v2, B.var_types[res]));
+    jump(join);
+
+    start_block(join);
+    seal_block(join);
+    if (!need_value || v1.kind == IA_NONE || v2.kind == IA_NONE) return (IrArg){0};
+    return read_var(res, join);
+}
+
+// ---- 循环的向量化 ----
+//
+// 形如下面的计数循环，循环体中数组的下标都是循环变量i，先翻译成每次处理一个向量（几个元素）的循环，
+// 剩下不足一个向量的几次迭代再由原来的循环逐个处理：
+//
+//     for i < n {
+//         a[i] = b[i] * k + c[i]
+//         i = i + 1
+//     }
+//
+// 数组都是各个函数栈帧中独立的存储，不同的数组存量之间没有别名；下标都是i时，
+// 不同的迭代访问的元素互不相同，所以每条语句一次算几个元素和逐个计算的结果一样。
+// 循环体中没有数组的子表达式（如上面的k）和循环无关，在进入循环之前算好，再复制到向量的每一路。
+// 只使用SSE2的指令，int的向量只能做加减法。
+
+#define VEC_MAX_INVS 16
+
+typedef struct VecLoop VecLoop;
+struct VecLoop {
+    int var; // 循环变量i
+    IrType type; // 数组元素的类型，所有的数组都相同
+    IrType vtype; // 对应的向量类型
+    int inv_count;
+    Node *invs[VEC_MAX_INVS]; // 和循环无关的子表达式
+    IrArg inv_vals[VEC_MAX_INVS]; // 它们复制到每一路的向量
+};
+
+typedef enum {
+    VK_BAD, // 不能向量化
+    VK_INV, // 和循环无关
+    VK_VEC, // 按下标i逐个元素计算
+} VecKind;
+
+// 表达式是否是存量i
+static bool is_var(Node *node, int var) {
+    return (node->kind == ND_IDENT || node->kind == ND_LNAME) && var_lookup(node->meta) == var;
+}
+
+// 下标为i的数组元素，返回数组的序号，不是时返回-1
+static int vec_elem(Node *node, VecLoop *vl) {
+    if (node->kind != ND_INDEX || node->as.index.parent->kind != ND_IDENT) return -1;
+    int arr = array_lookup(node->as.index.parent->meta);
+    if (arr < 0 || !is_var(node->as.index.idx, vl->var)) return -1;
+    IrArray *array = &B.fn->arrays[arr];
+    // 数组太小，不够一个向量
+    if (array->type != vl->type || array->size < ir_lanes(vl->vtype)) return -1;
+    return arr;
+}
+
+// 检查表达式能否向量化；和循环无关时，type是它的类型
+static VecKind vec_check(Node *node, VecLoop *vl, IrType *type) {
+    switch (node->kind) {
+    case ND_INT:
+        *type = IT_INT;
+        return VK_INV;
+    case ND_FLOAT:
+        *type = IT_FLOAT;
+        return VK_INV;
+    case ND_DOUBLE:
+        *type = IT_DOUBLE;
+        return VK_INV;
+    case ND_IDENT: {
+        // 循环体中只有i被赋值，其他的存量都和循环无关
+        int var = var_lookup(node->meta);
+        if (var < 0 || var == vl->var) return VK_BAD;
+        *type = B.var_types[var];
+        return VK_INV;
+    }
+    case ND_INDEX:
+        return vec_elem(node, vl) >= 0 ? VK_VEC : VK_BAD;
+    case ND_BINOP: {
+        Op op = node->as.bop.op;
+        if (op != OP_ADD && op != OP_SUB && op != OP_MUL && op != OP_DIV) return VK_BAD;
+        IrType lt, rt;
+        VecKind lk = vec_check(node->as.bop.left, vl, &lt);
+        VecKind rk = vec_check(node->as.bop.right, vl, &rt);
+        if (lk == VK_BAD || rk == VK_BAD) return VK_BAD;
+        if (lk == VK_INV && rk == VK_INV) {
+            *type = join_type(lt, rt);
+            // 提到循环之前的整数除法可能除以0，而原来的循环可能一次都不执行
+            return op == OP_DIV && *type == IT_INT ? VK_BAD : VK_INV;
+        }
+        if (vl->type == IT_INT && op != OP_ADD && op != OP_SUB) return VK_BAD;
+        // 和循环无关的一边转换成元素的类型参与运算，这和逐个计算时的类型提升一致
+        if ((lk == VK_INV && join_type(lt, vl->type) != vl->type) || (rk == VK_INV && join_type(rt, vl->type) != vl->type)) {
+            return VK_BAD;
+        }
+        return VK_VEC;
+    }
+    default:
+        return VK_BAD;
+    }
+}
+
+// `i = i + 1`或`i = 1 + i`
+static bool is_step(Node *node, int var) {
+    if (node->kind != ND_BINOP || node->as.bop.op != OP_ASN || !is_var(node->as.bop.left, var)) return false;
+    Node *right = node->as.bop.right;
+    if (right->kind != ND_BINOP || right->as.bop.op != OP_ADD) return false;
+    Node *l = right->as.bop.left, *r = right->as.bop.right;
+    return (is_var(l, var) && r->kind == ND_INT && r->as.num.val == 1) ||
+        (is_var(r, var) && l->kind == ND_INT && l->as.num.val == 1);
+}
+
+// 循环是否符合向量化的形式
+static bool vec_match(Node *loop, VecLoop *vl) {
+    Node *cond = loop->as.loop.cond;
+    Node *body = loop->as.loop.body;
+    if (cond->kind != ND_BINOP || cond->as.bop.op != OP_LT || cond->as.bop.left->kind != ND_IDENT) return false;
+    vl->var = var_lookup(cond->as.bop.left->meta);
+    if (vl->var < 0 || B.var_types[vl->var] != IT_INT) return false;
+    IrType bt;
+    if (vec_check(cond->as.bop.right, vl, &bt) != VK_INV || bt != IT_INT) return false;
+    if (body->kind != ND_BLOCK) return false;
+    int count = body->as.exprs.count;
+    if (count < 2 || !is_step(body->as.exprs.list[count - 1], vl->var)) return false;
+    for (int i = 0; i < count - 1; i++) {
+        Node *stmt = body->as.exprs.list[i];
+        if (stmt->kind != ND_BINOP || stmt->as.bop.op != OP_ASN) return false;
+        Node *left = stmt->as.bop.left;
+        int arr = left->kind == ND_INDEX && left->as.index.parent->kind == ND_IDENT ? array_lookup(left->as.index.parent->meta) : -1;
+        if (arr < 0) return false;
+        if (i == 0) {
+            vl->type = B.fn->arrays[arr].type;
+            vl->vtype = vl->type == IT_INT ? IT_VINT : vl->type == IT_FLOAT ? IT_VFLOAT : IT_VDOUBLE;
+        }
+        IrType rt;
+        if (vec_elem(left, vl) < 0) return false;
+        VecKind kind = vec_check(stmt->as.bop.right, vl, &rt);
+        if (kind == VK_BAD || (kind == VK_INV && join_type(rt, vl->type) != vl->type)) return false;
+    }
+    return true;
+}
+
+// 在循环之前算好和循环无关的子表达式，复制到向量的每一路
+static void vec_hoist(Node *node, VecLoop *vl) {
+    IrType type;
+    VecKind kind = vec_check(node, vl, &type);
+    if (kind == VK_INV) {
+        for (int i = 0; i < vl->inv_count; i++) {
+            if (vl->invs[i] == node) return;
+        }
+        if (vl->inv_count >= VEC_MAX_INVS) return;
+        IrArg val = convert(gen_expr(node), vl->type);
+        int dst = ir_new_typed_vreg(B.fn, NULL, vl->vtype);
+        ir_emit(B.cur, IR_SPLAT, dst, val, (IrArg){0});
+        vl->invs[vl->inv_count] = node;
+        vl->inv_vals[vl->inv_count++] = ir_reg(dst);
+    } else if (node->kind == ND_BINOP) {
+        vec_hoist(node->as.bop.left, vl);
+        vec_hoist(node->as.bop.right, vl);
+    }
+}
+
+static int vec_count_invs(Node *node, VecLoop *vl) {
+    IrType type;
+    if (vec_check(node, vl, &type) == VK_INV) return 1;
+    if (node->kind != ND_BINOP) return 0;
+    return vec_count_invs(node->as.bop.left, vl) + vec_count_invs(node->as.bop.right, vl);
+}
+
+static IrArg gen_vexpr(Node *node, VecLoop *vl) {
+    for (int i = 0; i < vl->inv_count; i++) {
+        if (vl->invs[i] == node) return vl->inv_vals[i];
+    }
+    int dst = ir_new_typed_vreg(B.fn, NULL, vl->vtype);
+    if (node->kind == ND_INDEX) {
+        IrArg arr = {IA_ARR, vec_elem(node, vl)};
+        ir_emit(B.cur, IR_ELEM, dst, arr, read_var(vl->var, B.cur));
+        return ir_reg(dst);
+    }
+    IrArg left = gen_vexpr(node->as.bop.left, vl);
+    IrArg right = gen_vexpr(node->as.bop.right, vl);
+    ir_emit(B.cur, binop_to_ir(node->as.bop.op), dst, left, right);
+    return ir_reg(dst);
+}
+
+// 符合条件时，先翻译向量化的循环，之后接着由原来的循环处理剩下的迭代
+static void gen_vector_for(Node *loop) {
+    VecLoop vl = {0};
+    if (!vec_match(loop, &vl)) return;
+    Node *body = loop->as.loop.body;
+    int count = body->as.exprs.count;
+    int invs = 0;
+    for (int i = 0; i < count - 1; i++) invs += vec_count_invs(body->as.exprs.list[i]->as.bop.right, &vl);
+    if (invs > VEC_MAX_INVS) return;
+    int lanes = ir_lanes(vl.vtype);
+
+    // 还剩至少一个向量时（i + lanes <= n，即i < n - (lanes - 1)）执行向量循环；
+    // n - (lanes - 1)溢出时不执行
+    IrArg n = gen_expr(loop->as.loop.cond->as.bop.right);
+    int lim = ir_new_vreg(B.fn, NULL);
+    ir_emit(B.cur, IR_SUB, lim, n, ir_imm(lanes - 1));
+    int ok = ir_new_vreg(B.fn, NULL);
+    ir_emit(B.cur, IR_LT, ok, ir_reg(lim), n);
+    for (int i = 0; i < count - 1; i++) vec_hoist(body->as.exprs.list[i]->as.bop.right, &vl);
+    IrBlock *head = add_block();
+    IrBlock *vbody = add_block();
+    IrBlock *rest = add_block();
+    branch(ir_reg(ok), head, rest);
+
+    start_block(head);
+    int cond = ir_new_vreg(B.fn, NULL);
+    ir_emit(B.cur, IR_LT, cond, read_var(vl.var, B.cur), ir_reg(lim));
+    branch(ir_reg(cond), vbody, rest);
+    seal_block(vbody);
+
+    start_block(vbody);
+    for (int i = 0; i < count - 1; i++) {
+        Node *stmt = body->as.exprs.list[i];
+        IrArg val = gen_vexpr(stmt->as.bop.right, &vl);
+        IrArg arr = {IA_ARR, vec_elem(stmt->as.bop.left, &vl)};
+        ir_emit(B.cur, IR_SETELEM, -1, arr, read_var(vl.var, B.cur))->c = val;
+    }
+    int next = ir_new_vreg(B.fn, NULL);
+    ir_emit(B.cur, IR_ADD, next, read_var(vl.var, B.cur), ir_imm(lanes));
+    write_var(vl.var, B.cur, ir_reg(next));
+    jump(head);
+    seal_block(head);
+
+    seal_block(rest);
+    start_block(rest);
+}
+
+static void gen_for(Node *expr) {
+    if (OPT.vec) gen_vector_for(expr);
+    IrBlock *head = add_block();
+    IrBlock *body = add_block();
+    IrBlock *exit = add_block();
+    jump(head);
+    // 循环头要等循环体翻译完、回边确定之后才能封闭
+    start_block(head);
+    gen_cond(expr->as.loop.cond, body, exit);
+    seal_block(body);
+    seal_block(exit);
+
+    start_block(body);
+    gen_block(expr->as.loop.body, false);
+    jump(head);
+    seal_block(head);
+
+    start_block(exit);
+}
+
+// 翻译表达式，返回存放结果的操作数
+static IrArg gen_expr(Node *expr) {
+    switch (expr->kind) {
+    case ND_INT:
+        return ir_imm(expr->as.num.val);
+    case ND_BOOL:
+        return ir_imm(expr->as.bul ? 1 : 0);
+    case ND_FLOAT:
+        return ir_num(B.prog, expr->as.float_num.val, IT_FLOAT);
+    case ND_DOUBLE:
+        return ir_num(B.prog, expr->as.double_num.val, IT_DOUBLE);
+    case ND_IDENT: {
+        int var = var_lookup(expr->meta);
+        if (var < 0 && array_lookup(expr->meta) >= 0) {
+            printf("Error: arrays can only be indexed in native code: %s\n", get_name(expr));
+            exit(1);
+        }
+        if (var < 0) {
+            printf("Error: unknown name for native code: %s\n", get_name(expr));
+            exit(1);
+        }
+        return read_var(var, B.cur);
+    }
+    case ND_NEG:
+    case ND_NOT: {
+        IrArg body = gen_expr(expr->as.una.body);
+        IrType type = expr->kind == ND_NEG ? ir_arg_type(B.fn, body) : IT_INT;
+        int dst = ir_new_typed_vreg(B.fn, NULL, type);
+        ir_emit(B.cur, expr->kind == ND_NEG ? IR_NEG : IR_NOT, dst, body, (IrArg){0});
+        return ir_reg(dst);
+    }
+    case ND_BINOP: {
+        if (expr->as.bop.op == OP_ASN) return gen_asn(expr);
+        IrArg left = gen_expr(expr->as.bop.left);
+        IrArg right = gen_expr(expr->as.bop.right);
+        IrOp op = binop_to_ir(expr->as.bop.op);
+        // 两边先转换成公共类型；比较的结果和逻辑运算都是int
+        IrType type = op == IR_AND || op == IR_OR ? IT_INT : join_type(ir_arg_type(B.fn, left), ir_arg_type(B.fn, right));
+        left = convert(left, type);
+        right = convert(right, type);
+        bool is_cmp = op >= IR_EQ && op <= IR_GE;
+        int dst = ir_new_typed_vreg(B.fn, NULL, is_cmp ? IT_INT : type);
+        ir_emit(B.cur, op, dst, left, right);
+        return ir_reg(dst);
+    }
+    case ND_IF:
+        return gen_if(expr, true);
+    case ND_BLOCK:
+        return gen_block(expr, true);
+    case ND_CALL:
+        return gen_call(expr);
+    case ND_INDEX:
+        return gen_index(expr);
+    default:
+        gen_stmt(expr);
+        return (IrArg){0};
+    }
+}
+
+// 翻译语句：不需要结果值
+static void gen_stmt(Node *expr) {
+    switch (expr->kind) {
+    case ND_LET:
+    case ND_MUT: {
+        Node *name = expr->as.asn.name;
+        if (expr->as.asn.value->kind == ND_ARRAY) {
+            gen_array(name, expr->as.asn.value);
+            return;
+        }
+        IrArg val = gen_expr(expr->as.asn.value);
+        IrType type = var_type(name->meta, val);
+        write_var(var_define(name->meta, get_name(name), type), B.cur, convert(val, type));
+        return;
+    }
+    case ND_IF:
+        gen_if(expr, false);
+        return;
+    case ND_FOR:
+        gen_for(expr);
+        return;
+    case ND_CALL:
+        gen_call(expr);
+        return;
+    case ND_BLOCK:
+        gen_block(expr, false);
+        return;
+    case ND_BINOP:
+    case ND_NEG:
+    case ND_NOT:
+    case ND_IDENT:
+    case ND_INT:
+    case ND_BOOL:
+    case ND_FLOAT:
+    case ND_DOUBLE:
+    case ND_INDEX:
+        gen_expr(expr);
+        return;
+    case ND_FN:
+        gen_fn(&expr->as.fn);
+        return;
+    case ND_USE:
+        // TODO: 支持模块
+        return;
+    default:
+        printf("Error: unsupported node kind for native code: %d\n", expr->kind);
+        exit(1);
+    }
+}
+
+char *ir_symbol(char *name) {
+    char *sym = calloc(strlen(name) + 3, sizeof(char));
+    strcpy(sym, "z_");
+    strcat(sym, name);
+    return sym;
+}
+
+// 开始翻译一个新的函数，建好入口块
+static IrFn *begin_fn(char *name) {
+    IrFn *fn = calloc(1, sizeof(IrFn));
+    fn->name = name;
+    fn->prog = B.prog;
+    B.fn = fn;
+    B.var_count = 0;
+    IrBlock *entry = add_block();
+    start_block(entry);
+    seal_block(entry);
+    return fn;
+}
+
+// 函数的返回值是函数体最后一个表达式的值，没有值时返回0
+static void end_fn(IrArg ret) {
+    if (ret.kind != IA_REG && ret.kind != IA_IMM && ret.kind != IA_FLT) ret = ir_imm(0);
+    ir_emit(B.cur, IR_RET, -1, convert(ret, B.fn->ret_type), (IrArg){0});
+}
+
+static void add_fn(IrFn *fn) {
+    IrProg *prog = B.prog;
+    if (prog->fn_count >= prog->fn_cap) {
+        prog->fn_cap = prog->fn_cap * 2 + 4;
+        prog->fns = realloc(prog->fns, prog->fn_cap * sizeof(IrFn *));
+    }
+    prog->fns[prog->fn_count++] = fn;
+}
+
+// 翻译自定义函数。函数体有自己的存量表，翻译完之后再回到外层的函数
+static IrFn *gen_fn(Fn *def) {
+    if (def->fname->as.path.len > 1) {
+        printf("Error: methods are not supported in native code: %s\n", def->name);
+        exit(1);
+    }
+    IrBuilder outer = B;
+    B.var_metas = NULL;
+    B.var_names = NULL;
+    B.var_types = NULL;
+    B.var_cap = 0;
+    B.arr_metas = NULL;
+    IrFn *fn = begin_fn(ir_symbol(def->name));
+    Params *params = def->params;
+    fn->param_count = params->count;
+    fn->param_types = calloc(params->count + 1, sizeof(IrType));
+    fn->ret_type = def->type ? ir_type(def->type->as.fn.ret) : IT_INT;
+    for (int i = 0; i < params->count; i++) {
+        Node *param = params->list[i];
+        char *pname = get_name(param);
+        IrType type = ir_type(param->meta->type);
+        fn->param_types[i] = type;
+        int dst = ir_new_typed_vreg(fn, pname, type);
+        ir_emit(B.cur, IR_PARAM, dst, ir_imm(i), (IrArg){0});
+        write_var(var_define(param->meta, pname, type), B.cur, ir_reg(dst));
+    }
+    end_fn(gen_block(def->body, true));
+    free(B.var_metas);
+    free(B.var_names);
+    free(B.var_types);
+    free(B.arr_metas);
+    add_fn(fn);
+    B = outer;
+    return fn;
+}
+
+IrProg *ir_build(Node *prog) {
+    B = (IrBuilder){0};
+    B.prog = calloc(1, sizeof(IrProg));
+    B.prog->main = begin_fn("main");
+    // main的返回值是程序最后一个表达式的值
+    end_fn(gen_block(prog, true));
+    return B.prog;
+}
+
+IrFn *ir_build_fn(IrProg *prog, Fn *def) {
+    B = (IrBuilder){0};
+    B.prog = prog;
+    return gen_fn(def);
+}
+
+// 循环翻译成一个没有参数的函数：入口处从slots中读入外部存量的值，循环结束后写回
+IrFn *ir_build_loop(IrProg *prog, Node *loop, int var_count, Meta **vars) {
+    B = (IrBuilder){0};
+    B.prog = prog;
+    IrFn *fn = begin_fn("loop");
+    for (int i = 0; i < var_count; i++) {
+        char *name = get_name(vars[i]->node);
+        int dst = ir_new_vreg(fn, name);
+        ir_emit(B.cur, IR_LOAD, dst, ir_imm(i), (IrArg){0});
+        write_var(var_define(vars[i], name, IT_INT), B.cur, ir_reg(dst));
+    }
+    gen_for(loop);
+    for (int i = 0; i < var_count; i++) {
+        ir_emit(B.cur, IR_STORE, -1, ir_imm(i), read_var(i, B.cur));
+    }
+    end_fn(ir_imm(0));
+    free(B.var_metas);
+    free(B.var_names);
+    free(B.var_types);
+    add_fn(fn);
+    return fn;
+}
+
+int ir_uses(Ir *ir, int uses[IR_MAX_USES]) {
+    int n = 0;
+    if (ir->op == IR_CALL || ir->op == IR_PHI) {
+        for (int i = 0; i < ir->argc && n < IR_MAX_USES; i++) {
+            if (ir->args[i].kind == IA_REG) uses[n++] = ir->args[i].val;
+        }
+        return n;
+    }
+    if (ir->a.kind == IA_REG) uses[n++] = ir->a.val;
+    if (ir->b.kind == IA_REG) uses[n++] = ir->b.val;
+    if (ir->c.kind == IA_REG) uses[n++] = ir->c.val;
+    return n;
+}
+
+static const char *IR_NAMES[] = {
+    [IR_IMM] = "imm", [IR_MOV] = "mov", [IR_ADD] = "add", [IR_SUB] = "sub",
+    [IR_MUL] = "mul", [IR_DIV] = "div", [IR_EQ] = "eq", [IR_NE] = "ne",
+    [IR_LT] = "lt", [IR_LE] = "le", [IR_GT] = "gt", [IR_GE] = "ge",
+    [IR_AND] = "and", [IR_OR] = "or", [IR_NEG] = "neg", [IR_NOT] = "not", [IR_CVT] = "cvt",
+    [IR_ELEM] = "elem", [IR_SETELEM] = "setelem", [IR_SPLAT] = "splat",
+    [IR_CALL] = "call", [IR_PHI] = "phi", [IR_PARAM] = "param",
+    [IR_LOAD] = "load", [IR_STORE] = "store", [IR_JMP] = "jmp", [IR_BR] = "br",
+    [IR_RET] = "ret",
+};
+
+static void print_arg(FILE *fp, IrFn *fn, IrArg a) {
+    switch (a.kind) {
+    case IA_REG:
+        if (fn->vnames[a.val]) fprintf(fp, " %%%d(%s)", a.val, fn->vnames[a.val]);
+        else fprintf(fp, " %%%d", a.val);
+        break;
+    case IA_IMM:
+        fprintf(fp, " %d", a.val);
+        break;
+    case IA_STR:
+        fprintf(fp, " str%d", a.val);
+        break;
+    case IA_FLT:
+        fprintf(fp, " %g", fn->prog->nums[a.val].val);
+        break;
+    case IA_ARR:
+        fprintf(fp, " %s", fn->arrays[a.val].name);
+        break;
+    default:
+        break;
+    }
+}
+
+static void print_ir(FILE *fp, IrFn *fn, Ir *ir) {
+    fprintf(fp, "   ");
+    if (ir->dst >= 0) {
+        print_arg(fp, fn, ir_reg(ir->dst));
+        fprintf(fp, " =");
+    }
+    fprintf(fp, " %s", IR_NAMES[ir->op]);
+    if (ir->op == IR_CALL) fprintf(fp, " %s", ir->name);
+    if (ir->op == IR_CALL || ir->op == IR_PHI) {
+        for (int j = 0; j < ir->argc; j++) print_arg(fp, fn, ir->args[j]);
+    } else {
+        print_arg(fp, fn, ir->a);
+        print_arg(fp, fn, ir->b);
+        print_arg(fp, fn, ir->c);
+    }
+    fprintf(fp, "\n");
+}
+
+void ir_print(FILE *fp, IrFn *fn) {
+    fprintf(fp, "fn %s:\n", fn->name);
+    for (int i = 0; i < fn->block_count; i++) {
+        IrBlock *block = fn->blocks[i];
+        fprintf(fp, "B%d:", block->id);
+        if (block->pred_count > 0) {
+            fprintf(fp, " ; preds");
+            for (int k = 0; k < block->pred_count; k++) fprintf(fp, " B%d", block->preds[k]->id);
+        }
+        fprintf(fp, "\n");
+        for (int j = 0; j < block->phi_count; j++) print_ir(fp, fn, &block->phis[j]);
+        for (int j = 0; j < block->count; j++) {
+            Ir *ir = &block->code[j];
+            print_ir(fp, fn, ir);
+            if (ir->op == IR_JMP || ir->op == IR_BR) {
+                fprintf(fp, "    ->");
+                for (int k = 0; k < block->succ_count; k++) fprintf(fp, " B%d", block->succs[k]->id);
+                fprintf(fp, "\n");
+            }
+        }
+    }
+}
@@ -0,0 +1,234 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "zast.h"
+
+// 中间表示（IR）
+//
+// 原生编译器先把AST翻译成IR，在IR上做优化，再由寄存器分配和各个平台的后端生成汇编。
+//
+// IR是SSA形式的三地址指令：
+// - 每个函数由若干基本块（IrBlock）组成，每个基本块的最后一条指令是跳转、分支或返回；
+// - 指令的操作数是虚拟寄存器（vreg）、立即数或字符串常量，虚拟寄存器的数量不受限制；
+// - 每个虚拟寄存器只被赋值一次。Z的存量（let/mut）每次赋值都得到一个新的虚拟寄存器，
+//   在控制流汇合处用phi指令选出来自不同前驱的值。
+//
+// 虚拟寄存器有类型：int（bool也按int处理）、float和double，运算的类型由操作数决定，
+// 不同类型之间的转换是显式的IR_CVT指令。向量类型只出现在向量化的循环中。
+//
+// 数组不是虚拟寄存器，而是函数栈帧中的一块存储（IrArray），只能通过IR_ELEM和IR_SETELEM按下标读写。
+//
+// 在SSA形式上，复制传播、公共子表达式消除和死代码消除都只需要简单地替换和删除指令。
+// 生成汇编之前，ir_out_ssa()把phi指令转换成前驱块末尾的复制指令。
+
+typedef struct IrArg IrArg;
+typedef struct Ir Ir;
+typedef struct IrBlock IrBlock;
+typedef struct IrFn IrFn;
+typedef struct IrStr IrStr;
+typedef struct IrProg IrProg;
+typedef struct IrNum IrNum;
+typedef struct IrArray IrArray;
+
+// 虚拟寄存器的类型
+typedef enum {
+    IT_INT, // 32位整数，bool也用它表示
+    IT_FLOAT, // 32位浮点数
+    IT_DOUBLE, // 64位浮点数
+    // 16字节的向量，运算对每一路分别进行
+    IT_VINT, // 4个int
+    IT_VFLOAT, // 4个float
+    IT_VDOUBLE, // 2个double
+} IrType;
+
+typedef enum {
+    IR_IMM, // dst = 立即数a
+    IR_MOV, // dst = a
+    IR_ADD, // dst = a + b
+    IR_SUB, // dst = a - b
+    IR_MUL, // dst = a * b
+    IR_DIV, // dst = a / b
+    IR_EQ, // dst = a == b
+    IR_NE, // dst = a != b
+    IR_LT, // dst = a < b
+    IR_LE, // dst = a <= b
+    IR_GT, // dst = a > b
+    IR_GE, // dst = a >= b
+    IR_AND, // dst = a & b
+    IR_OR, // dst = a | b
+    IR_NEG, // dst = -a
+    IR_NOT, // dst = !a
+    IR_CVT, // dst = a，转换成dst的类型
+    IR_ELEM, // dst = a[b]，a是数组。dst是向量时，读取从a[b]开始的连续几个元素
+    IR_SETELEM, // a[b] = c，c是向量时写入从a[b]开始的连续几个元素
+    IR_SPLAT, // dst = 每一路都是a的向量
+    IR_CALL, // dst = name(args...)
+    IR_PHI, // dst = args[i]，i是实际到达的前驱块的序号
+    IR_PARAM, // dst = 第a个参数。只出现在入口块的开头
+    IR_LOAD, // dst = slots[a]，只在JIT中使用
+    IR_STORE, // slots[a] = b，只在JIT中使用
+    IR_JMP, // 跳转到succs[0]
+    IR_BR, // a不为0时跳转到succs[0]，否则跳转到succs[1]
+    IR_RET, // 返回a
+} IrOp;
+
+typedef enum {
+    IA_NONE, // 没有操作数
+    IA_REG, // 虚拟寄存器，val是编号
+    IA_IMM, // 32位立即数，val是数值
+    IA_STR, // 字符串常量，val是在IrProg.strs中的序号
+    IA_FLT, // 浮点数常量，val是在IrProg.nums中的序号
+    IA_ARR, // 数组，val是在IrFn.arrays中的序号
+} IrArgKind;
+
+struct IrArg {
+    IrArgKind kind;
+    int val;
+};
+
+// 一条三地址指令
+struct Ir {
+    IrOp op;
+    int dst; // 目标虚拟寄存器，-1表示没有
+    IrArg a;
+    IrArg b;
+    IrArg c; // IR_SETELEM要写入的值
+    char *name; // IR_CALL的函数名，见ir_symbol()
+    int argc; // IR_CALL的参数个数；IR_PHI的前驱个数
+    IrArg *args; // IR_CALL的参数；IR_PHI来自各个前驱的值
+    int var; // IR_PHI对应的存量，只在构造SSA时使用
+};
+
+// 基本块：中间没有跳转，也不会从中间跳入的一串指令
+struct IrBlock {
+    int id;
+    int count;
+    int cap;
+    Ir *code; // 最后一条是IR_JMP、IR_BR或IR_RET
+    int phi_count;
+    int phi_cap;
+    Ir *phis; // 块开头的phi指令
+    int pred_count;
+    int pred_cap;
+    IrBlock **preds; // 前驱块，顺序和phi指令的args一一对应
+    int succ_count;
+    IrBlock *succs[2]; // 后继块
+    // 构造SSA时使用
+    bool sealed; // 所有的前驱都已经确定
+    int def_cap;
+    IrArg *defs; // 每个存量在本块中的当前值
+    // 分析时使用
+    int rpo; // 逆后序编号
+    IrBlock *idom; // 直接支配者
+};
+
+// 一个函数的IR
+struct IrFn {
+    char *name; // 汇编中的符号名
+    int param_count;
+    int block_count;
+    int block_cap;
+    IrBlock **blocks; // 按照输出汇编时的顺序排列，第一个是入口块
+    int vreg_count;
+    int vreg_cap;
+    char **vnames; // 虚拟寄存器对应的存量名称，用于调试；中间结果为NULL
+    IrType *vtypes; // 虚拟寄存器的类型
+    IrType *param_types; // 参数的类型
+    IrType ret_type;
+    IrProg *prog; // 所属的程序，浮点数常量存放在其中
+    int array_count;
+    int array_cap;
+    IrArray *arrays; // 栈帧中的数组
+    int array_slots; // 所有数组占用的空间，以4字节为单位
+    int32_t *slots; // IR_LOAD和IR_STORE访问的存储区，由JIT提供
+};
+
+// 栈帧中的数组，元素是int、float或double
+struct IrArray {
+    char *name;
+    IrType type; // 元素的类型
+    int size; // 元素个数
+    int slot; // 在函数的数组区中的位置，以4字节为单位，总是16字节对齐
+};
+
+// 字符串常量，输出到汇编的数据段
+struct IrStr {
+    char *value;
+    bool has_newline; // print()的格式串需要在末尾加上换行
+};
+
+// 浮点数常量，输出到只读数据段
+struct IrNum {
+    double val;
+    IrType type; // IT_FLOAT或IT_DOUBLE
+};
+
+struct IrProg {
+    IrFn *main;
+    int fn_count;
+    int fn_cap;
+    IrFn **fns; // 自定义函数，按定义的顺序排列
+    int str_count;
+    int str_cap;
+    IrStr *strs;
+    int num_count;
+    int num_cap;
+    IrNum *nums;
+};
+
+static inline IrArg ir_reg(int vreg) { return (IrArg){IA_REG, vreg}; }
+static inline IrArg ir_imm(int val) { return (IrArg){IA_IMM, val}; }
+static inline bool ir_same(IrArg x, IrArg y) { return x.kind == y.kind && x.val == y.val; }
+
+// 把AST翻译成SSA形式的IR
+IrProg *ir_build(Node *prog);
+
+// 只翻译一个自定义函数，结果加入prog->fns。用于JIT
+IrFn *ir_build_fn(IrProg *prog, Fn *def);
+// 把一个循环翻译成单独的函数，用于JIT。
+// 循环外的存量vars在入口处用IR_LOAD从slots[i]读入，循环结束后用IR_STORE写回
+IrFn *ir_build_loop(IrProg *prog, Node *loop, int var_count, Meta **vars);
+
+// 自定义函数在汇编中的符号名：加上`z_`前缀，避免和C标准库或stdz中的函数重名
+char *ir_symbol(char *name);
+
+// 新建一个int类型的虚拟寄存器
+int ir_new_vreg(IrFn *fn, char *name);
+// 新建一个指定类型的虚拟寄存器
+int ir_new_typed_vreg(IrFn *fn, char *name, IrType type);
+// 操作数的类型
+IrType ir_arg_type(IrFn *fn, IrArg a);
+// 类型所占的字节数
+int ir_type_size(IrType type);
+// 向量类型的路数，标量为1
+int ir_lanes(IrType type);
+// 向量的每一路的类型，标量是其自身
+IrType ir_lane_type(IrType type);
+// 浮点数常量，相同的常量只保存一份
+IrArg ir_num(IrProg *prog, double val, IrType type);
+// 在基本块末尾添加一条指令
+Ir *ir_emit(IrBlock *block, IrOp op, int dst, IrArg a, IrArg b);
+// 新建一个基本块，并添加到函数的块列表末尾
+IrBlock *ir_new_block(IrFn *fn);
+// 添加一条从from到to的控制流边
+void ir_add_edge(IrBlock *from, IrBlock *to);
+// 删除to的前驱from，以及phi指令中对应的值
+void ir_remove_pred(IrBlock *to, IrBlock *from);
+// 基本块的最后一条指令
+Ir *ir_last(IrBlock *block);
+
+// 一条指令最多读取的虚拟寄存器个数
+#define IR_MAX_USES 16
+
+// 指令中读取的虚拟寄存器，存入uses，返回个数
+int ir_uses(Ir *ir, int uses[IR_MAX_USES]);
+
+// IR上的优化：常量传播与折叠、复制传播、公共子表达式消除和死代码消除，见iropt.c
+void ir_optimize(IrFn *fn);
+// 消去phi指令，转换成前驱块末尾的复制指令
+void ir_out_ssa(IrFn *fn);
+
+// 打印IR，用于调试
+void ir_print(FILE *fp, IrFn *fn);
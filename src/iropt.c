@@ -0,0 +1,532 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "ir.h"
+
+// IR上的优化
+//
+// 所有的优化都利用了SSA的性质：每个虚拟寄存器只有一处定值，而且定值支配所有的使用，
+// 所以“把x的所有使用替换成y”总是安全的。各个优化只需要在repl表中登记替换关系，
+// 然后由apply_repl()统一改写所有的操作数。
+//
+// - 常量传播与折叠：`x = imm 3`、`y = add x, 4`在替换之后成为`y = 7`，分支条件为常量时改为直接跳转；
+// - 复制传播：`x = mov y`之后，所有的x都换成y；
+// - phi化简：所有来源都相同（或是phi自身）的phi就是一次复制；
+// - 公共子表达式消除：沿着支配树向下，同样的运算只算一次；
+// - 死代码消除：从函数调用、分支和返回出发，标记所有用到的值，其余的指令都删除。
+//
+// 这些优化互相创造机会，因此反复进行，直到IR不再变化。
+
+// 每个虚拟寄存器应当替换成的值，IA_NONE表示不替换
+static IrArg *repl;
+
+static IrArg resolve(IrArg a) {
+    while (a.kind == IA_REG && repl[a.val].kind != IA_NONE) a = repl[a.val];
+    return a;
+}
+
+static bool resolve_arg(IrArg *a) {
+    IrArg r = resolve(*a);
+    if (ir_same(r, *a)) return false;
+    *a = r;
+    return true;
+}
+
+static bool apply_ir(Ir *ir) {
+    bool changed = resolve_arg(&ir->a);
+    changed |= resolve_arg(&ir->b);
+    changed |= resolve_arg(&ir->c);
+    if (ir->op == IR_CALL || ir->op == IR_PHI) {
+        for (int i = 0; i < ir->argc; i++) changed |= resolve_arg(&ir->args[i]);
+    }
+    return changed;
+}
+
+static bool apply_repl(IrFn *fn) {
+    bool changed = false;
+    for (int i = 0; i < fn->block_count; i++) {
+        IrBlock *block = fn->blocks[i];
+        for (int j = 0; j < block->phi_count; j++) changed |= apply_ir(&block->phis[j]);
+        for (int j = 0; j < block->count; j++) changed |= apply_ir(&block->code[j]);
+    }
+    return changed;
+}
+
+// 有副作用的指令，即使结果没人用也不能删除
+static bool has_side_effect(Ir *ir) {
+    switch (ir->op) {
+    case IR_CALL:
+    case IR_STORE:
+    case IR_SETELEM:
+    case IR_JMP:
+    case IR_BR:
+    case IR_RET:
+        return true;
+    case IR_DIV:
+        // 除以0会让程序出错，只有除数是非零常量时才可以删除
+        return ir->b.kind != IA_IMM || ir->b.val == 0;
+    default:
+        return false;
+    }
+}
+
+// ---- 常量折叠与复制传播 ----
+
+// 两个操作数都是常量时计算结果，无法计算时返回false。int按32位补码回绕
+static bool fold_binop(IrOp op, int32_t a, int32_t b, int32_t *res) {
+    uint32_t ua = (uint32_t)a, ub = (uint32_t)b;
+    switch (op) {
+    case IR_ADD: *res = (int32_t)(ua + ub); return true;
+    case IR_SUB: *res = (int32_t)(ua - ub); return true;
+    case IR_MUL: *res = (int32_t)(ua * ub); return true;
+    case IR_DIV:
+        if (b == 0 || (a == INT32_MIN && b == -1)) return false;
+        *res = a / b;
+        return true;
+    case IR_EQ: *res = a == b; return true;
+    case IR_NE: *res = a != b; return true;
+    case IR_LT: *res = a < b; return true;
+    case IR_LE: *res = a <= b; return true;
+    case IR_GT: *res = a > b; return true;
+    case IR_GE: *res = a >= b; return true;
+    case IR_AND: *res = a & b; return true;
+    case IR_OR: *res = a | b; return true;
+    default: return false;
+    }
+}
+
+// 指令的结果是否可以直接替换成一个已知的值
+static bool fold(Ir *ir, IrArg *val) {
+    switch (ir->op) {
+    case IR_IMM:
+    case IR_MOV:
+        *val = ir->a;
+        return true;
+    case IR_NEG:
+        if (ir->a.kind != IA_IMM) return false;
+        *val = ir_imm((int32_t)(0u - (uint32_t)ir->a.val));
+        return true;
+    case IR_NOT:
+        if (ir->a.kind != IA_IMM) return false;
+        *val = ir_imm(!ir->a.val);
+        return true;
+    case IR_PHI: {
+        // 除了自身之外，所有来源都相同
+        IrArg same = {0};
+        for (int i = 0; i < ir->argc; i++) {
+            IrArg a = ir->args[i];
+            if (ir_same(a, ir_reg(ir->dst)) || ir_same(a, same)) continue;
+            if (same.kind != IA_NONE) return false;
+            same = a;
+        }
+        if (same.kind == IA_NONE) return false;
+        *val = same;
+        return true;
+    }
+    default: {
+        int32_t res;
+        if (ir->a.kind != IA_IMM || ir->b.kind != IA_IMM) return false;
+        if (!fold_binop(ir->op, ir->a.val, ir->b.val, &res)) return false;
+        *val = ir_imm(res);
+        return true;
+    }
+    }
+}
+
+static bool propagate(IrFn *fn) {
+    bool changed = false;
+    for (int i = 0; i < fn->block_count; i++) {
+        IrBlock *block = fn->blocks[i];
+        int n = 0;
+        for (int j = 0; j < block->phi_count; j++) {
+            Ir *phi = &block->phis[j];
+            apply_ir(phi);
+            IrArg val;
+            if (fold(phi, &val)) {
+                repl[phi->dst] = val;
+                changed = true;
+                continue;
+            }
+            block->phis[n++] = *phi;
+        }
+        block->phi_count = n;
+
+        n = 0;
+        for (int j = 0; j < block->count; j++) {
+            Ir *ir = &block->code[j];
+            apply_ir(ir);
+            IrArg val;
+            if (ir->dst >= 0 && ir->op != IR_CALL && fold(ir, &val)) {
+                repl[ir->dst] = val;
+                changed = true;
+                continue;
+            }
+            if (ir->op == IR_BR && ir->a.kind == IA_IMM) {
+                // 条件已知的分支改为直接跳转，另一个后继少了一个前驱
+                IrBlock *taken = block->succs[ir->a.val ? 0 : 1];
+                IrBlock *dropped = block->succs[ir->a.val ? 1 : 0];
+                ir_remove_pred(dropped, block);
+                ir->op = IR_JMP;
+                ir->a = (IrArg){0};
+                block->succs[0] = taken;
+                block->succ_count = 1;
+                changed = true;
+            }
+            block->code[n++] = *ir;
+        }
+        block->count = n;
+    }
+    return changed;
+}
+
+// 删除从入口块到达不了的块
+static bool remove_unreachable(IrFn *fn) {
+    bool *reached = calloc(fn->block_count, sizeof(bool));
+    IrBlock **stack = calloc(fn->block_count, sizeof(IrBlock *));
+    for (int i = 0; i < fn->block_count; i++) fn->blocks[i]->rpo = i;
+    int top = 0;
+    stack[top++] = fn->blocks[0];
+    reached[0] = true;
+    while (top > 0) {
+        IrBlock *block = stack[--top];
+        for (int k = 0; k < block->succ_count; k++) {
+            IrBlock *succ = block->succs[k];
+            if (!reached[succ->rpo]) {
+                reached[succ->rpo] = true;
+                stack[top++] = succ;
+            }
+        }
+    }
+    int n = 0;
+    bool changed = false;
+    for (int i = 0; i < fn->block_count; i++) {
+        IrBlock *block = fn->blocks[i];
+        if (reached[i]) {
+            fn->blocks[n++] = block;
+            continue;
+        }
+        for (int k = 0; k < block->succ_count; k++) ir_remove_pred(block->succs[k], block);
+        changed = true;
+    }
+    fn->block_count = n;
+    free(stack);
+    free(reached);
+    return changed;
+}
+
+// ---- 支配树与公共子表达式消除 ----
+
+static int rpo_count;
+
+static void dfs_post(IrBlock *block, bool *seen, IrBlock **order) {
+    seen[block->id] = true;
+    for (int k = 0; k < block->succ_count; k++) {
+        if (!seen[block->succs[k]->id]) dfs_post(block->succs[k], seen, order);
+    }
+    order[rpo_count++] = block;
+}
+
+static IrBlock *intersect(IrBlock *a, IrBlock *b) {
+    while (a != b) {
+        while (a->rpo > b->rpo) a = a->idom;
+        while (b->rpo > a->rpo) b = b->idom;
+    }
+    return a;
+}
+
+// 计算支配树。采用Cooper、Harvey和Kennedy的迭代算法（A Simple, Fast Dominance Algorithm）。
+// 返回按逆后序排列的块
+static IrBlock **dominators(IrFn *fn) {
+    for (int i = 0; i < fn->block_count; i++) {
+        fn->blocks[i]->id = i;
+        fn->blocks[i]->idom = NULL;
+    }
+    bool *seen = calloc(fn->block_count, sizeof(bool));
+    IrBlock **post = calloc(fn->block_count, sizeof(IrBlock *));
+    rpo_count = 0;
+    dfs_post(fn->blocks[0], seen, post);
+    IrBlock **rpo = calloc(fn->block_count, sizeof(IrBlock *));
+    for (int i = 0; i < rpo_count; i++) {
+        rpo[i] = post[rpo_count - 1 - i];
+        rpo[i]->rpo = i;
+    }
+    IrBlock *entry = rpo[0];
+    entry->idom = entry;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int i = 1; i < rpo_count; i++) {
+            IrBlock *block = rpo[i];
+            IrBlock *idom = NULL;
+            for (int k = 0; k < block->pred_count; k++) {
+                IrBlock *pred = block->preds[k];
+                if (pred->idom == NULL) continue;
+                idom = idom ? intersect(pred, idom) : pred;
+            }
+            if (idom != block->idom) {
+                block->idom = idom;
+                changed = true;
+            }
+        }
+    }
+    free(post);
+    free(seen);
+    return rpo;
+}
+
+typedef struct CseEntry CseEntry;
+struct CseEntry {
+    IrOp op;
+    IrArg a;
+    IrArg b;
+    int dst;
+    IrBlock *block; // 登记这个运算的块，只对它支配的块有效
+};
+
+static bool is_pure_op(IrOp op) {
+    return op >= IR_ADD && op <= IR_NOT;
+}
+
+static bool is_commutative(IrOp op) {
+    return op == IR_ADD || op == IR_MUL || op == IR_EQ || op == IR_NE || op == IR_AND || op == IR_OR;
+}
+
+static bool dominates(IrBlock *a, IrBlock *b) {
+    while (true) {
+        if (a == b) return true;
+        if (b->idom == b) return false;
+        b = b->idom;
+    }
+}
+
+// 按逆后序遍历块时，支配者总是先被访问。
+// 表中的运算只有在其所在块支配当前块时才可用；表很小，直接线性查找
+static bool cse(IrFn *fn) {
+    IrBlock **rpo = dominators(fn);
+    int cap = 16, count = 0;
+    CseEntry *table = calloc(cap, sizeof(CseEntry));
+    bool changed = false;
+    for (int i = 0; i < rpo_count; i++) {
+        IrBlock *block = rpo[i];
+        for (int j = 0; j < block->count; j++) {
+            Ir *ir = &block->code[j];
+            if (!is_pure_op(ir->op) || ir->dst < 0) continue;
+            IrArg a = ir->a, b = ir->b;
+            // 可交换的运算，把操作数排成固定的顺序
+            if (is_commutative(ir->op) && (a.kind > b.kind || (a.kind == b.kind && a.val > b.val))) {
+                IrArg t = a; a = b; b = t;
+            }
+            int found = -1;
+            for (int k = 0; k < count; k++) {
+                CseEntry *e = &table[k];
+                if (e->op == ir->op && ir_same(e->a, a) && ir_same(e->b, b) && dominates(e->block, block)) {
+                    found = k;
+                    break;
+                }
+            }
+            if (found >= 0) {
+                // 后面的propagate会把这条指令作为复制删除
+                ir->op = IR_MOV;
+                ir->a = ir_reg(table[found].dst);
+                ir->b = (IrArg){0};
+                changed = true;
+                continue;
+            }
+            if (count >= cap) {
+                cap *= 2;
+                table = realloc(table, cap * sizeof(CseEntry));
+            }
+            table[count++] = (CseEntry){ir->op, a, b, ir->dst, block};
+        }
+    }
+    free(table);
+    free(rpo);
+    return changed;
+}
+
+// ---- 死代码消除 ----
+
+static bool dce(IrFn *fn) {
+    bool *live = calloc(fn->vreg_count + 1, sizeof(bool));
+    int *work = calloc(fn->vreg_count + 1, sizeof(int));
+    int top = 0;
+    // 定值所在的指令，用于从一个值找到它的操作数
+    Ir **defs = calloc(fn->vreg_count + 1, sizeof(Ir *));
+    for (int i = 0; i < fn->block_count; i++) {
+        IrBlock *block = fn->blocks[i];
+        for (int j = 0; j < block->phi_count; j++) defs[block->phis[j].dst] = &block->phis[j];
+        for (int j = 0; j < block->count; j++) {
+            Ir *ir = &block->code[j];
+            if (ir->dst >= 0) defs[ir->dst] = ir;
+        }
+    }
+    // 从有副作用的指令出发
+    for (int i = 0; i < fn->block_count; i++) {
+        IrBlock *block = fn->blocks[i];
+        for (int j = 0; j < block->count; j++) {
+            Ir *ir = &block->code[j];
+            if (!has_side_effect(ir)) continue;
+            int uses[IR_MAX_USES];
+            int n = ir_uses(ir, uses);
+            for (int k = 0; k < n; k++) {
+                if (!live[uses[k]]) {
+                    live[uses[k]] = true;
+                    work[top++] = uses[k];
+                }
+            }
+        }
+    }
+    while (top > 0) {
+        Ir *ir = defs[work[--top]];
+        if (ir == NULL) continue;
+        int uses[IR_MAX_USES];
+        int n = ir_uses(ir, uses);
+        for (int k = 0; k < n; k++) {
+            if (!live[uses[k]]) {
+                live[uses[k]] = true;
+                work[top++] = uses[k];
+            }
+        }
+    }
+
+    bool changed = false;
+    for (int i = 0; i < fn->block_count; i++) {
+        IrBlock *block = fn->blocks[i];
+        int n = 0;
+        for (int j = 0; j < block->phi_count; j++) {
+            if (live[block->phis[j].dst]) block->phis[n++] = block->phis[j];
+        }
+        changed |= n != block->phi_count;
+        block->phi_count = n;
+        n = 0;
+        for (int j = 0; j < block->count; j++) {
+            Ir *ir = &block->code[j];
+            if (ir->dst >= 0 && !live[ir->dst]) {
+                if (has_side_effect(ir)) {
+                    ir->dst = -1; // 调用的结果没人用
+                } else {
+                    changed = true;
+                    continue;
+                }
+            }
+            block->code[n++] = *ir;
+        }
+        block->count = n;
+    }
+    free(defs);
+    free(work);
+    free(live);
+    return changed;
+}
+
+void ir_optimize(IrFn *fn) {
+    repl = calloc(fn->vreg_count + 1, sizeof(IrArg));
+    bool changed = true;
+    while (changed) {
+        changed = propagate(fn);
+        changed |= apply_repl(fn);
+        changed |= remove_unreachable(fn);
+        changed |= cse(fn);
+        changed |= dce(fn);
+    }
+    free(repl);
+    repl = NULL;
+}
+
+// ---- 消去phi ----
+
+typedef struct Copy Copy;
+struct Copy {
+    int dst;
+    IrArg src;
+};
+
+// 在块的终结指令之前插入一条复制
+static void insert_copy(IrBlock *block, int dst, IrArg src) {
+    ir_emit(block, IR_JMP, -1, (IrArg){0}, (IrArg){0}); // 先在末尾占一个位置
+    Ir *code = block->code;
+    int n = block->count;
+    code[n - 1] = code[n - 2];
+    code[n - 2] = (Ir){.op = src.kind == IA_IMM || src.kind == IA_FLT ? IR_IMM : IR_MOV, .dst = dst, .a = src};
+}
+
+// 把一组并行的复制（所有的源都在任何目标被改写之前读取）排成顺序执行的复制。
+// 每次先做目标不再被其他复制读取的那一条；剩下的复制成环时，用一个新的虚拟寄存器暂存环中的一个值
+static void sequentialize(IrFn *fn, IrBlock *block, Copy *copies, int n) {
+    bool *done = calloc(n + 1, sizeof(bool));
+    int left = n;
+    for (int i = 0; i < n; i++) {
+        if (ir_same(copies[i].src, ir_reg(copies[i].dst))) {
+            done[i] = true;
+            left--;
+        }
+    }
+    while (left > 0) {
+        bool progress = false;
+        for (int i = 0; i < n; i++) {
+            if (done[i]) continue;
+            bool blocked = false;
+            for (int j = 0; j < n; j++) {
+                if (j != i && !done[j] && ir_same(copies[j].src, ir_reg(copies[i].dst))) blocked = true;
+            }
+            if (blocked) continue;
+            insert_copy(block, copies[i].dst, copies[i].src);
+            done[i] = true;
+            left--;
+            progress = true;
+        }
+        if (progress) continue;
+        for (int i = 0; i < n; i++) {
+            if (done[i]) continue;
+            int tmp = ir_new_typed_vreg(fn, NULL, fn->vtypes[copies[i].dst]);
+            insert_copy(block, tmp, ir_reg(copies[i].dst));
+            for (int j = 0; j < n; j++) {
+                if (!done[j] && ir_same(copies[j].src, ir_reg(copies[i].dst))) copies[j].src = ir_reg(tmp);
+            }
+            break;
+        }
+    }
+    free(done);
+}
+
+// 拆开关键边（critical edge）：从有多个后继的块到有多个前驱的块的边上，
+// 无处安放phi的复制，需要在中间插入一个新块
+static void split_critical_edges(IrFn *fn) {
+    int count = fn->block_count;
+    for (int i = 0; i < count; i++) {
+        IrBlock *block = fn->blocks[i];
+        if (block->phi_count == 0 || block->pred_count < 2) continue;
+        for (int k = 0; k < block->pred_count; k++) {
+            IrBlock *pred = block->preds[k];
+            if (pred->succ_count < 2) continue;
+            IrBlock *mid = ir_new_block(fn);
+            ir_emit(mid, IR_JMP, -1, (IrArg){0}, (IrArg){0});
+            mid->succs[mid->succ_count++] = block;
+            mid->preds = calloc(1, sizeof(IrBlock *));
+            mid->preds[0] = pred;
+            mid->pred_count = mid->pred_cap = 1;
+            for (int s = 0; s < pred->succ_count; s++) {
+                if (pred->succs[s] == block) pred->succs[s] = mid;
+            }
+            block->preds[k] = mid;
+        }
+    }
+}
+
+void ir_out_ssa(IrFn *fn) {
+    split_critical_edges(fn);
+    for (int i = 0; i < fn->block_count; i++) {
+        IrBlock *block = fn->blocks[i];
+        if (block->phi_count == 0) continue;
+        Copy *copies = calloc(block->phi_count, sizeof(Copy));
+        for (int k = 0; k < block->pred_count; k++) {
+            for (int j = 0; j < block->phi_count; j++) {
+                copies[j] = (Copy){block->phis[j].dst, block->phis[j].args[k]};
+            }
+            sequentialize(fn, block->preds[k], copies, block->phi_count);
+        }
+        free(copies);
+        block->phi_count = 0;
+    }
+    for (int i = 0; i < fn->block_count; i++) fn->blocks[i]->id = i;
+}
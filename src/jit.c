@@ -0,0 +1,577 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+#include "jit.h"
+#include "ir.h"
+#include "codegen.h"
+#include "x86.h"
+#include "meta.h"
+#include "hash.h"
+#include "type.h"
+#include "util.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define JIT_ENABLED
+#endif
+
+// 机器码直接在当前进程中运行，所以使用宿主平台的调用约定
+#ifdef _WIN32
+#define HOST_ABI ABI_WIN64
+#else
+#define HOST_ABI ABI_SYSV
+#endif
+
+// 代码能否编译，取决于每个表达式的类型
+typedef enum {
+    JT_BAD, // 不能编译
+    JT_VOID, // 没有值
+    JT_INT,
+    JT_BOOL,
+} JitType;
+
+typedef enum {
+    JS_NEW,
+    JS_CHECKING, // 正在检查，递归调用时会遇到
+    JS_OK, // 可以编译
+    JS_FAILED, // 不能编译，以后都由解释器执行
+} JitState;
+
+struct Jit {
+    JitState state;
+    int hits; // 调用次数或者迭代次数
+    JitType ret; // 函数的返回类型
+    int callee_count;
+    int callee_cap;
+    Fn **callees; // 调用到的自定义函数
+    void *code; // 机器码的入口
+    // 循环中用到的、循环外的存量
+    int var_count;
+    int var_cap;
+    Meta **vars;
+    JitType *var_types;
+    bool *var_written; // 循环中是否有赋值，有的话结束后要写回解释器
+    int32_t *slots; // 机器码读写这些存量的存储区
+};
+
+// 已经编译的函数：符号名 => 机器码入口
+static HashTable *JIT_FNS = NULL;
+
+static Jit *get_jit(Jit **jit) {
+    if (*jit == NULL) *jit = calloc(1, sizeof(Jit));
+    return *jit;
+}
+
+// ---- 类型检查 ----
+
+typedef struct Checker Checker;
+struct Checker {
+    Jit *jit; // 正在检查的函数或循环
+    // 已知类型的存量，按声明处的节点查找
+    int count;
+    int cap;
+    Node **decls;
+    JitType *types;
+    JitVarRef ref; // 检查循环时，用来获取循环外存量当前的值
+};
+
+static JitType check(Checker *c, Node *expr);
+static JitType check_fn(Fn *fn);
+
+static void define(Checker *c, Node *decl, JitType type) {
+    if (c->count >= c->cap) {
+        c->cap = c->cap * 2 + 8;
+        c->decls = realloc(c->decls, c->cap * sizeof(Node *));
+        c->types = realloc(c->types, c->cap * sizeof(JitType));
+    }
+    c->decls[c->count] = decl;
+    c->types[c->count++] = type;
+}
+
+static JitType type_of_val(Value *val) {
+    if (val == NULL) return JT_BAD;
+    if (val->kind == VAL_INT) return JT_INT;
+    if (val->kind == VAL_BOOL) return JT_BOOL;
+    return JT_BAD;
+}
+
+// 循环外的存量，类型由解释器中当前的值决定
+static int add_var(Checker *c, Meta *m) {
+    Jit *j = c->jit;
+    Value **ref = c->ref(get_name(m->node));
+    JitType type = type_of_val(ref ? *ref : NULL);
+    if (type == JT_BAD) return -1;
+    if (j->var_count >= j->var_cap) {
+        j->var_cap = j->var_cap * 2 + 8;
+        j->vars = realloc(j->vars, j->var_cap * sizeof(Meta *));
+        j->var_types = realloc(j->var_types, j->var_cap * sizeof(JitType));
+        j->var_written = realloc(j->var_written, j->var_cap * sizeof(bool));
+    }
+    j->vars[j->var_count] = m;
+    j->var_types[j->var_count] = type;
+    j->var_written[j->var_count] = false;
+    define(c, m->node, type);
+    return j->var_count++;
+}
+
+// 存量的类型。is_write为true时，记下循环外的存量被赋值了
+static JitType check_name(Checker *c, Node *name, bool is_write) {
+    Meta *m = name->meta;
+    if (m == NULL || m->node == NULL || m->is_field || name->as.path.len != 1) return JT_BAD;
+    if (name->as.path.names[0].kind != NM_NAME) return JT_BAD;
+    for (int i = c->count - 1; i >= 0; i--) {
+        if (c->decls[i] != m->node) continue;
+        Jit *j = c->jit;
+        for (int k = 0; is_write && k < j->var_count; k++) {
+            if (j->vars[k]->node == m->node) j->var_written[k] = true;
+        }
+        return c->types[i];
+    }
+    if (c->ref == NULL) return JT_BAD;
+    int k = add_var(c, m);
+    if (k < 0) return JT_BAD;
+    c->jit->var_written[k] = is_write;
+    return c->jit->var_types[k];
+}
+
+static JitType check_binop(Checker *c, Node *expr) {
+    BinOp *bop = &expr->as.bop;
+    if (bop->op == OP_ASN) {
+        if (bop->left->kind != ND_LNAME) return JT_BAD;
+        JitType val = check(c, bop->right);
+        JitType var = check_name(c, bop->left, true);
+        return var != JT_BAD && var == val ? val : JT_BAD;
+    }
+    JitType left = check(c, bop->left);
+    JitType right = check(c, bop->right);
+    switch (bop->op) {
+    case OP_ADD:
+    case OP_SUB:
+    case OP_MUL:
+        return left == JT_INT && right == JT_INT ? JT_INT : JT_BAD;
+    case OP_DIV:
+        // 机器码中除以0会直接让进程崩溃，所以只编译除数是非零常量的除法
+        if (bop->right->kind != ND_INT || bop->right->as.num.val == 0) return JT_BAD;
+        return left == JT_INT ? JT_INT : JT_BAD;
+    case OP_LT:
+    case OP_LE:
+    case OP_GT:
+    case OP_GE:
+        return left == JT_INT && right == JT_INT ? JT_BOOL : JT_BAD;
+    case OP_EQ:
+    case OP_NE:
+        return (left == JT_INT || left == JT_BOOL) && left == right ? JT_BOOL : JT_BAD;
+    case OP_AND:
+    case OP_OR:
+        return left == JT_BOOL && right == JT_BOOL ? JT_BOOL : JT_BAD;
+    default:
+        return JT_BAD;
+    }
+}
+
+static void add_callee(Jit *j, Fn *fn) {
+    for (int i = 0; i < j->callee_count; i++) {
+        if (j->callees[i] == fn) return;
+    }
+    if (j->callee_count >= j->callee_cap) {
+        j->callee_cap = j->callee_cap * 2 + 4;
+        j->callees = realloc(j->callees, j->callee_cap * sizeof(Fn *));
+    }
+    j->callees[j->callee_count++] = fn;
+}
+
+// print只支持字符串字面量和int：原生代码用printf输出，bool会被输出成0和1
+static JitType check_call(Checker *c, Node *expr) {
+    CallExpr *call = &expr->as.call;
+    Node *name = call->name;
+    if (name->as.path.len != 1) return JT_BAD;
+    if (strcmp(get_name(name), "print") == 0) {
+        if (call->argc != 1) return JT_BAD;
+        Node *arg = call->args[0];
+        if (arg->kind == ND_STR) return strchr(arg->as.str, '%') ? JT_BAD : JT_VOID;
+        return check(c, arg) == JT_INT ? JT_VOID : JT_BAD;
+    }
+    Meta *m = name->meta;
+    if (m == NULL || m->kind != ND_FN || !m->is_def) return JT_BAD;
+    Fn *fn = &m->node->as.fn;
+    if (call->argc != fn->params->count) return JT_BAD;
+    for (int i = 0; i < call->argc; i++) {
+        JitType arg = check(c, call->args[i]);
+        Type *ptype = fn->params->list[i]->meta->type;
+        JitType param = ptype == &TYPE_INT ? JT_INT : ptype == &TYPE_BOOL ? JT_BOOL : JT_BAD;
+        if (arg == JT_BAD || arg != param) return JT_BAD;
+    }
+    JitType ret = check_fn(fn);
+    if (ret != JT_BAD) add_callee(c->jit, fn);
+    return ret;
+}
+
+// 检查表达式能否编译，返回它的类型。
+// 类型必须和解释器的结果一致：例如let语句和没有else的if在原生代码中没有值
+static JitType check(Checker *c, Node *expr) {
+    switch (expr->kind) {
+    case ND_INT:
+        return JT_INT;
+    case ND_BOOL:
+        return JT_BOOL;
+    case ND_IDENT:
+        return check_name(c, expr, false);
+    case ND_NEG:
+        return check(c, expr->as.una.body) == JT_INT ? JT_INT : JT_BAD;
+    case ND_NOT:
+        return check(c, expr->as.una.body) == JT_BOOL ? JT_BOOL : JT_BAD;
+    case ND_BINOP:
+        return check_binop(c, expr);
+    case ND_LET:
+    case ND_MUT: {
+        JitType val = check(c, expr->as.asn.value);
+        if (val != JT_INT && val != JT_BOOL) return JT_BAD;
+        define(c, expr->as.asn.name, val);
+        return JT_VOID;
+    }
+    case ND_BLOCK: {
+        JitType last = JT_VOID;
+        for (int i = 0; i < expr->as.exprs.count; i++) {
+            last = check(c, expr->as.exprs.list[i]);
+            if (last == JT_BAD) return JT_BAD;
+        }
+        return last;
+    }
+    case ND_IF: {
+        IfElse *if_else = &expr->as.if_else;
+        if (check(c, if_else->cond) != JT_BOOL) return JT_BAD;
+        JitType then = check(c, if_else->then);
+        JitType els = if_else->els ? check(c, if_else->els) : JT_VOID;
+        if (then == JT_BAD || els == JT_BAD) return JT_BAD;
+        return then == els ? then : JT_VOID;
+    }
+    case ND_FOR:
+        if (check(c, expr->as.loop.cond) != JT_BOOL) return JT_BAD;
+        return check(c, expr->as.loop.body) == JT_BAD ? JT_BAD : JT_VOID;
+    case ND_CALL:
+        return check_call(c, expr);
+    default:
+        return JT_BAD;
+    }
+}
+
+static JitType param_type(Node *param) {
+    Type *type = param->meta->type;
+    if (type == &TYPE_INT) return JT_INT;
+    if (type == &TYPE_BOOL) return JT_BOOL;
+    return JT_BAD;
+}
+
+// 检查函数能否编译，返回它的返回类型。
+// 递归调用时函数还没检查完，先假定返回int；结果不是int的话，按实际的类型再检查一遍
+static JitType check_fn(Fn *fn) {
+    Jit *j = get_jit(&fn->jit);
+    switch (j->state) {
+    case JS_CHECKING:
+    case JS_OK:
+        return j->ret;
+    case JS_FAILED:
+        return JT_BAD;
+    case JS_NEW:
+        break;
+    }
+    if (fn->fname->as.path.len > 1 || fn->params->count > HOST_ABI.arg_count) {
+        j->state = JS_FAILED;
+        return JT_BAD;
+    }
+    j->state = JS_CHECKING;
+    j->ret = JT_INT;
+    for (int round = 0; round < 2; round++) {
+        Checker c = {.jit = j};
+        j->callee_count = 0;
+        JitType ret = JT_VOID;
+        for (int i = 0; i < fn->params->count; i++) {
+            Node *param = fn->params->list[i];
+            JitType type = param_type(param);
+            if (type == JT_BAD) ret = JT_BAD;
+            define(&c, param, type);
+        }
+        if (ret != JT_BAD) ret = check(&c, fn->body);
+        free(c.decls);
+        free(c.types);
+        if (ret == j->ret) {
+            j->state = JS_OK;
+            return ret;
+        }
+        if (ret != JT_INT && ret != JT_BOOL) break;
+        j->ret = ret;
+    }
+    j->state = JS_FAILED;
+    return JT_BAD;
+}
+
+// ---- 编译 ----
+
+#ifdef JIT_ENABLED
+
+static void *exec_alloc(int size) {
+#ifdef _WIN32
+    void *buf = VirtualAlloc(NULL, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+    return buf;
+#else
+    void *buf = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return buf == MAP_FAILED ? NULL : buf;
+#endif
+}
+
+// 写完机器码之后改成只读可执行
+static bool exec_protect(void *buf, int size) {
+#ifdef _WIN32
+    DWORD old;
+    return VirtualProtect(buf, size, PAGE_EXECUTE_READ, &old);
+#else
+    return mprotect(buf, size, PROT_READ | PROT_EXEC) == 0;
+#endif
+}
+
+// 单元外的函数：之前编译过的自定义函数，或者C库中的printf
+static void *extern_addr(char *sym) {
+    void *addr = JIT_FNS ? hash_get(JIT_FNS, sym) : NULL;
+    if (addr == NULL && strcmp(sym, "printf") == 0) addr = (void *)printf;
+    return addr;
+}
+
+// 跳板：`jmp [rip+0]`后面跟着8字节的目标地址
+#define STUB_SIZE 16
+
+// 编译一个单元中的所有函数，放到同一块可执行内存中，entries中返回各个函数的入口。
+// 单元内的调用直接跳转；单元外的函数可能离得很远，超出rel32的范围，所以经过跳板。
+// 字符串常量放在代码之后
+static bool compile_unit(IrProg *prog, int count, IrFn **fns, void **entries) {
+    X86Code code = {0};
+    int *starts = calloc(count, sizeof(int));
+    for (int i = 0; i < count; i++) {
+        codegen_lower(fns[i]);
+        starts[i] = x86_encode(&code, gen_asm_fn(fns[i], &HOST_ABI, 0));
+    }
+    // 跳板和字符串的位置
+    int stub_count = 0;
+    char **stub_syms = calloc(code.reloc_count + 1, sizeof(char *));
+    int *targets = calloc(code.reloc_count + 1, sizeof(int));
+    int stubs_at = (code.size + 15) / 16 * 16;
+    for (int r = 0; r < code.reloc_count; r++) {
+        X86Reloc *reloc = &code.relocs[r];
+        if (reloc->kind != XR_CALL) continue;
+        targets[r] = -1;
+        for (int i = 0; i < count; i++) {
+            if (strcmp(fns[i]->name, reloc->sym) == 0) targets[r] = starts[i];
+        }
+        if (targets[r] >= 0) continue;
+        int k = 0;
+        while (k < stub_count && strcmp(stub_syms[k], reloc->sym) != 0) k++;
+        if (k == stub_count) stub_syms[stub_count++] = reloc->sym;
+        targets[r] = stubs_at + k * STUB_SIZE;
+    }
+    int strs_at = stubs_at + stub_count * STUB_SIZE;
+    int *str_offsets = calloc(prog->str_count + 1, sizeof(int));
+    int size = strs_at;
+    for (int i = 0; i < prog->str_count; i++) {
+        str_offsets[i] = size;
+        size += strlen(prog->strs[i].value) + 2;
+    }
+
+    uint8_t *buf = exec_alloc(size);
+    bool ok = buf != NULL;
+    for (int k = 0; ok && k < stub_count; k++) {
+        void *addr = extern_addr(stub_syms[k]);
+        if (addr == NULL) ok = false;
+        uint8_t *stub = buf + stubs_at + k * STUB_SIZE;
+        memcpy(stub, "\xff\x25\x00\x00\x00\x00", 6);
+        memcpy(stub + 6, &addr, 8);
+    }
+    if (ok) {
+        memcpy(buf, code.buf, code.size);
+        for (int i = 0; i < prog->str_count; i++) {
+            IrStr *str = &prog->strs[i];
+            char *dst = (char *)buf + str_offsets[i];
+            strcpy(dst, str->value);
+            if (str->has_newline) strcat(dst, "\n");
+        }
+        for (int r = 0; r < code.reloc_count; r++) {
+            X86Reloc *reloc = &code.relocs[r];
+            int target = reloc->kind == XR_CALL ? targets[r] : str_offsets[reloc->str];
+            int32_t rel = target - (reloc->offset + 4);
+            memcpy(buf + reloc->offset, &rel, 4);
+        }
+        ok = exec_protect(buf, size);
+    }
+    for (int i = 0; ok && i < count; i++) {
+        entries[i] = buf + starts[i];
+    }
+    free(code.buf);
+    free(code.relocs);
+    free(starts);
+    free(stub_syms);
+    free(targets);
+    free(str_offsets);
+    return ok;
+}
+
+// 收集单元中要编译的函数：直接或间接调用到的、还没有编译过的函数
+static int collect_fns(Jit *j, Fn ***fns, int count, int *cap) {
+    for (int i = 0; i < j->callee_count; i++) {
+        Fn *fn = j->callees[i];
+        if (fn->jit->code != NULL) continue;
+        bool found = false;
+        for (int k = 0; k < count; k++) {
+            if ((*fns)[k] == fn) found = true;
+        }
+        if (found) continue;
+        if (count >= *cap) {
+            *cap = *cap * 2 + 4;
+            *fns = realloc(*fns, *cap * sizeof(Fn *));
+        }
+        (*fns)[count++] = fn;
+        count = collect_fns(fn->jit, fns, count, cap);
+    }
+    return count;
+}
+
+// 编译入口（函数或循环）以及它调用到的函数。entry是入口的IR，已经在prog中
+static bool compile(IrProg *prog, IrFn *entry, Jit *j, Fn **fns, int count) {
+    IrFn **irs = calloc(count + 1, sizeof(IrFn *));
+    void **entries = calloc(count + 1, sizeof(void *));
+    irs[0] = entry;
+    for (int i = 0; i < count; i++) {
+        irs[i + 1] = ir_build_fn(prog, fns[i]);
+    }
+    bool ok = compile_unit(prog, count + 1, irs, entries);
+    if (ok) {
+        if (JIT_FNS == NULL) JIT_FNS = new_hash_table();
+        j->code = entries[0];
+        for (int i = 0; i < count; i++) {
+            fns[i]->jit->code = entries[i + 1];
+            hash_set(JIT_FNS, irs[i + 1]->name, entries[i + 1]);
+        }
+        log_trace("JIT: compiled %s and %d functions\n", entry->name, count);
+    }
+    free(irs);
+    free(entries);
+    return ok;
+}
+
+static bool compile_fn(Fn *fn) {
+    Jit *j = fn->jit;
+    int cap = 0;
+    Fn **fns = NULL;
+    int count = collect_fns(j, &fns, 0, &cap);
+    // 递归函数会在收集时把自己也加进来
+    int n = 0;
+    for (int i = 0; i < count; i++) {
+        if (fns[i] != fn) fns[n++] = fns[i];
+    }
+    IrProg *prog = calloc(1, sizeof(IrProg));
+    IrFn *entry = ir_build_fn(prog, fn);
+    bool ok = compile(prog, entry, j, fns, n);
+    if (ok) hash_set(JIT_FNS, entry->name, j->code);
+    free(fns);
+    return ok;
+}
+
+static bool compile_loop(Node *loop) {
+    Jit *j = loop->as.loop.jit;
+    int cap = 0;
+    Fn **fns = NULL;
+    int count = collect_fns(j, &fns, 0, &cap);
+    IrProg *prog = calloc(1, sizeof(IrProg));
+    j->slots = calloc(j->var_count + 1, sizeof(int32_t));
+    IrFn *entry = ir_build_loop(prog, loop, j->var_count, j->vars);
+    entry->slots = j->slots;
+    bool ok = compile(prog, entry, j, fns, count);
+    free(fns);
+    return ok;
+}
+
+typedef int32_t (*Native0)(void);
+typedef int32_t (*Native1)(int32_t);
+typedef int32_t (*Native2)(int32_t, int32_t);
+typedef int32_t (*Native3)(int32_t, int32_t, int32_t);
+typedef int32_t (*Native4)(int32_t, int32_t, int32_t, int32_t);
+typedef int32_t (*Native5)(int32_t, int32_t, int32_t, int32_t, int32_t);
+typedef int32_t (*Native6)(int32_t, int32_t, int32_t, int32_t, int32_t, int32_t);
+
+static int32_t call_native(void *code, int argc, int32_t *a) {
+    switch (argc) {
+    case 0: return ((Native0)code)();
+    case 1: return ((Native1)code)(a[0]);
+    case 2: return ((Native2)code)(a[0], a[1]);
+    case 3: return ((Native3)code)(a[0], a[1], a[2]);
+    case 4: return ((Native4)code)(a[0], a[1], a[2], a[3]);
+    case 5: return ((Native5)code)(a[0], a[1], a[2], a[3], a[4]);
+    default: return ((Native6)code)(a[0], a[1], a[2], a[3], a[4], a[5]);
+    }
+}
+
+static int32_t to_native(Value *val) {
+    return val->kind == VAL_BOOL ? val->as.bul : val->as.num;
+}
+
+static Value *from_native(JitType type, int32_t val) {
+    return type == JT_BOOL ? new_bool(val != 0) : new_int(val);
+}
+
+#endif
+
+bool jit_call(Fn *fn, Value **args, Value **ret) {
+#ifdef JIT_ENABLED
+    Jit *j = get_jit(&fn->jit);
+    if (j->code == NULL) {
+        if (j->state == JS_FAILED || ++j->hits < JIT_HOT_CALLS) return false;
+        if (check_fn(fn) == JT_BAD || !compile_fn(fn)) {
+            j->state = JS_FAILED;
+            return false;
+        }
+    }
+    int32_t a[6];
+    for (int i = 0; i < fn->params->count; i++) {
+        if (type_of_val(args[i]) != param_type(fn->params->list[i])) return false;
+        a[i] = to_native(args[i]);
+    }
+    *ret = from_native(j->ret, call_native(j->code, fn->params->count, a));
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool jit_loop(Node *loop, JitVarRef ref) {
+#ifdef JIT_ENABLED
+    Jit *j = get_jit(&loop->as.loop.jit);
+    if (j->code == NULL) {
+        if (j->state == JS_FAILED || ++j->hits < JIT_HOT_LOOP) return false;
+        Checker c = {.jit = j, .ref = ref};
+        bool ok = check(&c, loop) != JT_BAD;
+        free(c.decls);
+        free(c.types);
+        if (!ok || !compile_loop(loop)) {
+            j->state = JS_FAILED;
+            return false;
+        }
+        j->state = JS_OK;
+    }
+    // 循环外存量的类型和编译时不同的话，这一次仍由解释器执行
+    for (int i = 0; i < j->var_count; i++) {
+        Value **slot = ref(get_name(j->vars[i]->node));
+        if (slot == NULL || type_of_val(*slot) != j->var_types[i]) return false;
+        j->slots[i] = to_native(*slot);
+    }
+    call_native(j->code, 0, NULL);
+    for (int i = 0; i < j->var_count; i++) {
+        if (!j->var_written[i]) continue;
+        *ref(get_name(j->vars[i]->node)) = from_native(j->var_types[i], j->slots[i]);
+    }
+    return true;
+#else
+    return false;
+#endif
+}
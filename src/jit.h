@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stdbool.h>
+#include "zast.h"
+#include "value.h"
+
+// 即时编译（JIT）
+//
+// 解释器执行时统计函数的调用次数和循环的迭代次数，足够“热”的函数和循环
+// 就复用原生编译器的流程（IR、优化、寄存器分配、指令选择）编译成机器码，
+// 再由x86.c直接编码到可执行内存中运行，不需要外部的汇编器和链接器。
+//
+// 只有能确定全部是int和bool运算的代码才会被编译，其他情况仍然由解释器执行。
+
+// 函数被调用多少次之后编译
+#define JIT_HOT_CALLS 2
+// 循环累计迭代多少轮之后编译
+#define JIT_HOT_LOOP 64
+
+// 解释器中名为name的存量的存储位置，不存在时返回NULL
+typedef Value **(*JitVarRef)(char *name);
+
+// 用机器码执行一次函数调用，args是已经求值的实参。
+// 返回false表示函数还不够热、无法编译或者实参的类型不符，需要由解释器执行
+bool jit_call(Fn *fn, Value **args, Value **ret);
+
+// 用机器码执行循环剩下的迭代（从判断条件开始），循环外的存量通过ref读写。
+// 返回false表示需要由解释器继续执行
+bool jit_loop(Node *loop, JitVarRef ref);
@@ -1,17 +1,23 @@
 #include <stdio.h>
 #include <string.h>
+#include <stdlib.h>
 
 #include "interp.h"
 #include "compiler.h"
 #include "transpiler.h"
 #include "util.h"
+#include "opt.h"
+#include "pool.h"
+#include "cc.h"
+#include "wasm.h"
 
 static void help(void) {
-  printf("【用法】：`z <源码>` 或 `z repl` 或\n `z interp <源码>` 或\n `z build <文件.z>` 或\n `z c|py|js <hello.z>\n");
+  printf("【用法】：`z <源码>` 或 `z repl` 或\n `z interp <源码>` 或\n `z build <文件.z>` 或\n `z c|py|js|wasm <hello.z>\n");
+  printf("【选项】：`-O0` 关闭优化，`-O1` 开启优化（默认），`-O2`、`-O3` 同时提高C编译器的优化级别，`-j<N>` 用N个线程生成代码（默认为CPU核数），`-funity` 转译C时把所有模块输出到一个app.c中，`-fnumpy` 转译Python时用NumPy实现数值数组，`-fsourcemap` 转译JS和Python时输出源码映射\n");
 }
 
 static void help_run(void) {
-  printf("【用法】：./z run c|py|js <hello.z>\n");
+  printf("【用法】：./z run c|py|js|wasm <hello.z>\n");
 }
 
 void run(char *target, char *file) {
@@ -29,16 +35,23 @@ void run(char *target, char *file) {
         system("node app.js");
         return;
     }
+    if (strcmp(target, "wasm") == 0) {
+        log_trace("Building %s...\n", file);
+        trans_wasm(file);
+        log_trace("\nRunning %s...\n", file);
+        system("node app.mjs");
+        return;
+    }
     if (strcmp(target, "c") == 0) {
         log_trace("Building %s...\n", file);
         trans_c(file);
-#ifdef _WIN32
-        system("cl app.c");
+        int count;
+        char **files = c_sources(&count);
+        if (!cc_build(files, count, "app.exe")) exit(1);
         log_trace("\nRunning %s...\n", file);
+#ifdef _WIN32
         system("app.exe");
 #else
-        system("clang app.c -o app.exe");
-        log_trace("\nRunning %s...\n", file);
         system("./app.exe");
 #endif
         return;
@@ -46,6 +59,20 @@ void run(char *target, char *file) {
 }
 
 int main(int argc, char** argv) {
+    // 先取出优化选项和线程数，剩下的参数保持原来的顺序
+    cc_set_home(argv[0]);
+    int n = 1;
+    for (int i = 1; i < argc; i++) {
+        // `-O<N>`同时也是C编译器的优化级别
+        if (strncmp(argv[i], "-O", 2) == 0 && is_digit(argv[i][2])) cc_set_level(atoi(argv[i] + 2));
+        if (strncmp(argv[i], "-j", 2) == 0) {
+            pool_set_jobs(atoi(argv[i] + 2));
+            continue;
+        }
+        if (!set_opt(argv[i])) argv[n++] = argv[i];
+    }
+    argc = n;
+
     if (argc == 1) {
         repl();
         return 0;
@@ -87,6 +114,8 @@ int main(int argc, char** argv) {
         trans_py(argv[2]);
     } else if (strcmp(cmd, "js") == 0) {
         trans_js(argv[2]);
+    } else if (strcmp(cmd, "wasm") == 0) {
+        trans_wasm(argv[2]);
     } else {
         help();
     }
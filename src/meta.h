@@ -21,6 +21,7 @@ struct Meta {
     int offset;
     bool need_return; // for block
     bool is_def; // self defined function
+    bool is_field; // 自定义类型的字段，此时seq是字段的槽位，offset是字段的字节偏移
 };
 
 typedef enum {
@@ -0,0 +1,266 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "obj.h"
+
+// 不依赖系统的<elf.h>，这样在windows下也能输出linux的目标文件
+
+// 节的编号
+enum {
+    SEC_NULL,
+    SEC_TEXT,
+    SEC_RODATA,
+    SEC_RELA_TEXT,
+    SEC_SYMTAB,
+    SEC_STRTAB,
+    SEC_SHSTRTAB,
+    SEC_NOTE_STACK, // 空的.note.GNU-stack节，表示不需要可执行的栈
+    SEC_COUNT,
+};
+
+#define SHT_PROGBITS 1
+#define SHT_SYMTAB 2
+#define SHT_STRTAB 3
+#define SHT_RELA 4
+
+#define SHF_ALLOC 0x2
+#define SHF_EXECINSTR 0x4
+#define SHF_INFO_LINK 0x40
+
+#define STB_LOCAL 0
+#define STB_GLOBAL 1
+#define STT_NOTYPE 0
+#define STT_FUNC 2
+#define STT_SECTION 3
+
+#define R_X86_64_PC32 2
+#define R_X86_64_PLT32 4
+
+#define EHDR_SIZE 64
+#define SHDR_SIZE 64
+#define SYM_SIZE 24
+#define RELA_SIZE 24
+
+// 按小端序写入的字节缓冲区
+typedef struct ByteBuf ByteBuf;
+struct ByteBuf {
+    uint8_t *data;
+    int size;
+    int cap;
+};
+
+static void put(ByteBuf *b, const void *data, int size) {
+    if (b->size + size > b->cap) {
+        while (b->size + size > b->cap) b->cap = b->cap * 2 + 256;
+        b->data = realloc(b->data, b->cap);
+    }
+    memcpy(b->data + b->size, data, size);
+    b->size += size;
+}
+
+static void put_u8(ByteBuf *b, uint8_t v) {
+    put(b, &v, 1);
+}
+
+static void put_uint(ByteBuf *b, uint64_t v, int size) {
+    for (int i = 0; i < size; i++) put_u8(b, (uint8_t)(v >> (i * 8)));
+}
+
+#define put_u16(b, v) put_uint(b, v, 2)
+#define put_u32(b, v) put_uint(b, v, 4)
+#define put_u64(b, v) put_uint(b, v, 8)
+
+static void align(ByteBuf *b, int n) {
+    while (b->size % n != 0) put_u8(b, 0);
+}
+
+// 往字符串表中添加一个名称，返回它的偏移
+static int add_name(ByteBuf *strtab, const char *name) {
+    int off = strtab->size;
+    put(strtab, name, strlen(name) + 1);
+    return off;
+}
+
+static void put_sym(ByteBuf *b, int name, int bind, int type, int shndx, uint64_t value, uint64_t size) {
+    put_u32(b, name);
+    put_u8(b, (uint8_t)(bind << 4 | type));
+    put_u8(b, 0);
+    put_u16(b, shndx);
+    put_u64(b, value);
+    put_u64(b, size);
+}
+
+static void put_rela(ByteBuf *b, uint64_t offset, int sym, int type, int64_t addend) {
+    put_u64(b, offset);
+    put_u64(b, (uint64_t)sym << 32 | type);
+    put_u64(b, (uint64_t)addend);
+}
+
+typedef struct Shdr Shdr;
+struct Shdr {
+    int name;
+    int type;
+    uint64_t flags;
+    uint64_t offset;
+    uint64_t size;
+    int link;
+    int info;
+    int align;
+    int entsize;
+};
+
+static int find_fn(int fn_count, ElfFn *fns, char *name) {
+    for (int i = 0; i < fn_count; i++) {
+        if (strcmp(fns[i].name, name) == 0) return i;
+    }
+    return -1;
+}
+
+bool elf_write(const char *path, X86Code *code, int fn_count, ElfFn *fns, IrProg *prog) {
+    ByteBuf text = {0}, rodata = {0}, rela = {0}, symtab = {0}, strtab = {0}, shstrtab = {0};
+    put(&text, code->buf, code->size);
+
+    // 字符串常量
+    int *str_offsets = calloc(prog->str_count + 1, sizeof(int));
+    for (int i = 0; i < prog->str_count; i++) {
+        IrStr *str = &prog->strs[i];
+        str_offsets[i] = rodata.size;
+        put(&rodata, str->value, strlen(str->value));
+        if (str->has_newline) put_u8(&rodata, '\n');
+        put_u8(&rodata, 0);
+    }
+    // 浮点数常量，按8字节对齐
+    int *num_offsets = calloc(prog->num_count + 1, sizeof(int));
+    while (rodata.size % 8 != 0) put_u8(&rodata, 0);
+    for (int i = 0; i < prog->num_count; i++) {
+        IrNum *num = &prog->nums[i];
+        num_offsets[i] = rodata.size;
+        if (num->type == IT_DOUBLE) {
+            put(&rodata, &num->val, 8);
+        } else {
+            float val = (float)num->val;
+            put(&rodata, &val, 4);
+            put(&rodata, "\0\0\0\0", 4);
+        }
+    }
+
+    // 符号表：局部符号必须排在全局符号前面
+    put_u8(&strtab, 0);
+    put_sym(&symtab, 0, STB_LOCAL, STT_NOTYPE, 0, 0, 0);
+    put_sym(&symtab, 0, STB_LOCAL, STT_SECTION, SEC_TEXT, 0, 0);
+    int rodata_sym = 2;
+    put_sym(&symtab, 0, STB_LOCAL, STT_SECTION, SEC_RODATA, 0, 0);
+    int first_global = 3;
+    for (int i = 0; i < fn_count; i++) {
+        if (!fns[i].global) first_global++;
+    }
+    for (int pass = 0; pass < 2; pass++) {
+        for (int i = 0; i < fn_count; i++) {
+            ElfFn *fn = &fns[i];
+            if (fn->global != (pass == 1)) continue;
+            int bind = fn->global ? STB_GLOBAL : STB_LOCAL;
+            put_sym(&symtab, add_name(&strtab, fn->name), bind, STT_FUNC, SEC_TEXT, fn->offset, fn->size);
+        }
+    }
+    int extern_base = 3 + fn_count;
+
+    // 外部函数：未定义的全局符号
+    int extern_count = 0;
+    char **externs = calloc(code->reloc_count + 1, sizeof(char *));
+    for (int r = 0; r < code->reloc_count; r++) {
+        X86Reloc *reloc = &code->relocs[r];
+        if (reloc->kind == XR_STR) {
+            put_rela(&rela, reloc->offset, rodata_sym, R_X86_64_PC32, (int64_t)str_offsets[reloc->str] - 4);
+            continue;
+        }
+        if (reloc->kind == XR_NUM) {
+            put_rela(&rela, reloc->offset, rodata_sym, R_X86_64_PC32, (int64_t)num_offsets[reloc->str] - 4);
+            continue;
+        }
+        int fn = find_fn(fn_count, fns, reloc->sym);
+        if (fn >= 0) {
+            // 文件内的调用直接填好
+            int32_t rel = fns[fn].offset - (reloc->offset + 4);
+            memcpy(text.data + reloc->offset, &rel, 4);
+            continue;
+        }
+        int k = 0;
+        while (k < extern_count && strcmp(externs[k], reloc->sym) != 0) k++;
+        if (k == extern_count) {
+            externs[extern_count++] = reloc->sym;
+            put_sym(&symtab, add_name(&strtab, reloc->sym), STB_GLOBAL, STT_NOTYPE, 0, 0, 0);
+        }
+        put_rela(&rela, reloc->offset, extern_base + k, R_X86_64_PLT32, -4);
+    }
+
+    // 节头
+    put_u8(&shstrtab, 0);
+    Shdr sh[SEC_COUNT] = {0};
+    sh[SEC_TEXT] = (Shdr){add_name(&shstrtab, ".text"), SHT_PROGBITS, SHF_ALLOC | SHF_EXECINSTR, 0, text.size, 0, 0, 16, 0};
+    sh[SEC_RODATA] = (Shdr){add_name(&shstrtab, ".rodata"), SHT_PROGBITS, SHF_ALLOC, 0, rodata.size, 0, 0, 8, 0};
+    sh[SEC_RELA_TEXT] = (Shdr){add_name(&shstrtab, ".rela.text"), SHT_RELA, SHF_INFO_LINK, 0, rela.size, SEC_SYMTAB, SEC_TEXT, 8, RELA_SIZE};
+    sh[SEC_SYMTAB] = (Shdr){add_name(&shstrtab, ".symtab"), SHT_SYMTAB, 0, 0, symtab.size, SEC_STRTAB, first_global, 8, SYM_SIZE};
+    sh[SEC_STRTAB] = (Shdr){add_name(&shstrtab, ".strtab"), SHT_STRTAB, 0, 0, strtab.size, 0, 0, 1, 0};
+    sh[SEC_SHSTRTAB] = (Shdr){add_name(&shstrtab, ".shstrtab"), SHT_STRTAB, 0, 0, 0, 0, 0, 1, 0};
+    sh[SEC_NOTE_STACK] = (Shdr){add_name(&shstrtab, ".note.GNU-stack"), SHT_PROGBITS, 0, 0, 0, 0, 0, 1, 0};
+    sh[SEC_SHSTRTAB].size = shstrtab.size;
+
+    // 文件内容：ELF头、各个节的内容，最后是节头表
+    ByteBuf out = {0};
+    put(&out, "\x7f" "ELF", 4);
+    put_u8(&out, 2); // 64位
+    put_u8(&out, 1); // 小端序
+    put_u8(&out, 1); // 版本
+    while (out.size < 16) put_u8(&out, 0);
+    put_u16(&out, 1); // 可重定位文件
+    put_u16(&out, 62); // x86-64
+    put_u32(&out, 1);
+    put_u64(&out, 0); // 入口
+    put_u64(&out, 0); // 程序头
+    int shoff_at = out.size;
+    put_u64(&out, 0); // 节头表的位置，最后再填
+    put_u32(&out, 0);
+    put_u16(&out, EHDR_SIZE);
+    put_u16(&out, 0);
+    put_u16(&out, 0);
+    put_u16(&out, SHDR_SIZE);
+    put_u16(&out, SEC_COUNT);
+    put_u16(&out, SEC_SHSTRTAB);
+
+    ByteBuf *contents[SEC_COUNT] = {
+        [SEC_TEXT] = &text, [SEC_RODATA] = &rodata, [SEC_RELA_TEXT] = &rela,
+        [SEC_SYMTAB] = &symtab, [SEC_STRTAB] = &strtab, [SEC_SHSTRTAB] = &shstrtab,
+    };
+    for (int i = 1; i < SEC_COUNT; i++) {
+        align(&out, sh[i].align);
+        sh[i].offset = out.size;
+        if (contents[i]) put(&out, contents[i]->data, contents[i]->size);
+    }
+    align(&out, 8);
+    uint64_t shoff = out.size;
+    for (int i = 0; i < SEC_COUNT; i++) {
+        put_u32(&out, sh[i].name);
+        put_u32(&out, sh[i].type);
+        put_u64(&out, sh[i].flags);
+        put_u64(&out, 0);
+        put_u64(&out, sh[i].offset);
+        put_u64(&out, sh[i].size);
+        put_u32(&out, sh[i].link);
+        put_u32(&out, sh[i].info);
+        put_u64(&out, sh[i].align);
+        put_u64(&out, sh[i].entsize);
+    }
+    for (int i = 0; i < 8; i++) out.data[shoff_at + i] = (uint8_t)(shoff >> (i * 8));
+
+    FILE *fp = fopen(path, "wb");
+    bool ok = fp != NULL && fwrite(out.data, 1, out.size, fp) == (size_t)out.size;
+    if (fp) fclose(fp);
+
+    ByteBuf *bufs[] = {&text, &rodata, &rela, &symtab, &strtab, &shstrtab, &out};
+    for (int i = 0; i < 7; i++) free(bufs[i]->data);
+    free(str_offsets);
+    free(num_offsets);
+    free(externs);
+    return ok;
+}
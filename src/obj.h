@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stdbool.h>
+#include "x86.h"
+#include "ir.h"
+
+// ELF64目标文件
+//
+// 原生编译器在linux下直接输出可重定位的目标文件（.o），不需要再调用汇编器：
+// - .text：x86.c编码的机器码
+// - .rodata：字符串常量和浮点数常量
+// - .symtab：文件中定义的函数，以及调用到的外部函数（printf和stdz中的函数）
+// - .rela.text：对外部函数和常量的引用
+// 文件内部的函数调用在写出时直接填好，不需要重定位。
+
+typedef struct ElfFn ElfFn;
+
+// 目标文件中定义的函数
+struct ElfFn {
+    char *name;
+    int offset; // 在.text中的偏移
+    int size;
+    bool global; // 是否导出，如main
+};
+
+// 写出目标文件，字符串常量取自prog。失败时返回false
+bool elf_write(const char *path, X86Code *code, int fn_count, ElfFn *fns, IrProg *prog);
@@ -0,0 +1,1027 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "opt.h"
+#include "meta.h"
+#include "type.h"
+
+// -fno-inline不会被之后的-O1/-O2/-O3重新打开
+static bool no_inline;
+
+OptConfig OPT = {
+    .fold = true,
+    .inlining = true,
+    .ir = true,
+    .peep = true,
+    .licm = true,
+    .vec = true,
+    .jit = true,
+};
+
+bool set_opt(const char *arg) {
+    if (strcmp(arg, "-O0") == 0) {
+        OPT.fold = false;
+        OPT.inlining = false;
+        OPT.ir = false;
+        OPT.peep = false;
+        OPT.licm = false;
+        OPT.vec = false;
+        OPT.jit = false;
+        return true;
+    } else if (strcmp(arg, "-O1") == 0 || strcmp(arg, "-O2") == 0 || strcmp(arg, "-O3") == 0) {
+        OPT.fold = true;
+        OPT.inlining = !no_inline;
+        OPT.ir = true;
+        OPT.peep = true;
+        OPT.licm = true;
+        OPT.vec = true;
+        OPT.jit = true;
+        return true;
+    } else if (strcmp(arg, "-fno-inline") == 0) {
+        no_inline = true;
+        OPT.inlining = false;
+        return true;
+    } else if (strcmp(arg, "-funity") == 0) {
+        OPT.unity = true;
+        return true;
+    } else if (strcmp(arg, "-fnumpy") == 0) {
+        OPT.numpy = true;
+        return true;
+    } else if (strcmp(arg, "-fsourcemap") == 0) {
+        OPT.source_map = true;
+        return true;
+    }
+    return false;
+}
+
+// 常量折叠（Constant Folding）
+//
+// 自底向上遍历AST，把只包含字面量的子树直接算出结果，并做一些代数化简：
+// - `2*3+4` => `10`，`-(1+2)` => `-3`，`!true` => `false`
+// - `x*1`、`x+0`、`x-0`、`x/1`、`x&&true`、`x||false` => `x`
+// - `if true {...} else {...}` => 直接展开对应的分支
+//
+// 注意：Z的int是32位整数，折叠时按32位补码回绕；除数为0时不折叠，留给运行时报错。
+
+static Node *fold(Node *expr);
+
+static bool is_const(Node *expr) {
+    return expr->kind == ND_INT || expr->kind == ND_BOOL || expr->kind == ND_FLOAT || expr->kind == ND_DOUBLE;
+}
+
+static bool is_int(Node *expr, int32_t val) {
+    return expr->kind == ND_INT && expr->as.num.val == val;
+}
+
+static bool is_bool(Node *expr, bool val) {
+    return expr->kind == ND_BOOL && expr->as.bul == val;
+}
+
+// 表达式是否没有副作用，也不会在运行时出错；这样的表达式被化简掉也不影响程序的行为
+static bool is_pure(Node *expr) {
+    switch (expr->kind) {
+    case ND_INT:
+    case ND_BOOL:
+    case ND_FLOAT:
+    case ND_DOUBLE:
+    case ND_STR:
+    case ND_IDENT:
+        return true;
+    case ND_NEG:
+    case ND_NOT:
+        return is_pure(expr->as.una.body);
+    case ND_BINOP:
+        if (expr->as.bop.op == OP_ASN || expr->as.bop.op == OP_DIV) return false;
+        return is_pure(expr->as.bop.left) && is_pure(expr->as.bop.right);
+    default:
+        return false;
+    }
+}
+
+// 折叠出来的字面量节点。基本类型是共享的只读对象，Meta中的类型指针不会被用来修改它
+static Node *new_lit_node(NodeKind kind, const Type *type) {
+    Node *node = new_node(kind);
+    node->meta->type = (Type*)type;
+    return node;
+}
+
+static Node *new_int_node(int32_t val) {
+    Node *node = new_lit_node(ND_INT, &TYPE_INT);
+    node->as.num.val = val;
+    char buf[16];
+    snprintf(buf, sizeof(buf), "%d", val);
+    node->as.num.lit = strdup(buf);
+    return node;
+}
+
+static Node *new_bool_node(bool val) {
+    Node *node = new_lit_node(ND_BOOL, &TYPE_BOOL);
+    node->as.bul = val;
+    return node;
+}
+
+// 浮点数的字面量需要能被各个后端原样输出，所以保证其中有小数点
+static char *float_lit(double val, int digits) {
+    char buf[40];
+    snprintf(buf, sizeof(buf), "%.*g", digits, val);
+    if (strpbrk(buf, ".en") == NULL) strcat(buf, ".0");
+    return strdup(buf);
+}
+
+static Node *new_float_node(float val) {
+    Node *node = new_lit_node(ND_FLOAT, &TYPE_FLOAT);
+    node->as.float_num.val = val;
+    node->as.float_num.lit = float_lit(val, 9);
+    return node;
+}
+
+static Node *new_double_node(double val) {
+    Node *node = new_lit_node(ND_DOUBLE, &TYPE_DOUBLE);
+    node->as.double_num.val = val;
+    node->as.double_num.lit = float_lit(val, 17);
+    return node;
+}
+
+static Node *fold_int_binop(Op op, int32_t a, int32_t b) {
+    // 用无符号数计算，得到32位补码回绕的结果，避免C语言中有符号溢出的未定义行为
+    uint32_t ua = (uint32_t)a, ub = (uint32_t)b;
+    switch (op) {
+    case OP_ADD: return new_int_node((int32_t)(ua + ub));
+    case OP_SUB: return new_int_node((int32_t)(ua - ub));
+    case OP_MUL: return new_int_node((int32_t)(ua * ub));
+    case OP_DIV:
+        if (b == 0 || (a == INT32_MIN && b == -1)) return NULL;
+        return new_int_node(a / b);
+    case OP_GT: return new_bool_node(a > b);
+    case OP_LT: return new_bool_node(a < b);
+    case OP_GE: return new_bool_node(a >= b);
+    case OP_LE: return new_bool_node(a <= b);
+    case OP_EQ: return new_bool_node(a == b);
+    case OP_NE: return new_bool_node(a != b);
+    default: return NULL;
+    }
+}
+
+// 浮点数的相等比较在各个后端的语义不同（解释器有误差容忍），因此不折叠==和!=
+#define FOLD_FLOAT_BINOP(NEW, op, a, b) \
+    switch (op) { \
+    case OP_ADD: return NEW((a) + (b)); \
+    case OP_SUB: return NEW((a) - (b)); \
+    case OP_MUL: return NEW((a) * (b)); \
+    case OP_DIV: return NEW((a) / (b)); \
+    case OP_GT: return new_bool_node((a) > (b)); \
+    case OP_LT: return new_bool_node((a) < (b)); \
+    case OP_GE: return new_bool_node((a) >= (b)); \
+    case OP_LE: return new_bool_node((a) <= (b)); \
+    default: return NULL; \
+    }
+
+static Node *fold_float_binop(Op op, float a, float b) {
+    FOLD_FLOAT_BINOP(new_float_node, op, a, b)
+}
+
+static Node *fold_double_binop(Op op, double a, double b) {
+    FOLD_FLOAT_BINOP(new_double_node, op, a, b)
+}
+
+static Node *fold_bool_binop(Op op, bool a, bool b) {
+    switch (op) {
+    case OP_AND: return new_bool_node(a && b);
+    case OP_OR: return new_bool_node(a || b);
+    case OP_EQ: return new_bool_node(a == b);
+    case OP_NE: return new_bool_node(a != b);
+    default: return NULL;
+    }
+}
+
+// 两侧都是字面量时，直接计算结果；无法折叠时返回NULL
+static Node *fold_consts(Op op, Node *left, Node *right) {
+    if (left->kind != right->kind) return NULL;
+    switch (left->kind) {
+    case ND_INT:
+        return fold_int_binop(op, left->as.num.val, right->as.num.val);
+    case ND_FLOAT:
+        return fold_float_binop(op, left->as.float_num.val, right->as.float_num.val);
+    case ND_DOUBLE:
+        return fold_double_binop(op, left->as.double_num.val, right->as.double_num.val);
+    case ND_BOOL:
+        return fold_bool_binop(op, left->as.bul, right->as.bul);
+    default:
+        return NULL;
+    }
+}
+
+// 代数化简：只有一侧是字面量时，尝试消去这个运算；无法化简时返回NULL
+static Node *simplify(Op op, Node *left, Node *right) {
+    switch (op) {
+    case OP_ADD:
+        if (is_int(right, 0)) return left;
+        if (is_int(left, 0)) return right;
+        break;
+    case OP_SUB:
+        if (is_int(right, 0)) return left;
+        break;
+    case OP_MUL:
+        if (is_int(right, 1)) return left;
+        if (is_int(left, 1)) return right;
+        if (is_int(right, 0) && is_pure(left)) return right;
+        if (is_int(left, 0) && is_pure(right)) return left;
+        break;
+    case OP_DIV:
+        if (is_int(right, 1)) return left;
+        break;
+    case OP_AND:
+        if (is_bool(right, true)) return left;
+        if (is_bool(left, true)) return right;
+        if (is_bool(right, false) && is_pure(left)) return right;
+        if (is_bool(left, false)) return left;
+        break;
+    case OP_OR:
+        if (is_bool(right, false)) return left;
+        if (is_bool(left, false)) return right;
+        if (is_bool(right, true) && is_pure(left)) return right;
+        if (is_bool(left, true)) return left;
+        break;
+    default:
+        break;
+    }
+    return NULL;
+}
+
+static Node *fold_binop(Node *expr) {
+    BinOp *bop = &expr->as.bop;
+    if (bop->op != OP_ASN) bop->left = fold(bop->left);
+    bop->right = fold(bop->right);
+    if (bop->op == OP_ASN) return expr;
+    if (is_const(bop->left) && is_const(bop->right)) {
+        Node *res = fold_consts(bop->op, bop->left, bop->right);
+        if (res) return res;
+    }
+    Node *res = simplify(bop->op, bop->left, bop->right);
+    return res ? res : expr;
+}
+
+static Node *fold_neg(Node *expr) {
+    Node *body = fold(expr->as.una.body);
+    expr->as.una.body = body;
+    switch (body->kind) {
+    case ND_INT:
+        return new_int_node((int32_t)(0u - (uint32_t)body->as.num.val));
+    case ND_FLOAT:
+        return new_float_node(-body->as.float_num.val);
+    case ND_DOUBLE:
+        return new_double_node(-body->as.double_num.val);
+    case ND_NEG: // -(-x) => x
+        return body->as.una.body;
+    default:
+        return expr;
+    }
+}
+
+static Node *fold_not(Node *expr) {
+    Node *body = fold(expr->as.una.body);
+    expr->as.una.body = body;
+    if (body->kind == ND_BOOL) return new_bool_node(!body->as.bul);
+    if (body->kind == ND_NOT) return body->as.una.body; // !!x => x
+    return expr;
+}
+
+// 代码块中是否有声明。有声明的代码块不能展开到外层，否则会改变名称的视野
+static bool has_decl(Node *block) {
+    for (int i = 0; i < block->as.exprs.count; i++) {
+        NodeKind kind = block->as.exprs.list[i]->kind;
+        if (kind == ND_LET || kind == ND_MUT || kind == ND_FN || kind == ND_TYPE || kind == ND_USE) return true;
+    }
+    return false;
+}
+
+// 条件为常量的if语句，返回应当执行的分支；如果没有对应的分支，返回一个空代码块
+static Node *taken_branch(Node *expr) {
+    Node *branch = expr->as.if_else.cond->as.bul ? expr->as.if_else.then : expr->as.if_else.els;
+    return branch ? branch : new_block();
+}
+
+static Node *fold_if(Node *expr) {
+    IfElse *if_else = &expr->as.if_else;
+    if_else->cond = fold(if_else->cond);
+    if_else->then = fold(if_else->then);
+    if (if_else->els) if_else->els = fold(if_else->els);
+    // 单独出现在表达式中的if，只有分支中恰好是一个表达式时才能替换
+    if (if_else->cond->kind == ND_BOOL) {
+        Node *branch = taken_branch(expr);
+        if (branch->as.exprs.count == 1 && !has_decl(branch)) return branch->as.exprs.list[0];
+    }
+    return expr;
+}
+
+// 折叠语句列表，同时把条件为常量的if语句展开到列表中
+static void fold_exprs(Node *parent) {
+    Exprs *exprs = &parent->as.exprs;
+    int count = 0;
+    for (int i = 0; i < exprs->count; i++) {
+        Node *e = exprs->list[i];
+        if (e->kind == ND_IF) {
+            e->as.if_else.cond = fold(e->as.if_else.cond);
+            if (e->as.if_else.cond->kind == ND_BOOL) {
+                Node *branch = fold(taken_branch(e));
+                bool is_last = i == exprs->count - 1;
+                // 最后一句是代码块的值，只有分支不为空时才能展开
+                if (!has_decl(branch) && (!is_last || branch->as.exprs.count > 0)) {
+                    // 展开后列表不会比原来更长的话，可以原地写入；否则需要扩容
+                    int extra = branch->as.exprs.count - 1;
+                    if (extra > 0) {
+                        exprs->cap = exprs->count + extra;
+                        exprs->list = realloc(exprs->list, exprs->cap * sizeof(Node *));
+                        memmove(&exprs->list[i + 1 + extra], &exprs->list[i + 1], (exprs->count - i - 1) * sizeof(Node *));
+                        exprs->count += extra;
+                        i += extra;
+                    }
+                    for (int j = 0; j < branch->as.exprs.count; j++) {
+                        exprs->list[count++] = branch->as.exprs.list[j];
+                    }
+                    continue;
+                }
+            }
+        }
+        exprs->list[count++] = fold(e);
+    }
+    exprs->count = count;
+}
+
+static Node *fold(Node *expr) {
+    if (expr == NULL) return NULL;
+    switch (expr->kind) {
+    case ND_PROG:
+    case ND_BLOCK:
+        fold_exprs(expr);
+        return expr;
+    case ND_BINOP:
+        return fold_binop(expr);
+    case ND_NEG:
+        return fold_neg(expr);
+    case ND_NOT:
+        return fold_not(expr);
+    case ND_IF:
+        return fold_if(expr);
+    case ND_FOR:
+        expr->as.loop.cond = fold(expr->as.loop.cond);
+        expr->as.loop.body = fold(expr->as.loop.body);
+        return expr;
+    case ND_LET:
+    case ND_MUT:
+        expr->as.asn.value = fold(expr->as.asn.value);
+        return expr;
+    case ND_FN:
+        expr->as.fn.body = fold(expr->as.fn.body);
+        return expr;
+    case ND_CALL:
+        for (int i = 0; i < expr->as.call.argc; i++) {
+            expr->as.call.args[i] = fold(expr->as.call.args[i]);
+        }
+        return expr;
+    case ND_ARRAY:
+        for (int i = 0; i < expr->as.array.size; i++) {
+            expr->as.array.items[i] = fold(expr->as.array.items[i]);
+        }
+        return expr;
+    case ND_INDEX:
+        expr->as.index.idx = fold(expr->as.index.idx);
+        return expr;
+    case ND_DICT: {
+        HashIter *i = hash_iter(expr->as.dict.entries);
+        while (hash_next(expr->as.dict.entries, i)) {
+            Node *kv = (Node*)i->value;
+            kv->as.kv.val = fold(kv->as.kv.val);
+        }
+        return expr;
+    }
+    case ND_OBJ: {
+        // 初值既存放在成员表中，也按槽位存放在fields中，两边都需要更新
+        Type *type = expr->meta->type;
+        HashIter *i = hash_iter(expr->as.obj.members);
+        while (hash_next(expr->as.obj.members, i)) {
+            Node *kv = (Node*)i->value;
+            Node *old = kv->as.kv.val;
+            kv->as.kv.val = fold(old);
+            for (int j = 0; j < type->as.user.field_count; j++) {
+                if (expr->as.obj.fields[j] == old) expr->as.obj.fields[j] = kv->as.kv.val;
+            }
+        }
+        return expr;
+    }
+    default:
+        return expr;
+    }
+}
+
+// 函数内联（Inlining）
+//
+// 函数体只是一个简单表达式的小函数，调用处直接替换成这个表达式，参数换成实参：
+// - `fn add(a int, b int) int { a + b }; add(x, 7)` => `x + 7`
+// - `use mat; mat.add(5, 7)` => `5 + 7`，其他模块中的函数通过mod_lookup找到定义
+// 这样省掉了解释器中绑定参数的开销，也省掉了编译和转译结果中的函数调用，内联的表达式还能继续被折叠。
+//
+// 只内联由字面量、参数和运算组成的函数体，其中不能引用其他名称（在调用处可能看不到）；
+// 实参必须没有副作用，因为内联后它们的求值次数和顺序可能改变；使用多次的参数，实参只能是字面量或名称。
+// 实参的类型还要与参数声明的类型一致，否则内联会绕过调用时的类型检查。
+
+// 可以内联的函数体最多包含的节点数
+#define INLINE_BUDGET 16
+
+static Front *front;
+
+// 函数体中名称引用的第几个参数，不是参数时返回-1
+static int param_index(Node *fn, Node *ident) {
+    if (ident->as.path.len != 1 || ident->meta == NULL) return -1;
+    Params *params = fn->as.fn.params;
+    for (int i = 0; i < params->count; i++) {
+        if (ident->meta->node == params->list[i]) return i;
+    }
+    return -1;
+}
+
+// 检查函数体能否内联，同时统计每个参数用到的次数；返回节点数，不能内联时返回-1
+static int inline_cost(Node *fn, Node *expr, int *uses) {
+    switch (expr->kind) {
+    case ND_INT:
+    case ND_BOOL:
+    case ND_FLOAT:
+    case ND_DOUBLE:
+        return 1;
+    case ND_IDENT: {
+        int i = param_index(fn, expr);
+        if (i < 0) return -1;
+        uses[i]++;
+        return 1;
+    }
+    case ND_NEG:
+    case ND_NOT: {
+        int n = inline_cost(fn, expr->as.una.body, uses);
+        return n < 0 ? -1 : n + 1;
+    }
+    case ND_BINOP: {
+        if (expr->as.bop.op == OP_ASN) return -1;
+        int l = inline_cost(fn, expr->as.bop.left, uses);
+        int r = inline_cost(fn, expr->as.bop.right, uses);
+        return l < 0 || r < 0 ? -1 : l + r + 1;
+    }
+    default:
+        return -1;
+    }
+}
+
+static bool is_compare(Op op) {
+    return op == OP_GT || op == OP_LT || op == OP_GE || op == OP_LE || op == OP_EQ || op == OP_NE;
+}
+
+static bool is_trivial(Node *expr) {
+    return is_const(expr) || (expr->kind == ND_IDENT && expr->as.path.len == 1);
+}
+
+// 复制函数体，把参数替换成实参。
+// 复制出来的节点都记为调用处的位置：函数可能在其他模块中，它的位置不能按当前模块的源码换算行列
+static Node *substitute(Node *fn, Node *expr, Node **args, uint32_t loc) {
+    switch (expr->kind) {
+    case ND_IDENT:
+        return args[param_index(fn, expr)];
+    case ND_NEG:
+    case ND_NOT: {
+        Node *node = new_node(expr->kind);
+        node->loc = loc;
+        node->as.una.op = expr->as.una.op;
+        node->as.una.body = substitute(fn, expr->as.una.body, args, loc);
+        node->meta->type = expr->meta->type ? expr->meta->type : node->as.una.body->meta->type;
+        return node;
+    }
+    case ND_BINOP: {
+        Node *node = new_node(ND_BINOP);
+        node->loc = loc;
+        node->as.bop.op = expr->as.bop.op;
+        node->as.bop.left = substitute(fn, expr->as.bop.left, args, loc);
+        node->as.bop.right = substitute(fn, expr->as.bop.right, args, loc);
+        // 参数没有标注类型时，和解析器一样由左侧的类型推导
+        const Type *type = expr->meta->type;
+        if (type == NULL) type = is_compare(expr->as.bop.op) ? &TYPE_BOOL : node->as.bop.left->meta->type;
+        node->meta->type = (Type*)type;
+        return node;
+    }
+    default: {
+        // 字面量也要复制，不能和函数体共用，否则位置不对
+        Node *node = new_node(expr->kind);
+        node->loc = loc;
+        node->as = expr->as;
+        node->meta->type = expr->meta->type;
+        return node;
+    }
+    }
+}
+
+// 调用的函数定义：同一模块中的函数直接从名称的元信息取得，其他模块中的函数通过mod_lookup查找
+static Node *callee(Node *call) {
+    Node *name = call->as.call.name;
+    if (name->kind != ND_IDENT) return NULL;
+    Meta *m = name->as.path.len > 1 ? mod_lookup(front, name) : name->meta;
+    if (m == NULL || m->kind != ND_FN || !m->is_def || m->node == NULL) return NULL;
+    Node *fn = m->node;
+    if (fn->as.fn.type == NULL || fn->as.fn.type->as.fn.is_method) return NULL;
+    return fn;
+}
+
+// 实参的类型与参数声明的类型一致。不一致的调用不内联，留给解释器在调用时报告类型错误（见interp.c中的check_arg）
+static bool arg_matches(Node *param, Node *arg) {
+    Type *type = param->meta->type;
+    if (type == NULL) return true;
+    Type *t = arg->meta ? arg->meta->type : NULL;
+    return t && t->kind == type->kind;
+}
+
+static Node *inline_call(Node *call) {
+    Node *fn = callee(call);
+    if (fn == NULL) return call;
+    Params *params = fn->as.fn.params;
+    Node *body = fn->as.fn.body;
+    if (params->count != call->as.call.argc || body == NULL || body->as.exprs.count != 1) return call;
+    int uses[params->count + 1];
+    memset(uses, 0, sizeof(uses));
+    int cost = inline_cost(fn, body->as.exprs.list[0], uses);
+    if (cost < 0 || cost > INLINE_BUDGET) return call;
+    for (int i = 0; i < params->count; i++) {
+        Node *arg = call->as.call.args[i];
+        if (!is_pure(arg) || (uses[i] > 1 && !is_trivial(arg))) return call;
+        if (!arg_matches(params->list[i], arg)) return call;
+    }
+    Node *res = substitute(fn, body->as.exprs.list[0], call->as.call.args, call->loc);
+    if (res->meta->type == NULL) res->meta->type = call->meta->type;
+    return res;
+}
+
+static Node *inline_calls(Node *expr) {
+    if (expr == NULL) return NULL;
+    switch (expr->kind) {
+    case ND_PROG:
+    case ND_BLOCK:
+        for (int i = 0; i < expr->as.exprs.count; i++) {
+            expr->as.exprs.list[i] = inline_calls(expr->as.exprs.list[i]);
+        }
+        return expr;
+    case ND_CALL:
+        for (int i = 0; i < expr->as.call.argc; i++) {
+            expr->as.call.args[i] = inline_calls(expr->as.call.args[i]);
+        }
+        return inline_call(expr);
+    case ND_BINOP:
+        expr->as.bop.left = inline_calls(expr->as.bop.left);
+        expr->as.bop.right = inline_calls(expr->as.bop.right);
+        return expr;
+    case ND_NEG:
+    case ND_NOT:
+        expr->as.una.body = inline_calls(expr->as.una.body);
+        return expr;
+    case ND_IF:
+        expr->as.if_else.cond = inline_calls(expr->as.if_else.cond);
+        expr->as.if_else.then = inline_calls(expr->as.if_else.then);
+        expr->as.if_else.els = inline_calls(expr->as.if_else.els);
+        return expr;
+    case ND_FOR:
+        expr->as.loop.cond = inline_calls(expr->as.loop.cond);
+        expr->as.loop.body = inline_calls(expr->as.loop.body);
+        return expr;
+    case ND_LET:
+    case ND_MUT:
+        expr->as.asn.value = inline_calls(expr->as.asn.value);
+        return expr;
+    case ND_FN:
+        expr->as.fn.body = inline_calls(expr->as.fn.body);
+        return expr;
+    case ND_ARRAY:
+        for (int i = 0; i < expr->as.array.size; i++) {
+            expr->as.array.items[i] = inline_calls(expr->as.array.items[i]);
+        }
+        return expr;
+    case ND_INDEX:
+        expr->as.index.idx = inline_calls(expr->as.index.idx);
+        return expr;
+    default:
+        return expr;
+    }
+}
+
+// 循环不变量外提（Loop-Invariant Code Motion）与强度削弱（Strength Reduction）
+//
+// 每个后端都会在每轮循环中重新计算条件和循环体中的所有表达式，其中不随循环变化的子表达式可以提到循环之前，只算一次：
+// - `for i < n - 1 { s = s + a * b; i = i + 1 }`
+//   => `let _inv0 = n - 1; let _inv1 = a * b; for i < _inv0 { s = s + _inv1; i = i + 1 }`
+// 归纳变量（循环体中只以`i = i + c`的形式改变的存量）与不变量的乘法，改成随归纳变量一起递增的加法：
+// - `for i < n { s = s + i * 4; i = i + 1 }`
+//   => `mut _sr0 = i * 4; for i < n { s = s + _sr0; i = i + 1; _sr0 = _sr0 + 4 }`
+//
+// 循环一次都不执行时，外提的表达式也会被求值，所以只外提不会出错的数值运算（整数除法可能除以0，不外提）。
+// 自定义函数可能改写循环外的存量，因此调用了自定义函数的循环不做变换。
+
+typedef struct LoopVar LoopVar;
+typedef struct Reduced Reduced;
+typedef struct Loop Loop;
+
+// 循环中被改变的存量
+struct LoopVar {
+    Meta *meta;
+    int writes; // 在循环中被赋值的次数
+    int steps; // 其中循环体中`v = v + c`形式的语句数，与writes相等时v是归纳变量
+    bool declared; // 在循环中声明，每轮都是新的存量
+};
+
+// 强度削弱后的乘法`iv * k`，由存量var代替
+struct Reduced {
+    Meta *iv;
+    Node *k; // 整数字面量或者不变的存量
+    Meta *var;
+};
+
+#define MAX_REDUCED 8
+
+struct Loop {
+    LoopVar *vars;
+    int var_count;
+    int var_cap;
+    bool has_call; // 调用了自定义函数，或者包含无法分析的代码
+    Reduced reds[MAX_REDUCED];
+    int red_count;
+    Node *pre; // 要插入到循环之前的声明
+};
+
+static int tmp_count = 0; // 新存量的编号，保证名称不重复
+
+static LoopVar *find_var(Loop *loop, Meta *m) {
+    for (int i = 0; i < loop->var_count; i++) {
+        if (loop->vars[i].meta == m) return &loop->vars[i];
+    }
+    return NULL;
+}
+
+static void write_var(Loop *loop, Meta *m, bool declared) {
+    if (m == NULL) return;
+    LoopVar *v = find_var(loop, m);
+    if (v == NULL) {
+        if (loop->var_count >= loop->var_cap) {
+            loop->var_cap = loop->var_cap ? loop->var_cap * 2 : 8;
+            loop->vars = realloc(loop->vars, loop->var_cap * sizeof(LoopVar));
+        }
+        v = &loop->vars[loop->var_count++];
+        memset(v, 0, sizeof(LoopVar));
+        v->meta = m;
+    }
+    v->writes++;
+    if (declared) v->declared = true;
+}
+
+// 收集循环中被改变的存量
+static void scan(Loop *loop, Node *expr) {
+    if (expr == NULL) return;
+    switch (expr->kind) {
+    case ND_BLOCK:
+        for (int i = 0; i < expr->as.exprs.count; i++) scan(loop, expr->as.exprs.list[i]);
+        break;
+    case ND_LET:
+    case ND_MUT:
+        write_var(loop, expr->as.asn.name->meta, true);
+        scan(loop, expr->as.asn.value);
+        break;
+    case ND_BINOP: {
+        Node *left = expr->as.bop.left;
+        if (expr->as.bop.op == OP_ASN) {
+            // 给数组元素赋值，整个数组都视为被改变
+            Node *target = left->kind == ND_INDEX ? left->as.index.parent : left;
+            write_var(loop, target->meta, false);
+        }
+        scan(loop, left);
+        scan(loop, expr->as.bop.right);
+        break;
+    }
+    case ND_NEG:
+    case ND_NOT:
+        scan(loop, expr->as.una.body);
+        break;
+    case ND_IF:
+        scan(loop, expr->as.if_else.cond);
+        scan(loop, expr->as.if_else.then);
+        scan(loop, expr->as.if_else.els);
+        break;
+    case ND_FOR:
+        scan(loop, expr->as.loop.cond);
+        scan(loop, expr->as.loop.body);
+        break;
+    case ND_CALL: {
+        // 内置函数不会改写Z的存量；自定义函数、方法和其他模块中的函数都可能改写
+        Node *name = expr->as.call.name;
+        if (name->meta == NULL || name->meta->is_def || name->as.path.len > 1) loop->has_call = true;
+        for (int i = 0; i < expr->as.call.argc; i++) scan(loop, expr->as.call.args[i]);
+        break;
+    }
+    case ND_INDEX:
+        scan(loop, expr->as.index.parent);
+        scan(loop, expr->as.index.idx);
+        break;
+    case ND_ARRAY:
+        for (int i = 0; i < expr->as.array.size; i++) scan(loop, expr->as.array.items[i]);
+        break;
+    case ND_INT:
+    case ND_BOOL:
+    case ND_FLOAT:
+    case ND_DOUBLE:
+    case ND_STR:
+    case ND_IDENT:
+    case ND_LNAME:
+        break;
+    default:
+        loop->has_call = true;
+        break;
+    }
+}
+
+// 语句是`v = v + c`或`v = v - c`时返回v，并把每次增加的量写入step
+static Meta *induct_step(Node *stmt, int32_t *step) {
+    if (stmt->kind != ND_BINOP || stmt->as.bop.op != OP_ASN) return NULL;
+    Node *left = stmt->as.bop.left, *right = stmt->as.bop.right;
+    if ((left->kind != ND_LNAME && left->kind != ND_IDENT) || left->as.path.len != 1) return NULL;
+    if (right->kind != ND_BINOP || (right->as.bop.op != OP_ADD && right->as.bop.op != OP_SUB)) return NULL;
+    Node *base = right->as.bop.left, *inc = right->as.bop.right;
+    if (base->kind != ND_IDENT || base->meta != left->meta || inc->kind != ND_INT) return NULL;
+    uint32_t c = (uint32_t)inc->as.num.val;
+    *step = (int32_t)(right->as.bop.op == OP_ADD ? c : 0u - c);
+    return left->meta;
+}
+
+static bool is_type(Node *expr, TypeKind kind) {
+    return expr->meta && expr->meta->type && expr->meta->type->kind == kind;
+}
+
+static bool is_scalar(Node *expr) {
+    return is_type(expr, TY_INT) || is_type(expr, TY_BOOL) || is_type(expr, TY_FLOAT) || is_type(expr, TY_DOUBLE);
+}
+
+static bool is_induct(Loop *loop, Meta *m) {
+    LoopVar *v = find_var(loop, m);
+    return v && !v->declared && v->writes == v->steps && m->type == &TYPE_INT;
+}
+
+// 表达式在循环中是否不变，并且求值不会出错
+static bool is_invariant(Loop *loop, Node *expr) {
+    switch (expr->kind) {
+    case ND_INT:
+    case ND_BOOL:
+    case ND_FLOAT:
+    case ND_DOUBLE:
+        return true;
+    case ND_IDENT:
+        return expr->as.path.len == 1 && expr->meta && !expr->meta->is_field && find_var(loop, expr->meta) == NULL;
+    case ND_NEG:
+    case ND_NOT:
+        return is_invariant(loop, expr->as.una.body);
+    case ND_BINOP:
+        if (expr->as.bop.op == OP_ASN) return false;
+        if (expr->as.bop.op == OP_DIV && !is_type(expr, TY_FLOAT) && !is_type(expr, TY_DOUBLE)) return false;
+        return is_invariant(loop, expr->as.bop.left) && is_invariant(loop, expr->as.bop.right);
+    default:
+        return false;
+    }
+}
+
+// 在循环之前声明一个新的存量，初值为value
+static Meta *declare(Loop *loop, NodeKind kind, char *prefix, Node *value) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%s%d", prefix, tmp_count++);
+    Node *name = new_node(ND_IDENT);
+    name->as.path.names[0].name = strdup(buf);
+    name->as.path.len = 1;
+    name->meta->type = value->meta->type;
+    Node *decl = new_node(kind);
+    decl->as.asn.name = name;
+    decl->as.asn.value = value;
+    append_expr(loop->pre, decl);
+    return name->meta;
+}
+
+// 引用存量m，m是声明时的元信息，m->node是声明中的名称
+static Node *use_var(Meta *m, NodeKind kind) {
+    Node *node = new_node(kind);
+    node->as.path.names[0].name = m->node->as.path.names[0].name;
+    node->as.path.len = 1;
+    node->meta = m;
+    return node;
+}
+
+static Node *new_binop(Op op, Node *left, Node *right) {
+    Node *node = new_node(ND_BINOP);
+    node->as.bop.op = op;
+    node->as.bop.left = left;
+    node->as.bop.right = right;
+    node->meta->type = left->meta->type;
+    return node;
+}
+
+// 乘数k是整数字面量，或者不变的int存量
+static bool is_factor(Loop *loop, Node *k) {
+    return k->kind == ND_INT || (k->kind == ND_IDENT && is_type(k, TY_INT) && is_invariant(loop, k));
+}
+
+static bool same_factor(Node *x, Node *y) {
+    if (x->kind != y->kind) return false;
+    return x->kind == ND_INT ? x->as.num.val == y->as.num.val : x->meta == y->meta;
+}
+
+// `iv * k`或`k * iv`替换成随iv递增的存量
+static Node *reduce_mul(Loop *loop, Node *expr) {
+    if (expr->as.bop.op != OP_MUL || !is_type(expr, TY_INT)) return expr;
+    Node *iv = expr->as.bop.left, *k = expr->as.bop.right;
+    if (iv->kind != ND_IDENT || !is_induct(loop, iv->meta)) {
+        Node *t = iv;
+        iv = k;
+        k = t;
+    }
+    if (iv->kind != ND_IDENT || !is_induct(loop, iv->meta) || !is_factor(loop, k)) return expr;
+    for (int i = 0; i < loop->red_count; i++) {
+        Reduced *r = &loop->reds[i];
+        if (r->iv == iv->meta && same_factor(r->k, k)) return use_var(r->var, ND_IDENT);
+    }
+    if (loop->red_count >= MAX_REDUCED) return expr;
+    Reduced *r = &loop->reds[loop->red_count++];
+    r->iv = iv->meta;
+    r->k = k;
+    r->var = declare(loop, ND_MUT, "_sr", expr);
+    return use_var(r->var, ND_IDENT);
+}
+
+// 自顶向下替换不变的表达式，自底向上做强度削弱
+static Node *transform(Loop *loop, Node *expr) {
+    if (expr == NULL) return NULL;
+    bool is_op = expr->kind == ND_BINOP || expr->kind == ND_NEG || expr->kind == ND_NOT;
+    if (is_op && is_scalar(expr) && is_invariant(loop, expr)) {
+        return use_var(declare(loop, ND_LET, "_inv", expr), ND_IDENT);
+    }
+    switch (expr->kind) {
+    case ND_BLOCK:
+        for (int i = 0; i < expr->as.exprs.count; i++) {
+            expr->as.exprs.list[i] = transform(loop, expr->as.exprs.list[i]);
+        }
+        break;
+    case ND_LET:
+    case ND_MUT:
+        expr->as.asn.value = transform(loop, expr->as.asn.value);
+        break;
+    case ND_BINOP: {
+        Node *left = expr->as.bop.left;
+        if (expr->as.bop.op != OP_ASN) {
+            expr->as.bop.left = transform(loop, left);
+        } else if (left->kind == ND_INDEX) {
+            left->as.index.idx = transform(loop, left->as.index.idx);
+        }
+        expr->as.bop.right = transform(loop, expr->as.bop.right);
+        return reduce_mul(loop, expr);
+    }
+    case ND_NEG:
+    case ND_NOT:
+        expr->as.una.body = transform(loop, expr->as.una.body);
+        break;
+    case ND_IF:
+        expr->as.if_else.cond = transform(loop, expr->as.if_else.cond);
+        expr->as.if_else.then = transform(loop, expr->as.if_else.then);
+        expr->as.if_else.els = transform(loop, expr->as.if_else.els);
+        break;
+    case ND_FOR:
+        expr->as.loop.cond = transform(loop, expr->as.loop.cond);
+        expr->as.loop.body = transform(loop, expr->as.loop.body);
+        break;
+    case ND_CALL:
+        for (int i = 0; i < expr->as.call.argc; i++) {
+            expr->as.call.args[i] = transform(loop, expr->as.call.args[i]);
+        }
+        break;
+    case ND_INDEX:
+        expr->as.index.idx = transform(loop, expr->as.index.idx);
+        break;
+    case ND_ARRAY:
+        for (int i = 0; i < expr->as.array.size; i++) {
+            expr->as.array.items[i] = transform(loop, expr->as.array.items[i]);
+        }
+        break;
+    default:
+        break;
+    }
+    return expr;
+}
+
+// 把block中的语句插入到parent的第at条语句之前
+static void insert_exprs(Node *parent, int at, Node *block) {
+    Exprs *exprs = &parent->as.exprs;
+    int n = block->as.exprs.count;
+    if (exprs->count + n > exprs->cap) {
+        exprs->cap = exprs->count + n;
+        exprs->list = realloc(exprs->list, exprs->cap * sizeof(Node *));
+    }
+    memmove(&exprs->list[at + n], &exprs->list[at], (exprs->count - at) * sizeof(Node *));
+    memcpy(&exprs->list[at], block->as.exprs.list, n * sizeof(Node *));
+    exprs->count += n;
+}
+
+// 在归纳变量的每条`iv = iv + c`之后，把替代`iv * k`的存量加上c * k
+static void update_reduced(Loop *loop, Node *body) {
+    for (int i = 0; i < body->as.exprs.count; i++) {
+        int32_t step;
+        Meta *iv = induct_step(body->as.exprs.list[i], &step);
+        if (iv == NULL) continue;
+        Node *updates = new_block();
+        for (int j = 0; j < loop->red_count; j++) {
+            Reduced *r = &loop->reds[j];
+            if (r->iv != iv) continue;
+            Node *inc;
+            if (r->k->kind == ND_INT) {
+                inc = new_int_node((int32_t)((uint32_t)step * (uint32_t)r->k->as.num.val));
+            } else if (step == 1) {
+                inc = use_var(r->k->meta, ND_IDENT);
+            } else {
+                Node *prod = new_binop(OP_MUL, new_int_node(step), use_var(r->k->meta, ND_IDENT));
+                inc = use_var(declare(loop, ND_LET, "_inv", prod), ND_IDENT);
+            }
+            Node *sum = new_binop(OP_ADD, use_var(r->var, ND_IDENT), inc);
+            append_expr(updates, new_binop(OP_ASN, use_var(r->var, ND_LNAME), sum));
+        }
+        insert_exprs(body, i + 1, updates);
+        i += updates->as.exprs.count;
+    }
+}
+
+static void hoist_exprs(Node *parent);
+
+static void hoist_in(Node *expr) {
+    if (expr == NULL) return;
+    switch (expr->kind) {
+    case ND_PROG:
+    case ND_BLOCK:
+        hoist_exprs(expr);
+        break;
+    case ND_FN:
+        hoist_in(expr->as.fn.body);
+        break;
+    case ND_IF:
+        hoist_in(expr->as.if_else.then);
+        hoist_in(expr->as.if_else.els);
+        break;
+    case ND_FOR:
+        hoist_in(expr->as.loop.body);
+        break;
+    case ND_LET:
+    case ND_MUT:
+        hoist_in(expr->as.asn.value);
+        break;
+    default:
+        break;
+    }
+}
+
+// 变换一个for循环，返回需要插入到循环之前的声明
+static Node *hoist_loop(Node *expr) {
+    // 先处理内层的循环，它们外提的声明成为外层循环体中的语句
+    hoist_in(expr->as.loop.body);
+    Loop loop = {0};
+    loop.pre = new_block();
+    Node *body = expr->as.loop.body;
+    scan(&loop, expr->as.loop.cond);
+    scan(&loop, body);
+    if (!loop.has_call) {
+        for (int i = 0; i < body->as.exprs.count; i++) {
+            int32_t step;
+            Meta *iv = induct_step(body->as.exprs.list[i], &step);
+            LoopVar *v = iv ? find_var(&loop, iv) : NULL;
+            if (v) v->steps++;
+        }
+        expr->as.loop.cond = transform(&loop, expr->as.loop.cond);
+        transform(&loop, body);
+        update_reduced(&loop, body);
+    }
+    free(loop.vars);
+    return loop.pre;
+}
+
+static void hoist_exprs(Node *parent) {
+    Exprs *exprs = &parent->as.exprs;
+    for (int i = 0; i < exprs->count; i++) {
+        Node *e = exprs->list[i];
+        if (e->kind != ND_FOR) {
+            hoist_in(e);
+            continue;
+        }
+        Node *pre = hoist_loop(e);
+        insert_exprs(parent, i, pre);
+        i += pre->as.exprs.count;
+    }
+}
+
+void optimize(Front *f, Node *prog) {
+    if (prog == NULL) return;
+    front = f;
+    // 先内联，内联进来的表达式再参与折叠和循环的优化
+    if (OPT.inlining) inline_calls(prog);
+    if (OPT.fold) fold(prog);
+    if (OPT.licm) hoist_in(prog);
+}
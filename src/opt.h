@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdbool.h>
+#include "zast.h"
+#include "front.h"
+
+typedef struct OptConfig OptConfig;
+
+// 优化选项，由命令行参数设置
+struct OptConfig {
+    bool fold; // 常量折叠与代数化简
+    bool inlining; // 把小函数内联到调用处，`-fno-inline`单独关闭
+    bool licm; // 循环不变量外提与强度削弱
+    bool ir; // 原生编译器在IR上的优化：常量与复制传播、公共子表达式消除、死代码消除
+    bool peep; // 原生编译器在指令列表上的窥孔优化
+    bool vec; // 原生编译器把数组上的简单计数循环向量化
+    bool jit; // 解释器把频繁执行的函数和循环即时编译成机器码
+    bool unity; // C转译器把所有模块输出到一个文件中，`-funity`开启
+    bool numpy; // Python转译器用NumPy实现数值数组和数组上的循环，`-fnumpy`开启
+    bool source_map; // JS和Python转译器输出源码映射（见srcmap.h），`-fsourcemap`开启
+};
+
+extern OptConfig OPT;
+
+// 根据命令行参数设置优化选项，如`-O0`关闭所有优化，`-fno-inline`只关闭内联，`-funity`开启单文件输出，`-fnumpy`开启NumPy输出，`-fsourcemap`开启源码映射。
+// 返回true表示arg是一个优化选项
+bool set_opt(const char *arg);
+
+// 对AST进行优化。优化发生在解析之后、各个后端之前，因此解释器、编译器和转译器都能受益。
+// front用来查找其他模块中的函数定义，以便跨模块内联
+void optimize(Front *front, Node *prog);
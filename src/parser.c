@@ -20,6 +20,12 @@ static void advance(Parser *parser) {
     parser->next = next_token(parser->lexer);
 }
 
+// 记下节点在源码中的位置。已经有位置的节点（如括号中的表达式）保留原来的位置
+static void set_loc(Parser *parser, Node *node, Token *tok) {
+    if (node->loc > 0) return;
+    node->loc = tok->pos - parser->code + 1;
+}
+
 static bool match(Parser *parser, TokenKind kind) {
     return parser->cur->kind == kind;
 }
@@ -36,7 +42,13 @@ static bool skip_empty_line(Parser *parser) {
 // 检查当前词符是否为kind，如果是，就跳过它，否则就报错
 static void expect(Parser *parser, TokenKind kind) {
     if (parser->cur->kind != kind) {
-        printf("Expected %s, but got %s\n", token_to_str(kind), token_to_str(parser->cur->kind));
+        printf("Expected %s, but got %s", token_to_str(kind), token_to_str(parser->cur->kind));
+        if (parser->source) {
+            int line, col;
+            source_locate(parser->source, parser->cur->pos - parser->code + 1, &line, &col);
+            printf(" at %s:%d:%d", parser->source->name, line, col);
+        }
+        printf("\n");
         exit(1);
     }
     advance(parser);
@@ -70,17 +82,18 @@ typedef struct {
 
 #define MAX_ARGS 4
 
-ArgBuf *arg_buf;
-
+// 解析实参列表。每次调用都用新的缓冲区，因为实参中可能还有嵌套的调用，如`f(g(1), 2)`
 static ArgBuf *args(Parser *parser) {
-    if (arg_buf == NULL) {
-        arg_buf = malloc(sizeof(ArgBuf) + MAX_ARGS * sizeof(Node *));
-    }
-    ArgBuf *buf = arg_buf;
+    ArgBuf *buf = malloc(sizeof(ArgBuf) + MAX_ARGS * sizeof(Node *));
     buf->count = 0;
     buf->cap = MAX_ARGS;
     while (parser->cur->kind != TK_RPAREN) {
-        buf->data[buf->count++] = expression(parser);
+        Node *arg = expression(parser);
+        if (buf->count == buf->cap) {
+            buf->cap *= 2;
+            buf = realloc(buf, sizeof(ArgBuf) + buf->cap * sizeof(Node *));
+        }
+        buf->data[buf->count++] = arg;
         if (parser->cur->kind == TK_COMMA) {
         advance(parser);
         }
@@ -191,6 +204,26 @@ static Node *ident(Parser *parser) {
         exit(1);
     }
     node->meta = m;
+    // 标注名称的种类，方便后端区分模块成员、对象字段和方法
+    Name *names = node->as.path.names;
+    if (node->as.path.len == 1 && m->kind == ND_FN) {
+        // 方法体中直接调用的方法，是对接收者的调用
+        Meta *self = scope_lookup(parser->scope, "self");
+        if (self && self->type && hash_get(self->type->as.user.members, names[0].name) == m) {
+            names[1].name = names[0].name;
+            names[1].kind = NM_FN;
+            names[0].name = "self";
+            node->as.path.len = 2;
+            return node;
+        }
+    }
+    if (node->as.path.len == 1) {
+        if (m->is_field) names[0].kind = NM_MEMB; // 方法体中直接访问的字段
+    } else if (find_mod(parser->front, names[0].name) != NULL) {
+        names[0].kind = NM_MOD;
+    } else {
+        names[1].kind = m->kind == ND_FN ? NM_FN : NM_MEMB;
+    }
     return node;
 }
 
@@ -200,11 +233,13 @@ static Node *call(Parser *parser, Node *left) {
     expect(parser, TK_RPAREN);
     Node *node = malloc(sizeof(Node) + buf->count * sizeof(Node *));
     node->kind = ND_CALL;
+    node->loc = left->loc;
     node->as.call.name = left;
     node->as.call.argc = buf->count;
     for (int i = 0; i < buf->count; i++) {
         node->as.call.args[i] = buf->data[i];
     }
+    free(buf);
     Node *name = node->as.call.name;
     if (name->kind == ND_IDENT) {
         Meta *m = ident_lookup(parser, name);
@@ -394,6 +429,12 @@ static Node *symbol_def(Parser *parser, NodeKind kind) {
     if (type == NULL && value_node->meta) { // 如果没有指定类型，就尝试用右侧值的类型来推导
         type = value_node->meta->type;
     }
+    if (type == NULL && value_node->kind == ND_CALL) { // 调用自定义函数的值，类型是函数的返回类型
+        Meta *fm = value_node->meta;
+        if (fm && fm->kind == ND_FN && fm->is_def && fm->node->as.fn.type) {
+            type = fm->node->as.fn.type->as.fn.ret;
+        }
+    }
 
     // 收集元信息
     Meta *m = do_meta(parser, store_name);
@@ -608,7 +649,7 @@ static Params *params(Parser *parser) {
     Params *p = calloc(1, sizeof(Params));
     p->count = 0;
     p->cap = 4;
-    p->list = calloc(1, sizeof(Node *));
+    p->list = calloc(p->cap, sizeof(Node *));
     while (parser->cur->kind != TK_RPAREN) {
         Node *pname = new_node(ND_IDENT);
         pname->as.path.names[0].name = get_text(parser);
@@ -640,6 +681,18 @@ static char *get_class_name(Node *fname) {
 static void enter_method_scope(Parser *parser, Type *class_type) {
     Scope *scope = new_scope(parser->scope);
     scope_set(scope, "self", new_type_meta(class_type));
+    // 方法体中也可以直接调用同一类型的其他方法（包括自己），解析时改写为`self.method()`，见ident()
+    HashIter *it = hash_iter(class_type->as.user.members);
+    while (hash_next(class_type->as.user.members, it)) {
+        Meta *mm = it->value;
+        if (mm->kind == ND_FN) hash_set(scope->as.block->table, it->key, mm);
+    }
+    // 方法体中可以直接访问接收者的字段。
+    // 注意：这里不能用scope_set，否则会改写字段Meta中的槽位信息
+    for (int i = 0; i < class_type->as.user.field_count; i++) {
+        Meta *fm = class_type->as.user.fields[i];
+        hash_set(scope->as.block->table, fm->name, fm);
+    }
 
     parser->scope = scope;
 }
@@ -652,14 +705,26 @@ static Node *fn(Parser *parser) {
     Node *expr = new_node(ND_FN);
     expr->as.fn.name = get_full_name(fname);
     expr->as.fn.fname = fname;
+    // 先登记函数名称，这样函数体中可以递归调用自己
+    Meta *m = do_meta(parser, expr);
+    m->is_def = true;
     // 处理函数类型
     Type *fn_type = calloc(1, sizeof(Type));
     fn_type->kind = TY_FN;
+    Type *class_type = NULL;
     if (is_meth) {
         fn_type->as.fn.is_method = true;
         char *class_name = get_class_name(fname);
-        fn_type->as.fn.class = type_lookup(parser, class_name);
-        enter_method_scope(parser, fn_type);
+        Meta *cm = scope_lookup(parser->scope, class_name);
+        if (cm == NULL || cm->type == NULL || cm->type->kind != TY_USER) {
+            printf("Error: Unknown type for method: %s\n", expr->as.fn.name);
+            exit(1);
+        }
+        class_type = cm->type;
+        fn_type->as.fn.class = class_type;
+        // 先登记到类型的成员表中，以便通过`obj.method()`调用，方法体中也可以递归调用自己
+        hash_set(class_type->as.user.members, fname->as.path.names[1].name, m);
+        enter_method_scope(parser, class_type);
     } else {
         enter_scope(parser);
     }
@@ -667,10 +732,10 @@ static Node *fn(Parser *parser) {
     Params *p = params(parser);
     expr->as.fn.params = p;
     expect(parser, TK_RPAREN);
-    // 在视野中设置参数名称
+    // 在视野中设置参数名称。函数体中的引用和参数共用同一个元信息，这样引用处也知道参数的类型
     for (int i = 0; i < p->count; i++) {
         Node *param = p->list[i];
-        scope_set(parser->scope, get_full_name(param), new_meta(param));
+        scope_set(parser->scope, get_full_name(param), param->meta);
     }
     fn_type->as.fn.param_count = p->count;
     fn_type->as.fn.params = calloc(p->count, sizeof(Type *));
@@ -685,6 +750,7 @@ static Node *fn(Parser *parser) {
     } else {
         fn_type->as.fn.ret = &TYPE_INT; // 暂时默认返回类型是int，未来需要改为void
     }
+    expr->as.fn.type = fn_type;
     // 函数体
     expr->as.fn.body = block(parser);
     // 注意：函数体需要处理返回值
@@ -692,8 +758,6 @@ static Node *fn(Parser *parser) {
     body_meta->need_return = true;
     expr->as.fn.body->meta = body_meta;
     exit_scope(parser);
-    Meta *m = do_meta(parser, expr);
-    m->is_def = true;
     return expr;
 }
 
@@ -757,12 +821,27 @@ static Node *type(Parser *parser) {
     // 创建编译器中的UserType
     Type *tp = new_user_type(tname);
     tp->as.user.members = new_hash_table();
+    tp->as.user.field_count = fs->size;
+    tp->as.user.fields = calloc(fs->size, sizeof(Meta *));
+    // 计算对象的布局：每个字段按声明顺序占一个槽位，并按其类型对齐
+    int offset = 0;
+    int max_align = 1;
     for (int i = 0; i < fs->size; i++) {
         Node *field = fs->items[i];
         char *fname = get_name(field);
-        // Type *ftype = field->meta->type;
-        hash_set(tp->as.user.members, fname, field->meta);
+        Meta *fm = field->meta;
+        int align = type_align(fm->type);
+        if (align > max_align) max_align = align;
+        offset = (offset + align - 1) / align * align;
+        fm->is_field = true;
+        fm->seq = i;
+        fm->offset = offset;
+        fm->name = fname;
+        offset += type_size(fm->type);
+        tp->as.user.fields[i] = fm;
+        hash_set(tp->as.user.members, fname, fm);
     }
+    tp->as.user.size = (offset + max_align - 1) / max_align * max_align;
     Meta *tmeta = new_meta(type_decl);
     type_decl->meta = tmeta;
     tmeta->type = tp;
@@ -874,6 +953,19 @@ static Node *object(Parser *parser, Node *left) {
     Node *dic = dict(parser);
     obj->as.obj.members = dic->as.dict.entries;
     obj->meta = tmeta;
+    // 把各个初值按字段的槽位排好，这样求值时就不需要再查找成员表了
+    Type *type = tmeta->type;
+    obj->as.obj.fields = calloc(type->as.user.field_count, sizeof(Node *));
+    HashIter *i = hash_iter(obj->as.obj.members);
+    while (hash_next(obj->as.obj.members, i)) {
+        Meta *fm = hash_get(type->as.user.members, i->key);
+        if (fm == NULL || !fm->is_field) {
+            printf("Error: Unknown field %s for type %s\n", i->key, n);
+            exit(1);
+        }
+        Node *entry = (Node*)i->value;
+        obj->as.obj.fields[fm->seq] = entry->as.kv.val;
+    }
     return obj;
 }
 
@@ -882,7 +974,9 @@ static bool allow_postfix(NodeKind kind) {
 }
 
 static Node *unary(Parser *parser) {
+    Token *start = parser->cur;
     Node *expr = single(parser);
+    set_loc(parser, expr, start);
     if (!allow_postfix(expr->kind)) {
         return expr;
     }
@@ -906,6 +1000,7 @@ static Node *unary(Parser *parser) {
         default:
             has_more_postfix = false;
         }
+        set_loc(parser, res, start);
     }
     return res;
 }
@@ -1000,6 +1095,7 @@ static Node *binop(Parser *parser, Node *left, Precedence base_prec) {
             return left;
         }
         Node *bop = new_node(ND_BINOP);
+        bop->loc = left->loc;
         Op op = get_op(cur->kind);
         bop->as.bop.op = op;
         if (op == OP_ASN && left->kind == ND_IDENT) {
@@ -1027,8 +1123,9 @@ static Node *binop(Parser *parser, Node *left, Precedence base_prec) {
         Precedence next_prec = get_prec(parser->cur->kind); // 下一个操作符的优先级。注意，调用`unary`之后，cur已经指向了下一个词符
         // peek
         if (next_prec > cur_prec) { // 下一个操作符优先级更高，右结合
-            // 如果下一个运算符的优先级更高，那么就递归调用binop
-            Node *right_bop = binop(parser, right, get_prec(parser->cur->kind));
+            // 如果下一个运算符的优先级更高，那么就递归调用binop，
+            // 把所有比当前运算符优先级更高的运算都归入右侧，如`a = b * c + d`中的`b * c + d`
+            Node *right_bop = binop(parser, right, cur_prec + 1);
             bop->as.bop.right = right_bop;
             Node *res = binop(parser, bop, base_prec);
             echo_node(res);
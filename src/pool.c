@@ -0,0 +1,99 @@
+#include <stdlib.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
+#include "pool.h"
+
+#define MAX_JOBS 64
+
+static int jobs = 0; // 0表示使用CPU的核数
+
+typedef struct Pool Pool;
+
+struct Pool {
+    PoolTask task;
+    void *arg;
+    int count;
+    volatile long next; // 下一个还没有被领取的任务
+};
+
+void pool_set_jobs(int n) {
+    jobs = n > 0 ? n : 0;
+}
+
+static int cpu_count() {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (int)info.dwNumberOfProcessors;
+#else
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+#endif
+}
+
+// 领取下一个任务的序号
+static int take(Pool *pool) {
+#ifdef _WIN32
+    return (int)InterlockedIncrement(&pool->next) - 1;
+#else
+    return (int)__atomic_fetch_add(&pool->next, 1, __ATOMIC_RELAXED);
+#endif
+}
+
+// 每个工作线程不断领取任务，直到全部领完。任务的耗时不均匀时，先做完的线程会多做几个
+static void work(Pool *pool) {
+    for (int i = take(pool); i < pool->count; i = take(pool)) {
+        pool->task(pool->arg, i);
+    }
+}
+
+#ifdef _WIN32
+static DWORD WINAPI worker(LPVOID arg) {
+    work((Pool*)arg);
+    return 0;
+}
+#else
+static void *worker(void *arg) {
+    work((Pool*)arg);
+    return NULL;
+}
+#endif
+
+void pool_run(int count, PoolTask task, void *arg) {
+    Pool pool = {.task = task, .arg = arg, .count = count, .next = 0};
+    int n = jobs > 0 ? jobs : cpu_count();
+    if (n > count) n = count;
+    if (n > MAX_JOBS) n = MAX_JOBS;
+    if (n <= 1) {
+        work(&pool);
+        return;
+    }
+    // 当前线程也参与执行，所以只需要再启动n-1个线程
+#ifdef _WIN32
+    HANDLE threads[MAX_JOBS];
+    int started = 0;
+    for (int i = 0; i < n - 1; i++) {
+        HANDLE h = CreateThread(NULL, 0, worker, &pool, 0, NULL);
+        if (h != NULL) threads[started++] = h;
+    }
+    work(&pool);
+    for (int i = 0; i < started; i++) {
+        WaitForSingleObject(threads[i], INFINITE);
+        CloseHandle(threads[i]);
+    }
+#else
+    pthread_t threads[MAX_JOBS];
+    int started = 0;
+    for (int i = 0; i < n - 1; i++) {
+        if (pthread_create(&threads[started], NULL, worker, &pool) == 0) started++;
+    }
+    work(&pool);
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+#endif
+}
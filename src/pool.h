@@ -0,0 +1,15 @@
+#pragma once
+
+// 工作线程池
+//
+// 把count个互相独立的任务分给若干个工作线程并行执行，全部完成之后才返回。
+// 线程数默认是CPU的核数，可以用命令行选项`-j<N>`指定；只有一个任务或者只用一个线程时，直接在当前线程中执行。
+
+// 一个任务：i是任务的序号，从0到count-1
+typedef void (*PoolTask)(void *arg, int i);
+
+// 设置线程数，n<=0时恢复为CPU的核数
+void pool_set_jobs(int n);
+
+// 并行执行task(arg, 0) ... task(arg, count-1)
+void pool_run(int count, PoolTask task, void *arg);
@@ -0,0 +1,412 @@
+#include <stdlib.h>
+#include <string.h>
+#include "regalloc.h"
+
+// 线性扫描寄存器分配
+//
+// 1. 活跃分析：把所有基本块按输出顺序排成一列指令，在指令级别的控制流图上反复计算
+//    每条指令之后仍然活跃的虚拟寄存器，直到不再变化；
+// 2. 合并复制：消去phi之后留下了很多复制指令`a = b`。如果a和b互不冲突，
+//    就把b改名为a，复制指令也就消失了。循环变量的新旧两个版本通常都能合并到一起；
+// 3. 活跃区间：每个虚拟寄存器从第一次活跃到最后一次活跃的指令范围。
+//    循环中用到的存量，在回边处依然活跃，所以它的区间会覆盖整个循环体；
+// 4. 按区间起点依次分配物理寄存器；没有空闲寄存器时，把区间终点最远的那个溢出到栈上。
+//
+// rax、rdx和r11留作指令选择时的临时寄存器（除法、函数返回值和内存到内存的复制），不参与分配。
+// 浮点数分配到向量寄存器中，两类寄存器互不干扰。向量寄存器只用调用者保存的，
+// 所以跨越函数调用的浮点数总是溢出到栈上。
+// 跨越函数调用的区间只能用被调用者保存的寄存器；在整个循环中都活跃的值（循环计数器和累加器）
+// 也优先用被调用者保存的寄存器，这样循环体中即使有函数调用，它们也能一直留在寄存器里；
+// 其他的值优先用调用者保存的寄存器，省掉序言和尾声中的保存与恢复。
+
+const Abi ABI_SYSV = {
+    .arg_count = 6,
+    .args = {R_RDI, R_RSI, R_RDX, R_RCX, R_R8, R_R9},
+    .callee_count = 5,
+    .callee = {R_RBX, R_R12, R_R13, R_R14, R_R15},
+    .caller_count = 6,
+    .caller = {R_RCX, R_RSI, R_RDI, R_R8, R_R9, R_R10},
+    .farg_count = 8,
+    .fargs = {R_XMM0, R_XMM1, R_XMM2, R_XMM3, R_XMM4, R_XMM5, R_XMM6, R_XMM7},
+    .fcaller_count = 15,
+    .fcaller = {
+        R_XMM0, R_XMM1, R_XMM2, R_XMM3, R_XMM4, R_XMM5, R_XMM6, R_XMM7,
+        R_XMM8, R_XMM9, R_XMM10, R_XMM11, R_XMM12, R_XMM13, R_XMM14,
+    },
+    .fscratch = R_XMM15,
+    .shadow = 0,
+    .vararg_al = true,
+};
+
+// Windows下rsi和rdi也由被调用者保存，调用时还要预留32字节的影子空间。
+// xmm6到xmm15也由被调用者保存，这里不使用它们
+const Abi ABI_WIN64 = {
+    .arg_count = 4,
+    .args = {R_RCX, R_RDX, R_R8, R_R9},
+    .farg_count = 4,
+    .fargs = {R_XMM0, R_XMM1, R_XMM2, R_XMM3},
+    .positional = true,
+    .fcaller_count = 5,
+    .fcaller = {R_XMM0, R_XMM1, R_XMM2, R_XMM3, R_XMM4},
+    .fscratch = R_XMM5,
+    .callee_count = 7,
+    .callee = {R_RBX, R_RSI, R_RDI, R_R12, R_R13, R_R14, R_R15},
+    .caller_count = 4,
+    .caller = {R_RCX, R_R8, R_R9, R_R10},
+    .shadow = 32,
+};
+
+bool is_callee_saved(const Abi *abi, Reg reg) {
+    for (int i = 0; i < abi->callee_count; i++) {
+        if (abi->callee[i] == reg) return true;
+    }
+    return false;
+}
+
+Reg abi_arg_reg(const Abi *abi, const IrType *types, int i) {
+    bool is_float = types[i] != IT_INT;
+    int k = i;
+    if (!abi->positional) {
+        // 同一类参数中的序号
+        k = 0;
+        for (int j = 0; j < i; j++) {
+            if ((types[j] != IT_INT) == is_float) k++;
+        }
+    }
+    if (is_float) return k < abi->farg_count ? abi->fargs[k] : R_COUNT;
+    return k < abi->arg_count ? abi->args[k] : R_COUNT;
+}
+
+typedef struct Interval Interval;
+struct Interval {
+    int vreg;
+    int start;
+    int end;
+    bool cross_call; // 区间中有函数调用
+    bool in_loop; // 在循环的回边处依然活跃，如循环计数器和累加器
+    bool is_float; // 放在向量寄存器中
+    Reg hint; // 优先使用的寄存器，如参数所在的寄存器，可以省掉一次复制
+};
+
+// 位集合，用来存放活跃的虚拟寄存器
+typedef uint64_t Bits;
+#define BITS_WORDS(n) (((n) + 63) / 64)
+#define BIT_HAS(set, i) (((set)[(i) / 64] >> ((i) % 64)) & 1)
+#define BIT_ADD(set, i) ((set)[(i) / 64] |= (Bits)1 << ((i) % 64))
+#define BIT_DEL(set, i) ((set)[(i) / 64] &= ~((Bits)1 << ((i) % 64)))
+
+// 按块的顺序排成一列的指令
+typedef struct Flat Flat;
+struct Flat {
+    int count;
+    Ir **code;
+    int (*succs)[2]; // 每条指令的后继，没有的用-1表示
+    int words; // 每个位集合的长度
+    Bits *live_out; // 每条指令执行之后仍然活跃的虚拟寄存器
+};
+
+static Flat *flatten(IrFn *fn) {
+    Flat *flat = calloc(1, sizeof(Flat));
+    // 每个块的第一条指令的位置
+    int *first = calloc(fn->block_count + 1, sizeof(int));
+    for (int i = 0; i < fn->block_count; i++) {
+        fn->blocks[i]->id = i;
+        first[i] = flat->count;
+        flat->count += fn->blocks[i]->count;
+    }
+    flat->code = calloc(flat->count + 1, sizeof(Ir *));
+    flat->succs = calloc(flat->count + 1, sizeof(int[2]));
+    int n = 0;
+    for (int i = 0; i < fn->block_count; i++) {
+        IrBlock *block = fn->blocks[i];
+        for (int j = 0; j < block->count; j++, n++) {
+            flat->code[n] = &block->code[j];
+            flat->succs[n][0] = -1;
+            flat->succs[n][1] = -1;
+            if (j + 1 < block->count) {
+                flat->succs[n][0] = n + 1;
+                continue;
+            }
+            for (int k = 0; k < block->succ_count; k++) {
+                flat->succs[n][k] = first[block->succs[k]->id];
+            }
+        }
+    }
+    free(first);
+    return flat;
+}
+
+static void free_flat(Flat *flat) {
+    free(flat->live_out);
+    free(flat->succs);
+    free(flat->code);
+    free(flat);
+}
+
+// 活跃分析，结果存入flat->live_out
+static void liveness(Flat *flat, int vreg_count) {
+    int n = flat->count;
+    int words = BITS_WORDS(vreg_count);
+    Bits *live_in = calloc((size_t)n * words + 1, sizeof(Bits));
+    Bits *live_out = calloc((size_t)n * words + 1, sizeof(Bits));
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        // 倒序遍历，这样大部分信息一轮就能传播到位
+        for (int i = n - 1; i >= 0; i--) {
+            Ir *ir = flat->code[i];
+            Bits *out = &live_out[(size_t)i * words];
+            Bits *in = &live_in[(size_t)i * words];
+            for (int k = 0; k < 2; k++) {
+                int s = flat->succs[i][k];
+                if (s < 0) continue;
+                Bits *sin = &live_in[(size_t)s * words];
+                for (int w = 0; w < words; w++) {
+                    if ((out[w] | sin[w]) != out[w]) {
+                        out[w] |= sin[w];
+                        changed = true;
+                    }
+                }
+            }
+            // in = uses ∪ (out - def)
+            for (int w = 0; w < words; w++) in[w] = out[w];
+            if (ir->dst >= 0) BIT_DEL(in, ir->dst);
+            int uses[IR_MAX_USES];
+            int nu = ir_uses(ir, uses);
+            for (int k = 0; k < nu; k++) BIT_ADD(in, uses[k]);
+        }
+    }
+    free(live_in);
+    flat->words = words;
+    flat->live_out = live_out;
+}
+
+// ---- 合并复制 ----
+
+static bool is_copy(Ir *ir, int dst, int src) {
+    return ir->op == IR_MOV && ir->dst == dst && ir->a.kind == IA_REG && ir->a.val == src;
+}
+
+// a和b是否冲突：其中一个被赋值时，另一个仍然活跃。两者之间的复制不算冲突，因为赋值前后它们的值相同
+static bool interfere(Flat *flat, int a, int b) {
+    for (int i = 0; i < flat->count; i++) {
+        Ir *ir = flat->code[i];
+        Bits *out = &flat->live_out[(size_t)i * flat->words];
+        if (ir->dst == a && BIT_HAS(out, b) && !is_copy(ir, a, b)) return true;
+        if (ir->dst == b && BIT_HAS(out, a) && !is_copy(ir, b, a)) return true;
+    }
+    return false;
+}
+
+static void rename_arg(IrArg *arg, int from, int to) {
+    if (arg->kind == IA_REG && arg->val == from) arg->val = to;
+}
+
+// 把虚拟寄存器from全部改名为to，并删掉变成`to = to`的复制
+static void rename_vreg(IrFn *fn, int from, int to) {
+    for (int i = 0; i < fn->block_count; i++) {
+        IrBlock *block = fn->blocks[i];
+        int n = 0;
+        for (int j = 0; j < block->count; j++) {
+            Ir *ir = &block->code[j];
+            if (ir->dst == from) ir->dst = to;
+            rename_arg(&ir->a, from, to);
+            rename_arg(&ir->b, from, to);
+            rename_arg(&ir->c, from, to);
+            if (ir->op == IR_CALL) {
+                for (int k = 0; k < ir->argc; k++) rename_arg(&ir->args[k], from, to);
+            }
+            if (is_copy(ir, to, to)) continue;
+            block->code[n++] = *ir;
+        }
+        block->count = n;
+    }
+}
+
+static void coalesce(IrFn *fn) {
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        Flat *flat = flatten(fn);
+        liveness(flat, fn->vreg_count);
+        for (int i = 0; i < flat->count && !changed; i++) {
+            Ir *ir = flat->code[i];
+            if (ir->op != IR_MOV || ir->a.kind != IA_REG) continue;
+            int a = ir->dst, b = ir->a.val;
+            if (interfere(flat, a, b)) continue;
+            // 保留存量的名称，方便调试
+            if (fn->vnames[a] == NULL) fn->vnames[a] = fn->vnames[b];
+            rename_vreg(fn, b, a);
+            changed = true;
+        }
+        free_flat(flat);
+    }
+}
+
+// ---- 线性扫描 ----
+
+static void extend(Interval *it, int pos) {
+    if (pos < it->start) it->start = pos;
+    if (pos > it->end) it->end = pos;
+}
+
+static Interval *build_intervals(IrFn *fn, Flat *flat, const Abi *abi) {
+    int nv = fn->vreg_count;
+    Interval *its = calloc(nv + 1, sizeof(Interval));
+    for (int v = 0; v < nv; v++) {
+        its[v] = (Interval){.vreg = v, .start = flat->count, .end = -1, .hint = R_COUNT, .is_float = fn->vtypes[v] != IT_INT};
+    }
+    // 入口处的参数是同时从参数寄存器中取出的（见codegen.c），所以它们的区间都要延续到最后一个参数之后
+    int param_end = 0;
+    while (param_end < flat->count && flat->code[param_end]->op == IR_PARAM) param_end++;
+    for (int i = 0; i < flat->count; i++) {
+        Ir *ir = flat->code[i];
+        if (ir->op == IR_PARAM) {
+            extend(&its[ir->dst], param_end);
+            its[ir->dst].hint = abi_arg_reg(abi, fn->param_types, ir->a.val);
+        }
+        if (ir->dst >= 0) extend(&its[ir->dst], i);
+        int uses[IR_MAX_USES];
+        int nu = ir_uses(ir, uses);
+        for (int k = 0; k < nu; k++) extend(&its[uses[k]], i);
+        Bits *out = &flat->live_out[(size_t)i * flat->words];
+        // 向回跳转的指令
+        bool back = (ir->op == IR_JMP || ir->op == IR_BR) &&
+            ((flat->succs[i][0] >= 0 && flat->succs[i][0] <= i) || (flat->succs[i][1] >= 0 && flat->succs[i][1] <= i));
+        for (int v = 0; v < nv; v++) {
+            if (!BIT_HAS(out, v)) continue;
+            extend(&its[v], i);
+            // 在调用之后依然活跃的值（调用的结果本身除外），需要跨越这次调用
+            if (ir->op == IR_CALL && v != ir->dst) its[v].cross_call = true;
+            // 向回跳转之后依然活跃的值，在整个循环中都要保留
+            if (back) its[v].in_loop = true;
+        }
+    }
+    return its;
+}
+
+static int cmp_start(const void *a, const void *b) {
+    const Interval *x = *(const Interval **)a;
+    const Interval *y = *(const Interval **)b;
+    if (x->start != y->start) return x->start - y->start;
+    return x->vreg - y->vreg;
+}
+
+// 从pool中找一个空闲的寄存器
+static Reg pick(const Reg *pool, int count, bool *busy) {
+    for (int i = 0; i < count; i++) {
+        if (!busy[pool[i]]) return pool[i];
+    }
+    return R_COUNT;
+}
+
+static bool in_pool(const Reg *pool, int count, Reg reg) {
+    for (int i = 0; i < count; i++) {
+        if (pool[i] == reg) return true;
+    }
+    return false;
+}
+
+static Reg pick_free(const Abi *abi, Interval *it, bool *busy) {
+    Reg hint = it->hint;
+    if (it->is_float) {
+        if (it->cross_call) return R_COUNT;
+        if (hint != R_COUNT && !busy[hint] && in_pool(abi->fcaller, abi->fcaller_count, hint)) return hint;
+        return pick(abi->fcaller, abi->fcaller_count, busy);
+    }
+    if (hint != R_COUNT && !busy[hint]) {
+        if (in_pool(abi->callee, abi->callee_count, hint)) return hint;
+        if (!it->cross_call && in_pool(abi->caller, abi->caller_count, hint)) return hint;
+    }
+    if (it->cross_call) return pick(abi->callee, abi->callee_count, busy);
+    Reg reg;
+    if (it->in_loop) {
+        reg = pick(abi->callee, abi->callee_count, busy);
+        if (reg == R_COUNT) reg = pick(abi->caller, abi->caller_count, busy);
+    } else {
+        reg = pick(abi->caller, abi->caller_count, busy);
+        if (reg == R_COUNT) reg = pick(abi->callee, abi->callee_count, busy);
+    }
+    return reg;
+}
+
+// 分配一个溢出槽位。向量的槽位16字节对齐，这样SSE指令可以直接使用
+static Loc spill(IrFn *fn, RegAlloc *ra, int vreg) {
+    int slots = ir_type_size(fn->vtypes[vreg]) / 4;
+    if (slots == 4) ra->slot_count = (ra->slot_count + 3) / 4 * 4;
+    Loc loc = {.spilled = true, .slot = ra->slot_count};
+    ra->slot_count += slots;
+    return loc;
+}
+
+RegAlloc *linear_scan(IrFn *fn, const Abi *abi) {
+    coalesce(fn);
+    Flat *flat = flatten(fn);
+    liveness(flat, fn->vreg_count);
+
+    int nv = fn->vreg_count;
+    RegAlloc *ra = calloc(1, sizeof(RegAlloc));
+    ra->locs = calloc(nv + 1, sizeof(Loc));
+    Interval *its = build_intervals(fn, flat, abi);
+
+    // 按起点排序
+    Interval **order = calloc(nv + 1, sizeof(Interval *));
+    int n = 0;
+    for (int v = 0; v < nv; v++) {
+        if (its[v].end >= 0) order[n++] = &its[v];
+    }
+    qsort(order, n, sizeof(Interval *), cmp_start);
+
+    // 当前占用寄存器的区间
+    Interval **active = calloc(nv + 1, sizeof(Interval *));
+    int active_count = 0;
+    bool busy[R_COUNT] = {0};
+
+    for (int i = 0; i < n; i++) {
+        Interval *cur = order[i];
+        // 释放已经结束的区间。终点和当前起点相同的也可以释放：
+        // 一条指令总是先读完操作数再写入结果，后端在选择指令时会处理好两者相同的情况
+        int keep = 0;
+        for (int j = 0; j < active_count; j++) {
+            Interval *a = active[j];
+            if (a->end <= cur->start) {
+                busy[ra->locs[a->vreg].reg] = false;
+            } else {
+                active[keep++] = a;
+            }
+        }
+        active_count = keep;
+
+        Reg reg = pick_free(abi, cur, busy);
+        if (reg == R_COUNT) {
+            // 没有空闲寄存器：在能让给cur的区间中，找终点最远的一个
+            int victim = -1;
+            for (int j = 0; j < active_count; j++) {
+                Interval *a = active[j];
+                if (a->is_float != cur->is_float) continue;
+                if (cur->cross_call && !is_callee_saved(abi, ra->locs[a->vreg].reg)) continue;
+                if (victim < 0 || a->end > active[victim]->end) victim = j;
+            }
+            if (victim >= 0 && active[victim]->end > cur->end) {
+                Interval *a = active[victim];
+                reg = ra->locs[a->vreg].reg;
+                ra->locs[a->vreg] = spill(fn, ra, a->vreg);
+                active[victim] = active[--active_count];
+            } else {
+                ra->locs[cur->vreg] = spill(fn, ra, cur->vreg);
+                continue;
+            }
+        }
+        ra->locs[cur->vreg] = (Loc){.reg = reg};
+        ra->used |= 1u << reg;
+        busy[reg] = true;
+        active[active_count++] = cur;
+    }
+
+    free(active);
+    free(order);
+    free(its);
+    free_flat(flat);
+    return ra;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <stdint.h>
+#include "ir.h"
+
+// x86-64的通用寄存器和SSE的向量寄存器，各自按照指令编码中的编号排列
+typedef enum {
+    R_RAX, R_RCX, R_RDX, R_RBX, R_RSP, R_RBP, R_RSI, R_RDI,
+    R_R8, R_R9, R_R10, R_R11, R_R12, R_R13, R_R14, R_R15,
+    R_XMM0, R_XMM1, R_XMM2, R_XMM3, R_XMM4, R_XMM5, R_XMM6, R_XMM7,
+    R_XMM8, R_XMM9, R_XMM10, R_XMM11, R_XMM12, R_XMM13, R_XMM14, R_XMM15,
+    R_COUNT,
+} Reg;
+
+static inline bool is_xmm(Reg reg) { return reg >= R_XMM0 && reg < R_COUNT; }
+
+typedef struct Abi Abi;
+typedef struct Loc Loc;
+typedef struct RegAlloc RegAlloc;
+
+// 调用约定：参数寄存器和两类可分配的寄存器
+struct Abi {
+    int arg_count;
+    Reg args[6]; // 传递参数的寄存器
+    int farg_count;
+    Reg fargs[8]; // 传递浮点数参数的向量寄存器
+    bool positional; // 第i个参数用第i个整数或向量寄存器（Windows）；否则两类参数各自依次使用（System V）
+    int callee_count;
+    Reg callee[8]; // 被调用者保存（callee-saved）的寄存器，用到时需要在函数的序言中保存
+    int caller_count;
+    Reg caller[8]; // 调用者保存（caller-saved）的寄存器，函数调用之后其中的值就失效了
+    int fcaller_count;
+    Reg fcaller[16]; // 可分配的向量寄存器。只使用调用者保存的，跨越函数调用的浮点数放在栈上
+    Reg fscratch; // 指令选择时使用的临时向量寄存器，不参与分配
+    int shadow; // 调用函数时需要在栈上为被调用者预留的空间
+    bool vararg_al; // 调用变参函数时，需要在al中给出用到的向量寄存器个数
+};
+
+// linux等系统使用的System V调用约定
+extern const Abi ABI_SYSV;
+// Windows x64调用约定
+extern const Abi ABI_WIN64;
+
+// 虚拟寄存器的位置：物理寄存器，或者栈上的溢出槽位
+struct Loc {
+    bool spilled;
+    Reg reg;
+    int slot; // 溢出槽位的序号，从0开始，每个槽位4字节，double占两个，向量占四个
+};
+
+// 一个函数的寄存器分配结果
+struct RegAlloc {
+    Loc *locs; // 每个虚拟寄存器的位置
+    int slot_count; // 溢出槽位的个数
+    uint32_t used; // 用到的物理寄存器，按位存放
+};
+
+// 线性扫描（Linear Scan）寄存器分配。fn不能再有phi指令，见ir_out_ssa()
+RegAlloc *linear_scan(IrFn *fn, const Abi *abi);
+
+bool is_callee_saved(const Abi *abi, Reg reg);
+
+// 类型依次为types的count个参数中，第i个参数所在的寄存器。放不进寄存器时返回R_COUNT
+Reg abi_arg_reg(const Abi *abi, const IrType *types, int i);
@@ -0,0 +1,136 @@
+#include <stdlib.h>
+#include "srcmap.h"
+
+// 一条映射，行列都从0开始
+typedef struct Mapping Mapping;
+
+struct Mapping {
+    int gen_line;
+    int gen_col;
+    int src_line;
+    int src_col;
+};
+
+struct SrcMap {
+    int count;
+    int cap;
+    Mapping *list;
+    // 输出缓冲中已经数过行号的部分，每次只需要从上次的位置往后数
+    size_t scanned;
+    int gen_line;
+    size_t line_start;
+};
+
+SrcMap *new_srcmap() {
+    return calloc(1, sizeof(SrcMap));
+}
+
+void free_srcmap(SrcMap *map) {
+    free(map->list);
+    free(map);
+}
+
+void srcmap_mark(SrcMap *map, Buf *out, int line, int col) {
+    for (; map->scanned < out->len; map->scanned++) {
+        if (out->data[map->scanned] == '\n') {
+            map->gen_line++;
+            map->line_start = map->scanned + 1;
+        }
+    }
+    int gen_col = out->len - map->line_start;
+    // 外层节点和它的第一个子节点常常从同一个位置开始，只保留外层的；与上一条指向同一处源码的也不必再记
+    if (map->count > 0) {
+        Mapping *last = &map->list[map->count - 1];
+        if (last->gen_line == map->gen_line && last->gen_col == gen_col) return;
+        if (last->src_line == line - 1 && last->src_col == col - 1) return;
+    }
+    if (map->count >= map->cap) {
+        map->cap = map->cap * 2 + 16;
+        map->list = realloc(map->list, map->cap * sizeof(Mapping));
+    }
+    map->list[map->count++] = (Mapping){map->gen_line, gen_col, line - 1, col - 1};
+}
+
+void srcmap_shift(SrcMap *map, int lines) {
+    for (int i = 0; i < map->count; i++) map->list[i].gen_line += lines;
+    map->gen_line += lines;
+}
+
+// JSON字符串，Windows的路径中有'\'
+static void put_json_str(Buf *buf, const char *str) {
+    buf_putc(buf, '"');
+    for (const char *p = str; *p; p++) {
+        if (*p == '"' || *p == '\\') buf_putc(buf, '\\');
+        buf_putc(buf, *p);
+    }
+    buf_putc(buf, '"');
+}
+
+static const char BASE64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// Base64 VLQ：最低位是符号，每个字符5位，第6位表示后面还有
+static void put_vlq(Buf *buf, int v) {
+    unsigned int u = v < 0 ? ((unsigned int)-v << 1) | 1 : (unsigned int)v << 1;
+    do {
+        unsigned int digit = u & 31;
+        u >>= 5;
+        if (u) digit |= 32;
+        buf_putc(buf, BASE64[digit]);
+    } while (u);
+}
+
+bool srcmap_save_js(SrcMap *map, const char *path, const char *file, const char *source) {
+    Buf *buf = new_buf();
+    buf_puts(buf, "{\"version\":3,\"file\":");
+    put_json_str(buf, file);
+    buf_puts(buf, ",\"sources\":[");
+    put_json_str(buf, source);
+    buf_puts(buf, "],\"names\":[],\"mappings\":\"");
+    // 各行之间用';'分隔，同一行的各段用','分隔。
+    // 输出的列相对于同一行的上一段，源码的行列相对于上一段（不分行）
+    int line = 0, prev_col = 0, prev_src_line = 0, prev_src_col = 0;
+    for (int i = 0; i < map->count; i++) {
+        Mapping *m = &map->list[i];
+        if (m->gen_line > line) {
+            for (; line < m->gen_line; line++) buf_putc(buf, ';');
+            prev_col = 0;
+        } else if (i > 0) {
+            buf_putc(buf, ',');
+        }
+        put_vlq(buf, m->gen_col - prev_col);
+        put_vlq(buf, 0); // 只有一个源文件
+        put_vlq(buf, m->src_line - prev_src_line);
+        put_vlq(buf, m->src_col - prev_src_col);
+        prev_col = m->gen_col;
+        prev_src_line = m->src_line;
+        prev_src_col = m->src_col;
+    }
+    buf_puts(buf, "\"}\n");
+    bool ok = buf_save(buf, path);
+    free_buf(buf);
+    return ok;
+}
+
+bool srcmap_save_lines(SrcMap *map, const char *path, const char *file, const char *source, int total_lines) {
+    Buf *buf = new_buf();
+    buf_puts(buf, "{\"version\":1,\"file\":");
+    put_json_str(buf, file);
+    buf_puts(buf, ",\"source\":");
+    put_json_str(buf, source);
+    buf_puts(buf, ",\"lines\":[");
+    // 没有映射的行沿用上一行的，与Source Map的规则一致；开头的import等行为0
+    int src_line = 0;
+    int k = 0;
+    for (int line = 0; line < total_lines; line++) {
+        while (k < map->count && map->list[k].gen_line == line) {
+            if (k == 0 || map->list[k - 1].gen_line != line) src_line = map->list[k].src_line + 1;
+            k++;
+        }
+        if (line > 0) buf_putc(buf, ',');
+        buf_int(buf, src_line);
+    }
+    buf_puts(buf, "]}\n");
+    bool ok = buf_save(buf, path);
+    free_buf(buf);
+    return ok;
+}
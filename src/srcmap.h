@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stdbool.h>
+#include "buf.h"
+
+// 源码映射
+//
+// 转译器生成代码时，在每个AST节点的开头记下“输出的行列 -> Z源码的行列”，
+// 这样性能分析和调试工具就能把输出代码中的位置对应回Z源码：
+// - JS输出标准的Source Map v3文件（app.js.map），并在app.js的末尾用`//# sourceMappingURL`引用它；
+// - Python没有通用的映射格式，输出一个JSON的行号对照表（app.py.map），lines[i]是app.py第i+1行对应的Z源码行号。
+// 由`-fsourcemap`选项开启。
+
+typedef struct SrcMap SrcMap;
+
+SrcMap *new_srcmap();
+void free_srcmap(SrcMap *map);
+
+// 记下out当前的末尾对应Z源码的第line行、第col列（都从1开始）
+void srcmap_mark(SrcMap *map, Buf *out, int line, int col);
+
+// 输出的前面又插入了lines行（如Python的import语句），已记下的映射都要下移
+void srcmap_shift(SrcMap *map, int lines);
+
+// 保存为Source Map v3文件。file是输出代码的文件名，source是Z源码的文件名
+bool srcmap_save_js(SrcMap *map, const char *path, const char *file, const char *source);
+
+// 保存为行号对照表，total_lines是输出代码的总行数
+bool srcmap_save_lines(SrcMap *map, const char *path, const char *file, const char *source, int total_lines);
@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <stdbool.h>
 #include <stdlib.h>
+#include <string.h>
 #include <errno.h>
 #include "zast.h"
 #include "transpiler.h"
@@ -8,9 +9,14 @@
 #include "util.h"
 #include "builtin.h"
 #include "front.h"
+#include "buf.h"
+#include "pool.h"
+#include "opt.h"
+#include "srcmap.h"
 
 #define MAX_USES 100
-typedef struct TransMeta TransMeta;
+#define MAX_GLOBALS 100
+typedef struct Emitter Emitter;
 
 typedef enum {
     LAN_C,
@@ -18,23 +24,31 @@ typedef enum {
     LAN_JS,
 } LAN;
 
-struct TransMeta {
+// 一个模块的输出状态。每个模块的代码生成都有自己的Emitter，互不干扰，因此多个模块可以同时生成
+struct Emitter {
+    Buf *out; // 输出缓冲
     int indent;
     int use_count;
     char *uses[MAX_USES];
     HashTable *imports;
     LAN lan;
+    bool is_lib; // 生成的是库模块：函数要在头文件中导出
+    bool unity; // 所有模块输出到同一个文件中，不需要引入其他模块的头文件
+    char *mod; // 单文件模式中正在生成的库模块，其中的函数名和全局存量名要加上模块名作前缀
+    int global_count;
+    Meta *globals[MAX_GLOBALS]; // 单文件模式中正在生成的库模块的全局存量
+    bool numpy; // Python的数值数组用NumPy实现
+    bool use_numpy; // 生成的代码用到了NumPy，需要引入
+    bool operand; // 正在生成二元运算的操作数，JS的`| 0`要加括号
+    bool plain; // JS的数值数组生成为普通数组，而不是类型化数组（嵌套数组的行和print的实参）
+    Node *body; // 正在生成的函数体，用来判断存量是否被改写
+    SrcMap *map; // 源码映射，NULL表示不生成
+    Source *source; // 正在生成的模块的源码，用来把节点位置换算成行列
 };
 
-static TransMeta META;
-
 // 检查是否需要引入标准库
-static void do_meta_c(Node *prog) {
-    // init META
-    META.indent = 0;
-    META.use_count = 0;
-    META.lan = LAN_C;
-    META.imports = new_hash_table();
+static void do_meta_c(Emitter *em, Node *prog) {
+    if (em->imports == NULL) em->imports = new_hash_table();
     char *name_in_use = "";
     for (int i = 0; i < prog->as.exprs.count; ++i) {
         Node *expr = prog->as.exprs.list[i];
@@ -42,16 +56,16 @@ static void do_meta_c(Node *prog) {
             if (expr->as.call.name->kind == ND_IDENT) {
                 char *name = get_name(expr->as.call.name);
                 if (strcmp(name, "print") == 0) {
-                    META.uses[META.use_count++] = "<stdio.h>";
-                    hash_set_int(META.imports, "<stdio.h>", 1);
+                    em->uses[em->use_count++] = "<stdio.h>";
+                    hash_set_int(em->imports, "<stdio.h>", 1);
                 } else if (strcmp(name, name_in_use) != 0) {
-                    META.uses[META.use_count++] = "\"stdz.h\"";
-                    hash_set_int(META.imports, "\"stdz.h\"", 1);
+                    em->uses[em->use_count++] = "\"stdz.h\"";
+                    hash_set_int(em->imports, "\"stdz.h\"", 1);
                 }
             }
-        } else if (expr->kind == ND_USE) {
-            META.uses[META.use_count++] = sfmt("\"%s.h\"", expr->as.use.mod);
-            hash_set_int(META.imports, sfmt("\"%s.h\"", expr->as.use.mod), 1);
+        } else if (expr->kind == ND_USE && !em->unity) {
+            em->uses[em->use_count++] = sfmt("\"%s.h\"", expr->as.use.mod);
+            hash_set_int(em->imports, sfmt("\"%s.h\"", expr->as.use.mod), 1);
             if (expr->as.use.name) {
                 name_in_use = expr->as.use.name;
             }
@@ -59,78 +73,217 @@ static void do_meta_c(Node *prog) {
     }
 }
 
-void gen_expr(FILE *fp, Node *expr);
+static void gen_expr(Emitter *em, Node *expr);
+
+// Z类型对应的C类型。类型未知时按int处理
+static char *c_type(Type *type) {
+    if (type == NULL) return "int";
+    switch (type->kind) {
+    case TY_BOOL: return "int"; // 与布尔值写成1/0一致
+    case TY_BYTE: return "unsigned char";
+    case TY_FLOAT: return "float";
+    case TY_DOUBLE: return "double";
+    case TY_STR: return "const char *";
+    case TY_USER: return type->name;
+    default: return "int";
+    }
+}
+
+// 输出C的声明：类型和名称
+static void gen_c_decl(Buf *out, Type *type, char *name) {
+    char *ctype = c_type(type);
+    buf_puts(out, ctype);
+    if (ctype[strlen(ctype) - 1] != '*') buf_putc(out, ' ');
+    buf_puts(out, name);
+}
+
+// 没有被改写的存量和参数声明为const。字符串的C类型本身就是`const char *`，不能再加
+static void put_const(Buf *out, Type *type) {
+    if (strncmp(c_type(type), "const ", 6) != 0) buf_puts(out, "const ");
+}
+
+// 表达式中是否有对存量m的赋值
+static bool assigns(Node *expr, Meta *m) {
+    if (expr == NULL) return false;
+    switch (expr->kind) {
+    case ND_PROG:
+    case ND_BLOCK:
+        for (int i = 0; i < expr->as.exprs.count; ++i) {
+            if (assigns(expr->as.exprs.list[i], m)) return true;
+        }
+        return false;
+    case ND_LET:
+    case ND_MUT:
+        return assigns(expr->as.asn.value, m);
+    case ND_BINOP:
+        if (expr->as.bop.op == OP_ASN && expr->as.bop.left->meta == m) return true;
+        return assigns(expr->as.bop.left, m) || assigns(expr->as.bop.right, m);
+    case ND_NEG:
+    case ND_NOT:
+        return assigns(expr->as.una.body, m);
+    case ND_IF:
+        return assigns(expr->as.if_else.cond, m) || assigns(expr->as.if_else.then, m) || assigns(expr->as.if_else.els, m);
+    case ND_FOR:
+        return assigns(expr->as.loop.cond, m) || assigns(expr->as.loop.body, m);
+    case ND_CALL:
+        for (int i = 0; i < expr->as.call.argc; ++i) {
+            if (assigns(expr->as.call.args[i], m)) return true;
+        }
+        return false;
+    case ND_INDEX:
+        return assigns(expr->as.index.idx, m);
+    default:
+        return false;
+    }
+}
+
+// 存量在当前函数中没有被改写，可以声明为const
+static bool is_const(Emitter *em, Meta *m) {
+    return m != NULL && em->body != NULL && !assigns(em->body, m);
+}
+
+// 单文件模式中，库模块的函数和全局存量加上模块名作前缀，不同模块中的同名函数和存量才不会冲突：`geo.add` => `geo_add`
+static char *mod_fn_name(char *mod, char *name) {
+    return join_str((char*[]){mod, name}, "_", 2);
+}
+
+static char *c_fn_name(Emitter *em, char *name) {
+    return em->mod ? mod_fn_name(em->mod, name) : name;
+}
+
+static bool is_global(Emitter *em, Meta *m) {
+    for (int i = 0; i < em->global_count; ++i) {
+        if (em->globals[i] == m) return true;
+    }
+    return false;
+}
+
+// 存量名：单文件模式中，`geo.k`和geo模块中对本模块全局存量的引用`k`都换成`geo_k`
+static char *c_var_name(Emitter *em, Node *name) {
+    if (name->as.path.len > 1 && name->as.path.names[0].kind == NM_MOD) {
+        return mod_fn_name(name->as.path.names[0].name, get_name(name));
+    }
+    if (name->as.path.len == 1 && is_global(em, name->meta)) return c_fn_name(em, get_name(name));
+    return get_name(name);
+}
+
+// 调用的函数名：单文件模式中，`geo.add`和geo模块中对本模块函数的调用`add`都换成`geo_add`
+static char *c_call_name(Emitter *em, Node *name) {
+    if (em->unity && name->kind == ND_IDENT) {
+        if (name->as.path.len > 1 && name->as.path.names[0].kind == NM_MOD) {
+            return mod_fn_name(name->as.path.names[0].name, get_name(name));
+        }
+        Meta *m = name->meta;
+        if (name->as.path.len == 1 && m != NULL && m->node != NULL && m->node->kind == ND_FN) {
+            return c_fn_name(em, get_name(name));
+        }
+    }
+    return get_name(name);
+}
+
+// C函数头：返回类型、名称和参数列表。
+// 定义中没有被改写的参数加上const；原型中参数的const没有意义，不输出
+static void gen_c_fn_head(Emitter *em, Node *expr, bool is_def) {
+    Params *params = expr->as.fn.params;
+    Type *type = expr->as.fn.type;
+    gen_c_decl(em->out, type ? type->as.fn.ret : NULL, c_fn_name(em, expr->as.fn.name));
+    buf_putc(em->out, '(');
+    if (params == NULL || params->count == 0) {
+        buf_puts(em->out, "void");
+    } else {
+        for (int i = 0; i < params->count; ++i) {
+            Node *param = params->list[i];
+            if (is_def && is_const(em, param->meta)) put_const(em->out, param->meta->type);
+            gen_c_decl(em->out, param->meta->type, get_name(param));
+            if (i < params->count - 1) {
+                buf_puts(em->out, ", ");
+            }
+        }
+    }
+    buf_putc(em->out, ')');
+}
 
 // 生成函数定义
-static void gen_fn(FILE *fp, Node *expr) {
+static void gen_fn(Emitter *em, Node *expr) {
     char *name = expr->as.fn.name;
     Params *params = expr->as.fn.params;
-    switch (META.lan) {
+    switch (em->lan) {
     case LAN_C: {
-        // TODO: 由于还没有支持返回类型，这里暂时统一都写成int
-        fprintf(fp, "int %s(", name);
-        if (params == NULL) {
-            fprintf(fp, "void");
-        } else {
-            for (int i = 0; i < params->count; ++i) {
-                Node *param = params->list[i];
-                fprintf(fp, "int %s", get_name(param));
-                if (i < params->count - 1) {
-                    fprintf(fp, ", ");
-                }
-            }
+        // 应用模块的函数只在本文件中使用，可以是static的；只有一个表达式的小函数再加上inline
+        Node *body = expr->as.fn.body;
+        if (!em->is_lib && strcmp(name, "main") != 0) {
+            buf_puts(em->out, body->as.exprs.count == 1 ? "static inline " : "static ");
         }
-        fprintf(fp, ") ");
-        gen_expr(fp, expr->as.fn.body);
-        fprintf(fp, "\n");
+        Node *outer = em->body;
+        em->body = body;
+        gen_c_fn_head(em, expr, true);
+        buf_putc(em->out, ' ');
+        gen_expr(em, body);
+        buf_putc(em->out, '\n');
+        em->body = outer;
         break;
     }
     case LAN_PY: {
-        fprintf(fp, "def %s(", name);
+        buf_printf(em->out, "def %s(", name);
         if (params != NULL) {
             for (int i = 0; i < params->count; ++i) {
                 Node *param = params->list[i];
-                fprintf(fp, "%s", get_name(param));
+                buf_puts(em->out, get_name(param));
                 if (i < params->count - 1) {
-                    fprintf(fp, ", ");
+                    buf_puts(em->out, ", ");
                 }
             }
         }
-        fprintf(fp, "):\n");
-        gen_expr(fp, expr->as.fn.body);
+        buf_puts(em->out, "):\n");
+        gen_expr(em, expr->as.fn.body);
         break;
     }
     case LAN_JS: {
-        fprintf(fp, "export function %s(", name);
+        buf_printf(em->out, "export function %s(", name);
         if (params != NULL) {
             for (int i = 0; i < params->count; ++i) {
                 Node *param = params->list[i];
-                fprintf(fp, "%s", get_name(param));
+                buf_puts(em->out, get_name(param));
                 if (i < params->count - 1) {
-                    fprintf(fp, ", ");
+                    buf_puts(em->out, ", ");
                 }
             }
         }
-        fprintf(fp, ") ");
-        gen_expr(fp, expr->as.fn.body);
-        fprintf(fp, "\n");
+        buf_puts(em->out, ") ");
+        gen_expr(em, expr->as.fn.body);
+        buf_putc(em->out, '\n');
         break;
     }
     }
 }
 
-static void add_indent() {
-    META.indent++;
+static void add_indent(Emitter *em) {
+    em->indent++;
+}
+
+static void sub_indent(Emitter *em) {
+    em->indent--;
 }
 
-static void sub_indent() {
-    META.indent--;
+// 写入文件并释放缓冲
+static void save_file(Buf *out, char *path) {
+    if (!buf_save(out, path)) {
+        printf("Error: failed to write %s\n", path);
+    }
+    free_buf(out);
 }
 
-static void print_indent(FILE *fp) {
-    for (int i = 0; i < META.indent; ++i) {
-        fprintf(fp, "    ");
+// 输出的行数，最后一行没有换行也算一行
+static int count_lines(Buf *out) {
+    int lines = 0;
+    for (size_t i = 0; i < out->len; i++) {
+        if (out->data[i] == '\n') lines++;
     }
+    return out->len > 0 && out->data[out->len - 1] != '\n' ? lines + 1 : lines;
+}
+
+static void print_indent(Emitter *em) {
+    buf_indent(em->out, em->indent);
 }
 
 static bool is_void_call(Node *expr) {
@@ -165,69 +318,70 @@ static char *get_primary_fmt(Type *type) {
 // 未来要想打印更复杂的数据结构，例如数组嵌套字典再嵌套数组，或者说多层的JSON，
 // 可以要在C中引入类似`json-c`这样的库，或者自己在Z的C标准库里实现一套了。
 // TODO: 还有一种办法，用元编程在Z之内就把格式化的to_str函数搞好，然后直接`printf("%s", to_str(obj))`。
-static void cprintf_array(FILE *fp, Node *expr) {
+static void cprintf_array(Emitter *em, Node *expr) {
     if (expr->kind == ND_ARRAY) { // 数组字面量
-        fprintf(fp, "printf(\"");
-        gen_expr(fp, expr);
-        fprintf(fp, "\\n\")");
+        buf_puts(em->out, "printf(\"");
+        gen_expr(em, expr);
+        buf_puts(em->out, "\\n\")");
     } else { // 存量
         Type *type = expr->meta->type;
         int size = type->as.array.size;
         Type *itype = type->as.array.item;
-        fprintf(fp, "// print(%s)\n", get_name(expr));
-        print_indent(fp);
-        fprintf(fp, "printf(\"{\");\n");
-        print_indent(fp);
-        fprintf(fp, "for (int i = 0; i < %d; ++i) {\n", size);
-        add_indent();
-        print_indent(fp);
+        buf_printf(em->out, "// print(%s)\n", get_name(expr));
+        print_indent(em);
+        buf_puts(em->out, "printf(\"{\");\n");
+        print_indent(em);
+        buf_printf(em->out, "for (int i = 0; i < %d; ++i) {\n", size);
+        add_indent(em);
+        print_indent(em);
         if (itype->kind == TY_ARRAY) {
-            fprintf(fp, "if (i > 0) printf(\", \");\n");
-            print_indent(fp);
-            fprintf(fp, "printf(\"{\");\n");
-            print_indent(fp);
-            fprintf(fp, "for (int j = 0; j < %d; ++j) {\n", itype->as.array.size);
-            add_indent();
-            print_indent(fp);
-            fprintf(fp, "if (j > 0) printf(\", \");\n");
-            print_indent(fp);
-            fprintf(fp, "printf(\"%%%s", get_primary_fmt(itype->as.array.item));
-            fprintf(fp, "\", %s[i][j]);\n", get_name(expr));
-            sub_indent();
-            print_indent(fp);
-            fprintf(fp, "}\n");
-            print_indent(fp);
-            fprintf(fp, "printf(\"}\");\n");
+            buf_puts(em->out, "if (i > 0) printf(\", \");\n");
+            print_indent(em);
+            buf_puts(em->out, "printf(\"{\");\n");
+            print_indent(em);
+            buf_printf(em->out, "for (int j = 0; j < %d; ++j) {\n", itype->as.array.size);
+            add_indent(em);
+            print_indent(em);
+            buf_puts(em->out, "if (j > 0) printf(\", \");\n");
+            print_indent(em);
+            buf_printf(em->out, "printf(\"%%%s", get_primary_fmt(itype->as.array.item));
+            buf_printf(em->out, "\", %s[i][j]);\n", get_name(expr));
+            sub_indent(em);
+            print_indent(em);
+            buf_puts(em->out, "}\n");
+            print_indent(em);
+            buf_puts(em->out, "printf(\"}\");\n");
         } else {
-            fprintf(fp, get_primary_fmt(itype));
-            fprintf(fp, "\\n\", %s[i]);", get_name(expr));
+            buf_puts(em->out, get_primary_fmt(itype));
+            buf_printf(em->out, "\\n\", %s[i]);", get_name(expr));
         }
-        sub_indent();
-        print_indent(fp);
-        fprintf(fp, "}\n");
-        print_indent(fp);
-        fprintf(fp, "printf(\"}\")");
+        sub_indent(em);
+        print_indent(em);
+        buf_puts(em->out, "}\n");
+        print_indent(em);
+        buf_puts(em->out, "printf(\"}\")");
     }
 }
 
-static void cprintf(FILE *fp, Node *expr) {
+static void cprintf(Emitter *em, Node *expr) {
     Type *type = expr->meta->type;
     if (type->kind == TY_ARRAY) {
-        cprintf_array(fp, expr);
+        cprintf_array(em, expr);
     } else {
         char *fmt = get_primary_fmt(type); // 这个也包括了ND_INDEX和ND_BINOP
-        fprintf(fp, "printf(\"%%%s\\n\", ", fmt);
-        gen_expr(fp, expr);
-        if (type->kind == TY_BOOL) fprintf(fp, " ? \"true\" : \"false\"");
-        fprintf(fp, ")");
+        buf_printf(em->out, "printf(\"%%%s\\n\", ", fmt);
+        gen_expr(em, expr);
+        if (type->kind == TY_BOOL) buf_puts(em->out, " ? \"true\" : \"false\"");
+        buf_putc(em->out, ')');
     }
 }
 
-static void gen_store(FILE *fp, Node *expr) {
+static void gen_store(Emitter *em, Node *expr) {
     char *ckw = expr->kind == ND_MUT ? "" : "const ";
     char *jskw = expr->kind == ND_MUT ? "let" : "const";
     char *name = get_name(expr->as.asn.name);
-    if (META.lan == LAN_C) {
+    if (em->lan == LAN_C) {
+        if (em->unity) name = c_var_name(em, expr->as.asn.name);
         Type *type = expr->as.asn.name->meta->type;
         if (type == NULL) type = &TYPE_INT;
         if (type->kind == TY_ARRAY) {
@@ -236,96 +390,101 @@ static void gen_store(FILE *fp, Node *expr) {
                 int size1 = type->as.array.size;
                 int size2 = itype->as.array.size;
                 char *iname = itype->as.array.item->name;
-                fprintf(fp, "%s%s %s[%d][%d] = ", ckw, iname, name, size1, size2);
+                buf_printf(em->out, "%s%s %s[%d][%d] = ", ckw, iname, name, size1, size2);
             } else {
-                fprintf(fp, "%s%s %s[%d] = ", ckw, itype->name, name, type->as.array.size);
+                buf_printf(em->out, "%s%s %s[%d] = ", ckw, itype->name, name, type->as.array.size);
             }
         } else {
-            fprintf(fp, "%s %s = ", type->name, name);
+            if (expr->kind == ND_LET && is_const(em, expr->as.asn.name->meta)) put_const(em->out, type);
+            gen_c_decl(em->out, type, name);
+            buf_puts(em->out, " = ");
         }
-    } else if (META.lan == LAN_PY) {
-        fprintf(fp, "%s = ", name);
-    } else if (META.lan == LAN_JS) {
-        fprintf(fp, "%s %s = ", jskw, name);
+    } else if (em->lan == LAN_PY) {
+        buf_printf(em->out, "%s = ", name);
+    } else if (em->lan == LAN_JS) {
+        buf_printf(em->out, "%s %s = ", jskw, name);
     }
-    gen_expr(fp, expr->as.asn.value);
+    gen_expr(em, expr->as.asn.value);
 }
 
 // 生成类型的定义
 // C: typedef sturct { ... }
 // Python: class ...
 // JS: class ...
-static void gen_type_decl(FILE *fp, Node *expr) {
-    switch (META.lan) {
+static void gen_type_decl(Emitter *em, Node *expr) {
+    switch (em->lan) {
     case LAN_C: {
-        // TODO: C语言的结构体定义应当放在`main`函数之外，另外也需要在头文件中声明。
-        fprintf(fp, "typedef struct {\n");
-        add_indent();
+        // 结构体定义放在文件的开头（见extract_main），这样函数中也能使用
+        // TODO: 库模块的结构体也需要在头文件中声明。
+        char *name = get_name(expr->as.type.name);
+        buf_printf(em->out, "typedef struct %s {\n", name);
+        add_indent(em);
         for (int i = 0; i < expr->as.type.fields->size; ++i) {
             Node *field = expr->as.type.fields->items[i];
-            print_indent(fp);
-            fprintf(fp, "%s %s;\n", field->meta->type->name, get_name(field));
+            print_indent(em);
+            gen_c_decl(em->out, field->meta->type, get_name(field));
+            buf_puts(em->out, ";\n");
         }
-        sub_indent();
-        print_indent(fp);
-        fprintf(fp, "} %s", get_name(expr->as.type.name));
+        sub_indent(em);
+        print_indent(em);
+        buf_printf(em->out, "} %s", name);
         break;
     }
     case LAN_PY: {
-        fprintf(fp, "class %s:\n", get_name(expr->as.type.name));
-        add_indent();
+        buf_printf(em->out, "class %s:\n", get_name(expr->as.type.name));
+        add_indent(em);
         // 构造函数
-        print_indent(fp);
-        fprintf(fp, "def __init__(self, ");
+        print_indent(em);
+        buf_puts(em->out, "def __init__(self, ");
         // 参数列表
         for (int i = 0; i < expr->as.type.fields->size; ++i) {
             Node *field = expr->as.type.fields->items[i];
-            fprintf(fp, "%s", get_name(field));
+            buf_puts(em->out, get_name(field));
             if (i < expr->as.type.fields->size - 1) {
-                fprintf(fp, ", ");
+                buf_puts(em->out, ", ");
             }
         }
-        fprintf(fp, "):\n");
+        buf_puts(em->out, "):\n");
         // 函数体
-        add_indent();
+        add_indent(em);
         for (int i = 0; i < expr->as.type.fields->size; ++i) {
             Node *field = expr->as.type.fields->items[i];
-            print_indent(fp);
-            fprintf(fp, "self.%s = %s\n", get_name(field), get_name(field));
+            print_indent(em);
+            buf_printf(em->out, "self.%s = %s\n", get_name(field), get_name(field));
         }
-        sub_indent();
-        sub_indent();
+        sub_indent(em);
+        sub_indent(em);
         break;
     }
     case LAN_JS: {
-        fprintf(fp, "class %s {\n", get_name(expr->as.type.name));
-        add_indent();
+        buf_printf(em->out, "class %s {\n", get_name(expr->as.type.name));
+        add_indent(em);
         // 构造函数
-        print_indent(fp);
-        fprintf(fp, "constructor(");
+        print_indent(em);
+        buf_puts(em->out, "constructor(");
         // 参数列表：这里的顺序是哈希表的顺序，可能和Z源码提供的参数顺序不一致。未来需要解决
         for (int i = 0; i < expr->as.type.fields->size; ++i) {
             Node *field = expr->as.type.fields->items[i];
             char *name = get_name(field);
-            fprintf(fp, "%s", get_name(field));
+            buf_puts(em->out, get_name(field));
             if (i < expr->as.type.fields->size - 1) {
-                fprintf(fp, ", ");
+                buf_puts(em->out, ", ");
             }
         }
-        fprintf(fp, ") {\n");
+        buf_puts(em->out, ") {\n");
         // 构造函数体
-        add_indent();
+        add_indent(em);
         for (int i = 0; i < expr->as.type.fields->size; ++i) {
             Node *field = expr->as.type.fields->items[i];
             char *name = get_name(field);
-            print_indent(fp);
-            fprintf(fp, "this.%s = %s;\n", name, name);
-        }
-        sub_indent();
-        print_indent(fp);
-        fprintf(fp, "}\n");
-        sub_indent();
-        fprintf(fp, "}\n");
+            print_indent(em);
+            buf_printf(em->out, "this.%s = %s;\n", name, name);
+        }
+        sub_indent(em);
+        print_indent(em);
+        buf_puts(em->out, "}\n");
+        sub_indent(em);
+        buf_puts(em->out, "}\n");
         break;
         // TODO: 如何加入方法？
     }
@@ -333,10 +492,10 @@ static void gen_type_decl(FILE *fp, Node *expr) {
 }
 
 // 生成一个对象
-static void gen_obj(FILE *fp, Node *expr) {
-    switch (META.lan) {
+static void gen_obj(Emitter *em, Node *expr) {
+    switch (em->lan) {
     case LAN_C: {
-        fprintf(fp, "{");
+        buf_putc(em->out, '{');
         HashTable *t = expr->as.obj.members;
         HashIter *i = hash_iter(t);
         int j = 0;
@@ -344,17 +503,17 @@ static void gen_obj(FILE *fp, Node *expr) {
             char *key = i->key;
             Node *entry = (Node*)i->value;
             Node *val = entry->as.kv.val;
-            fprintf(fp, ".%s = ", key);
-            gen_expr(fp, val);
+            buf_printf(em->out, ".%s = ", key);
+            gen_expr(em, val);
             if (j++ < t->size - 1) {
-                fprintf(fp, ", ");
+                buf_puts(em->out, ", ");
             }
         }
-        fprintf(fp, "}");
+        buf_putc(em->out, '}');
         break;
     }
     case LAN_PY: {
-        fprintf(fp, "%s(", expr->meta->type->name);
+        buf_printf(em->out, "%s(", expr->meta->type->name);
         HashTable *t = expr->as.obj.members;
         HashIter *i = hash_iter(t);
         int j = 0;
@@ -362,13 +521,13 @@ static void gen_obj(FILE *fp, Node *expr) {
             char *key = i->key;
             Node *entry = (Node*)i->value;
             Node *val = entry->as.kv.val;
-            fprintf(fp, "%s = ", key);
-            gen_expr(fp, val);
+            buf_printf(em->out, "%s = ", key);
+            gen_expr(em, val);
             if (j++ < t->size - 1) {
-                fprintf(fp, ", ");
+                buf_puts(em->out, ", ");
             }
         }
-        fprintf(fp, ")");
+        buf_putc(em->out, ')');
         break;
     }
     case LAN_JS: {
@@ -376,250 +535,613 @@ static void gen_obj(FILE *fp, Node *expr) {
         // 由于丢掉了成员名称，按照哈希表的默认顺序提供，可能导致参数位置匹配错误
         // 解决办法：统一用名字参数形式调用？不知道好不好使
         Type *type = expr->meta->type;
-        fprintf(fp, "new %s(", type->name);
+        buf_printf(em->out, "new %s(", type->name);
         HashTable *t = expr->as.obj.members;
         HashIter *i = hash_iter(t);
         int j = 0;
         while (hash_next(t, i)) {
             Node *entry = (Node*)i->value;
             Node *val = entry->as.kv.val;
-            gen_expr(fp, val);
+            gen_expr(em, val);
             if (j++ < t->size - 1) {
-                fprintf(fp, ", ");
+                buf_puts(em->out, ", ");
             }
         }
-        fprintf(fp, ")\n");
+        buf_puts(em->out, ")\n");
         break;
     }
     }
 }
 
+// NumPy模式（`-fnumpy`）
+//
+// 元素是int/float/double的数组字面量生成为带dtype的numpy.array，
+// 数组上的简单计数循环（与原生编译器的向量化相同的形式，见ir.c）生成为整段切片的运算：
+//
+//     for i < n {              a[i:n] = b[i:n] * k + c[i:n]
+//         a[i] = b[i] * k + c[i]   =>   i = max(i, n)
+//         i = i + 1
+//     }
+//
+// 循环体中只有数组元素a[i]和i被赋值，各次迭代访问的元素互不相同，所以先后执行每条语句的整段切片，
+// 与逐次迭代的结果相同。其他形式的循环仍然生成普通的while循环。
+//
+// 注意：切片越界时NumPy会悄悄截断，而逐个元素访问会抛出IndexError。
+// 所以循环的上界n必须是整数字面量，且不超过循环中每个数组的长度（数组字面量的元素个数），否则不生成切片。
+
+// 数值数组的元素类型，不是时返回NULL
+static const Type *num_item(const Type *type) {
+    if (type == NULL || type->kind != TY_ARRAY) return NULL;
+    Type *item = type->as.array.item;
+    if (item == NULL) return NULL;
+    if (item->kind != TY_INT && item->kind != TY_FLOAT && item->kind != TY_DOUBLE) return NULL;
+    return item;
+}
+
+static char *dtype(const Type *item) {
+    switch (item->kind) {
+    case TY_INT: return "np.int32";
+    case TY_FLOAT: return "np.float32";
+    default: return "np.float64";
+    }
+}
+
+// print一个numpy.array时输出的是`[1 2 3]`，与默认的Python列表`[1, 2, 3]`不同。
+// 所以print的实参中，数组字面量仍生成为普通列表，数值数组存量先用tolist()转换
+static void gen_py_print(Emitter *em, Node *expr) {
+    buf_puts(em->out, "print(");
+    bool numpy = em->numpy;
+    em->numpy = false;
+    for (int i = 0; i < expr->as.call.argc; ++i) {
+        Node *arg = expr->as.call.args[i];
+        gen_expr(em, arg);
+        if (arg->kind == ND_IDENT && arg->meta && num_item(arg->meta->type)) buf_puts(em->out, ".tolist()");
+        if (i < expr->as.call.argc - 1) buf_puts(em->out, ", ");
+    }
+    em->numpy = numpy;
+    buf_putc(em->out, ')');
+}
+
+static bool is_loop_var(Node *node, Meta *var) {
+    return (node->kind == ND_IDENT || node->kind == ND_LNAME) && node->as.path.len == 1 && node->meta == var;
+}
+
+// 下标为i的数值数组元素，元素类型要与item相同，数组的长度不小于循环的上界n
+static bool is_slice_elem(Node *node, Meta *var, const Type *item, int n) {
+    if (node->kind != ND_INDEX || node->as.index.parent->kind != ND_IDENT) return false;
+    Type *type = node->as.index.parent->meta ? node->as.index.parent->meta->type : NULL;
+    const Type *t = num_item(type);
+    return t && t->kind == item->kind && type->as.array.size >= n && is_loop_var(node->as.index.idx, var);
+}
+
+// 表达式能否按切片整段计算：由字面量、与循环无关的数值存量和a[i]通过四则运算组成
+static bool can_slice(Node *node, Meta *var, const Type *item, int n) {
+    switch (node->kind) {
+    case ND_INT:
+    case ND_FLOAT:
+    case ND_DOUBLE:
+        return true;
+    case ND_IDENT: {
+        if (node->as.path.len != 1 || node->meta == var || node->meta == NULL) return false;
+        Type *t = node->meta->type;
+        return t && (t->kind == TY_INT || t->kind == TY_FLOAT || t->kind == TY_DOUBLE);
+    }
+    case ND_INDEX:
+        return is_slice_elem(node, var, item, n);
+    case ND_BINOP: {
+        Op op = node->as.bop.op;
+        if (op != OP_ADD && op != OP_SUB && op != OP_MUL && op != OP_DIV) return false;
+        // 整数数组的除法，Python的`/`得到浮点数
+        if (op == OP_DIV && item->kind == TY_INT) return false;
+        return can_slice(node->as.bop.left, var, item, n) && can_slice(node->as.bop.right, var, item, n);
+    }
+    default:
+        return false;
+    }
+}
+
+// `i = i + 1`
+static bool is_py_step(Node *node, Meta *var) {
+    if (node->kind != ND_BINOP || node->as.bop.op != OP_ASN || !is_loop_var(node->as.bop.left, var)) return false;
+    Node *right = node->as.bop.right;
+    return right->kind == ND_BINOP && right->as.bop.op == OP_ADD && is_loop_var(right->as.bop.left, var) &&
+        right->as.bop.right->kind == ND_INT && right->as.bop.right->as.num.val == 1;
+}
+
+// 循环是否可以生成为切片运算
+static bool slice_match(Node *loop) {
+    Node *cond = loop->as.loop.cond;
+    Node *body = loop->as.loop.body;
+    if (cond->kind != ND_BINOP || cond->as.bop.op != OP_LT || cond->as.bop.left->kind != ND_IDENT) return false;
+    Meta *var = cond->as.bop.left->meta;
+    if (var == NULL || var->type == NULL || var->type->kind != TY_INT) return false;
+    Node *end = cond->as.bop.right;
+    if (end->kind != ND_INT || body->kind != ND_BLOCK) return false;
+    int n = end->as.num.val;
+    int count = body->as.exprs.count;
+    if (count < 2 || !is_py_step(body->as.exprs.list[count - 1], var)) return false;
+    const Type *item = NULL;
+    for (int i = 0; i < count - 1; i++) {
+        Node *stmt = body->as.exprs.list[i];
+        if (stmt->kind != ND_BINOP || stmt->as.bop.op != OP_ASN) return false;
+        Node *left = stmt->as.bop.left;
+        if (left->kind != ND_INDEX || left->as.index.parent->kind != ND_IDENT) return false;
+        if (item == NULL) item = num_item(left->as.index.parent->meta ? left->as.index.parent->meta->type : NULL);
+        if (item == NULL || !is_slice_elem(left, var, item, n) || !can_slice(stmt->as.bop.right, var, item, n)) return false;
+    }
+    return true;
+}
+
+// 把表达式中的a[i]换成a[i:n]
+static void gen_slice(Emitter *em, Node *node, Node *end) {
+    switch (node->kind) {
+    case ND_INDEX:
+        gen_expr(em, node->as.index.parent);
+        buf_putc(em->out, '[');
+        gen_expr(em, node->as.index.idx);
+        buf_putc(em->out, ':');
+        gen_expr(em, end);
+        buf_putc(em->out, ']');
+        return;
+    case ND_BINOP:
+        gen_slice(em, node->as.bop.left, end);
+        switch (node->as.bop.op) {
+        case OP_ADD: buf_puts(em->out, " + "); break;
+        case OP_SUB: buf_puts(em->out, " - "); break;
+        case OP_MUL: buf_puts(em->out, " * "); break;
+        case OP_DIV: buf_puts(em->out, " / "); break;
+        case OP_ASN: buf_puts(em->out, " = "); break;
+        default: break;
+        }
+        gen_slice(em, node->as.bop.right, end);
+        return;
+    default:
+        gen_expr(em, node);
+        return;
+    }
+}
+
+static void gen_slice_loop(Emitter *em, Node *loop) {
+    Node *cond = loop->as.loop.cond;
+    Node *body = loop->as.loop.body;
+    Node *end = cond->as.bop.right;
+    for (int i = 0; i < body->as.exprs.count - 1; i++) {
+        if (i > 0) print_indent(em);
+        gen_slice(em, body->as.exprs.list[i], end);
+        buf_putc(em->out, '\n');
+    }
+    print_indent(em);
+    gen_expr(em, cond->as.bop.left);
+    buf_puts(em->out, " = max(");
+    gen_expr(em, cond->as.bop.left);
+    buf_puts(em->out, ", ");
+    gen_expr(em, end);
+    buf_putc(em->out, ')');
+}
+
+// JS的数值都是双精度浮点数。为了让V8能按整数和单精度浮点数来优化，
+// 类型确定的运算（见check.c中的Spec）加上转换，结果与Z的int（32位补码回绕）和float相同：
+// - int的加减法：`a + b - c | 0`，连续的加减法只在最外层转换一次，中间结果不会超出双精度的精确范围
+// - int的乘法：`Math.imul(a, b)`；除法：`a / b | 0`，向0取整；取负：`-(a) | 0`
+// `|`的优先级比算术和比较运算都低，所以作为操作数时要加括号；作为语句时不加，以免行首的`(`接到上一行
+// - float的运算：`Math.fround(a * b + c)`，和int的加减法一样，连续的float运算只在最外层转换一次，
+//   相当于C语言中FLT_EVAL_METHOD为1时的求值方式；单独的float字面量也用Math.fround转换，
+//   所以存入变量、传给参数和返回的float值都已经是单精度的
+// 转换有代价：work/bench_js.mjs中float的smooth()比不转换时慢，这是与原生的float结果一致的代价。
+// 元素是数值的一维数组生成为Int32Array、Float32Array或Float64Array；嵌套数组的各行仍是普通数组。
+
+static char *js_array(const Type *item) {
+    switch (item->kind) {
+    case TY_INT: return "Int32Array";
+    case TY_FLOAT: return "Float32Array";
+    default: return "Float64Array";
+    }
+}
+
+static void gen_op(Emitter *em, Op op) {
+    switch (op) {
+    case OP_ADD: buf_puts(em->out, " + "); break;
+    case OP_SUB: buf_puts(em->out, " - "); break;
+    case OP_MUL: buf_puts(em->out, " * "); break;
+    case OP_DIV: buf_puts(em->out, " / "); break;
+    default: break;
+    }
+}
+
+static bool is_int_sum(Node *expr) {
+    return expr->kind == ND_BINOP && (expr->as.bop.spec == SP_ADD_INT || expr->as.bop.spec == SP_SUB_INT);
+}
+
+static void gen_operand(Emitter *em, Node *expr, bool operand) {
+    bool outer = em->operand;
+    em->operand = operand;
+    gen_expr(em, expr);
+    em->operand = outer;
+}
+
+static bool is_float_op(Node *expr) {
+    return expr->kind == ND_BINOP && expr->as.bop.spec >= SP_ADD_FLOAT && expr->as.bop.spec <= SP_DIV_FLOAT;
+}
+
+// 连续的float运算：中间结果不转换，按优先级加上括号
+static void gen_js_float(Emitter *em, Node *expr) {
+    Op op = expr->as.bop.op;
+    for (int i = 0; i < 2; i++) {
+        Node *child = i == 0 ? expr->as.bop.left : expr->as.bop.right;
+        if (i == 1) gen_op(em, op);
+        if (is_float_op(child)) {
+            bool low = child->as.bop.op == OP_ADD || child->as.bop.op == OP_SUB;
+            bool high = op == OP_MUL || op == OP_DIV;
+            // 低优先级的子运算在高优先级的运算中，或者同级的子运算在右边，都要加括号
+            bool paren = (low && high) || (i == 1 && low == !high);
+            if (paren) buf_putc(em->out, '(');
+            gen_js_float(em, child);
+            if (paren) buf_putc(em->out, ')');
+        } else if (child->kind == ND_FLOAT) {
+            buf_puts(em->out, child->as.float_num.lit);
+        } else {
+            gen_operand(em, child, true);
+        }
+    }
+}
+
+// 连续的int加减法，只有左边的加减法可以合并，右边的照常转换
+static void gen_js_sum(Emitter *em, Node *expr) {
+    Node *left = expr->as.bop.left;
+    if (is_int_sum(left)) gen_js_sum(em, left);
+    else gen_operand(em, left, true);
+    gen_op(em, expr->as.bop.op);
+    gen_operand(em, expr->as.bop.right, true);
+}
+
+// console.log打印类型化数组时会带上类型名，如`Int32Array(3) [ 1, 2, 3 ]`，与其他目标的输出不同。
+// 所以print的实参中，数组字面量生成为普通数组，数值数组存量先用Array.from转换
+static void gen_js_print(Emitter *em, Node *expr) {
+    buf_puts(em->out, "console.log(");
+    bool plain = em->plain;
+    em->plain = true;
+    for (int i = 0; i < expr->as.call.argc; ++i) {
+        Node *arg = expr->as.call.args[i];
+        if (arg->kind == ND_IDENT && arg->meta && num_item(arg->meta->type)) {
+            buf_puts(em->out, "Array.from(");
+            gen_expr(em, arg);
+            buf_putc(em->out, ')');
+        } else {
+            gen_expr(em, arg);
+        }
+        if (i < expr->as.call.argc - 1) buf_puts(em->out, ", ");
+    }
+    em->plain = plain;
+    buf_putc(em->out, ')');
+}
+
+// 生成类型确定的数值运算，不需要转换时返回false
+static bool gen_js_num(Emitter *em, Node *expr) {
+    BinOp *bop = &expr->as.bop;
+    bool paren = em->operand;
+    switch (bop->spec) {
+    case SP_ADD_INT:
+    case SP_SUB_INT:
+        if (paren) buf_putc(em->out, '(');
+        gen_js_sum(em, expr);
+        buf_puts(em->out, " | 0");
+        if (paren) buf_putc(em->out, ')');
+        return true;
+    case SP_MUL_INT:
+        buf_puts(em->out, "Math.imul(");
+        gen_operand(em, bop->left, false);
+        buf_puts(em->out, ", ");
+        gen_operand(em, bop->right, false);
+        buf_putc(em->out, ')');
+        return true;
+    case SP_DIV_INT:
+        if (paren) buf_putc(em->out, '(');
+        gen_operand(em, bop->left, true);
+        buf_puts(em->out, " / ");
+        gen_operand(em, bop->right, true);
+        buf_puts(em->out, " | 0");
+        if (paren) buf_putc(em->out, ')');
+        return true;
+    case SP_ADD_FLOAT:
+    case SP_SUB_FLOAT:
+    case SP_MUL_FLOAT:
+    case SP_DIV_FLOAT:
+        buf_puts(em->out, "Math.fround(");
+        gen_js_float(em, expr);
+        buf_putc(em->out, ')');
+        return true;
+    default:
+        return false;
+    }
+}
+
+// 记下输出的当前位置对应节点在源码中的位置
+static void mark(Emitter *em, Node *expr) {
+    if (em->map == NULL || expr->loc == 0) return;
+    int line, col;
+    source_locate(em->source, expr->loc, &line, &col);
+    srcmap_mark(em->map, em->out, line, col);
+}
+
 // 生成一个语句
-static void gen_expr(FILE *fp, Node *expr) {
+static void gen_expr(Emitter *em, Node *expr) {
+    mark(em, expr);
     switch (expr->kind) {
     case ND_BLOCK: {
         bool need_return = (expr->meta && ((Meta*)expr->meta)->need_return) ? true : false;
-        add_indent();
-        if (META.lan != LAN_PY) fprintf(fp, "{\n");
+        bool operand = em->operand;
+        em->operand = false;
+        add_indent(em);
+        if (em->lan != LAN_PY) buf_puts(em->out, "{\n");
         int cnt = expr->as.exprs.count;
         if (cnt > 0) {
             for (int i = 0; i < expr->as.exprs.count - 1; ++i) {
                 Node *e = expr->as.exprs.list[i];
                 if (e->kind == ND_USE) continue;
-                print_indent(fp);
-                gen_expr(fp, e);
-                if (META.lan == LAN_C) fprintf(fp, ";\n");
-                else fprintf(fp, "\n");
+                print_indent(em);
+                gen_expr(em, e);
+                if (em->lan == LAN_C) buf_puts(em->out, ";\n");
+                else buf_putc(em->out, '\n');
             }
             // 处理最后一句
             Node *last = expr->as.exprs.list[expr->as.exprs.count - 1];
             if (need_return) {
-                if (META.lan == LAN_C) {
+                if (em->lan == LAN_C) {
                     if (is_void_call(last)) {
-                        print_indent(fp);
-                        gen_expr(fp, last);
-                        fprintf(fp, ";\n");
-                        print_indent(fp);
-                        fprintf(fp, "return 0;\n");
+                        print_indent(em);
+                        gen_expr(em, last);
+                        buf_puts(em->out, ";\n");
+                        print_indent(em);
+                        buf_puts(em->out, "return 0;\n");
                     } else {
-                        print_indent(fp);
-                        fprintf(fp, "return ");
-                        gen_expr(fp, last);
-                        fprintf(fp, ";\n");
+                        print_indent(em);
+                        mark(em, last);
+                        buf_puts(em->out, "return ");
+                        gen_expr(em, last);
+                        buf_puts(em->out, ";\n");
                     }
                 } else {
-                    print_indent(fp);
-                    fprintf(fp, "return ");
-                    gen_expr(fp, last);
-                    fprintf(fp, "\n");
+                    print_indent(em);
+                    mark(em, last);
+                    buf_puts(em->out, "return ");
+                    gen_expr(em, last);
+                    buf_putc(em->out, '\n');
                 }
             } else {
-                print_indent(fp);
-                gen_expr(fp, last);
-                if (META.lan == LAN_C) fprintf(fp, ";\n");
-                else fprintf(fp, "\n");
+                print_indent(em);
+                gen_expr(em, last);
+                if (em->lan == LAN_C) buf_puts(em->out, ";\n");
+                else buf_putc(em->out, '\n');
             }
         }
-        sub_indent();
-        if (META.lan != LAN_PY) {
-          print_indent(fp);
-          fprintf(fp, "}");
+        sub_indent(em);
+        if (em->lan != LAN_PY) {
+          print_indent(em);
+          buf_putc(em->out, '}');
         }
+        em->operand = operand;
         return;
     }
     case ND_TYPE:
-        gen_type_decl(fp, expr);
+        gen_type_decl(em, expr);
         return;
     case ND_OBJ:
-        gen_obj(fp, expr);
+        gen_obj(em, expr);
         return;
     case ND_ARRAY: {
-        if (META.lan == LAN_C) fprintf(fp, "{");
-        else fprintf(fp, "[");
+        const Type *item = em->numpy && expr->meta ? num_item(expr->meta->type) : NULL;
+        if (item) {
+            buf_puts(em->out, "np.array(");
+            em->use_numpy = true;
+        }
+        if (em->lan == LAN_JS && !em->plain && expr->meta && num_item(expr->meta->type)) {
+            buf_printf(em->out, "%s.of(", js_array(num_item(expr->meta->type)));
+            for (int i = 0; i < expr->as.array.size; ++i) {
+                Node *it = expr->as.array.items[i];
+                // 元素写入Float32Array时就会转换，字面量不必再用Math.fround
+                if (it->kind == ND_FLOAT) buf_puts(em->out, it->as.float_num.lit);
+                else gen_expr(em, it);
+                if (i < expr->as.array.size - 1) buf_puts(em->out, ", ");
+            }
+            buf_putc(em->out, ')');
+            return;
+        }
+        if (em->lan == LAN_C) buf_putc(em->out, '{');
+        else buf_putc(em->out, '[');
 
+        bool plain = em->plain;
+        em->plain = true;
         for (int i = 0; i < expr->as.array.size; ++i) {
-            gen_expr(fp, expr->as.array.items[i]);
+            gen_expr(em, expr->as.array.items[i]);
             if (i < expr->as.array.size - 1) {
-                fprintf(fp, ", ");
+                buf_puts(em->out, ", ");
             }
         }
-        if (META.lan == LAN_C) fprintf(fp, "}");
-        else fprintf(fp, "]");
+        em->plain = plain;
+        if (em->lan == LAN_C) buf_putc(em->out, '}');
+        else buf_putc(em->out, ']');
+        if (item) buf_printf(em->out, ", dtype=%s)", dtype(item));
         return;
     }
     case ND_INDEX: {
-        gen_expr(fp, expr->as.index.parent);
-        fprintf(fp, "[");
-        gen_expr(fp, expr->as.index.idx);
-        fprintf(fp, "]");
+        gen_expr(em, expr->as.index.parent);
+        buf_putc(em->out, '[');
+        gen_operand(em, expr->as.index.idx, false);
+        buf_putc(em->out, ']');
         return;
     }
     case ND_MUT: {
-        gen_store(fp, expr);
+        gen_store(em, expr);
         return;
     }
     case ND_LET: {
-        gen_store(fp, expr);
+        gen_store(em, expr);
         return;
     }
     case ND_IF:
-        switch (META.lan) {
+        switch (em->lan) {
         case LAN_C:
         case LAN_JS:
-            fprintf(fp, "if (");
-            gen_expr(fp, expr->as.if_else.cond);
-            fprintf(fp, ") ");
-            gen_expr(fp, expr->as.if_else.then);
-            fprintf(fp, " else ");
-            gen_expr(fp, expr->as.if_else.els);
+            buf_puts(em->out, "if (");
+            gen_expr(em, expr->as.if_else.cond);
+            buf_puts(em->out, ") ");
+            gen_expr(em, expr->as.if_else.then);
+            buf_puts(em->out, " else ");
+            gen_expr(em, expr->as.if_else.els);
             break;
         case LAN_PY:
-            fprintf(fp, "if ");
-            gen_expr(fp, expr->as.if_else.cond);
-            fprintf(fp, ":\n");
-            gen_expr(fp, expr->as.if_else.then);
-            fprintf(fp, "else:\n");
-            gen_expr(fp, expr->as.if_else.els);
+            buf_puts(em->out, "if ");
+            gen_expr(em, expr->as.if_else.cond);
+            buf_puts(em->out, ":\n");
+            gen_expr(em, expr->as.if_else.then);
+            buf_puts(em->out, "else:\n");
+            gen_expr(em, expr->as.if_else.els);
             break;
         }
         return;
     case ND_FOR: {
-        switch (META.lan) {
+        switch (em->lan) {
         case LAN_C:
         case LAN_JS:
-            fprintf(fp, "while (");
-            gen_expr(fp, expr->as.loop.cond);
-            fprintf(fp, ") ");
-            gen_expr(fp, expr->as.loop.body);
+            buf_puts(em->out, "while (");
+            gen_expr(em, expr->as.loop.cond);
+            buf_puts(em->out, ") ");
+            gen_expr(em, expr->as.loop.body);
             break;
         case LAN_PY:
-            fprintf(fp, "while ");
-            gen_expr(fp, expr->as.loop.cond);
-            fprintf(fp, ":\n");
-            gen_expr(fp, expr->as.loop.body);
+            if (em->numpy && slice_match(expr)) {
+                gen_slice_loop(em, expr);
+                break;
+            }
+            buf_puts(em->out, "while ");
+            gen_expr(em, expr->as.loop.cond);
+            buf_puts(em->out, ":\n");
+            gen_expr(em, expr->as.loop.body);
             break;
         }
         return;
     }
     case ND_FN: {
-        gen_fn(fp, expr);
+        gen_fn(em, expr);
         return;
     }
     case ND_LNAME: 
     case ND_IDENT: {
+        if (em->lan == LAN_C && em->unity) {
+            buf_puts(em->out, c_var_name(em, expr));
+            return;
+        }
         for (int i = 0; i < expr->as.path.len; ++i) {
-            fprintf(fp, "%s", expr->as.path.names[i].name);
+            buf_puts(em->out, expr->as.path.names[i].name);
             if (i < expr->as.path.len - 1) {
-                fprintf(fp, ".");
+                buf_putc(em->out, '.');
             }
         }
         return;
     }
     case ND_INT:
-        fprintf(fp, "%s", expr->as.num.lit);
+        buf_puts(em->out, expr->as.num.lit);
         return;
     case ND_FLOAT:
-        fprintf(fp, "%s", expr->as.float_num.lit);
+        if (em->lan == LAN_JS) buf_printf(em->out, "Math.fround(%s)", expr->as.float_num.lit);
+        else buf_puts(em->out, expr->as.float_num.lit);
         return;
     case ND_DOUBLE:
-        fprintf(fp, "%s", expr->as.double_num.lit);
+        buf_puts(em->out, expr->as.double_num.lit);
         return;
     case ND_BOOL:
-        switch (META.lan) {
+        switch (em->lan) {
         case LAN_C:
             // 因为C里true/false还得单独引入stdbool.h，所以这里直接用1/0代替。
             // 未来有了更完善的依赖库引入功能之后，再改回true/false
-            fprintf(fp, "%s", expr->as.bul ? "1" : "0"); 
+            buf_puts(em->out, expr->as.bul ? "1" : "0"); 
             break;
         case LAN_PY:
-            fprintf(fp, "%s", expr->as.bul ? "True" : "False");
+            buf_puts(em->out, expr->as.bul ? "True" : "False");
             break;
         default:
-            fprintf(fp, "%s", expr->as.bul ? "true" : "false");
+            buf_puts(em->out, expr->as.bul ? "true" : "false");
             break;
         }
         return;
     case ND_STR:
-        fprintf(fp, "\"%s\"", expr->as.str);
+        buf_printf(em->out, "\"%s\"", expr->as.str);
         return;
     case ND_NEG:
-        fprintf(fp, "-(");
-        gen_expr(fp, expr->as.una.body);
-        fprintf(fp, ")");
+        if (em->lan == LAN_JS && expr->as.una.spec == SP_NEG_INT) {
+            bool paren = em->operand;
+            if (paren) buf_putc(em->out, '(');
+            buf_puts(em->out, "-(");
+            gen_operand(em, expr->as.una.body, false);
+            buf_puts(em->out, ") | 0");
+            if (paren) buf_putc(em->out, ')');
+            return;
+        }
+        buf_puts(em->out, "-(");
+        gen_operand(em, expr->as.una.body, false);
+        buf_putc(em->out, ')');
         return;
     case ND_NOT:
-        if (META.lan == LAN_PY) fprintf(fp, "not (");
-        else fprintf(fp, "!(");
-        gen_expr(fp, expr->as.una.body);
-        fprintf(fp, ")");
+        if (em->lan == LAN_PY) buf_puts(em->out, "not (");
+        else buf_puts(em->out, "!(");
+        gen_expr(em, expr->as.una.body);
+        buf_putc(em->out, ')');
         return;
     case ND_USE:
         return;
     case ND_CALL:
-        if (META.lan == LAN_C && strcmp(get_name(expr->as.call.name), "print") == 0) {
+        if (em->lan == LAN_C && strcmp(get_name(expr->as.call.name), "print") == 0) {
             // 注意：这里的print仍然只打印第一个参数。多参数的打印，要等Z支持可变长度参数之后再说。
-            cprintf(fp, expr->as.call.args[0]);
+            cprintf(em, expr->as.call.args[0]);
+            return;
+        } else if (em->lan == LAN_JS && strcmp(get_name(expr->as.call.name), "console.log") == 0) {
+            gen_js_print(em, expr);
+            return;
+        } else if (em->lan == LAN_PY && em->numpy && strcmp(get_name(expr->as.call.name), "print") == 0) {
+            gen_py_print(em, expr);
             return;
         } else {
-            fprintf(fp, "%s(", get_name(expr->as.call.name));
+            buf_printf(em->out, "%s(", em->lan == LAN_C ? c_call_name(em, expr->as.call.name) : get_name(expr->as.call.name));
             for (int i = 0; i < expr->as.call.argc; ++i) {
                 Node *arg = expr->as.call.args[i];
+                mark(em, arg); // 字面量和名称的实参直接输出，不经过gen_expr
                 switch (arg->kind) {
                 case ND_INT:
-                    fprintf(fp, "%s", arg->as.num.lit);
+                    buf_puts(em->out, arg->as.num.lit);
                     break;
                 case ND_BOOL:
-                    fprintf(fp, "%s", arg->as.bul ? "true" : "false");
+                    buf_puts(em->out, arg->as.bul ? "true" : "false");
                     break;
                 case ND_FLOAT:
-                    fprintf(fp, "%s", arg->as.float_num.lit);
+                    if (em->lan == LAN_JS) buf_printf(em->out, "Math.fround(%s)", arg->as.float_num.lit);
+                    else buf_puts(em->out, arg->as.float_num.lit);
                     break;
                 case ND_DOUBLE:
-                    fprintf(fp, "%s", arg->as.double_num.lit);
+                    buf_puts(em->out, arg->as.double_num.lit);
                     break;
                 case ND_STR:
-                    fprintf(fp, "\"%s\"", arg->as.str);
+                    buf_printf(em->out, "\"%s\"", arg->as.str);
                     break;
                 case ND_IDENT:
-                    fprintf(fp, "%s", get_name(arg));
+                    buf_puts(em->out, em->lan == LAN_C && em->unity ? c_var_name(em, arg) : get_name(arg));
                     break;
                 case ND_BINOP:
-                    gen_expr(fp, arg);
+                    gen_expr(em, arg);
                     break;
                 case ND_INDEX:
-                    gen_expr(fp, arg);
+                    gen_expr(em, arg);
                     break;
                 case ND_ARRAY:
-                    gen_expr(fp, arg);
+                    gen_expr(em, arg);
                     break;
                 default:
-                    fprintf(fp, "print: unknown kind of arg: %d\n", arg->kind);
+                    buf_printf(em->out, "print: unknown kind of arg: %d\n", arg->kind);
                 }
                 if (i < expr->as.call.argc - 1) {
-                    fprintf(fp, ", ");
+                    buf_puts(em->out, ", ");
                 }
             }
-            fprintf(fp, ")");
+            buf_putc(em->out, ')');
         }
         return;
     }
@@ -628,64 +1150,66 @@ static void gen_expr(FILE *fp, Node *expr) {
         printf("Error: unknown node kind for gen_expr: %d\n", expr->kind);
         return;
     }
+    if (em->lan == LAN_JS && gen_js_num(em, expr)) return;
     // 处理二元表达式
+    bool operand = expr->as.bop.op != OP_ASN;
     // 左膀，gen_expr_win完成之后，结果存在rax中
-    gen_expr(fp, expr->as.bop.left);
+    gen_operand(em, expr->as.bop.left, operand);
     // 操作符
     switch (expr->as.bop.op) {
     case OP_ADD:
-        fprintf(fp, " + ");
+        buf_puts(em->out, " + ");
         break;
     case OP_SUB:
-        fprintf(fp, " - ");
+        buf_puts(em->out, " - ");
         break;
     case OP_MUL:
-        fprintf(fp, " * ");
+        buf_puts(em->out, " * ");
         break;
     case OP_DIV:
-        fprintf(fp, " / ");
+        buf_puts(em->out, " / ");
         break;
     case OP_GT:
-        fprintf(fp, " > ");
+        buf_puts(em->out, " > ");
         break;
     case OP_LT:
-        fprintf(fp, " < ");
+        buf_puts(em->out, " < ");
         break;
     case OP_GE:
-        fprintf(fp, " >= ");
+        buf_puts(em->out, " >= ");
         break;
     case OP_LE:
-        fprintf(fp, " <= ");
+        buf_puts(em->out, " <= ");
         break;
     case OP_EQ:
-        fprintf(fp, " == ");
+        buf_puts(em->out, " == ");
         break;
     case OP_NE:
-        fprintf(fp, " != ");
+        buf_puts(em->out, " != ");
         break;
     case OP_AND:
-        if (META.lan == LAN_PY) fprintf(fp, " and ");
-        else fprintf(fp, " && ");
+        if (em->lan == LAN_PY) buf_puts(em->out, " and ");
+        else buf_puts(em->out, " && ");
         break;
     case OP_OR:
-        if (META.lan == LAN_PY) fprintf(fp, " or ");
-        else fprintf(fp, " || ");
+        if (em->lan == LAN_PY) buf_puts(em->out, " or ");
+        else buf_puts(em->out, " || ");
         break;
     case OP_ASN:
-        fprintf(fp, " = ");
+        buf_puts(em->out, " = ");
         break;
     default:
         printf("Error: unknown operator for binop expr: %d\n", expr->as.bop.op);
     }
     // 右臂
-    gen_expr(fp, expr->as.bop.right);
+    gen_operand(em, expr->as.bop.right, operand);
 }
 
 static Node *last_expr(Node *prog) {
     return prog->as.exprs.list[prog->as.exprs.count - 1];
 }
 
-// 把Z语言代码的语句重新组织：全局定义放在前面；其他语句统一填入main函数
+// 把Z语言代码的语句重新组织：全局定义（函数和类型）放在前面；其他语句统一填入main函数
 static Node *extract_main(Node *prog) {
     Node *p = new_prog();
     if (prog->as.exprs.count == 0) {
@@ -701,7 +1225,7 @@ static Node *extract_main(Node *prog) {
     for (int i = 0; i < prog->as.exprs.count; ++i) {
         Node *expr = prog->as.exprs.list[i];
         if (expr->kind == ND_USE) continue;
-        if (expr->kind == ND_FN) {
+        if (expr->kind == ND_FN || expr->kind == ND_TYPE) {
             append_expr(p, expr);
         } else {
             append_expr(main->as.fn.body, expr);
@@ -711,71 +1235,67 @@ static Node *extract_main(Node *prog) {
     return p;
 }
 
-// 将AST编译成C代码
-static void codegen_c_app(Node *prog) {
-    do_meta_c(prog);
-    META.lan = LAN_C;
-
-    prog = extract_main(prog);
-    // 打开输出文件
-    FILE *fp = fopen("app.c", "w"); // TODO: 以后还统一叫app.c吗？
-    HashIter *i = hash_iter(META.imports);
+static void gen_imports(Emitter *em) {
+    HashIter *i = hash_iter(em->imports);
     int imports = 0;
-    while (hash_next(META.imports, i)) {
-        fprintf(fp, "#include %s\n", i->key);
+    while (hash_next(em->imports, i)) {
+        buf_printf(em->out, "#include %s\n", i->key);
         imports++;
     }
-    if (imports > 0) fprintf(fp, "\n");
-    /*
-    for (int i = 0; i < META.use_count; ++i) {
-        fprintf(fp, "#include %s\n", META.uses[i]);
-    }
-    if (META.use_count > 0) fprintf(fp, "\n");
-    */
+    if (imports > 0) buf_putc(em->out, '\n');
+}
 
-    // 生成多条语句
+// 生成应用模块的语句：全局定义之后是main函数
+static void gen_app(Emitter *em, Node *prog) {
+    prog = extract_main(prog);
     for (int i = 0; i < prog->as.exprs.count; ++i) {
         Node *expr = prog->as.exprs.list[i];
         if (expr->kind == ND_USE) continue;
-        gen_expr(fp, expr);
-        if (i < prog->as.exprs.count - 1 && expr->kind == ND_FN) {
-            fprintf(fp, "\n");
+        gen_expr(em, expr);
+        if (expr->kind == ND_TYPE) buf_puts(em->out, ";\n");
+        if (i < prog->as.exprs.count - 1 && (expr->kind == ND_FN || expr->kind == ND_TYPE)) {
+            buf_putc(em->out, '\n');
         }
     }
-
-    // 保存并关闭文件
-    fclose(fp);
 }
 
-static void gen_fn_header(FILE *fp, Node *expr) {
-    char *name = expr->as.fn.name;
-    Params *params = expr->as.fn.params;
-    fprintf(fp, "int %s(", name);
-    if (params == NULL) {
-        fprintf(fp, "void");
-    } else {
-        for (int i = 0; i < params->count; ++i) {
-            Node *param = params->list[i];
-            fprintf(fp, "int %s", get_name(param));
-            if (i < params->count - 1) {
-                fprintf(fp, ", ");
-            }
-        }
+// 将AST编译成C代码
+static void codegen_c_app(Node *prog) {
+    // 输出内容先写到缓冲中
+    Emitter e = {.out = new_buf(), .lan = LAN_C, .is_lib = false};
+    Emitter *em = &e;
+    do_meta_c(em, prog);
+
+    gen_imports(em);
+    /*
+    for (int i = 0; i < em->use_count; ++i) {
+        buf_printf(em->out, "#include %s\n", em->uses[i]);
     }
-    fprintf(fp, ");\n");
+    if (em->use_count > 0) buf_putc(em->out, '\n');
+    */
+    gen_app(em, prog);
+
+    // 一次性写入文件
+    save_file(em->out, "app.c");
+}
+
+static void gen_fn_header(Emitter *em, Node *expr) {
+    gen_c_fn_head(em, expr, false);
+    buf_puts(em->out, ";\n");
 }
 
 // 将AST编译成C代码
 static void codegen_c_lib(Mod *mod, char *name) {
     Node *prog = mod->prog;
-    do_meta_c(prog);
-    META.lan = LAN_C;
+    Emitter e = {.out = new_buf(), .lan = LAN_C, .is_lib = true};
+    Emitter *em = &e;
+    do_meta_c(em, prog);
 
     char *c_file = sfmt("%s.c", name);
     char *h_file = sfmt("%s.h", name);
 
     // 找到所有的定义，放到头文件中
-    FILE *hp = fopen(h_file, "w");
+    Emitter header = {.out = new_buf(), .lan = LAN_C, .is_lib = true};
     Scope *scope = mod->scope;
     HashIter *i = hash_iter(scope->as.block->table);
     while (hash_next(scope->as.block->table, i)) {
@@ -783,46 +1303,166 @@ static void codegen_c_lib(Mod *mod, char *name) {
         switch (meta->kind) {
         case ND_FN: // 暂时只有函数定义需要输出到头文件
             if (meta->is_def == false) continue;
-            gen_fn_header(hp, meta->node);
+            gen_fn_header(&header, meta->node);
             break;
         }
     }
 
-    fclose(hp);
+    save_file(header.out, h_file);
 
     // 输出C文件
-    FILE *fp = fopen(c_file, "w");
-    fprintf(fp, "#include \"%s\"\n", h_file);
-    for (int i = 0; i < META.use_count; ++i) {
-        fprintf(fp, "#include %s\n", META.uses[i]);
+    buf_printf(em->out, "#include \"%s\"\n", h_file);
+    for (int i = 0; i < em->use_count; ++i) {
+        buf_printf(em->out, "#include %s\n", em->uses[i]);
     }
-    if (META.use_count > 0) fprintf(fp, "\n");
+    if (em->use_count > 0) buf_putc(em->out, '\n');
 
     // 生成多条语句
     for (int i = 0; i < prog->as.exprs.count; ++i) {
         Node *expr = prog->as.exprs.list[i];
         if (expr->kind == ND_USE) continue;
-        gen_expr(fp, expr);
-        if (i < prog->as.exprs.count - 1 && expr->kind == ND_FN) {
-            fprintf(fp, "\n");
+        gen_expr(em, expr);
+        if (expr->kind == ND_TYPE) buf_puts(em->out, ";\n");
+        if (i < prog->as.exprs.count - 1 && (expr->kind == ND_FN || expr->kind == ND_TYPE)) {
+            buf_putc(em->out, '\n');
         }
     }
 
-    // 保存并关闭文件
-    fclose(fp);
+    // 一次性写入文件
+    save_file(em->out, c_file);
 }
 
-static void codegen_c(Front *front) {
-    // 遍历front的所有模块：
+// 把front的所有模块收集到一个数组中，以便分给多个线程
+static Mod **list_mods(Front *front, int *count) {
+    Mod **mods = calloc(front->mods->size, sizeof(Mod*));
+    int n = 0;
     HashIter *i = hash_iter(front->mods);
     while (hash_next(front->mods, i)) {
-        Mod *mod = (Mod*)i->value;
-        if (strcmp(mod->name, "app") == 0) {
-            codegen_c_app(mod->prog);
-        } else {
-            codegen_c_lib(mod, mod->name);
+        mods[n++] = (Mod*)i->value;
+    }
+    *count = n;
+    return mods;
+}
+
+static void codegen_c_task(void *arg, int i) {
+    Mod *mod = ((Mod**)arg)[i];
+    if (strcmp(mod->name, "app") == 0) {
+        codegen_c_app(mod->prog);
+    } else {
+        codegen_c_lib(mod, mod->name);
+    }
+}
+
+// 最近一次转译生成的C文件
+static char **c_files;
+static int c_file_count;
+
+// 按依赖顺序收集模块：被引用的模块排在引用它的模块之前
+static void order_mods(Front *front, Mod *mod, HashTable *seen, Mod **list, int *count) {
+    hash_set_int(seen, mod->name, 1);
+    Node *prog = mod->prog;
+    for (int i = 0; i < prog->as.exprs.count; ++i) {
+        Node *expr = prog->as.exprs.list[i];
+        if (expr->kind != ND_USE) continue;
+        Mod *dep = find_mod(front, expr->as.use.mod);
+        if (dep != NULL && !hash_has(seen, dep->name)) {
+            order_mods(front, dep, seen, list, count);
         }
     }
+    list[(*count)++] = mod;
+}
+
+// 库模块在单文件中的代码：先是类型定义，再是所有函数的声明和全局存量，最后是函数定义和其他语句。
+// 有了声明，模块内的函数可以互相调用，不必在意定义的先后。
+// 全局存量和函数一样加上模块名作前缀，并且是static的
+static void gen_unity_lib(Emitter *em, Mod *mod) {
+    Node *prog = mod->prog;
+    em->mod = mod->name;
+    em->global_count = 0;
+    for (int i = 0; i < prog->as.exprs.count; ++i) {
+        Node *expr = prog->as.exprs.list[i];
+        if (expr->kind != ND_LET && expr->kind != ND_MUT) continue;
+        if (em->global_count >= MAX_GLOBALS) {
+            printf("Error: too many global variables in module %s\n", mod->name);
+            exit(1);
+        }
+        em->globals[em->global_count++] = expr->as.asn.name->meta;
+    }
+    for (int i = 0; i < prog->as.exprs.count; ++i) {
+        Node *expr = prog->as.exprs.list[i];
+        if (expr->kind != ND_TYPE) continue;
+        gen_expr(em, expr);
+        buf_puts(em->out, ";\n\n");
+    }
+    int fns = 0;
+    for (int i = 0; i < prog->as.exprs.count; ++i) {
+        Node *expr = prog->as.exprs.list[i];
+        if (expr->kind != ND_FN) continue;
+        buf_puts(em->out, "static ");
+        gen_fn_header(em, expr);
+        fns++;
+    }
+    if (fns > 0) buf_putc(em->out, '\n');
+    for (int i = 0; i < prog->as.exprs.count; ++i) {
+        Node *expr = prog->as.exprs.list[i];
+        if (expr->kind != ND_LET && expr->kind != ND_MUT) continue;
+        // 全局存量放在函数定义之前，函数中才能使用它们
+        buf_puts(em->out, "static ");
+        gen_expr(em, expr);
+        buf_puts(em->out, ";\n");
+    }
+    if (em->global_count > 0) buf_putc(em->out, '\n');
+    for (int i = 0; i < prog->as.exprs.count; ++i) {
+        Node *expr = prog->as.exprs.list[i];
+        if (expr->kind == ND_USE || expr->kind == ND_TYPE || expr->kind == ND_LET || expr->kind == ND_MUT) continue;
+        gen_expr(em, expr);
+        if (expr->kind == ND_FN) buf_putc(em->out, '\n');
+    }
+    em->mod = NULL;
+    em->global_count = 0;
+}
+
+// 单文件模式（`-funity`）：把所有模块按依赖顺序输出到app.c中，函数都是static的，
+// 这样C编译器能看到整个程序，可以跨模块内联和优化。库模块的函数名都加上了模块名作前缀（见c_fn_name）
+static void codegen_c_unity(Front *front, Mod *app) {
+    Emitter e = {.out = new_buf(), .lan = LAN_C, .is_lib = false, .unity = true};
+    Emitter *em = &e;
+    Mod **mods = calloc(front->mods->size, sizeof(Mod*));
+    int count = 0;
+    order_mods(front, app, new_hash_table(), mods, &count);
+
+    for (int i = 0; i < count; ++i) {
+        do_meta_c(em, mods[i]->prog);
+    }
+    gen_imports(em);
+
+    for (int i = 0; i < count; ++i) {
+        if (mods[i] == app) continue;
+        gen_unity_lib(em, mods[i]);
+    }
+    gen_app(em, app->prog);
+    free(mods);
+
+    save_file(em->out, "app.c");
+    c_files[0] = "app.c";
+    c_file_count = 1;
+}
+
+// 各个模块的代码生成互不依赖，并行进行
+static void codegen_c(Front *front) {
+    int count;
+    Mod **mods = list_mods(front, &count);
+    pool_run(count, codegen_c_task, mods);
+    c_file_count = 0;
+    for (int i = 0; i < count; ++i) {
+        c_files[c_file_count++] = strcmp(mods[i]->name, "app") == 0 ? "app.c" : sfmt("%s.c", mods[i]->name);
+    }
+    free(mods);
+}
+
+char **c_sources(int *count) {
+    *count = c_file_count;
+    return c_files;
 }
 
 void trans_c(char *file) {
@@ -835,16 +1475,21 @@ void trans_c(char *file) {
     mod->name = "app";
     trace_node(mod->prog);
     // 输出C代码
-    codegen_c(front);
+    c_files = realloc(c_files, front->mods->size * sizeof(char*));
+    if (OPT.unity) {
+        codegen_c_unity(front, mod);
+    } else {
+        codegen_c(front);
+    }
 }
 
 // 将AST编译成Python代码
 static void codegen_py_mod(Mod *mod) {
     Node *prog = mod->prog;
-    META.lan = LAN_PY;
-    // 打开输出文件
+    // 输出内容先写到缓冲中
     char *fname = sfmt("%s.py", mod->name);
-    FILE *fp = fopen(fname, "w");
+    Emitter e = {.out = new_buf(), .lan = LAN_PY, .numpy = OPT.numpy, .source = mod->source};
+    Emitter *em = &e;
     bool has_import = false;
     char *name_in_use = "";
     for (int i = 0; i < prog->as.exprs.count; ++i) {
@@ -852,7 +1497,7 @@ static void codegen_py_mod(Mod *mod) {
         if (expr->kind == ND_USE) {
             char *name = expr->as.use.name;
             if (name && strcmp(name, name_in_use) != 0) {
-                fprintf(fp, "from %s import %s\n", expr->as.use.mod, expr->as.use.name);
+                buf_printf(em->out, "from %s import %s\n", expr->as.use.mod, expr->as.use.name);
                 has_import = true;
             }
             name_in_use = name;
@@ -861,7 +1506,7 @@ static void codegen_py_mod(Mod *mod) {
             if (name_node->kind == ND_IDENT) {
                 char *name = get_name(expr->as.call.name);
                 if (strcmp(name, "print") != 0 && strcmp(name, name_in_use) != 0) {
-                    fprintf(fp, "from stdz import *\n", META.uses[i]);
+                    buf_puts(em->out, "from stdz import *\n");
                     has_import = true;
                 }
             }
@@ -874,29 +1519,51 @@ static void codegen_py_mod(Mod *mod) {
         if (path->as.path.len < 2) continue;
         char *mod = path->as.path.names[0].name;
         char *name = path->as.path.names[1].name;
-        fprintf(fp, "from %s import %s\n", mod, name);
+        buf_printf(em->out, "from %s import %s\n", mod, name);
         has_import = true;
     }
-    if (has_import) {
-        fprintf(fp, "\n");
-    }
+    // 是否用到NumPy要生成完才知道，所以语句先写到另一个缓冲中
+    Buf *head = em->out;
+    em->out = new_buf();
+    if (OPT.source_map) em->map = new_srcmap();
     for (int i = 0; i < prog->as.exprs.count; ++i) {
         Node *expr = prog->as.exprs.list[i];
         if (expr->kind == ND_USE) continue;
-        gen_expr(fp, expr);
-        fprintf(fp, "\n");
+        gen_expr(em, expr);
+        buf_putc(em->out, '\n');
     }   
-    // 保存并关闭文件
-    fclose(fp);
+    if (em->use_numpy) {
+        buf_puts(head, "import numpy as np\n");
+        has_import = true;
+    }
+    if (has_import) {
+        buf_putc(head, '\n');
+    }
+    if (em->map) {
+        // 语句前面插入了import，映射要下移
+        srcmap_shift(em->map, count_lines(head));
+        int total = count_lines(head) + count_lines(em->out);
+        char *map_name = sfmt("%s.py.map", mod->name);
+        if (!srcmap_save_lines(em->map, map_name, fname, mod->source->name, total)) {
+            printf("Error: failed to write %s\n", map_name);
+        }
+        free_srcmap(em->map);
+    }
+    buf_putn(head, em->out->data, em->out->len);
+    free_buf(em->out);
+    // 一次性写入文件
+    save_file(head, fname);
+}
+
+static void codegen_py_task(void *arg, int i) {
+    codegen_py_mod(((Mod**)arg)[i]);
 }
 
 static void codegen_py(Front *front) {
-    // 遍历front的所有模块：
-    HashIter *i = hash_iter(front->mods);
-    while (hash_next(front->mods, i)) {
-        Mod *mod = (Mod*)i->value;
-        codegen_py_mod(mod);
-    }
+    int count;
+    Mod **mods = list_mods(front, &count);
+    pool_run(count, codegen_py_task, mods);
+    free(mods);
 }
 
 static void use_charts() {
@@ -921,11 +1588,11 @@ void trans_py(char *file) {
 // 将AST编译成JS代码
 static void codegen_js_mod(Mod *mod) {
     Node *prog = mod->prog;
-    META.lan = LAN_JS;
     Node *expr = prog->as.exprs.list[0];
-    // 打开输出文件
+    // 输出内容先写到缓冲中
     char *fname = sfmt("%s.js", mod->name);
-    FILE *fp = fopen(fname, "w");
+    Emitter e = {.out = new_buf(), .lan = LAN_JS, .source = mod->source};
+    Emitter *em = &e;
     // 第一道收集信息，顺便打出import语句
     bool has_import = false;
     char *name_in_use = "";
@@ -935,7 +1602,7 @@ static void codegen_js_mod(Mod *mod) {
         if (expr->kind == ND_USE) {
             char *name = expr->as.use.name;
             if (name != NULL && strcmp(name, name_in_use) != 0) {
-                fprintf(fp, "import {%s} from \"./%s\"\n", expr->as.use.name, expr->as.use.mod);
+                buf_printf(em->out, "import {%s} from \"./%s\"\n", expr->as.use.name, expr->as.use.mod);
                 has_import = true;
             }
             name_in_use = name;
@@ -949,11 +1616,11 @@ static void codegen_js_mod(Mod *mod) {
                 } else if (expr->meta) {
                     Meta *m = (Meta*)expr->meta;
                     if (m->kind == ND_FN && m->is_def == false) {
-                        fprintf(fp, "import {%s} from \"./stdz.js\"\n", name);
+                        buf_printf(em->out, "import {%s} from \"./stdz.js\"\n", name);
                         has_import = true;
                     }
                 } else if (strcmp(name, name_in_use) != 0) {
-                    fprintf(fp, "import {%s} from \"./stdz.js\"\n", name);
+                    buf_printf(em->out, "import {%s} from \"./stdz.js\"\n", name);
                     has_import = true;
                 }
             }
@@ -966,31 +1633,42 @@ static void codegen_js_mod(Mod *mod) {
         if (path->as.path.len < 2) continue;
         char *mod = path->as.path.names[0].name;
         char *name = path->as.path.names[1].name;
-        fprintf(fp, "import {%s} from \"./%s\"\n", name, mod);
+        buf_printf(em->out, "import {%s} from \"./%s\"\n", name, mod);
         has_import = true;
     }
     if (has_import) {
-        fprintf(fp, "\n");
+        buf_putc(em->out, '\n');
     }
     // 第二道，遍历每个语句，生成代码
+    if (OPT.source_map) em->map = new_srcmap();
     for (int i = 0; i < prog->as.exprs.count; ++i) {
         Node *expr = prog->as.exprs.list[i];
         if (expr->kind == ND_USE) continue;
-        gen_expr(fp, expr);
-        fprintf(fp, "\n");
+        gen_expr(em, expr);
+        buf_putc(em->out, '\n');
+    }
+    if (em->map) {
+        char *map_name = sfmt("%s.js.map", mod->name);
+        if (!srcmap_save_js(em->map, map_name, fname, mod->source->name)) {
+            printf("Error: failed to write %s\n", map_name);
+        }
+        buf_printf(em->out, "//# sourceMappingURL=%s\n", map_name);
+        free_srcmap(em->map);
     }
     
-    // 保存并关闭文件
-    fclose(fp);
+    // 一次性写入文件
+    save_file(em->out, fname);
+}
+
+static void codegen_js_task(void *arg, int i) {
+    codegen_js_mod(((Mod**)arg)[i]);
 }
 
 static void codegen_js(Front *front) {
-    // 遍历front的所有模块：
-    HashIter *i = hash_iter(front->mods);
-    while (hash_next(front->mods, i)) {
-        Mod *mod = (Mod*)i->value;
-        codegen_js_mod(mod);
-    }
+    int count;
+    Mod **mods = list_mods(front, &count);
+    pool_run(count, codegen_js_task, mods);
+    free(mods);
 }
 
 static void use_js_stdz() {
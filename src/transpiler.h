@@ -5,6 +5,9 @@
 // 将AST编译成C代码
 void trans_c(char *file);
 
+// 最近一次trans_c生成的C文件，交给C编译器（见cc.h）编译
+char **c_sources(int *count);
+
 // 将AST编译成Python代码
 void trans_py(char *file);
 
@@ -1,5 +1,6 @@
 #include <stdlib.h>
 #include "type.h"
+#include "meta.h"
 #include "string.h"
 
 const Type TYPE_BOOL = {TY_BOOL, "bool", 1};
@@ -10,7 +11,7 @@ const Type TYPE_DOUBLE = {TY_DOUBLE, "double", 8};
 const Type TYPE_STR = {TY_STR, "str", 0};
 
 Type *new_user_type(char *name) {
-    Type *type = malloc(sizeof(Type));
+    Type *type = calloc(1, sizeof(Type));
     type->kind = TY_USER;
     type->name = name;
     return type;
@@ -51,3 +52,41 @@ Type *check_primary_type(Node *node) {
         return NULL;
     }
 }
+
+int type_size(const Type *type) {
+    switch (type->kind) {
+    case TY_INT:
+    case TY_BOOL:
+    case TY_BYTE:
+    case TY_FLOAT:
+    case TY_DOUBLE:
+        return type->as.num.size;
+    case TY_USER:
+        return type->as.user.size;
+    case TY_ARRAY:
+        return type->as.array.size * type_size(type->as.array.item);
+    case TY_VOID:
+        return 0;
+    default: // 字符串、函数、字典等都按指针存储
+        return 8;
+    }
+}
+
+int type_align(Type *type) {
+    switch (type->kind) {
+    case TY_USER: {
+        int align = 1;
+        for (int i = 0; i < type->as.user.field_count; i++) {
+            int a = type_align(type->as.user.fields[i]->type);
+            if (a > align) align = a;
+        }
+        return align;
+    }
+    case TY_ARRAY:
+        return type_align(type->as.array.item);
+    default: {
+        int size = type_size(type);
+        return size > 0 ? size : 1;
+    }
+    }
+}
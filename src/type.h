@@ -32,8 +32,9 @@ struct TypeNum {
 struct TypeUser {
     int size; // 结构体所占的存储空间，字节数
     int field_count; // 成员字段个数
+    Meta **fields; // 按声明顺序排列的字段元信息，字段Meta的seq即其在对象中的槽位，offset即其字节偏移
 
-    HashTable *members; // 成员表：{名称->Meta*}
+    HashTable *members; // 成员表：{名称->Meta*}，包括字段和方法
 };
 
 struct TypeFn {
@@ -83,3 +84,9 @@ Type *new_array_type(Type *item, int size);
 Type *new_dict_type(Type *key, Type *val);
 
 Type *check_primary_type(Node *node);
+
+// 类型所占的字节数
+int type_size(const Type *type);
+
+// 类型的对齐要求，字节数
+int type_align(Type *type);
@@ -1,5 +1,6 @@
 #include <stdlib.h>
 #include "value.h"
+#include "meta.h"
 
 Value *new_int(int num) {
     Value *val = calloc(1, sizeof(Value));
@@ -47,6 +48,15 @@ Value *new_dict_val(HashTable *entries) {
     return val;
 }
 
+Value *new_obj_val(Type *type) {
+    Value *val = calloc(1, sizeof(Value));
+    val->kind = VAL_OBJ;
+    int count = type->as.user.field_count;
+    val->as.obj = calloc(1, sizeof(ValObj) + count * sizeof(Value *));
+    val->as.obj->type = type;
+    return val;
+}
+
 const Value TRUE_VAL = {VAL_BOOL, {true}};
 const Value FALSE_VAL = {VAL_BOOL, {false}};
 const Value NIL_VAL = {VAL_NIL, {0}};
@@ -189,6 +199,17 @@ void print_val(Value *val) {
         }
         printf("}");
         break;
+    case VAL_OBJ: {
+        TypeUser *user = &val->as.obj->type->as.user;
+        printf("{");
+        for (int i = 0; i < user->field_count; i++) {
+            if (i > 0) printf(", ");
+            printf("%s: ", user->fields[i]->name);
+            print_val(val->as.obj->fields[i]);
+        }
+        printf("}");
+        break;
+    }
     default:
         printf("Unknown value kind: %d\n", val->kind);
     }
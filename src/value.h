@@ -1,10 +1,12 @@
 #pragma once
 #include <stdbool.h>
 #include "zast.h"
+#include "type.h"
 
 typedef struct Value Value;
 typedef struct ValArray ValArray;
 typedef struct ValDict ValDict;
+typedef struct ValObj ValObj;
 
 /**
  * @brief 存值的种类
@@ -18,6 +20,7 @@ typedef enum {
     VAL_STR, /**< 字符串 */
     VAL_ARRAY, /**< 数组 */
     VAL_DICT, /**< 字典 */
+    VAL_OBJ, /**< 自定义类型的对象 */
     VAL_NIL /**< 空值 */
 } ValueKind;
 
@@ -31,6 +34,14 @@ struct ValDict {
     HashTable *entries;
 };
 
+/**
+ * @brief 自定义类型的对象。字段按类型中的槽位顺序紧凑存放，访问时直接按槽位取值。
+ */
+struct ValObj {
+    Type *type; /**< 对象的类型 */
+    Value *fields[]; /**< 字段值，个数为type->as.user.field_count */
+};
+
 /**
  * @brief 存值
  */
@@ -45,6 +56,7 @@ struct Value {
         char *str; /**< 字符串 */
         ValArray *array; /**< 数组 */
         ValDict *dict;
+        ValObj *obj; /**< 对象 */
     } as;
 };
 
@@ -57,6 +69,7 @@ Value *new_nil();
 Value *new_fn(Fn *fn);
 Value *new_array_val(int count);
 Value *new_dict_val(HashTable *entries);
+Value *new_obj_val(Type *type);
 
 Value *neg_val(Value *val);
 Value *add_val(Value *a, Value *b);
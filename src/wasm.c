@@ -0,0 +1,924 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "wasm.h"
+#include "parser.h"
+#include "util.h"
+#include "front.h"
+#include "buf.h"
+#include "type.h"
+
+// WebAssembly后端
+//
+// 直接从类型检查过的AST（见check.c）生成.wasm的二进制格式：
+// - int和bool是i32，float是f32，double是f64，运算按Spec选择对应的指令；类型不确定的运算不支持
+// - 每个函数都导出，模块顶层的语句放到导出的main函数中，和C转译器一样，顶层的存量是main的局部变量
+// - 数值数组放在线性内存的栈帧中：全局变量sp是栈顶，函数进入时减去栈帧的大小，返回前恢复
+// - 字符串字面量放在数据段中
+// - print由加载器提供，从env模块导入：print_int、print_float、print_double、print_bool、print_str
+//
+// 加载器app.mjs在node中用fs读取app.wasm，在浏览器中用fetch，实例化之后调用main。
+
+#define MAX_LOCALS 256
+#define MAX_VARS 256
+#define PAGES 16 // 线性内存的大小：1MB，栈从顶部向下增长
+#define DATA_BASE 1024 // 字符串字面量的起始地址
+
+// 值的类型
+#define WT_I32 0x7F
+#define WT_F32 0x7D
+#define WT_F64 0x7C
+#define WT_VOID 0x40 // 没有结果的块
+
+// 用到的指令
+#define W_BLOCK 0x02
+#define W_LOOP 0x03
+#define W_IF 0x04
+#define W_ELSE 0x05
+#define W_END 0x0B
+#define W_BR 0x0C
+#define W_BR_IF 0x0D
+#define W_CALL 0x10
+#define W_DROP 0x1A
+#define W_LOCAL_GET 0x20
+#define W_LOCAL_SET 0x21
+#define W_GLOBAL_GET 0x23
+#define W_GLOBAL_SET 0x24
+#define W_I32_LOAD 0x28
+#define W_F32_LOAD 0x2A
+#define W_F64_LOAD 0x2B
+#define W_I32_STORE 0x36
+#define W_F32_STORE 0x38
+#define W_F64_STORE 0x39
+#define W_I32_CONST 0x41
+#define W_F32_CONST 0x43
+#define W_F64_CONST 0x44
+#define W_I32_EQZ 0x45
+#define W_I32_EQ 0x46
+#define W_I32_NE 0x47
+#define W_I32_ADD 0x6A
+#define W_I32_SUB 0x6B
+#define W_I32_MUL 0x6C
+#define W_F32_NEG 0x8C
+#define W_F64_NEG 0x9A
+#define W_I32_TRUNC_F32 0xA8
+#define W_I32_TRUNC_F64 0xAA
+#define W_F32_CONVERT_I32 0xB2
+#define W_F32_DEMOTE_F64 0xB6
+#define W_F64_CONVERT_I32 0xB7
+#define W_F64_PROMOTE_F32 0xBB
+
+// 数值运算的指令，按Op中OP_ADD到OP_NE的顺序排列
+static const uint8_t I32_OPS[] = {0x6A, 0x6B, 0x6C, 0x6D, 0x4A, 0x48, 0x4E, 0x4C, 0x46, 0x47};
+static const uint8_t F32_OPS[] = {0x92, 0x93, 0x94, 0x95, 0x5E, 0x5D, 0x60, 0x5F, 0x5B, 0x5C};
+static const uint8_t F64_OPS[] = {0xA0, 0xA1, 0xA2, 0xA3, 0x64, 0x63, 0x66, 0x65, 0x61, 0x62};
+
+// 导入的print函数，它们在函数序号中排在最前面
+typedef enum {
+    IMP_INT,
+    IMP_FLOAT,
+    IMP_DOUBLE,
+    IMP_BOOL,
+    IMP_STR,
+    IMP_COUNT,
+} Import;
+
+static const char *IMPORT_NAMES[] = {"print_int", "print_float", "print_double", "print_bool", "print_str"};
+
+typedef struct Var Var;
+
+// 函数中的存量：标量是局部变量，数组在栈帧中
+struct Var {
+    Meta *meta;
+    const Type *type;
+    int local; // 局部变量的序号
+    int offset; // 数组在栈帧中的偏移
+    bool is_array;
+};
+
+typedef struct WasmFn WasmFn;
+
+// 正在生成的函数
+struct WasmFn {
+    Buf *code;
+    int param_count;
+    int local_count; // 包括参数
+    uint8_t local_types[MAX_LOCALS];
+    int var_count;
+    Var vars[MAX_VARS];
+    int frame; // 栈帧的大小
+    int fp; // 保存栈帧地址的局部变量，-1表示还没有
+};
+
+static WasmFn *F;
+static HashTable *fn_index; // 函数名 -> 函数序号
+static Buf *data; // 数据段，存放字符串字面量
+static Source *source; // 正在生成的模块的源码，报错时用来把节点位置换算成行列
+
+// 报错时给出节点在源码中的位置和节点的内容。echo_node只在开启LOG_TRACE时才输出，所以这里用fecho_node
+static void fail(const char *msg, Node *node) {
+    printf("Error: %s for wasm", msg);
+    if (source != NULL && node->loc != 0) {
+        int line, col;
+        source_locate(source, node->loc, &line, &col);
+        printf(" at %s:%d:%d", source->name, line, col);
+    }
+    printf(": ");
+    fecho_node(stdout, node);
+    printf("\n");
+    exit(1);
+}
+
+// 无符号LEB128编码
+static void put_u32(Buf *buf, uint32_t v) {
+    do {
+        uint8_t b = v & 0x7F;
+        v >>= 7;
+        if (v) b |= 0x80;
+        buf_putc(buf, b);
+    } while (v);
+}
+
+// 有符号LEB128编码
+static void put_s32(Buf *buf, int32_t v) {
+    for (;;) {
+        uint8_t b = v & 0x7F;
+        v >>= 7;
+        if ((v == 0 && !(b & 0x40)) || (v == -1 && (b & 0x40))) {
+            buf_putc(buf, b);
+            return;
+        }
+        buf_putc(buf, b | 0x80);
+    }
+}
+
+static void put_name(Buf *buf, const char *name) {
+    put_u32(buf, strlen(name));
+    buf_puts(buf, name);
+}
+
+// 一个段：段号、长度和内容
+static void put_section(Buf *out, uint8_t id, Buf *content) {
+    buf_putc(out, id);
+    put_u32(out, content->len);
+    buf_putn(out, content->data, content->len);
+    free_buf(content);
+}
+
+static void emit(uint8_t op) {
+    buf_putc(F->code, op);
+}
+
+static void emit_u32(uint8_t op, uint32_t v) {
+    emit(op);
+    put_u32(F->code, v);
+}
+
+static bool is_num(const Type *t) {
+    return t && (t->kind == TY_INT || t->kind == TY_BOOL || t->kind == TY_FLOAT || t->kind == TY_DOUBLE);
+}
+
+static uint8_t val_type(const Type *t) {
+    switch (t->kind) {
+    case TY_FLOAT: return WT_F32;
+    case TY_DOUBLE: return WT_F64;
+    default: return WT_I32;
+    }
+}
+
+static int new_local(const Type *t) {
+    if (F->local_count >= MAX_LOCALS) {
+        printf("Error: too many locals for wasm\n");
+        exit(1);
+    }
+    F->local_types[F->local_count] = val_type(t);
+    return F->local_count++;
+}
+
+static Var *add_var(Meta *m, const Type *t) {
+    if (F->var_count >= MAX_VARS) {
+        printf("Error: too many variables for wasm\n");
+        exit(1);
+    }
+    Var *v = &F->vars[F->var_count++];
+    v->meta = m;
+    v->type = t;
+    return v;
+}
+
+static Var *find_var(Meta *m) {
+    if (m == NULL) return NULL;
+    for (int i = F->var_count - 1; i >= 0; i--) {
+        Meta *vm = F->vars[i].meta;
+        if (vm == m || (vm->node && vm->node == m->node)) return &F->vars[i];
+    }
+    return NULL;
+}
+
+// 自定义函数的返回值类型，NULL表示没有返回值。
+// 没有标注返回值类型的函数默认返回int，除非函数体的最后是print
+static const Type *fn_ret(Node *fn) {
+    const Type *type = fn->as.fn.type;
+    if (type && type->as.fn.ret) return type->as.fn.ret;
+    Node *body = fn->as.fn.body;
+    if (body->kind == ND_BLOCK && body->as.exprs.count > 0) {
+        Node *last = body->as.exprs.list[body->as.exprs.count - 1];
+        if (last->kind == ND_CALL && strcmp(get_name(last->as.call.name), "print") == 0) return NULL;
+    }
+    return &TYPE_INT;
+}
+
+static const Type *type_of(Node *expr);
+
+// 特化运算的结果类型
+static const Type *spec_type(Spec spec, Node *expr) {
+    if (spec >= SP_ADD_INT && spec <= SP_DIV_INT) return &TYPE_INT;
+    if (spec >= SP_ADD_FLOAT && spec <= SP_DIV_FLOAT) return &TYPE_FLOAT;
+    if (spec >= SP_ADD_DOUBLE && spec <= SP_DIV_DOUBLE) return &TYPE_DOUBLE;
+    if (spec == SP_NEG_INT) return &TYPE_INT;
+    if (spec == SP_NEG_FLOAT) return &TYPE_FLOAT;
+    if (spec == SP_NEG_DOUBLE) return &TYPE_DOUBLE;
+    if (spec == SP_NONE) fail("operand types unknown", expr);
+    return &TYPE_BOOL;
+}
+
+// 运算的特化：数组元素在类型检查时是动态类型，这时按两边操作数的类型来确定
+static Spec bop_spec(Node *expr) {
+    BinOp *bop = &expr->as.bop;
+    if (bop->spec != SP_NONE || bop->op > OP_NE) return bop->spec;
+    const Type *l = type_of(bop->left), *r = type_of(bop->right);
+    if (!is_num(l) || !is_num(r)) fail("operand types unknown", expr);
+    if (l->kind == TY_BOOL && r->kind == TY_BOOL) {
+        if (bop->op == OP_EQ) return SP_EQ_BOOL;
+        if (bop->op == OP_NE) return SP_NE_BOOL;
+    }
+    if (l->kind == TY_DOUBLE || r->kind == TY_DOUBLE) return SP_ADD_DOUBLE + bop->op;
+    if (l->kind == TY_FLOAT || r->kind == TY_FLOAT) return SP_ADD_FLOAT + bop->op;
+    return SP_ADD_INT + bop->op;
+}
+
+static Spec una_spec(Node *expr) {
+    Unary *una = &expr->as.una;
+    if (una->spec != SP_NONE) return una->spec;
+    if (expr->kind == ND_NOT) return SP_NOT;
+    const Type *t = type_of(una->body);
+    if (!is_num(t)) fail("operand type unknown", expr);
+    return t->kind == TY_DOUBLE ? SP_NEG_DOUBLE : t->kind == TY_FLOAT ? SP_NEG_FLOAT : SP_NEG_INT;
+}
+
+// 表达式的类型，NULL表示没有值
+static const Type *type_of(Node *expr) {
+    switch (expr->kind) {
+    case ND_INT:
+    case ND_FLOAT:
+    case ND_DOUBLE:
+    case ND_BOOL:
+        return check_primary_type(expr);
+    case ND_IDENT: {
+        Var *v = find_var(expr->meta);
+        if (v == NULL || v->is_array) fail("unknown variable", expr);
+        return v->type;
+    }
+    case ND_BINOP:
+        if (expr->as.bop.op == OP_ASN) return NULL;
+        return spec_type(bop_spec(expr), expr);
+    case ND_NEG:
+    case ND_NOT:
+        return spec_type(una_spec(expr), expr);
+    case ND_CALL: {
+        if (strcmp(get_name(expr->as.call.name), "print") == 0) return NULL;
+        Meta *m = expr->meta;
+        if (m == NULL || m->node == NULL || m->node->kind != ND_FN) fail("unknown function", expr);
+        return fn_ret(m->node);
+    }
+    case ND_INDEX: {
+        Var *v = find_var(expr->as.index.parent->meta);
+        if (v == NULL || !v->is_array) fail("only local arrays can be indexed", expr);
+        return v->type->as.array.item;
+    }
+    case ND_IF:
+        return expr->as.if_else.els ? type_of(expr->as.if_else.then) : NULL;
+    case ND_BLOCK:
+        if (expr->as.exprs.count == 0) return NULL;
+        return type_of(expr->as.exprs.list[expr->as.exprs.count - 1]);
+    default:
+        return NULL;
+    }
+}
+
+// 把栈顶的值从have转换成want
+static void convert(const Type *have, const Type *want) {
+    uint8_t h = val_type(have), w = val_type(want);
+    if (h == w) return;
+    if (w == WT_F64) emit(h == WT_I32 ? W_F64_CONVERT_I32 : W_F64_PROMOTE_F32);
+    else if (w == WT_F32) emit(h == WT_I32 ? W_F32_CONVERT_I32 : W_F32_DEMOTE_F64);
+    else emit(h == WT_F32 ? W_I32_TRUNC_F32 : W_I32_TRUNC_F64);
+}
+
+static void emit_zero(const Type *t) {
+    switch (val_type(t)) {
+    case WT_F32:
+        emit(W_F32_CONST);
+        buf_putn(F->code, "\0\0\0\0", 4);
+        break;
+    case WT_F64:
+        emit(W_F64_CONST);
+        buf_putn(F->code, "\0\0\0\0\0\0\0\0", 8);
+        break;
+    default:
+        emit(W_I32_CONST);
+        put_s32(F->code, 0);
+    }
+}
+
+static void gen(Node *expr, const Type *want);
+
+// 数组元素的地址：fp + i * size，数组的偏移放在指令的offset中
+static Var *gen_addr(Node *expr) {
+    Var *v = find_var(expr->as.index.parent->meta);
+    if (v == NULL || !v->is_array) fail("only local arrays can be indexed", expr);
+    emit_u32(W_LOCAL_GET, F->fp);
+    gen(expr->as.index.idx, &TYPE_INT);
+    emit(W_I32_CONST);
+    put_s32(F->code, type_size(v->type->as.array.item));
+    emit(W_I32_MUL);
+    emit(W_I32_ADD);
+    return v;
+}
+
+// 读写内存的指令，后面是对齐（2的幂次）和偏移
+static void emit_mem(uint8_t op, const Type *item, int offset) {
+    emit(op);
+    put_u32(F->code, val_type(item) == WT_F64 ? 3 : 2);
+    put_u32(F->code, offset);
+}
+
+static uint8_t load_op(const Type *t) {
+    uint8_t v = val_type(t);
+    return v == WT_F64 ? W_F64_LOAD : v == WT_F32 ? W_F32_LOAD : W_I32_LOAD;
+}
+
+static uint8_t store_op(const Type *t) {
+    uint8_t v = val_type(t);
+    return v == WT_F64 ? W_F64_STORE : v == WT_F32 ? W_F32_STORE : W_I32_STORE;
+}
+
+// 在栈帧中为数组分配空间，并写入各个元素
+static void gen_array(Meta *m, Node *array) {
+    const Type *type = m->type;
+    if (type == NULL || type->kind != TY_ARRAY || !is_num(type->as.array.item)) {
+        fail("only arrays of numbers are supported", array);
+    }
+    const Type *item = type->as.array.item;
+    int size = type_size(item);
+    if (F->fp < 0) F->fp = new_local(&TYPE_INT);
+    F->frame = (F->frame + 7) & ~7;
+    Var *v = add_var(m, type);
+    v->is_array = true;
+    v->offset = F->frame;
+    F->frame += type->as.array.size * size;
+    for (int i = 0; i < array->as.array.size; i++) {
+        emit_u32(W_LOCAL_GET, F->fp);
+        gen(array->as.array.items[i], item);
+        emit_mem(store_op(item), item, v->offset + i * size);
+    }
+}
+
+static void gen_store(Node *expr) {
+    Meta *m = expr->as.asn.name->meta;
+    Node *value = expr->as.asn.value;
+    if (value->kind == ND_ARRAY) {
+        gen_array(m, value);
+        return;
+    }
+    const Type *type = is_num(m->type) ? m->type : type_of(value);
+    if (!is_num(type)) fail("only numbers can be stored", expr);
+    Var *v = add_var(m, type);
+    v->local = new_local(type);
+    gen(value, type);
+    emit_u32(W_LOCAL_SET, v->local);
+}
+
+static void gen_assign(Node *expr) {
+    Node *left = expr->as.bop.left;
+    if (left->kind == ND_INDEX) {
+        Var *v = gen_addr(left);
+        const Type *item = v->type->as.array.item;
+        gen(expr->as.bop.right, item);
+        emit_mem(store_op(item), item, v->offset);
+        return;
+    }
+    Var *v = find_var(left->meta);
+    if (v == NULL || v->is_array) fail("unknown variable", left);
+    gen(expr->as.bop.right, v->type);
+    emit_u32(W_LOCAL_SET, v->local);
+}
+
+static void gen_binop(Node *expr) {
+    BinOp *bop = &expr->as.bop;
+    Spec spec = bop_spec(expr);
+    switch (spec) {
+    case SP_AND:
+        // 短路求值：左边为假时不再计算右边
+        gen(bop->left, &TYPE_BOOL);
+        emit(W_IF);
+        emit(WT_I32);
+        gen(bop->right, &TYPE_BOOL);
+        emit(W_ELSE);
+        emit_zero(&TYPE_BOOL);
+        emit(W_END);
+        return;
+    case SP_OR:
+        gen(bop->left, &TYPE_BOOL);
+        emit(W_IF);
+        emit(WT_I32);
+        emit(W_I32_CONST);
+        put_s32(F->code, 1);
+        emit(W_ELSE);
+        gen(bop->right, &TYPE_BOOL);
+        emit(W_END);
+        return;
+    case SP_EQ_BOOL:
+    case SP_NE_BOOL:
+        gen(bop->left, &TYPE_BOOL);
+        gen(bop->right, &TYPE_BOOL);
+        emit(spec == SP_EQ_BOOL ? W_I32_EQ : W_I32_NE);
+        return;
+    default:
+        break;
+    }
+    if (spec >= SP_ADD_INT && spec <= SP_NE_INT) {
+        gen(bop->left, &TYPE_INT);
+        gen(bop->right, &TYPE_INT);
+        emit(I32_OPS[spec - SP_ADD_INT]);
+    } else if (spec >= SP_ADD_FLOAT && spec <= SP_NE_FLOAT) {
+        gen(bop->left, &TYPE_FLOAT);
+        gen(bop->right, &TYPE_FLOAT);
+        emit(F32_OPS[spec - SP_ADD_FLOAT]);
+    } else if (spec >= SP_ADD_DOUBLE && spec <= SP_NE_DOUBLE) {
+        gen(bop->left, &TYPE_DOUBLE);
+        gen(bop->right, &TYPE_DOUBLE);
+        emit(F64_OPS[spec - SP_ADD_DOUBLE]);
+    } else {
+        fail("operand types unknown", expr);
+    }
+}
+
+static void gen_unary(Node *expr) {
+    Unary *una = &expr->as.una;
+    switch (una_spec(expr)) {
+    case SP_NEG_INT:
+        // 0 - x
+        emit_zero(&TYPE_INT);
+        gen(una->body, &TYPE_INT);
+        emit(W_I32_SUB);
+        return;
+    case SP_NEG_FLOAT:
+        gen(una->body, &TYPE_FLOAT);
+        emit(W_F32_NEG);
+        return;
+    case SP_NEG_DOUBLE:
+        gen(una->body, &TYPE_DOUBLE);
+        emit(W_F64_NEG);
+        return;
+    case SP_NOT:
+        gen(una->body, &TYPE_BOOL);
+        emit(W_I32_EQZ);
+        return;
+    default:
+        fail("operand type unknown", expr);
+    }
+}
+
+static void gen_print(Node *expr) {
+    Node *arg = expr->as.call.args[0];
+    if (arg->kind == ND_STR) {
+        emit(W_I32_CONST);
+        put_s32(F->code, DATA_BASE + data->len);
+        emit(W_I32_CONST);
+        put_s32(F->code, strlen(arg->as.str));
+        emit_u32(W_CALL, IMP_STR);
+        buf_puts(data, arg->as.str);
+        return;
+    }
+    const Type *t = type_of(arg);
+    if (!is_num(t)) fail("only numbers and strings can be printed", arg);
+    gen(arg, t);
+    Import imp = t->kind == TY_FLOAT ? IMP_FLOAT : t->kind == TY_DOUBLE ? IMP_DOUBLE : t->kind == TY_BOOL ? IMP_BOOL : IMP_INT;
+    emit_u32(W_CALL, imp);
+}
+
+static void gen_call(Node *expr) {
+    if (strcmp(get_name(expr->as.call.name), "print") == 0) {
+        gen_print(expr);
+        return;
+    }
+    Node *fn = expr->meta ? expr->meta->node : NULL;
+    int idx = fn && fn->kind == ND_FN ? hash_get_int(fn_index, fn->as.fn.name) : 0;
+    if (idx == 0) fail("unknown function", expr);
+    Params *params = fn->as.fn.params;
+    for (int i = 0; i < expr->as.call.argc; i++) {
+        gen(expr->as.call.args[i], params->list[i]->meta->type);
+    }
+    emit_u32(W_CALL, idx);
+}
+
+static void gen_if(Node *expr, const Type *want) {
+    IfElse *ie = &expr->as.if_else;
+    gen(ie->cond, &TYPE_BOOL);
+    emit(W_IF);
+    if (want && ie->els) {
+        emit(val_type(want));
+        gen(ie->then, want);
+        emit(W_ELSE);
+        gen(ie->els, want);
+    } else {
+        emit(WT_VOID);
+        gen(ie->then, NULL);
+        if (ie->els) {
+            emit(W_ELSE);
+            gen(ie->els, NULL);
+        }
+    }
+    emit(W_END);
+}
+
+// block { loop { if !cond break; body; continue } }
+static void gen_for(Node *expr) {
+    emit(W_BLOCK);
+    emit(WT_VOID);
+    emit(W_LOOP);
+    emit(WT_VOID);
+    gen(expr->as.loop.cond, &TYPE_BOOL);
+    emit(W_I32_EQZ);
+    emit_u32(W_BR_IF, 1);
+    gen(expr->as.loop.body, NULL);
+    emit_u32(W_BR, 0);
+    emit(W_END);
+    emit(W_END);
+}
+
+static void gen_block(Node *expr, const Type *want) {
+    // 最后一个表达式是代码块的值，函数定义另外生成，不算在内
+    int last = expr->as.exprs.count - 1;
+    while (last >= 0 && expr->as.exprs.list[last]->kind == ND_FN) last--;
+    for (int i = 0; i <= last; i++) {
+        Node *e = expr->as.exprs.list[i];
+        if (e->kind == ND_FN) continue;
+        gen(e, i == last ? want : NULL);
+    }
+    if (want && last < 0) emit_zero(want);
+}
+
+// 生成表达式；want是需要的值的类型，NULL表示不需要值，有值时丢弃
+static void gen(Node *expr, const Type *want) {
+    const Type *have = NULL;
+    switch (expr->kind) {
+    case ND_BLOCK:
+    case ND_PROG:
+        gen_block(expr, want);
+        return;
+    case ND_INT:
+        emit(W_I32_CONST);
+        put_s32(F->code, expr->as.num.val);
+        have = &TYPE_INT;
+        break;
+    case ND_BOOL:
+        emit(W_I32_CONST);
+        put_s32(F->code, expr->as.bul ? 1 : 0);
+        have = &TYPE_BOOL;
+        break;
+    case ND_FLOAT:
+        emit(W_F32_CONST);
+        buf_putn(F->code, (char*)&expr->as.float_num.val, 4);
+        have = &TYPE_FLOAT;
+        break;
+    case ND_DOUBLE:
+        emit(W_F64_CONST);
+        buf_putn(F->code, (char*)&expr->as.double_num.val, 8);
+        have = &TYPE_DOUBLE;
+        break;
+    case ND_IDENT: {
+        Var *v = find_var(expr->meta);
+        if (v == NULL || v->is_array) fail("unknown variable", expr);
+        emit_u32(W_LOCAL_GET, v->local);
+        have = v->type;
+        break;
+    }
+    case ND_INDEX: {
+        Var *v = gen_addr(expr);
+        have = v->type->as.array.item;
+        emit_mem(load_op(have), have, v->offset);
+        break;
+    }
+    case ND_LET:
+    case ND_MUT:
+        gen_store(expr);
+        break;
+    case ND_BINOP:
+        if (expr->as.bop.op == OP_ASN) {
+            gen_assign(expr);
+            break;
+        }
+        gen_binop(expr);
+        have = type_of(expr);
+        break;
+    case ND_NEG:
+    case ND_NOT:
+        gen_unary(expr);
+        have = type_of(expr);
+        break;
+    case ND_CALL:
+        gen_call(expr);
+        have = type_of(expr);
+        break;
+    case ND_IF:
+        gen_if(expr, want);
+        if (want && expr->as.if_else.els) return;
+        break;
+    case ND_FOR:
+        gen_for(expr);
+        break;
+    case ND_FN:
+        break;
+    default:
+        fail("unsupported expression", expr);
+    }
+    if (want == NULL) {
+        if (have) emit(W_DROP);
+    } else if (have == NULL) {
+        emit_zero(want);
+    } else {
+        convert(have, want);
+    }
+}
+
+// 生成一个函数的代码段：局部变量的声明、栈帧的分配、函数体和栈帧的释放
+static void gen_fn_code(Buf *codes, Node *body, const Type *ret) {
+    gen(body, ret);
+
+    Buf *fn = new_buf();
+    // 局部变量按类型分组声明，这里每个变量单独一组
+    int locals = F->local_count - F->param_count;
+    put_u32(fn, locals);
+    for (int i = F->param_count; i < F->local_count; i++) {
+        put_u32(fn, 1);
+        buf_putc(fn, F->local_types[i]);
+    }
+    int frame = (F->frame + 15) & ~15;
+    if (frame > 0) {
+        // fp = sp = sp - frame
+        buf_putc(fn, W_GLOBAL_GET);
+        put_u32(fn, 0);
+        buf_putc(fn, W_I32_CONST);
+        put_s32(fn, frame);
+        buf_putc(fn, W_I32_SUB);
+        buf_putc(fn, 0x22); // local.tee
+        put_u32(fn, F->fp);
+        buf_putc(fn, W_GLOBAL_SET);
+        put_u32(fn, 0);
+        // 返回前恢复sp，返回值留在操作数栈上不受影响
+        emit_u32(W_LOCAL_GET, F->fp);
+        emit(W_I32_CONST);
+        put_s32(F->code, frame);
+        emit(W_I32_ADD);
+        emit_u32(W_GLOBAL_SET, 0);
+    }
+    emit(W_END);
+    buf_putn(fn, F->code->data, F->code->len);
+
+    put_u32(codes, fn->len);
+    buf_putn(codes, fn->data, fn->len);
+    free_buf(fn);
+    free_buf(F->code);
+}
+
+static void put_fn_type(Buf *types, Params *params, const Type *ret) {
+    buf_putc(types, 0x60);
+    int count = params ? params->count : 0;
+    put_u32(types, count);
+    for (int i = 0; i < count; i++) {
+        const Type *t = params->list[i]->meta->type;
+        if (!is_num(t)) fail("only number parameters are supported", params->list[i]);
+        buf_putc(types, val_type(t));
+    }
+    if (ret) {
+        put_u32(types, 1);
+        buf_putc(types, val_type(ret));
+    } else {
+        put_u32(types, 0);
+    }
+}
+
+static void codegen_wasm(Node *prog) {
+    Buf *types = new_buf();
+    Buf *imports = new_buf();
+    Buf *funcs = new_buf();
+    Buf *exports = new_buf();
+    Buf *codes = new_buf();
+    data = new_buf();
+    fn_index = new_hash_table();
+
+    // 导入的print函数
+    static const uint8_t IMPORT_TYPES[] = {WT_I32, WT_F32, WT_F64, WT_I32};
+    for (int i = 0; i < IMP_STR; i++) {
+        buf_putc(types, 0x60);
+        put_u32(types, 1);
+        buf_putc(types, IMPORT_TYPES[i]);
+        put_u32(types, 0);
+    }
+    buf_putn(types, "\x60\x02\x7F\x7F\x00", 5); // print_str(ptr, len)
+    put_u32(imports, IMP_COUNT);
+    for (int i = 0; i < IMP_COUNT; i++) {
+        put_name(imports, "env");
+        put_name(imports, IMPORT_NAMES[i]);
+        buf_putc(imports, 0x00); // 函数
+        put_u32(imports, i);
+    }
+
+    // 先给所有函数编号，函数体中就可以调用后面定义的函数
+    int type_count = IMP_COUNT;
+    int fn_count = 0;
+    for (int i = 0; i < prog->as.exprs.count; i++) {
+        Node *expr = prog->as.exprs.list[i];
+        if (expr->kind == ND_USE) fail("modules are not supported", expr);
+        if (expr->kind != ND_FN) continue;
+        hash_set_int(fn_index, expr->as.fn.name, IMP_COUNT + fn_count++);
+    }
+
+    // 各个函数
+    for (int i = 0; i < prog->as.exprs.count; i++) {
+        Node *expr = prog->as.exprs.list[i];
+        if (expr->kind != ND_FN) continue;
+        Params *params = expr->as.fn.params;
+        const Type *ret = fn_ret(expr);
+        put_fn_type(types, params, ret);
+        put_u32(funcs, type_count++);
+        put_name(exports, expr->as.fn.name);
+        buf_putc(exports, 0x00);
+        put_u32(exports, hash_get_int(fn_index, expr->as.fn.name));
+
+        WasmFn fn = {.code = new_buf(), .fp = -1};
+        F = &fn;
+        int count = params ? params->count : 0;
+        for (int j = 0; j < count; j++) {
+            Meta *m = params->list[j]->meta;
+            Var *v = add_var(m, m->type);
+            v->local = new_local(m->type);
+        }
+        fn.param_count = count;
+        gen_fn_code(codes, expr->as.fn.body, ret);
+    }
+
+    // 顶层语句放在main中，返回最后一个表达式的值
+    WasmFn main = {.code = new_buf(), .fp = -1};
+    F = &main;
+    Node *last = NULL;
+    for (int i = 0; i < prog->as.exprs.count; i++) {
+        if (prog->as.exprs.list[i]->kind != ND_FN) last = prog->as.exprs.list[i];
+    }
+    // 先生成一遍来确定最后一个表达式的类型（它可能用到前面定义的存量）
+    const Type *ret = NULL;
+    if (last) {
+        for (int i = 0; i < prog->as.exprs.count; i++) {
+            Node *expr = prog->as.exprs.list[i];
+            if (expr == last) break;
+            if (expr->kind != ND_FN) gen(expr, NULL);
+        }
+        ret = type_of(last);
+        free_buf(main.code);
+        main = (WasmFn){.code = new_buf(), .fp = -1};
+        data->len = 0;
+    }
+    buf_putc(types, 0x60);
+    put_u32(types, 0);
+    if (ret) {
+        put_u32(types, 1);
+        buf_putc(types, val_type(ret));
+    } else {
+        put_u32(types, 0);
+    }
+    put_u32(funcs, type_count++);
+    put_name(exports, "main");
+    buf_putc(exports, 0x00);
+    put_u32(exports, IMP_COUNT + fn_count);
+    gen_fn_code(codes, prog, ret);
+    fn_count++;
+
+    put_name(exports, "memory");
+    buf_putc(exports, 0x02);
+    put_u32(exports, 0);
+
+    // 组装模块
+    Buf *out = new_buf();
+    buf_putn(out, "\0asm\x01\0\0\0", 8);
+
+    Buf *sec = new_buf();
+    put_u32(sec, type_count);
+    buf_putn(sec, types->data, types->len);
+    free_buf(types);
+    put_section(out, 1, sec);
+
+    put_section(out, 2, imports);
+
+    sec = new_buf();
+    put_u32(sec, fn_count);
+    buf_putn(sec, funcs->data, funcs->len);
+    free_buf(funcs);
+    put_section(out, 3, sec);
+
+    // 内存：最小PAGES页
+    sec = new_buf();
+    put_u32(sec, 1);
+    buf_putc(sec, 0x00);
+    put_u32(sec, PAGES);
+    put_section(out, 5, sec);
+
+    // 全局变量sp：可变的i32，初始为内存的顶部
+    sec = new_buf();
+    put_u32(sec, 1);
+    buf_putc(sec, WT_I32);
+    buf_putc(sec, 0x01);
+    buf_putc(sec, W_I32_CONST);
+    put_s32(sec, PAGES * 65536);
+    buf_putc(sec, W_END);
+    put_section(out, 6, sec);
+
+    sec = new_buf();
+    put_u32(sec, fn_count + 1);
+    buf_putn(sec, exports->data, exports->len);
+    free_buf(exports);
+    put_section(out, 7, sec);
+
+    sec = new_buf();
+    put_u32(sec, fn_count);
+    buf_putn(sec, codes->data, codes->len);
+    free_buf(codes);
+    put_section(out, 10, sec);
+
+    if (data->len > 0) {
+        sec = new_buf();
+        put_u32(sec, 1);
+        buf_putc(sec, 0x00); // 活动段，写入0号内存
+        buf_putc(sec, W_I32_CONST);
+        put_s32(sec, DATA_BASE);
+        buf_putc(sec, W_END);
+        put_u32(sec, data->len);
+        buf_putn(sec, data->data, data->len);
+        put_section(out, 11, sec);
+    }
+    free_buf(data);
+
+    // 二进制文件，不能用buf_save的文本方式写入
+    FILE *fp = fopen("app.wasm", "wb");
+    if (fp == NULL || fwrite(out->data, 1, out->len, fp) != out->len) {
+        printf("Error: failed to write app.wasm\n");
+    }
+    if (fp) fclose(fp);
+    free_buf(out);
+}
+
+// 加载器：node中用fs读取app.wasm，浏览器中用fetch
+static const char *LOADER =
+    "const decoder = new TextDecoder()\n"
+    "let memory\n"
+    "const imports = {\n"
+    "    env: {\n"
+    "        print_int: x => console.log(x),\n"
+    "        print_float: x => console.log(x.toFixed(6)),\n"
+    "        print_double: x => console.log(x.toFixed(6)),\n"
+    "        print_bool: x => console.log(x ? \"true\" : \"false\"),\n"
+    "        print_str: (ptr, len) => console.log(decoder.decode(new Uint8Array(memory.buffer, ptr, len))),\n"
+    "    },\n"
+    "}\n"
+    "\n"
+    "const url = new URL(\"./app.wasm\", import.meta.url)\n"
+    "const bytes = typeof process !== \"undefined\" && process.versions?.node\n"
+    "    ? (await import(\"node:fs\")).readFileSync(url)\n"
+    "    : await (await fetch(url)).arrayBuffer()\n"
+    "const { instance } = await WebAssembly.instantiate(bytes, imports)\n"
+    "memory = instance.exports.memory\n"
+    "instance.exports.main()\n"
+    "\n"
+    "export default instance.exports\n";
+
+void trans_wasm(char *file) {
+    log_trace("Transpiling %s to WebAssembly\n", file);
+    // 新建前端
+    init_global_scope(SC_BLOCK);
+    Front *front = new_front();
+    // 解析文件并生成模块
+    Mod *mod = do_file(front, file);
+    mod->name = "app";
+    trace_node(mod->prog);
+    source = mod->source;
+    codegen_wasm(mod->prog);
+
+    Buf *loader = new_buf();
+    buf_puts(loader, LOADER);
+    if (!buf_save(loader, "app.mjs")) {
+        printf("Error: failed to write app.mjs\n");
+    }
+    free_buf(loader);
+}
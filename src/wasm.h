@@ -0,0 +1,6 @@
+#pragma once
+
+#include "zast.h"
+
+// 将AST编译成WebAssembly：输出app.wasm以及加载它的app.mjs
+void trans_wasm(char *file);
@@ -0,0 +1,393 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include "x86.h"
+
+// 一条指令的编码结果，x86-64的指令最长15字节
+typedef struct Enc Enc;
+struct Enc {
+    uint8_t b[16];
+    int n;
+    int reloc_at; // 需要重定位的rel32在指令中的偏移，没有时为-1
+};
+
+static void byte(Enc *e, uint8_t v) {
+    e->b[e->n++] = v;
+}
+
+static void imm32(Enc *e, int32_t v) {
+    uint32_t u = (uint32_t)v;
+    for (int i = 0; i < 4; i++) byte(e, (uint8_t)(u >> (i * 8)));
+}
+
+static void imm64(Enc *e, int64_t v) {
+    uint64_t u = (uint64_t)v;
+    for (int i = 0; i < 8; i++) byte(e, (uint8_t)(u >> (i * 8)));
+}
+
+static bool fits8(int32_t v) {
+    return v >= -128 && v <= 127;
+}
+
+// 前缀、操作码和ModRM。reg是ModRM.reg字段：寄存器编号或操作码的扩展（/digit）；
+// rm是寄存器、[base+disp]形式的内存或者字符串、浮点数常量（rip相对寻址）。
+// 向量寄存器xmmN的编号是R_XMM0+N，编码时和通用寄存器一样只取低4位
+static void op_rm(Enc *e, int size, uint8_t op1, int op2, int reg, AsmOpnd *rm) {
+    uint8_t rex = 0x40;
+    if (size == 8) rex |= 0x08;
+    if ((reg & 15) >= 8) rex |= 0x04;
+    if ((rm->kind == AO_REG || rm->kind == AO_MEM) && (rm->reg & 15) >= 8) rex |= 0x01;
+    if (rm->kind == AO_MEM && rm->scale && rm->index >= 8) rex |= 0x02;
+    // spl、bpl、sil和dil需要REX前缀，否则会被当成ah、ch、dh和bh
+    bool byte_reg = rm->kind == AO_REG && rm->size == 1 && rm->reg >= R_RSP && rm->reg <= R_RDI;
+    if (rex != 0x40 || byte_reg) byte(e, rex);
+    byte(e, op1);
+    if (op2 >= 0) byte(e, (uint8_t)op2);
+    int r = (reg & 7) << 3;
+    switch (rm->kind) {
+    case AO_REG:
+        byte(e, 0xc0 | r | (rm->reg & 7));
+        return;
+    case AO_MEM: {
+        int base = rm->reg & 7;
+        int32_t disp = rm->val;
+        // rbp和r13作基址时没有不带偏移的形式
+        int mod = disp == 0 && base != 5 ? 0 : fits8(disp) ? 1 : 2;
+        if (rm->scale) {
+            // 有变址寄存器时用SIB：比例、变址和基址
+            int ss = rm->scale == 8 ? 3 : rm->scale == 4 ? 2 : rm->scale == 2 ? 1 : 0;
+            byte(e, (uint8_t)(mod << 6 | r | 4));
+            byte(e, (uint8_t)(ss << 6 | (rm->index & 7) << 3 | base));
+        } else {
+            byte(e, (uint8_t)(mod << 6 | r | base));
+            if (base == 4) byte(e, 0x24); // rsp和r12作基址时需要SIB
+        }
+        if (mod == 1) byte(e, (uint8_t)disp);
+        else if (mod == 2) imm32(e, disp);
+        return;
+    }
+    case AO_STR:
+    case AO_NUM:
+        byte(e, 0x05 | r);
+        e->reloc_at = e->n;
+        imm32(e, 0);
+        return;
+    default:
+        return;
+    }
+}
+
+// 算术指令的/digit扩展，同时也决定了寄存器形式的操作码
+static int alu_digit(AsmOp op) {
+    switch (op) {
+    case A_ADD: return 0;
+    case A_OR: return 1;
+    case A_AND: return 4;
+    case A_SUB: return 5;
+    case A_XOR: return 6;
+    case A_CMP: return 7;
+    default: return -1;
+    }
+}
+
+static int opnd_size(AsmOpnd *o) {
+    return o->kind == AO_REG ? o->size : 4;
+}
+
+static void encode_mov(Enc *e, AsmIns *ins) {
+    AsmOpnd *a = &ins->a, *b = &ins->b;
+    if (b->kind == AO_IMM) {
+        if (a->kind == AO_REG && a->size == 4) {
+            if (a->reg >= 8) byte(e, 0x41);
+            byte(e, 0xb8 + (a->reg & 7));
+        } else {
+            op_rm(e, opnd_size(a), 0xc7, -1, 0, a);
+        }
+        imm32(e, b->val);
+    } else if (b->kind == AO_REG) {
+        op_rm(e, opnd_size(a), 0x89, -1, b->reg, a);
+    } else {
+        op_rm(e, a->size, 0x8b, -1, a->reg, b);
+    }
+}
+
+static void encode_alu(Enc *e, AsmIns *ins) {
+    AsmOpnd *a = &ins->a, *b = &ins->b;
+    int digit = alu_digit(ins->op);
+    int size = opnd_size(a);
+    if (b->kind == AO_IMM) {
+        if (fits8(b->val)) {
+            op_rm(e, size, 0x83, -1, digit, a);
+            byte(e, (uint8_t)b->val);
+        } else {
+            op_rm(e, size, 0x81, -1, digit, a);
+            imm32(e, b->val);
+        }
+    } else if (b->kind == AO_REG) {
+        op_rm(e, size, (uint8_t)(digit * 8 + 1), -1, b->reg, a);
+    } else {
+        op_rm(e, size, (uint8_t)(digit * 8 + 3), -1, a->reg, b);
+    }
+}
+
+static void encode_imul(Enc *e, AsmIns *ins) {
+    if (ins->c.kind == AO_IMM) {
+        bool short_imm = fits8(ins->c.val);
+        op_rm(e, 4, short_imm ? 0x6b : 0x69, -1, ins->a.reg, &ins->b);
+        if (short_imm) byte(e, (uint8_t)ins->c.val);
+        else imm32(e, ins->c.val);
+    } else {
+        op_rm(e, 4, 0x0f, 0xaf, ins->a.reg, &ins->b);
+    }
+}
+
+// SSE指令：强制前缀（66、F2或F3，0表示没有）必须在REX之前，然后是0F和操作码
+static void sse(Enc *e, uint8_t prefix, int size, uint8_t op, int reg, AsmOpnd *rm) {
+    if (prefix) byte(e, prefix);
+    op_rm(e, size, 0x0f, op, reg, rm);
+}
+
+// 标量单精度的指令用F3前缀，双精度的用F2前缀
+static uint8_t scalar_prefix(AsmOp op, AsmOp single) {
+    return op == single ? 0xf3 : 0xf2;
+}
+
+// 编码一条指令。跳转指令的长短由wide决定，target是跳转目标的偏移，pos是这条指令的偏移
+static void encode(Enc *e, AsmIns *ins, bool wide, int target, int pos) {
+    e->n = 0;
+    e->reloc_at = -1;
+    switch (ins->op) {
+    case A_MOV:
+        encode_mov(e, ins);
+        return;
+    case A_MOVABS:
+        byte(e, ins->a.reg >= 8 ? 0x49 : 0x48);
+        byte(e, 0xb8 + (ins->a.reg & 7));
+        imm64(e, ins->imm64);
+        return;
+    case A_MOVZX:
+        op_rm(e, 4, 0x0f, 0xb6, ins->a.reg, &ins->b);
+        return;
+    case A_ADD:
+    case A_SUB:
+    case A_AND:
+    case A_OR:
+    case A_XOR:
+    case A_CMP:
+        encode_alu(e, ins);
+        return;
+    case A_IMUL:
+        encode_imul(e, ins);
+        return;
+    case A_IDIV:
+        op_rm(e, opnd_size(&ins->a), 0xf7, -1, 7, &ins->a);
+        return;
+    case A_NEG:
+        op_rm(e, opnd_size(&ins->a), 0xf7, -1, 3, &ins->a);
+        return;
+    case A_CDQ:
+        byte(e, 0x99);
+        return;
+    case A_SET:
+        op_rm(e, 1, 0x0f, 0x90 + ins->cc, 0, &ins->a);
+        return;
+    case A_PUSH:
+    case A_POP:
+        if (ins->a.reg >= 8) byte(e, 0x41);
+        byte(e, (ins->op == A_PUSH ? 0x50 : 0x58) + (ins->a.reg & 7));
+        return;
+    case A_LEA:
+        op_rm(e, 8, 0x8d, -1, ins->a.reg, &ins->b);
+        return;
+    case A_CALL:
+        byte(e, 0xe8);
+        e->reloc_at = e->n;
+        imm32(e, 0);
+        return;
+    case A_JMP:
+        if (wide) {
+            byte(e, 0xe9);
+            imm32(e, target - (pos + 5));
+        } else {
+            byte(e, 0xeb);
+            byte(e, (uint8_t)(target - (pos + 2)));
+        }
+        return;
+    case A_JCC:
+        if (wide) {
+            byte(e, 0x0f);
+            byte(e, 0x80 + ins->cc);
+            imm32(e, target - (pos + 6));
+        } else {
+            byte(e, 0x70 + ins->cc);
+            byte(e, (uint8_t)(target - (pos + 2)));
+        }
+        return;
+    case A_RET:
+        byte(e, 0xc3);
+        return;
+    case A_MOVSS:
+    case A_MOVSD:
+        if (ins->a.kind == AO_MEM) sse(e, scalar_prefix(ins->op, A_MOVSS), 4, 0x11, ins->b.reg, &ins->a);
+        else sse(e, scalar_prefix(ins->op, A_MOVSS), 4, 0x10, ins->a.reg, &ins->b);
+        return;
+    case A_ADDSS:
+    case A_ADDSD:
+        sse(e, scalar_prefix(ins->op, A_ADDSS), 4, 0x58, ins->a.reg, &ins->b);
+        return;
+    case A_MULSS:
+    case A_MULSD:
+        sse(e, scalar_prefix(ins->op, A_MULSS), 4, 0x59, ins->a.reg, &ins->b);
+        return;
+    case A_SUBSS:
+    case A_SUBSD:
+        sse(e, scalar_prefix(ins->op, A_SUBSS), 4, 0x5c, ins->a.reg, &ins->b);
+        return;
+    case A_DIVSS:
+    case A_DIVSD:
+        sse(e, scalar_prefix(ins->op, A_DIVSS), 4, 0x5e, ins->a.reg, &ins->b);
+        return;
+    case A_UCOMISS:
+    case A_UCOMISD:
+        sse(e, ins->op == A_UCOMISS ? 0 : 0x66, 4, 0x2e, ins->a.reg, &ins->b);
+        return;
+    case A_CVTSI2SS:
+    case A_CVTSI2SD:
+        sse(e, scalar_prefix(ins->op, A_CVTSI2SS), 4, 0x2a, ins->a.reg, &ins->b);
+        return;
+    case A_CVTTSS2SI:
+    case A_CVTTSD2SI:
+        sse(e, scalar_prefix(ins->op, A_CVTTSS2SI), 4, 0x2c, ins->a.reg, &ins->b);
+        return;
+    case A_CVTSS2SD:
+    case A_CVTSD2SS:
+        sse(e, scalar_prefix(ins->op, A_CVTSS2SD), 4, 0x5a, ins->a.reg, &ins->b);
+        return;
+    case A_XORPS:
+        sse(e, 0, 4, 0x57, ins->a.reg, &ins->b);
+        return;
+    case A_MOVQ:
+        sse(e, 0x66, 8, 0x7e, ins->b.reg, &ins->a);
+        return;
+    case A_MOVUPS:
+        if (ins->a.kind == AO_MEM) sse(e, 0, 4, 0x11, ins->b.reg, &ins->a);
+        else sse(e, 0, 4, 0x10, ins->a.reg, &ins->b);
+        return;
+    case A_ADDPS:
+    case A_ADDPD:
+        sse(e, ins->op == A_ADDPS ? 0 : 0x66, 4, 0x58, ins->a.reg, &ins->b);
+        return;
+    case A_SUBPS:
+    case A_SUBPD:
+        sse(e, ins->op == A_SUBPS ? 0 : 0x66, 4, 0x5c, ins->a.reg, &ins->b);
+        return;
+    case A_MULPS:
+    case A_MULPD:
+        sse(e, ins->op == A_MULPS ? 0 : 0x66, 4, 0x59, ins->a.reg, &ins->b);
+        return;
+    case A_DIVPS:
+    case A_DIVPD:
+        sse(e, ins->op == A_DIVPS ? 0 : 0x66, 4, 0x5e, ins->a.reg, &ins->b);
+        return;
+    case A_PADDD:
+        sse(e, 0x66, 4, 0xfe, ins->a.reg, &ins->b);
+        return;
+    case A_PSUBD:
+        sse(e, 0x66, 4, 0xfa, ins->a.reg, &ins->b);
+        return;
+    case A_MOVD:
+        sse(e, 0x66, 4, 0x6e, ins->a.reg, &ins->b);
+        return;
+    case A_PSHUFD:
+        sse(e, 0x66, 4, 0x70, ins->a.reg, &ins->b);
+        byte(e, (uint8_t)ins->c.val);
+        return;
+    case A_SHUFPS:
+        sse(e, 0, 4, 0xc6, ins->a.reg, &ins->b);
+        byte(e, (uint8_t)ins->c.val);
+        return;
+    case A_UNPCKLPD:
+        sse(e, 0x66, 4, 0x14, ins->a.reg, &ins->b);
+        return;
+    case A_LABEL:
+        return;
+    }
+}
+
+static bool is_jump(AsmIns *ins) {
+    return ins->op == A_JMP || ins->op == A_JCC;
+}
+
+static void ensure(X86Code *code, int extra) {
+    if (code->size + extra <= code->cap) return;
+    while (code->size + extra > code->cap) code->cap = code->cap * 2 + 256;
+    code->buf = realloc(code->buf, code->cap);
+}
+
+static void add_reloc(X86Code *code, X86Reloc reloc) {
+    if (code->reloc_count >= code->reloc_cap) {
+        code->reloc_cap = code->reloc_cap * 2 + 8;
+        code->relocs = realloc(code->relocs, code->reloc_cap * sizeof(X86Reloc));
+    }
+    code->relocs[code->reloc_count++] = reloc;
+}
+
+// 跳转的长短取决于到目标的距离，而距离又取决于中间其他跳转的长短。
+// 先假设所有跳转都是短跳转，放不下的改成长跳转，再重新计算，直到不再变化。
+// 跳转只会由短变长，所以这个过程一定会结束
+int x86_encode(X86Code *code, AsmFn *fn) {
+    int n = fn->count;
+    int min_label = 0, max_label = -1;
+    for (int i = 0; i < n; i++) {
+        AsmIns *ins = &fn->code[i];
+        if (ins->op != A_LABEL && !is_jump(ins)) continue;
+        if (max_label < min_label) min_label = max_label = ins->label;
+        if (ins->label < min_label) min_label = ins->label;
+        if (ins->label > max_label) max_label = ins->label;
+    }
+    int *labels = calloc(max_label - min_label + 2, sizeof(int));
+    int *pos = calloc(n + 1, sizeof(int));
+    bool *wide = calloc(n + 1, sizeof(bool));
+    Enc e;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        int off = 0;
+        for (int i = 0; i < n; i++) {
+            AsmIns *ins = &fn->code[i];
+            pos[i] = off;
+            if (ins->op == A_LABEL) labels[ins->label - min_label] = off;
+            encode(&e, ins, wide[i], 0, off);
+            off += e.n;
+        }
+        for (int i = 0; i < n; i++) {
+            AsmIns *ins = &fn->code[i];
+            if (!is_jump(ins) || wide[i]) continue;
+            int rel = labels[ins->label - min_label] - (pos[i] + 2);
+            if (!fits8(rel)) {
+                wide[i] = true;
+                changed = true;
+            }
+        }
+    }
+
+    int start = code->size;
+    for (int i = 0; i < n; i++) {
+        AsmIns *ins = &fn->code[i];
+        int target = is_jump(ins) ? labels[ins->label - min_label] : 0;
+        encode(&e, ins, wide[i], target, pos[i]);
+        ensure(code, e.n);
+        if (e.reloc_at >= 0) {
+            int at = code->size + e.reloc_at;
+            if (ins->op == A_CALL) add_reloc(code, (X86Reloc){XR_CALL, at, ins->sym, 0});
+            else if (ins->b.kind == AO_NUM) add_reloc(code, (X86Reloc){XR_NUM, at, NULL, ins->b.val});
+            else add_reloc(code, (X86Reloc){XR_STR, at, NULL, ins->b.val});
+        }
+        memcpy(code->buf + code->size, e.b, e.n);
+        code->size += e.n;
+    }
+    free(labels);
+    free(pos);
+    free(wide);
+    return start;
+}
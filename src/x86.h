@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stdint.h>
+#include "asm.h"
+
+// x86-64机器码编码器
+//
+// 把指令列表（asm.h）直接编码成机器码，不需要外部的汇编器。
+// 编码结果中对外部符号和字符串常量的引用先留空，记录为重定位项，
+// 由使用者（JIT或目标文件输出）在确定地址之后填写。
+
+typedef struct X86Code X86Code;
+typedef struct X86Reloc X86Reloc;
+
+typedef enum {
+    XR_CALL, // call rel32，目标是函数sym
+    XR_STR, // lea reg, [rip+rel32]，目标是第str个字符串常量
+    XR_NUM, // 浮点数指令的[rip+rel32]，目标是第str个浮点数常量
+} X86RelocKind;
+
+// 需要填写的rel32：值为目标地址 - (offset + 4)
+struct X86Reloc {
+    X86RelocKind kind;
+    int offset; // rel32在代码中的偏移
+    char *sym;
+    int str;
+};
+
+struct X86Code {
+    uint8_t *buf;
+    int size;
+    int cap;
+    X86Reloc *relocs;
+    int reloc_count;
+    int reloc_cap;
+};
+
+// 把一个函数编码到code的末尾，返回函数的起始偏移。
+// 跳转指令优先使用1字节的偏移，放不下时改用4字节
+int x86_encode(X86Code *code, AsmFn *fn);
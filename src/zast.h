@@ -27,6 +27,9 @@ typedef struct List List;
 typedef struct Obj Obj;
 typedef struct Dict Dict;
 typedef struct KV KV;
+typedef struct InlineCache InlineCache;
+typedef struct Jit Jit;
+typedef struct Type Type;
 
 typedef enum {
     ND_PROG, // 一段程序（可以包含一个或多个模块，也可以只是一个程序片段）
@@ -84,15 +87,33 @@ typedef enum {
 
 char *op_to_str(Op op);
 
+// 特化的运算：类型检查（见check.c）确定了操作数的类型之后，解释器直接按类型计算，不再检查存值的种类。
+// 每种数值类型的运算都按Op中OP_ADD到OP_NE的顺序排列
+typedef enum {
+    SP_NONE, // 操作数的类型不确定，按存值的种类动态处理
+    SP_ADD_INT, SP_SUB_INT, SP_MUL_INT, SP_DIV_INT,
+    SP_GT_INT, SP_LT_INT, SP_GE_INT, SP_LE_INT, SP_EQ_INT, SP_NE_INT,
+    SP_ADD_FLOAT, SP_SUB_FLOAT, SP_MUL_FLOAT, SP_DIV_FLOAT,
+    SP_GT_FLOAT, SP_LT_FLOAT, SP_GE_FLOAT, SP_LE_FLOAT, SP_EQ_FLOAT, SP_NE_FLOAT,
+    SP_ADD_DOUBLE, SP_SUB_DOUBLE, SP_MUL_DOUBLE, SP_DIV_DOUBLE,
+    SP_GT_DOUBLE, SP_LT_DOUBLE, SP_GE_DOUBLE, SP_LE_DOUBLE, SP_EQ_DOUBLE, SP_NE_DOUBLE,
+    SP_EQ_BOOL, SP_NE_BOOL,
+    SP_AND, SP_OR,
+    SP_NEG_INT, SP_NEG_FLOAT, SP_NEG_DOUBLE,
+    SP_NOT,
+} Spec;
+
 struct BinOp {
     Node *left;
     Node *right;
     Op op;
+    Spec spec; // 特化的运算
 };
 
 struct Unary {
   Op op;
   Node *body;
+  Spec spec; // 特化的运算
 };
 
 // Exprs是一个动态的数组
@@ -156,6 +177,7 @@ struct IfElse {
 struct For {
     Node *cond;
     Node *body;
+    Jit *jit; // 解释器对这个循环的即时编译状态，见jit.c
 };
 
 struct Params {
@@ -169,6 +191,8 @@ struct Fn {
     Node *fname;
     Params *params;
     Node *body;
+    Type *type; // 函数类型，包括参数和返回值的类型
+    Jit *jit; // 解释器对这个函数的即时编译状态，见jit.c
 };
 
 typedef enum {
@@ -188,6 +212,7 @@ struct Name {
 struct Path {
     int len;
     Name names[MAX_PATH_LEN];
+    InlineCache *ic; // 解释器在这个名称处的内联缓存，见interp.c
 };
 
 struct List {
@@ -203,6 +228,7 @@ struct TypeDecl {
 
 struct Obj {
     HashTable *members;
+    Node **fields; // 按类型中字段的槽位排列的初值表达式
 };
 
 struct Dict {
@@ -220,6 +246,9 @@ typedef struct Meta Meta;
 // AST节点
 struct Node {
     NodeKind kind;
+    // 节点在源码中的位置：起始字节的偏移+1，0表示没有对应的源码（如优化时新建的节点）。
+    // 行列用source_locate查询。放在kind后面，正好占用对齐留下的空隙，不增加节点的大小
+    uint32_t loc;
     Meta* meta; // 节点的元信息。TODO：改为Meta类型？
     union {
         CallExpr call;
@@ -255,6 +284,8 @@ void fprint_node(FILE* f, Node *node);
 void trace_node(Node *node);
 // 在开启LOG_TRACE开关时，打印节点信息。用于开发阶段辅助调试
 void echo_node(Node *node);
+// 把节点还原成源码的形式，输出到fp
+void fecho_node(FILE *fp, Node *node);
 
 // util
 
@@ -1,9 +1,7 @@
 includelib msvcrt.lib
 .code
 main proc
-    mov rax, 1
-    add rax, 5
-    sub rax, 3
+    mov eax, 3
     ret
 main endp
 end
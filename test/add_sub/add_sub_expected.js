@@ -1 +1 @@
-1 + 5 - 3
+3
@@ -2,7 +2,5 @@
     .text
     .global main
 main:
-    mov rax, 1
-    add rax, 5
-    sub rax, 3
+    mov eax, 3
     ret
@@ -1,5 +1,5 @@
 console.log([1, 2, 3])
-let a = [1.1, 2.1, 3.1]
+let a = Float64Array.of(1.1, 2.1, 3.1)
 a[1] = 4.2
 a[2] = 5.2
 console.log(a[2])
@@ -1,3 +1,3 @@
 int main(void) {
-    return 2 * 3 + 4 * 5 - 1 * 7;
+    return 19;
 }
@@ -1 +1 @@
-2 * 3 + 4 * 5 - 1 * 7
+19
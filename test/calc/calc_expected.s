@@ -2,20 +2,5 @@
     .text
     .global main
 main:
-    mov rax, 2
-    imul rax, 3
-    push rax
-    mov rax, 4
-    imul rax, 5
-    push rax
-    pop rdi
-    pop rax
-    add rax, rdi
-    push rax
-    mov rax, 1
-    imul rax, 7
-    push rax
-    pop rdi
-    pop rax
-    sub rax, rdi
+    mov eax, 19
     ret
@@ -1,5 +1,5 @@
 int main(void) {
-    int a = 10;
-    int b = 20;
-    return !(a < b) && 1;
+    const int a = 10;
+    const int b = 20;
+    return !(a < b);
 }
@@ -1,3 +1,3 @@
 const a = 10
 const b = 20
-!(a < b) && true
+!(a < b)
@@ -1,3 +1,3 @@
 a = 10
 b = 20
-not (a < b) and True
+not (a < b)
@@ -0,0 +1,13 @@
+includelib msvcrt.lib
+.code
+z_add proc
+    mov r8d, edx
+    add ecx, r8d
+    mov eax, ecx
+    ret
+z_add endp
+main proc
+    mov eax, 12
+    ret
+main endp
+end
@@ -1,9 +1,7 @@
-#include "stdz.h"
-
-int add(int a, int b) {
+static inline int add(const int a, const int b) {
     return b + a;
 }
 
 int main(void) {
-    return add(5, 7);
+    return 12;
 }
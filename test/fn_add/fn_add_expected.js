@@ -1,5 +1,5 @@
 export function add(a, b) {
-    return b + a
+    return b + a | 0
 }
 
-add(5, 7)
+12
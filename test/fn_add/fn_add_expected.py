@@ -1,6 +1,4 @@
-from stdz import *
-
 def add(a, b):
     return b + a
 
-add(5, 7)
+12
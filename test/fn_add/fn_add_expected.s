@@ -0,0 +1,11 @@
+    .intel_syntax noprefix
+    .text
+    .global main
+z_add:
+    mov ecx, esi
+    add ecx, edi
+    mov eax, ecx
+    ret
+main:
+    mov eax, 12
+    ret
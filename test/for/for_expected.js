@@ -1,7 +1,7 @@
 let i = 0
 let sum = 0
 while (i < 10) {
-    sum = sum + i
-    i = i + 1
+    sum = sum + i | 0
+    i = i + 1 | 0
 }
 sum
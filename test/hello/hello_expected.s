@@ -5,7 +5,9 @@ main:
     push rbp
     mov rbp, rsp
     lea rdi, [rip+ct0]
+    mov eax, 0
     call printf
+    mov eax, 0
     pop rbp
     ret
 ct0:
@@ -1,7 +1,7 @@
 let a = 10
 if (a > 10) {
-    a = a + 100
+    a = a + 100 | 0
 } else {
-    a = a - 100
+    a = a - 100 | 0
 }
 a
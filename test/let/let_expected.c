@@ -1,8 +1,8 @@
 int main(void) {
-    int a = 2;
-    int b = 3;
-    int c = 4;
-    int d = 5;
-    int e = 6;
+    const int a = 2;
+    const int b = 3;
+    const int c = 4;
+    const int d = 5;
+    const int e = 6;
     return a * b + c * d + e;
 }
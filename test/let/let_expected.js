@@ -3,4 +3,4 @@ const b = 3
 const c = 4
 const d = 5
 const e = 6
-a * b + c * d + e
+Math.imul(a, b) + Math.imul(c, d) + e | 0
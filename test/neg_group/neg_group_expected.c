@@ -1,3 +1,3 @@
 int main(void) {
-    return -(3 * 5 + -(2) - 8);
+    return -5;
 }
@@ -1 +1 @@
--(3 * 5 + -(2) - 8)
+-5
@@ -0,0 +1,21 @@
+import numpy as np
+
+b = np.array([1.5, 2.5, 3.5, 4.5], dtype=np.float64)
+c = np.array([0.5, 0.5, 0.5, 0.5], dtype=np.float64)
+a = np.array([0.0, 0.0, 0.0, 0.0], dtype=np.float64)
+k = 2.0
+i = 0
+a[i:4] = b[i:4] * k + c[i:4]
+i = max(i, 4)
+def f(x):
+    j = 0
+    s = np.array([1, 2, 3], dtype=np.int32)
+    s[j:3] = s[j:3] + x
+    j = max(j, 3)
+    return s[2]
+
+print(a[3])
+r = f(5)
+print(r)
+print(a.tolist())
+print([7, 8])
@@ -7,8 +7,11 @@ includelib stdz.lib
 main proc
     push rbp
     mov rbp, rsp
+    sub rsp, 32
     lea rcx, ct0
     call read_file
+    mov eax, 0
+    add rsp, 32
     pop rbp
     ret
 main endp
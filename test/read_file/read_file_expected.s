@@ -6,6 +6,7 @@ main:
     mov rbp, rsp
     lea rdi, [rip+ct0]
     call read_file
+    mov eax, 0
     pop rbp
     ret
 ct0:
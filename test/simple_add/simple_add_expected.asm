@@ -1,8 +1,7 @@
 includelib msvcrt.lib
 .code
 main proc
-    mov rax, 37
-    add rax, 4
+    mov eax, 41
     ret
 main endp
 end
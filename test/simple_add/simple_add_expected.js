@@ -1 +1 @@
-37 + 4
+41
@@ -2,6 +2,5 @@
     .text
     .global main
 main:
-    mov rax, 37
-    add rax, 4
+    mov eax, 41
     ret
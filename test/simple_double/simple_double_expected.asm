@@ -0,0 +1,33 @@
+includelib msvcrt.lib
+includelib legacy_stdio_definitions.lib
+includelib stdz.lib
+.data
+    align 8
+    cf0 real8 3.1415929999999999
+    cf1 real8 5.2000000000000002
+    cf2 real8 3.0
+    ct0 db '%f', 10, 0
+.code
+    externdef printf:proc
+    externdef print_bool:proc
+main proc
+    push rbp
+    mov rbp, rsp
+    sub rsp, 32
+    movsd xmm0, cf0
+    addsd xmm0, cf1
+    lea rcx, ct0
+    movsd xmm1, xmm0
+    movq rdx, xmm1
+    call printf
+    movsd xmm5, cf0
+    ucomisd xmm5, cf2
+    seta al
+    movzx ecx, al
+    call print_bool
+    mov eax, 0
+    add rsp, 32
+    pop rbp
+    ret
+main endp
+end
@@ -1,7 +1,7 @@
 #include <stdio.h>
 
 int main(void) {
-    double f = 3.141593;
+    const double f = 3.141593;
     printf("%lf\n", f + 5.2);
     printf("%s\n", f > 3.0 ? "true" : "false");
     return 0;
@@ -0,0 +1,29 @@
+    .intel_syntax noprefix
+    .text
+    .global main
+main:
+    push rbp
+    mov rbp, rsp
+    movsd xmm0, qword ptr [rip+cf0]
+    addsd xmm0, qword ptr [rip+cf1]
+    lea rdi, [rip+ct0]
+    mov eax, 1
+    call printf
+    movsd xmm15, qword ptr [rip+cf0]
+    ucomisd xmm15, qword ptr [rip+cf2]
+    seta al
+    movzx ecx, al
+    mov edi, ecx
+    call print_bool
+    mov eax, 0
+    pop rbp
+    ret
+ct0:
+    .asciz "%f\n"
+    .p2align 3
+cf0:
+    .double 3.1415929999999999
+cf1:
+    .double 5.2000000000000002
+cf2:
+    .double 3.0
@@ -7,9 +7,12 @@ includelib legacy_stdio_definitions.lib
 main proc
     push rbp
     mov rbp, rsp
+    sub rsp, 32
     lea rcx, ct0
-    mov rdx, 41
+    mov edx, 41
     call printf
+    mov eax, 0
+    add rsp, 32
     pop rbp
     ret
 main endp
@@ -5,8 +5,10 @@ main:
     push rbp
     mov rbp, rsp
     lea rdi, [rip+ct0]
-    mov rsi, 41
+    mov esi, 41
+    mov eax, 0
     call printf
+    mov eax, 0
     pop rbp
     ret
 ct0:
@@ -1,7 +1,7 @@
 includelib msvcrt.lib
 .code
 main proc
-    mov rax, 42
+    mov eax, 42
     ret
 main endp
 end
@@ -2,5 +2,5 @@
     .text
     .global main
 main:
-    mov rax, 42
+    mov eax, 42
     ret
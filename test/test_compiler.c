@@ -1,12 +1,47 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include "compiler.h"
 #include "util.h"
 
+#ifndef _WIN32
+// 把编译器直接输出的目标文件app.o与标准库链接成app.exe，运行它，并把输出与期望的内容比较。
+// 标准库libstdz.a和测试程序在同一个目录中
+static int run_obj(char *self, char *expected) {
+    char *slash = strrchr(self, '/');
+    char *home = slash ? substr(self, 0, slash - self) : ".";
+    const char *cc = getenv("CC");
+    if (cc == NULL || *cc == '\0') cc = "cc";
+    char cmd[1024];
+    snprintf(cmd, sizeof(cmd), "%s app.o -L\"%s\" -lstdz -lm -o app.exe", cc, home);
+    if (system(cmd) != 0) {
+        printf("Error: failed to link app.o\n");
+        return 1;
+    }
+    if (system("./app.exe > app.out") != 0) {
+        printf("Error: app.exe failed\n");
+        return 1;
+    }
+    return compare_file("app.out", expected);
+}
+#endif
+
 int main(int argc, char** argv) {
     // 需要两个参数，一个是要编译的文件，例如hello.z；另一个是期望输出的内容，例如hello_expect.s
     if (argc < 3) {
         return -1;
     }
+    // `run <hello.z> <hello_expected.out>`：编译后链接并运行，比较程序的输出
+    if (strcmp(argv[1], "run") == 0) {
+        if (argc < 4) return -1;
+#ifdef _WIN32
+        // Windows上没有直接输出的目标文件
+        return 0;
+#else
+        build(argv[2]);
+        return run_obj(argv[0], argv[3]);
+#endif
+    }
     // 编译文件并输出到app.s或app.asm
     build(argv[1]); // output to app.s/app.asm
 
@@ -18,4 +53,4 @@ int main(int argc, char** argv) {
 #else
     return compare_file("app.s", expected);
 #endif
-}
\ No newline at end of file
+}
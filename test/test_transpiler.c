@@ -1,17 +1,62 @@
 #include <stdio.h>
 #include <string.h>
+#include <stdlib.h>
 #include "util.h"
 #include "transpiler.h"
+#include "opt.h"
+#include "wasm.h"
+
+// .wasm是二进制文件，要逐字节比较，不能用compare_file的文本方式
+static int compare_bin(char *file1, char *file2) {
+    FILE *fp1 = fopen(file1, "rb");
+    FILE *fp2 = fopen(file2, "rb");
+    if (fp1 == NULL || fp2 == NULL) {
+        printf("似乎无法打开文件：%s 或 %s\n", file1, file2);
+        exit(1);
+    }
+    int result = 0;
+    for (;;) {
+        int c1 = fgetc(fp1);
+        int c2 = fgetc(fp2);
+        if (c1 != c2) {
+            result = 1;
+            break;
+        }
+        if (c1 == EOF) break;
+    }
+    fclose(fp1);
+    fclose(fp2);
+    return result;
+}
 
 int main(int argc, char** argv) {
     if (argc < 4) {
-        printf("Error: args: c|py|js <hello.z> <hello_expect.c>\n");
+        printf("Error: args: c|unity|py|numpy|pymap|js|jsmap|wasm <hello.z> <hello_expect.c>\n");
         return -1;
     }
     char *cmd = argv[1];
     if (strcmp(cmd, "c") == 0) {
         trans_c(argv[2]);
         return compare_file("app.c", argv[3]);
+    } else if (strcmp(cmd, "unity") == 0) {
+        OPT.unity = true;
+        trans_c(argv[2]);
+        return compare_file("app.c", argv[3]);
+    } else if (strcmp(cmd, "numpy") == 0) {
+        OPT.numpy = true;
+        trans_py(argv[2]);
+        return compare_file("app.py", argv[3]);
+    } else if (strcmp(cmd, "wasm") == 0) {
+        trans_wasm(argv[2]);
+        return compare_bin("app.wasm", argv[3]);
+    } else if (strcmp(cmd, "pymap") == 0) {
+        OPT.source_map = true;
+        trans_py(argv[2]);
+        return compare_file("app.py.map", argv[3]);
+    } else if (strcmp(cmd, "jsmap") == 0) {
+        OPT.source_map = true;
+        trans_js(argv[2]);
+        return compare_file("app.js.map", argv[3]);
     } else if (strcmp(cmd, "py") == 0) {
         trans_py(argv[2]);
         return compare_file("app.py", argv[3]);
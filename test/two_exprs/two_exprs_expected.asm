@@ -7,16 +7,11 @@ includelib legacy_stdio_definitions.lib
 main proc
     push rbp
     mov rbp, rsp
+    sub rsp, 32
     lea rcx, ct0
     call printf
-    mov rax, 2
-    push rax
-    mov rax, 5
-    imul rax, 3
-    push rax
-    pop rdi
-    pop rax
-    add rax, rdi
+    mov eax, 17
+    add rsp, 32
     pop rbp
     ret
 main endp
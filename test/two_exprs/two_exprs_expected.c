@@ -2,5 +2,5 @@
 
 int main(void) {
     printf("%s\n", "Hello");
-    return 2 + 5 * 3;
+    return 17;
 }
@@ -1,2 +1,2 @@
 console.log("Hello")
-2 + 5 * 3
+17
@@ -1,2 +1,2 @@
 print("Hello")
-2 + 5 * 3
+17
@@ -5,15 +5,9 @@ main:
     push rbp
     mov rbp, rsp
     lea rdi, [rip+ct0]
+    mov eax, 0
     call printf
-    mov rax, 2
-    push rax
-    mov rax, 5
-    imul rax, 3
-    push rax
-    pop rdi
-    pop rax
-    add rax, rdi
+    mov eax, 17
     pop rbp
     ret
 ct0:
@@ -1,11 +1,12 @@
 #include <stdio.h>
 
+typedef struct Point {
+    int x;
+    int y;
+} Point;
+
 int main(void) {
-    typedef struct {
-        int x;
-        int y;
-    } Point;
-    Point p = {.x = 3, .y = 4};
+    const Point p = {.x = 3, .y = 4};
     printf("%d\n", p.x + p.y);
     return 0;
 }
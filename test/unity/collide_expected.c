@@ -0,0 +1,45 @@
+static int m1_add(int a, int b);
+static int m1_sum3(int a, int b, int c);
+static int m1_twice(int a);
+
+static int m1_k = 1;
+
+static inline int m1_add(const int a, const int b) {
+    return a + b;
+}
+
+static int m1_sum3(const int a, const int b, const int c) {
+    int s = 0;
+    s = a + b;
+    s = s + c;
+    return s;
+}
+
+static inline int m1_twice(const int a) {
+    return m1_sum3(a, a, m1_k - 1);
+}
+
+static int m2_add(int a, int b);
+static int m2_sum3(int a, int b, int c);
+static int m2_twice(int a);
+
+static int m2_k = 2;
+
+static inline int m2_add(const int a, const int b) {
+    return a * b;
+}
+
+static int m2_sum3(const int a, const int b, const int c) {
+    int s = 0;
+    s = a * b;
+    s = s * c;
+    return s;
+}
+
+static inline int m2_twice(const int a) {
+    return m2_sum3(a, m2_k, 1);
+}
+
+int main(void) {
+    return 11 + m1_twice(4) + m2_twice(5) + m1_k + m2_k;
+}
@@ -0,0 +1,23 @@
+static int num_sq(int a);
+
+static inline int num_sq(const int a) {
+    return a * a;
+}
+
+static int geo_add(int a, int b);
+static int geo_norm2(int x, int y);
+
+static inline int geo_add(const int a, const int b) {
+    return a + b;
+}
+
+static int geo_norm2(const int x, const int y) {
+    int s = 0;
+    s = x * x + y * y;
+    return s;
+}
+
+int main(void) {
+    const int d = geo_norm2(3, 4);
+    return d * d;
+}
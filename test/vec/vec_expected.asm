@@ -0,0 +1,194 @@
+includelib msvcrt.lib
+includelib legacy_stdio_definitions.lib
+.data
+    align 8
+    cf0 real4 0.0
+    cf1 real4 1.0
+    cf2 real4 2.0
+    cf3 real4 3.0
+    cf4 real4 4.0
+    cf5 real4 5.0
+    cf6 real4 6.0
+    cf7 real4 7.0
+    cf8 real4 0.5
+    ct0 db '%f', 10, 0
+    ct1 db '%d', 10, 0
+.code
+    externdef printf:proc
+main proc
+    push rbp
+    mov rbp, rsp
+    push rbx
+    sub rsp, 280
+    movss xmm5, cf0
+    movss dword ptr [rbp-48], xmm5
+    movss xmm5, cf0
+    movss dword ptr [rbp-44], xmm5
+    movss xmm5, cf0
+    movss dword ptr [rbp-40], xmm5
+    movss xmm5, cf0
+    movss dword ptr [rbp-36], xmm5
+    movss xmm5, cf0
+    movss dword ptr [rbp-32], xmm5
+    movss xmm5, cf0
+    movss dword ptr [rbp-28], xmm5
+    movss xmm5, cf0
+    movss dword ptr [rbp-24], xmm5
+    movss xmm5, cf1
+    movss dword ptr [rbp-80], xmm5
+    movss xmm5, cf2
+    movss dword ptr [rbp-76], xmm5
+    movss xmm5, cf3
+    movss dword ptr [rbp-72], xmm5
+    movss xmm5, cf4
+    movss dword ptr [rbp-68], xmm5
+    movss xmm5, cf5
+    movss dword ptr [rbp-64], xmm5
+    movss xmm5, cf6
+    movss dword ptr [rbp-60], xmm5
+    movss xmm5, cf7
+    movss dword ptr [rbp-56], xmm5
+    movss xmm5, cf8
+    movss dword ptr [rbp-112], xmm5
+    movss xmm5, cf8
+    movss dword ptr [rbp-108], xmm5
+    movss xmm5, cf8
+    movss dword ptr [rbp-104], xmm5
+    movss xmm5, cf8
+    movss dword ptr [rbp-100], xmm5
+    movss xmm5, cf8
+    movss dword ptr [rbp-96], xmm5
+    movss xmm5, cf8
+    movss dword ptr [rbp-92], xmm5
+    movss xmm5, cf8
+    movss dword ptr [rbp-88], xmm5
+    movss xmm0, cf2
+    shufps xmm0, xmm0, 0
+    mov ebx, 0
+_L1:
+    cmp ebx, 4
+    jge _L3
+    movups xmm1, xmmword ptr [rbp+rbx*4-80]
+    mulps xmm1, xmm0
+    movups xmm2, xmmword ptr [rbp+rbx*4-112]
+    addps xmm1, xmm2
+    movups xmmword ptr [rbp+rbx*4-48], xmm1
+    add ebx, 4
+    jmp _L1
+_L3:
+_L4:
+    cmp ebx, 7
+    jge _L6
+    movss xmm0, dword ptr [rbp+rbx*4-80]
+    mulss xmm0, cf2
+    movss xmm1, dword ptr [rbp+rbx*4-112]
+    addss xmm0, xmm1
+    movss dword ptr [rbp+rbx*4-48], xmm0
+    add ebx, 1
+    jmp _L4
+_L6:
+    movss xmm0, dword ptr [rbp-48]
+    cvtss2sd xmm0, xmm0
+    lea rcx, ct0
+    movsd xmm1, xmm0
+    movq rdx, xmm1
+    call printf
+    movss xmm0, dword ptr [rbp-32]
+    cvtss2sd xmm0, xmm0
+    lea rcx, ct0
+    movsd xmm1, xmm0
+    movq rdx, xmm1
+    call printf
+    movss xmm0, dword ptr [rbp-24]
+    cvtss2sd xmm0, xmm0
+    lea rcx, ct0
+    movsd xmm1, xmm0
+    movq rdx, xmm1
+    call printf
+    mov dword ptr [rbp-160], 1
+    mov dword ptr [rbp-156], 2
+    mov dword ptr [rbp-152], 3
+    mov dword ptr [rbp-148], 4
+    mov dword ptr [rbp-144], 5
+    mov dword ptr [rbp-140], 6
+    mov dword ptr [rbp-136], 7
+    mov dword ptr [rbp-132], 8
+    mov dword ptr [rbp-128], 9
+    mov dword ptr [rbp-124], 10
+    mov dword ptr [rbp-208], 10
+    mov dword ptr [rbp-204], 20
+    mov dword ptr [rbp-200], 30
+    mov dword ptr [rbp-196], 40
+    mov dword ptr [rbp-192], 50
+    mov dword ptr [rbp-188], 60
+    mov dword ptr [rbp-184], 70
+    mov dword ptr [rbp-180], 80
+    mov dword ptr [rbp-176], 90
+    mov dword ptr [rbp-172], 100
+    mov eax, 1
+    movd xmm0, eax
+    pshufd xmm0, xmm0, 0
+    mov ebx, 0
+_L7:
+    cmp ebx, 7
+    jge _L9
+    movups xmm1, xmmword ptr [rbp+rbx*4-160]
+    movups xmm2, xmmword ptr [rbp+rbx*4-208]
+    paddd xmm1, xmm2
+    psubd xmm1, xmm0
+    movups xmmword ptr [rbp+rbx*4-160], xmm1
+    add ebx, 4
+    jmp _L7
+_L9:
+_L10:
+    cmp ebx, 10
+    jge _L12
+    mov ecx, dword ptr [rbp+rbx*4-160]
+    mov r8d, dword ptr [rbp+rbx*4-208]
+    add ecx, r8d
+    sub ecx, 1
+    mov dword ptr [rbp+rbx*4-160], ecx
+    add ebx, 1
+    jmp _L10
+_L12:
+    mov ecx, dword ptr [rbp-148]
+    mov edx, ecx
+    lea rcx, ct1
+    call printf
+    mov ecx, dword ptr [rbp-124]
+    mov edx, ecx
+    lea rcx, ct1
+    call printf
+    mov dword ptr [rbp-256], 1
+    mov dword ptr [rbp-252], 1
+    mov dword ptr [rbp-248], 1
+    mov dword ptr [rbp-244], 1
+    mov dword ptr [rbp-240], 1
+    mov dword ptr [rbp-236], 1
+    mov dword ptr [rbp-232], 1
+    mov dword ptr [rbp-228], 1
+    mov dword ptr [rbp-224], 1
+    mov ebx, 1
+_L13:
+    cmp ebx, 9
+    jge _L15
+    mov ecx, ebx
+    sub ecx, 1
+    mov ecx, dword ptr [rbp+rcx*4-256]
+    mov r8d, dword ptr [rbp+rbx*4-256]
+    add ecx, r8d
+    mov dword ptr [rbp+rbx*4-256], ecx
+    add ebx, 1
+    jmp _L13
+_L15:
+    mov ecx, dword ptr [rbp-224]
+    mov edx, ecx
+    lea rcx, ct1
+    call printf
+    mov eax, 0
+    add rsp, 280
+    pop rbx
+    pop rbp
+    ret
+main endp
+end
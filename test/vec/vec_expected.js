@@ -0,0 +1,28 @@
+let a = Float32Array.of(0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0)
+const b = Float32Array.of(1.0, 2.0, 3.0, 4.0, 5.0, 6.0, 7.0)
+const c = Float32Array.of(0.5, 0.5, 0.5, 0.5, 0.5, 0.5, 0.5)
+const k = Math.fround(2.0)
+let i = 0
+while (i < 7) {
+    a[i] = Math.fround(b[i] * k + c[i])
+    i = i + 1 | 0
+}
+console.log(a[0])
+console.log(a[4])
+console.log(a[6])
+let x = Int32Array.of(1, 2, 3, 4, 5, 6, 7, 8, 9, 10)
+const y = Int32Array.of(10, 20, 30, 40, 50, 60, 70, 80, 90, 100)
+let j = 0
+while (j < 10) {
+    x[j] = x[j] + y[j] - 1 | 0
+    j = j + 1 | 0
+}
+console.log(x[3])
+console.log(x[9])
+let p = Int32Array.of(1, 1, 1, 1, 1, 1, 1, 1, 1)
+let q = 1
+while (q < 9) {
+    p[q] = p[q - 1 | 0] + p[q] | 0
+    q = q + 1 | 0
+}
+console.log(p[8])
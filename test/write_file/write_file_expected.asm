@@ -8,9 +8,12 @@ includelib stdz.lib
 main proc
     push rbp
     mov rbp, rsp
+    sub rsp, 32
     lea rcx, ct0
     lea rdx, ct1
     call write_file
+    mov eax, 0
+    add rsp, 32
     pop rbp
     ret
 main endp
@@ -7,6 +7,7 @@ main:
     lea rdi, [rip+ct0]
     lea rsi, [rip+ct1]
     call write_file
+    mov eax, 0
     pop rbp
     ret
 ct0:
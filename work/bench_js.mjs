@@ -0,0 +1,15 @@
+// 计时app.js中导出的函数：先预热，再取5次的中位数
+import * as app from "./app.js"
+
+for (const [name, fn] of Object.entries(app)) {
+    for (let i = 0; i < 5; i++) fn()
+    const times = []
+    let result
+    for (let i = 0; i < 5; i++) {
+        const start = performance.now()
+        result = fn()
+        times.push(performance.now() - start)
+    }
+    times.sort((a, b) => a - b)
+    console.log(`${name}: ${times[2].toFixed(1)} ms (${result})`)
+}
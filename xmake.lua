@@ -16,8 +16,6 @@ local skip_table = {
     ["write_file"] = {["js"] = true},
     ["alert"] = {["c"]=true, ["py"]=true, ["compiler"]=true},
     ["use"] = {["compiler"]=true, ["c"]=true, ["js"]=true},
-    ["fn_add"] = {["compiler"]=true},
-    ["simple_double"] = {["compiler"]=true},
     ["array"] = {["compiler"]=true},
     ["type"] = {["compiler"]=true}
 }
@@ -28,12 +26,19 @@ target("stdz")
     add_files("src/util.c")
     add_includedirs("lib")
     add_includedirs("src")
+    -- `z run c`从z所在的目录查找标准库和它的头文件，见src/cc.c
+    after_build(function (target)
+        os.cp("lib/stdz.h", target:targetdir())
+    end)
 
 target("z")
     set_kind("binary")
     add_files("src/*.c")
     add_deps("stdz")
     add_includedirs("lib")
+    if not is_plat("windows") then
+        add_syslinks("pthread") -- 转译器并行生成各个模块，见src/pool.c
+    end
     if is_mode("debug") then
         add_defines("LOG_TRACE")
     end
@@ -45,6 +50,7 @@ target("z")
         os.rm("work/*.lnk")
         os.rm("work/*.tmp")
         os.rm("work/a.out")
+        os.rm("work/.zcache")
         for _, d in ipairs(case_list) do
             os.rm("test/"..d.."/app.*")
             os.rm("test/"..d.."/*.lnk")
@@ -75,9 +81,14 @@ target("test_interp")
     add_deps("stdz")
     add_includedirs("lib")
     add_files("test/test_interp.c")
+    if not is_plat("windows") then
+        add_syslinks("pthread")
+    end
     add_tests("hello", {runargs="print(\"Hello, world!\")", trim_output=true, pass_outputs="Hello, world!"})
     add_tests("hello1", {runargs="print(\"Now!\")", trim_output=true, pass_outputs="Now!"})
     add_tests("simple_int", {runargs="print(41)", trim_output=true, pass_outputs="41"})
+    -- 与编译器的print_bool测试（test/print_bool）输出相同
+    add_tests("print_bool", {runargs="mut i = 0; mut n = 0; for i < 5 { n = n + i; i = i + 1 }; let big = n > 8; print(big); print(n == 3); print(!(n < 8)); print(n > 1 && n < 20); print(true)", trim_output=true, pass_outputs="true\nfalse\ntrue\ntrue\ntrue"})
     add_tests("single_int", {runargs="42", trim_output=true, pass_outputs="42"})
     add_tests("simple_add", {runargs="37+4", trim_output=true, pass_outputs="41"})
     add_tests("add_sub", {runargs="1+5-3", trim_output=true, pass_outputs="3"})
@@ -88,6 +99,16 @@ target("test_interp")
     add_tests("mut", {runargs="mut a=10;a=5;a", trim_output=true, pass_outputs="5"})
     add_tests("for", {runargs="mut i = 0; mut sum = 0; for i < 10 { sum = sum + i; i = i + 1; }; sum", trim_output=true, pass_outputs="45"})
     add_tests("array", {runargs="let a = [1, 2, 3]; a[1]", trim_output=true, pass_outputs="2"})
+    add_tests("type", {runargs="type Point {x int; y int}; let p = Point{x: 3, y: 4}; p.x + p.y", trim_output=true, pass_outputs="7"})
+    add_tests("method", {runargs="type Point {x int; y int}; fn Point.square() int { x*x + y*y }; let p = Point{x: 3, y: 4}; p.square()", trim_output=true, pass_outputs="25"})
+    add_tests("method_call", {runargs="type C {n int}; fn C.sq(k int) int { k * n }; fn C.f(k int) int { if k < 1 { 0 } else { sq(k) + f(k - 1) + k } }; let c = C{n: 2}; c.f(3)", trim_output=true, pass_outputs="18"})
+    add_tests("fold", {runargs="mut x = 2; if false { x = 0 }; if 1 < 2 { x = x * 3 } else { x = 0 }; x * 1 + 2 * 0", trim_output=true, pass_outputs="6"})
+    add_tests("licm", {runargs="let k = 3; mut i = 0; mut s = 0; for i < 10 { s = s + i * k + k * 2; i = i + 1 }; s", trim_output=true, pass_outputs="195"})
+    add_tests("inline", {runargs="fn mad(a int, b int, c int) int { a + b * c }; mut x = 2; mad(1, x, 3) + mad(x, 3, x + 1)", trim_output=true, pass_outputs="18"})
+    add_tests("inline_type", {runargs="fn f(a int) int { a + 1 }; f(2.5)", trim_output=true, pass_outputs="Type mismatch: argument a of f"})
+    add_tests("spec", {runargs="let h = 0.5; mut x = 1.0; mut i = 0; for i < 4 { x = x * h + 1.0; i = i + 1 }; x > 1.5 && i == 4", trim_output=true, pass_outputs="true"})
+    add_tests("dynamic", {runargs="mut x = 1; x = 2.5; x * 2.0", trim_output=true, pass_outputs="5.000000"})
+    add_tests("jit", {runargs="fn fib(n int) int { if n < 2 { n } else { fib(n-1) + fib(n-2) } }; mut i = 0; mut s = 0; for i < 100 { s = s + fib(i / 10); i = i + 1 }; s", trim_output=true, pass_outputs="880"})
 
 -- 编译器compiler的测试用例
 target("test_compiler")
@@ -99,12 +120,25 @@ target("test_compiler")
     add_deps("stdz")
     add_includedirs("lib")
     add_files("test/test_compiler.c")
+    if not is_plat("windows") then
+        add_syslinks("pthread")
+    end
     for _, d in ipairs(case_list) do
         if skip_table[d] == nil or skip_table[d]["compiler"] == nil then
             local asm_ext = is_plat("windows") and "asm" or "s"
             add_tests(d, {rundir = os.projectdir().."/test/"..d, runargs = {d.."_case.z", d.."_expected."..asm_ext}})
         end
     end
+    -- 循环的向量化：长度不是向量宽度整数倍的数组要由标量循环处理剩下的元素，
+    -- 读取前一个元素的循环（p[q] = p[q - 1] + p[q]）不能向量化
+    add_tests("vec", {rundir = os.projectdir().."/test/vec", runargs = {"vec_case.z", "vec_expected."..(is_plat("windows") and "asm" or "s")}})
+    -- 直接输出的ELF目标文件：与标准库链接后运行，比较程序的输出
+    if not is_plat("windows") then
+        add_tests("elf", {rundir = os.projectdir().."/test/elf", runargs = {"run", "elf_case.z", "elf_expected.out"}})
+        -- bool的输出要和解释器一样是true/false
+        add_tests("print_bool", {rundir = os.projectdir().."/test/print_bool", runargs = {"run", "print_bool_case.z", "print_bool_expected.out"}})
+        add_tests("vec_run", {rundir = os.projectdir().."/test/vec", runargs = {"run", "vec_case.z", "vec_expected.out"}})
+    end
 
 -- 转译器transpiler的测试用例
 target("test_transpiler")
@@ -116,6 +150,9 @@ target("test_transpiler")
     add_includedirs("lib")
     remove_files("src/main.c")
     add_files("test/test_transpiler.c")
+    if not is_plat("windows") then
+        add_syslinks("pthread")
+    end
 
     for _, d in ipairs(case_list) do
         for _, lan in ipairs({"c", "py", "js"}) do
@@ -124,6 +161,20 @@ target("test_transpiler")
             end
         end
     end
+    -- 单文件模式：所有模块输出到同一个app.c中
+    add_tests("unity", {rundir = os.projectdir().."/test/unity", runargs = {"unity", "unity_case.z", "unity_expected.c"}})
+    add_tests("unity_collide", {rundir = os.projectdir().."/test/unity", runargs = {"unity", "collide_case.z", "collide_expected.c"}})
+    -- NumPy模式：数值数组和数组上的循环用NumPy实现
+    add_tests("numpy", {rundir = os.projectdir().."/test/numpy", runargs = {"numpy", "numpy_case.z", "numpy_expected.py"}})
+    -- 源码映射：JS输出Source Map v3，Python输出行号对照表
+    add_tests("jsmap", {rundir = os.projectdir().."/test/sourcemap", runargs = {"jsmap", "sourcemap_case.z", "sourcemap_expected.js.map"}})
+    add_tests("pymap", {rundir = os.projectdir().."/test/sourcemap", runargs = {"pymap", "sourcemap_case.z", "sourcemap_expected.py.map"}})
+    add_tests("jsmap_module", {rundir = os.projectdir().."/test/sourcemap", runargs = {"jsmap", "module_case.z", "module_expected.js.map"}})
+    add_tests("pymap_module", {rundir = os.projectdir().."/test/sourcemap", runargs = {"pymap", "module_case.z", "module_expected.py.map"}})
+    -- JS中float的运算和字面量用Math.fround舍入为单精度
+    add_tests("vec_js", {rundir = os.projectdir().."/test/vec", runargs = {"js", "vec_case.z", "vec_expected.js"}})
+    -- WebAssembly：直接输出app.wasm二进制文件
+    add_tests("wasm", {rundir = os.projectdir().."/test/wasm", runargs = {"wasm", "wasm_case.z", "wasm_expected.wasm"}})
 
 
 --